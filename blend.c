@@ -0,0 +1,705 @@
+#include "blend.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+ #include <immintrin.h>
+#elif defined(__SSE2__)
+ #include <emmintrin.h>
+#elif defined(__ARM_NEON)
+ #include <arm_neon.h>
+#endif
+
+#define LOG_MODULE "blend"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "debug.h"
+#include "macros.h"
+#include "util.h"
+
+/*
+ * Solid color OVER destination, through a mask. Glyphs (A8 masks)
+ * and component alpha (subpixel) glyphs, blended onto 8-bit, or
+ * 10-bit (linear blending), shm buffers.
+ *
+ * The 8-bit kernels produce the same result as pixman's own fast
+ * paths: x * y / 255 is rounded the same way, and the final addition
+ * saturates.
+ */
+
+static inline uint32_t
+div_255(uint32_t x)
+{
+    x += 0x80;
+    return (x + (x >> 8)) >> 8;
+}
+
+/* (x|a)8r8g8b8, A8 mask */
+static inline uint32_t
+over_a8_8888(uint32_t src, uint8_t m, uint32_t dst)
+{
+    if (m == 0)
+        return dst;
+
+    const uint32_t ia = 255 - div_255((src >> 24) * m);
+    uint32_t result = 0;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        const uint32_t s = div_255((src >> shift & 0xff) * m);
+        const uint32_t d = div_255((dst >> shift & 0xff) * ia);
+        result |= min(s + d, 0xff) << shift;
+    }
+
+    return result;
+}
+
+/* (x|a)8r8g8b8, component alpha mask */
+static inline uint32_t
+over_ca_8888(uint32_t src, uint32_t m, uint32_t dst)
+{
+    if (m == 0)
+        return dst;
+
+    const uint32_t sa = src >> 24;
+    uint32_t result = 0;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        const uint32_t mc = m >> shift & 0xff;
+        const uint32_t s = div_255((src >> shift & 0xff) * mc);
+        const uint32_t d = div_255((dst >> shift & 0xff) * (255 - div_255(mc * sa)));
+        result |= min(s + d, 0xff) << shift;
+    }
+
+    return result;
+}
+
+static void
+blend_row_a8_8888_generic(uint32_t *dst, const uint8_t *mask, uint32_t src,
+                          int width)
+{
+    for (int i = 0; i < width; i++)
+        dst[i] = over_a8_8888(src, mask[i], dst[i]);
+}
+
+static void
+blend_row_ca_8888_generic(uint32_t *dst, const uint32_t *mask,
+                          uint32_t mask_alpha, uint32_t src, int width)
+{
+    for (int i = 0; i < width; i++)
+        dst[i] = over_ca_8888(src, mask[i] | mask_alpha, dst[i]);
+}
+
+#if defined(__SSE2__)
+static inline __m128i
+mul_255_sse2(__m128i a, __m128i b)
+{
+    /* (t + (t >> 8)) >> 8, with t = a * b + 0x80 */
+    const __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(0x80));
+    return _mm_mulhi_epu16(t, _mm_set1_epi16(0x0101));
+}
+
+static inline __m128i
+alpha_sse2(__m128i x)
+{
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+#endif
+
+#if defined(__AVX2__)
+static inline __m256i
+mul_255_avx2(__m256i a, __m256i b)
+{
+    const __m256i t = _mm256_add_epi16(
+        _mm256_mullo_epi16(a, b), _mm256_set1_epi16(0x80));
+    return _mm256_mulhi_epu16(t, _mm256_set1_epi16(0x0101));
+}
+
+static inline __m256i
+alpha_avx2(__m256i x)
+{
+    x = _mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm256_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+#endif
+
+#if defined(__ARM_NEON)
+static inline uint8x8_t
+div_255_neon(uint16x8_t t)
+{
+    /* Same as div_255(): (t + 0x80 + ((t + 0x80) >> 8)) >> 8 */
+    return vrshrn_n_u16(vrsraq_n_u16(t, t, 8), 8);
+}
+#endif
+
+static void
+blend_row_a8_8888(uint32_t *dst, const uint8_t *mask, uint32_t src, int width)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i s = _mm256_unpacklo_epi8(_mm256_set1_epi32(src), zero);
+        const __m256i ff = _mm256_set1_epi16(0xff);
+        const __m256i replicate = _mm256_set1_epi32(0x01010101);
+
+        for (; i + 8 <= width; i += 8) {
+            uint64_t m8;
+            memcpy(&m8, &mask[i], sizeof(m8));
+            if (m8 == 0)
+                continue;
+
+            /* Each mask byte, in all four channels of its pixel */
+            const __m256i m = _mm256_mullo_epi32(
+                _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&mask[i])),
+                replicate);
+
+            __m256i *p = (__m256i *)&dst[i];
+            const __m256i d = _mm256_loadu_si256(p);
+
+            const __m256i sm_lo = mul_255_avx2(s, _mm256_unpacklo_epi8(m, zero));
+            const __m256i sm_hi = mul_255_avx2(s, _mm256_unpackhi_epi8(m, zero));
+
+            const __m256i d_lo = mul_255_avx2(
+                _mm256_unpacklo_epi8(d, zero),
+                _mm256_xor_si256(alpha_avx2(sm_lo), ff));
+            const __m256i d_hi = mul_255_avx2(
+                _mm256_unpackhi_epi8(d, zero),
+                _mm256_xor_si256(alpha_avx2(sm_hi), ff));
+
+            _mm256_storeu_si256(
+                p, _mm256_adds_epu8(_mm256_packus_epi16(sm_lo, sm_hi),
+                                    _mm256_packus_epi16(d_lo, d_hi)));
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i s = _mm_unpacklo_epi8(_mm_set1_epi32(src), zero);
+        const __m128i ff = _mm_set1_epi16(0xff);
+
+        for (; i + 4 <= width; i += 4) {
+            uint32_t m4;
+            memcpy(&m4, &mask[i], sizeof(m4));
+            if (m4 == 0)
+                continue;
+
+            __m128i m = _mm_cvtsi32_si128(m4);
+            m = _mm_unpacklo_epi8(m, m);
+            m = _mm_unpacklo_epi16(m, m);
+
+            __m128i *p = (__m128i *)&dst[i];
+            const __m128i d = _mm_loadu_si128(p);
+
+            const __m128i sm_lo = mul_255_sse2(s, _mm_unpacklo_epi8(m, zero));
+            const __m128i sm_hi = mul_255_sse2(s, _mm_unpackhi_epi8(m, zero));
+
+            const __m128i d_lo = mul_255_sse2(
+                _mm_unpacklo_epi8(d, zero), _mm_xor_si128(alpha_sse2(sm_lo), ff));
+            const __m128i d_hi = mul_255_sse2(
+                _mm_unpackhi_epi8(d, zero), _mm_xor_si128(alpha_sse2(sm_hi), ff));
+
+            _mm_storeu_si128(
+                p, _mm_adds_epu8(_mm_packus_epi16(sm_lo, sm_hi),
+                                 _mm_packus_epi16(d_lo, d_hi)));
+        }
+    }
+#elif defined(__ARM_NEON)
+    {
+        const uint8x8_t sb = vdup_n_u8(src >> 0 & 0xff);
+        const uint8x8_t sg = vdup_n_u8(src >> 8 & 0xff);
+        const uint8x8_t sr = vdup_n_u8(src >> 16 & 0xff);
+        const uint8x8_t sa = vdup_n_u8(src >> 24 & 0xff);
+
+        for (; i + 8 <= width; i += 8) {
+            const uint8x8_t m = vld1_u8(&mask[i]);
+            if (vget_lane_u64(vreinterpret_u64_u8(m), 0) == 0)
+                continue;
+
+            /* Deinterleaved; b, g, r, a */
+            uint8x8x4_t d = vld4_u8((const uint8_t *)&dst[i]);
+
+            const uint8x8_t sm_a = div_255_neon(vmull_u8(sa, m));
+            const uint8x8_t ia = vmvn_u8(sm_a);
+
+            d.val[0] = vqadd_u8(div_255_neon(vmull_u8(sb, m)),
+                                div_255_neon(vmull_u8(d.val[0], ia)));
+            d.val[1] = vqadd_u8(div_255_neon(vmull_u8(sg, m)),
+                                div_255_neon(vmull_u8(d.val[1], ia)));
+            d.val[2] = vqadd_u8(div_255_neon(vmull_u8(sr, m)),
+                                div_255_neon(vmull_u8(d.val[2], ia)));
+            d.val[3] = vqadd_u8(sm_a, div_255_neon(vmull_u8(d.val[3], ia)));
+
+            vst4_u8((uint8_t *)&dst[i], d);
+        }
+    }
+#endif
+
+    blend_row_a8_8888_generic(&dst[i], &mask[i], src, width - i);
+}
+
+static void
+blend_row_ca_8888(uint32_t *dst, const uint32_t *mask, uint32_t mask_alpha,
+                  uint32_t src, int width)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i s = _mm_unpacklo_epi8(_mm_set1_epi32(src), zero);
+        const __m128i sa = alpha_sse2(s);
+        const __m128i ff = _mm_set1_epi16(0xff);
+        const __m128i ma = _mm_set1_epi32(mask_alpha);
+
+        for (; i + 4 <= width; i += 4) {
+            const __m128i m = _mm_or_si128(
+                _mm_loadu_si128((const __m128i *)&mask[i]), ma);
+
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(m, zero)) == 0xffff)
+                continue;
+
+            __m128i *p = (__m128i *)&dst[i];
+            const __m128i d = _mm_loadu_si128(p);
+
+            const __m128i m_lo = _mm_unpacklo_epi8(m, zero);
+            const __m128i m_hi = _mm_unpackhi_epi8(m, zero);
+
+            const __m128i sm_lo = mul_255_sse2(s, m_lo);
+            const __m128i sm_hi = mul_255_sse2(s, m_hi);
+
+            const __m128i d_lo = mul_255_sse2(
+                _mm_unpacklo_epi8(d, zero),
+                _mm_xor_si128(mul_255_sse2(m_lo, sa), ff));
+            const __m128i d_hi = mul_255_sse2(
+                _mm_unpackhi_epi8(d, zero),
+                _mm_xor_si128(mul_255_sse2(m_hi, sa), ff));
+
+            _mm_storeu_si128(
+                p, _mm_adds_epu8(_mm_packus_epi16(sm_lo, sm_hi),
+                                 _mm_packus_epi16(d_lo, d_hi)));
+        }
+    }
+#elif defined(__ARM_NEON)
+    {
+        const uint8x8_t s[4] = {
+            vdup_n_u8(src >> 0 & 0xff),
+            vdup_n_u8(src >> 8 & 0xff),
+            vdup_n_u8(src >> 16 & 0xff),
+            vdup_n_u8(src >> 24 & 0xff),
+        };
+        const uint8x8_t ma = vdup_n_u8(mask_alpha >> 24);
+
+        for (; i + 8 <= width; i += 8) {
+            uint8x8x4_t m = vld4_u8((const uint8_t *)&mask[i]);
+            m.val[3] = vorr_u8(m.val[3], ma);
+
+            uint8x8x4_t d = vld4_u8((const uint8_t *)&dst[i]);
+
+            for (int c = 0; c < 4; c++) {
+                const uint8x8_t ia = vmvn_u8(div_255_neon(vmull_u8(m.val[c], s[3])));
+                d.val[c] = vqadd_u8(div_255_neon(vmull_u8(s[c], m.val[c])),
+                                    div_255_neon(vmull_u8(d.val[c], ia)));
+            }
+
+            vst4_u8((uint8_t *)&dst[i], d);
+        }
+    }
+#endif
+
+    blend_row_ca_8888_generic(&dst[i], &mask[i], mask_alpha, src, width - i);
+}
+
+/*
+ * 10-bit buffers are used both for linear blending (see
+ * render_do_linear_blending()), where the color is linear, and for
+ * tweak.surface-bit-depth=10-bit on its own, where it is sRGB
+ * encoded. Like pixman, the channel values are blended as-is, in
+ * whichever space they are in. Channels are kept at 10 bits, with
+ * the coverage in 8 bits.
+ */
+struct src_2101010 {
+    uint32_t c[4];    /* Indexed by channel shift / 10; alpha is 2 bits */
+    uint32_t alpha;   /* 8 bits */
+};
+
+static inline uint32_t
+over_2101010(const struct src_2101010 *src, const uint8_t m[static 4],
+             uint32_t dst)
+{
+    uint32_t result = 0;
+
+    for (int i = 0; i < 4; i++) {
+        const int shift = i * 10;
+        const uint32_t limit = i < 3 ? 0x3ff : 0x3;
+
+        const uint32_t s = div_255(src->c[i] * m[i]);
+        const uint32_t d = div_255(
+            (dst >> shift & limit) * (255 - div_255(m[i] * src->alpha)));
+        result |= min(s + d, limit) << shift;
+    }
+
+    return result;
+}
+
+static void
+blend_row_a8_2101010(uint32_t *dst, const uint8_t *mask,
+                     const struct src_2101010 *src, int width)
+{
+    for (int i = 0; i < width; i++) {
+        if (mask[i] == 0)
+            continue;
+        dst[i] = over_2101010(
+            src, (const uint8_t[4]){mask[i], mask[i], mask[i], mask[i]}, dst[i]);
+    }
+}
+
+static void
+blend_row_ca_2101010(uint32_t *dst, const uint32_t *mask, uint32_t mask_alpha,
+                     bool bgr, const struct src_2101010 *src, int width)
+{
+    for (int i = 0; i < width; i++) {
+        const uint32_t m = mask[i] | mask_alpha;
+        if (m == 0)
+            continue;
+
+        /* Mask is always r8g8b8; channel order in the 10-bit buffer may differ */
+        const uint8_t r = m >> 16, g = m >> 8, b = m, a = m >> 24;
+        dst[i] = over_2101010(
+            src,
+            bgr ? (const uint8_t[4]){r, g, b, a} : (const uint8_t[4]){b, g, r, a},
+            dst[i]);
+    }
+}
+
+bool
+blend_mask_over_solid(pixman_image_t *dst, const pixman_color_t *color,
+                      pixman_image_t *mask, int x, int y,
+                      const pixman_box32_t *clip)
+{
+    const pixman_format_code_t dst_format = pixman_image_get_format(dst);
+    const pixman_format_code_t mask_format = pixman_image_get_format(mask);
+
+    bool component_alpha;
+    uint32_t mask_alpha = 0;  /* OR:ed with each mask pixel */
+
+    switch (mask_format) {
+    case PIXMAN_a8:
+        component_alpha = false;
+        break;
+
+    case PIXMAN_x8r8g8b8:
+        mask_alpha = 0xff000000;
+        /* FALLTHROUGH */
+
+    case PIXMAN_a8r8g8b8:
+        /* Color glyphs are composited without a solid source */
+        if (!pixman_image_get_component_alpha(mask))
+            return false;
+        component_alpha = true;
+        break;
+
+    default:
+        return false;
+    }
+
+    bool ten_bit = false;
+    bool bgr = false;
+
+    switch (dst_format) {
+    case PIXMAN_a8r8g8b8:
+    case PIXMAN_x8r8g8b8:
+        break;
+
+    case PIXMAN_a2b10g10r10:
+    case PIXMAN_x2b10g10r10:
+        bgr = true;
+        /* FALLTHROUGH */
+
+    case PIXMAN_a2r10g10b10:
+    case PIXMAN_x2r10g10b10:
+        ten_bit = true;
+        break;
+
+    default:
+        return false;
+    }
+
+    uint8_t *dst_data = (uint8_t *)pixman_image_get_data(dst);
+    const uint8_t *mask_data = (const uint8_t *)pixman_image_get_data(mask);
+
+    if (dst_data == NULL || mask_data == NULL)
+        return false;
+
+    const int dst_stride = pixman_image_get_stride(dst);
+    const int mask_stride = pixman_image_get_stride(mask);
+
+    const int x0 = max(max(x, clip->x1), 0);
+    const int y0 = max(max(y, clip->y1), 0);
+    const int x1 = min(min(x + pixman_image_get_width(mask), clip->x2),
+                       pixman_image_get_width(dst));
+    const int y1 = min(min(y + pixman_image_get_height(mask), clip->y2),
+                       pixman_image_get_height(dst));
+
+    if (x0 >= x1 || y0 >= y1)
+        return true;
+
+    const int width = x1 - x0;
+    const int mask_bpp = component_alpha ? 4 : 1;
+
+    const uint32_t src_8888 =
+        (uint32_t)(color->alpha >> 8) << 24 |
+        (uint32_t)(color->red >> 8) << 16 |
+        (uint32_t)(color->green >> 8) << 8 |
+        (uint32_t)(color->blue >> 8);
+
+    const struct src_2101010 src_2101010 = {
+        .c = {
+            bgr ? color->red >> 6 : color->blue >> 6,
+            color->green >> 6,
+            bgr ? color->blue >> 6 : color->red >> 6,
+            color->alpha >> 14,
+        },
+        .alpha = color->alpha >> 8,
+    };
+
+    for (int row = y0; row < y1; row++) {
+        uint32_t *d = (uint32_t *)(dst_data + row * dst_stride) + x0;
+        const uint8_t *m =
+            mask_data + (row - y) * mask_stride + (x0 - x) * mask_bpp;
+
+        if (ten_bit) {
+            if (component_alpha) {
+                blend_row_ca_2101010(
+                    d, (const uint32_t *)m, mask_alpha, bgr, &src_2101010,
+                    width);
+            } else
+                blend_row_a8_2101010(d, m, &src_2101010, width);
+        } else {
+            if (component_alpha) {
+                blend_row_ca_8888(
+                    d, (const uint32_t *)m, mask_alpha, src_8888, width);
+            } else
+                blend_row_a8_8888(d, m, src_8888, width);
+        }
+    }
+
+    return true;
+}
+
+UNITTEST
+{
+    /* Pixman's results, for a couple of known values */
+    xassert(over_a8_8888(0xff102030, 0xff, 0x80405060) == 0xff102030);
+    xassert(over_a8_8888(0xff102030, 0x00, 0x80405060) == 0x80405060);
+    xassert(over_a8_8888(0xffffffff, 0x80, 0xff000000) == 0xff808080);
+    xassert(over_ca_8888(0xffffffff, 0x00ff8000, 0xff000000) == 0xffff8000);
+
+    /* The SIMD kernels must match the scalar ones, for all mask
+     * values, and all row lengths (i.e. the scalar tail) */
+    uint32_t seed = 1;
+#define rnd() (seed = seed * 1103515245 + 12345, seed >> 8)
+
+    const uint32_t colors[] = {
+        0xffffffff, 0xff000000, 0xff808080, 0xffdcdccc, 0x80402010, 0x00000000,
+    };
+
+    for (size_t c = 0; c < ALEN(colors); c++) {
+        for (int width = 1; width <= 40; width++) {
+            uint8_t mask8[40];
+            uint32_t mask32[40];
+            uint32_t dst[40];
+            uint32_t ref[40];
+
+            for (int i = 0; i < width; i++) {
+                /* Mostly fully transparent/opaque, like glyphs */
+                const uint32_t r = rnd();
+                mask8[i] = r % 3 == 0 ? 0 : r % 3 == 1 ? 0xff : rnd();
+                mask32[i] = r % 5 == 0 ? 0 : rnd() ^ rnd() << 16;
+                dst[i] = ref[i] = rnd() ^ rnd() << 16;
+            }
+
+            blend_row_a8_8888(dst, mask8, colors[c], width);
+            blend_row_a8_8888_generic(ref, mask8, colors[c], width);
+            xassert(memcmp(dst, ref, width * sizeof(dst[0])) == 0);
+
+            for (int i = 0; i < width; i++)
+                dst[i] = ref[i] = rnd() ^ rnd() << 16;
+
+            /* a8r8g8b8 and x8r8g8b8 masks */
+            const uint32_t mask_alphas[] = {0, 0xff000000};
+            for (size_t j = 0; j < ALEN(mask_alphas); j++) {
+                blend_row_ca_8888(dst, mask32, mask_alphas[j], colors[c], width);
+                blend_row_ca_8888_generic(
+                    ref, mask32, mask_alphas[j], colors[c], width);
+                xassert(memcmp(dst, ref, width * sizeof(dst[0])) == 0);
+            }
+        }
+    }
+
+    /* Exhaustively, for all mask values */
+    for (int m = 0; m < 256; m++) {
+        uint8_t mask8[16];
+        uint32_t dst[16];
+        uint32_t ref[16];
+
+        for (int i = 0; i < 16; i++) {
+            mask8[i] = m;
+            dst[i] = ref[i] = rnd() ^ rnd() << 16;
+        }
+
+        blend_row_a8_8888(dst, mask8, 0xffc0a080, 16);
+        blend_row_a8_8888_generic(ref, mask8, 0xffc0a080, 16);
+        xassert(memcmp(dst, ref, sizeof(dst)) == 0);
+    }
+
+#undef rnd
+
+    /* 10-bit; opaque white at full coverage, over black */
+    const struct src_2101010 white = {.c = {0x3ff, 0x3ff, 0x3ff, 0x3}, .alpha = 0xff};
+    uint32_t px = 0xc0000000;
+    blend_row_a8_2101010(&px, (const uint8_t[]){0xff}, &white, 1);
+    xassert(px == 0xffffffff);
+
+    px = 0xc0000000;
+    blend_row_a8_2101010(&px, (const uint8_t[]){0}, &white, 1);
+    xassert(px == 0xc0000000);
+}
+
+UNITTEST
+{
+    /*
+     * blend_mask_over_solid() vs. pixman_image_composite32(), for
+     * all supported destination and mask formats, with masks
+     * partially outside the destination and/or the clip box, and
+     * destination strides wider than the image.
+     *
+     * Pixman may use other code paths than the ones our kernels
+     * mimic (e.g. floating point for 10-bit destinations), so allow
+     * small rounding differences.
+     */
+    uint32_t seed = 1;
+#define rnd() (seed = seed * 1103515245 + 12345, seed >> 8)
+
+    enum { DST_W = 20, DST_H = 16, DST_STRIDE = 24, MASK_W = 7, MASK_H = 9 };
+
+    static const pixman_format_code_t dst_formats[] = {
+        PIXMAN_x8r8g8b8, PIXMAN_a8r8g8b8,
+        PIXMAN_x2r10g10b10, PIXMAN_a2r10g10b10,
+        PIXMAN_x2b10g10r10, PIXMAN_a2b10g10r10,
+    };
+    static const pixman_format_code_t mask_formats[] = {
+        PIXMAN_a8, PIXMAN_a8r8g8b8, PIXMAN_x8r8g8b8,
+    };
+    static const pixman_color_t colors[] = {
+        {0xffff, 0xffff, 0xffff, 0xffff},
+        {0xdcdc, 0x4040, 0x1010, 0xffff},
+        {0x4040, 0x2020, 0x1010, 0x8080},  /* Pre-multiplied */
+    };
+    static const struct {int x, y;} positions[] = {
+        {-3, -2}, {5, 4}, {15, 3}, {2, 12}, {18, 14},
+    };
+    static const pixman_box32_t clips[] = {
+        {0, 0, DST_W, DST_H},
+        {2, 3, 17, 11},
+    };
+
+    for (size_t df = 0; df < ALEN(dst_formats); df++) {
+        const pixman_format_code_t dst_format = dst_formats[df];
+        const bool ten_bit = PIXMAN_FORMAT_R(dst_format) == 10;
+        const bool has_alpha = PIXMAN_FORMAT_A(dst_format) > 0;
+
+        for (size_t mf = 0; mf < ALEN(mask_formats); mf++) {
+            const pixman_format_code_t mask_format = mask_formats[mf];
+            const bool component_alpha = mask_format != PIXMAN_a8;
+            const int mask_stride = component_alpha ? MASK_W * 4 : 8;
+
+            uint32_t mask_data[MASK_H * MASK_W];
+            for (size_t i = 0; i < sizeof(mask_data); i++) {
+                const uint32_t r = rnd();
+                ((uint8_t *)mask_data)[i] =
+                    r % 3 == 0 ? 0 : r % 3 == 1 ? 0xff : rnd();
+            }
+
+            pixman_image_t *mask = pixman_image_create_bits(
+                mask_format, MASK_W, MASK_H, mask_data, mask_stride);
+            pixman_image_set_component_alpha(mask, component_alpha);
+
+            for (size_t c = 0; c < ALEN(colors); c++) {
+                pixman_image_t *src = pixman_image_create_solid_fill(&colors[c]);
+
+                for (size_t p = 0; p < ALEN(positions); p++) {
+                    for (size_t cl = 0; cl < ALEN(clips); cl++) {
+                        const int x = positions[p].x;
+                        const int y = positions[p].y;
+                        const pixman_box32_t *clip = &clips[cl];
+
+                        uint32_t dst_data[DST_H * DST_STRIDE];
+                        uint32_t ref_data[DST_H * DST_STRIDE];
+                        for (size_t i = 0; i < ALEN(dst_data); i++)
+                            dst_data[i] = ref_data[i] = rnd() ^ rnd() << 16;
+
+                        pixman_image_t *dst = pixman_image_create_bits(
+                            dst_format, DST_W, DST_H, dst_data,
+                            DST_STRIDE * sizeof(uint32_t));
+                        pixman_image_t *ref = pixman_image_create_bits(
+                            dst_format, DST_W, DST_H, ref_data,
+                            DST_STRIDE * sizeof(uint32_t));
+
+                        pixman_region32_t region;
+                        pixman_region32_init_rect(
+                            &region, clip->x1, clip->y1,
+                            clip->x2 - clip->x1, clip->y2 - clip->y1);
+                        pixman_image_set_clip_region32(ref, &region);
+                        pixman_region32_fini(&region);
+
+                        pixman_image_composite32(
+                            PIXMAN_OP_OVER, src, mask, ref, 0, 0, 0, 0,
+                            x, y, MASK_W, MASK_H);
+                        xassert(blend_mask_over_solid(
+                            dst, &colors[c], mask, x, y, clip));
+
+                        for (size_t i = 0; i < ALEN(dst_data); i++) {
+                            /* Stride padding must be left untouched */
+                            if (i % DST_STRIDE >= DST_W) {
+                                xassert(dst_data[i] == ref_data[i]);
+                                continue;
+                            }
+
+                            const int bits = ten_bit ? 10 : 8;
+
+                            for (int ch = 0; ch < 4; ch++) {
+                                const bool alpha = ch == 3;
+                                if (alpha && !has_alpha)
+                                    continue;
+
+                                const uint32_t channel_mask =
+                                    alpha && ten_bit ? 0x3 : (1u << bits) - 1;
+                                const int tolerance =
+                                    alpha && ten_bit ? 1 : ten_bit ? 4 : 1;
+
+                                const int a = dst_data[i] >> (ch * bits) & channel_mask;
+                                const int b = ref_data[i] >> (ch * bits) & channel_mask;
+                                xassert(abs(a - b) <= tolerance);
+                            }
+                        }
+
+                        pixman_image_unref(dst);
+                        pixman_image_unref(ref);
+                    }
+                }
+
+                pixman_image_unref(src);
+            }
+
+            pixman_image_unref(mask);
+        }
+    }
+
+#undef rnd
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <pixman.h>
+
+/*
+ * Composites the solid 'color' (premultiplied), through 'mask', OVER
+ * 'dst', with the mask's top-left corner at 'x', 'y'. The result is
+ * clipped to 'clip'.
+ *
+ * Supported masks are A8 glyphs, and component alpha (subpixel)
+ * glyphs. The destination must be a (x|a)8r8g8b8 or 10-bit shm
+ * buffer.
+ *
+ * Returns false, without touching 'dst', if the formats aren't
+ * supported; use pixman instead.
+ */
+bool blend_mask_over_solid(
+    pixman_image_t *dst, const pixman_color_t *color, pixman_image_t *mask,
+    int x, int y, const pixman_box32_t *clip);
@@ -18,6 +18,10 @@ cmd_scrollback_up(struct terminal *term, int rows)
     if (urls_mode_is_active(term))
         return;
 
+    /* Make sure there's something to scroll to, if the scrollback is
+     * still being reflowed */
+    term_reflow_rows(term, rows);
+
     const struct grid *grid = term->grid;
     const int view = grid->view;
     const int grid_rows = grid->num_rows;
@@ -5,6 +5,7 @@
 
 #include "debug.h"
 #include "terminal.h"
+#include "xmalloc.h"
 
 uint32_t
 composed_key_from_chars(const uint32_t chars[], size_t count)
@@ -51,28 +52,87 @@ UNITTEST
     xassert(k3 == k4);
 }
 
-const struct composed *
-composed_lookup(struct composed *root, uint32_t key)
+/* Smallest slot array */
+#define COMPOSED_MIN_SLOTS_SHIFT (32 - 6)
+
+static inline size_t
+slot_count(const struct composed_slots *slots)
 {
-    struct composed *node = root;
+    return (size_t)1 << (32 - slots->shift);
+}
 
-    while (node != NULL) {
-        if (key == node->key)
-            return node;
+/* Fibonacci hashing; keys with nearby values are common (see
+ * composed_lookup_without_collision()) */
+static inline size_t
+slot_idx(const struct composed_slots *slots, uint32_t key)
+{
+    return (uint32_t)(key * 2654435769u) >> slots->shift;
+}
+
+static struct composed_slots *
+slots_new(unsigned shift)
+{
+    struct composed_slots *slots = xcalloc(
+        1, sizeof(*slots) + ((size_t)1 << (32 - shift)) * sizeof(slots->v[0]));
+    slots->shift = shift;
+    return slots;
+}
+
+static void
+slots_insert(struct composed_slots *slots, struct composed *node)
+{
+    const size_t mask = slot_count(slots) - 1;
 
-        node = key < node->key ? node->left : node->right;
+    size_t idx = slot_idx(slots, node->key);
+    while (slots->v[idx] != NULL) {
+        xassert(slots->v[idx]->key != node->key);
+        idx = (idx + 1) & mask;
     }
 
-    return NULL;
+    /* Pairs with the acquire in composed_lookup() */
+    __atomic_store_n(&slots->v[idx], node, __ATOMIC_RELEASE);
+}
+
+/* Slot array for 'count' entries, at most half full */
+static struct composed_slots *
+slots_for_count(size_t count)
+{
+    unsigned shift = COMPOSED_MIN_SLOTS_SHIFT;
+    while (((size_t)1 << (32 - shift)) < 2 * count)
+        shift--;
+    return slots_new(shift);
 }
 
 const struct composed *
-composed_lookup_without_collision(struct composed *root, uint32_t *key,
+composed_lookup(const struct composed_table *table, uint32_t key)
+{
+    /* May run concurrently with composed_insert(), see composed.h */
+    const struct composed_slots *slots =
+        __atomic_load_n(&table->slots, __ATOMIC_ACQUIRE);
+    if (slots == NULL)
+        return NULL;
+
+    const size_t mask = slot_count(slots) - 1;
+
+    for (size_t idx = slot_idx(slots, key);; idx = (idx + 1) & mask) {
+        const struct composed *node =
+            __atomic_load_n(&slots->v[idx], __ATOMIC_ACQUIRE);
+
+        if (node == NULL)
+            return NULL;
+        if (node->key == key)
+            return node;
+    }
+}
+
+const struct composed *
+composed_lookup_without_collision(const struct composed_table *table,
+                                  uint32_t *key,
                                   const char32_t *prefix_text, size_t prefix_len,
                                   char32_t wc, int forced_width)
 {
     while (true) {
-        const struct composed *cc = composed_lookup(root, *key);
+        const struct composed *cc = composed_lookup(table, *key);
         if (cc == NULL)
             return NULL;
 
@@ -102,48 +162,158 @@ composed_lookup_without_collision(struct composed *root, uint32_t *key,
 }
 
 void
-composed_insert(struct composed **root, struct composed *node)
+composed_insert(struct composed_table *table, struct composed *node)
 {
-    node->left = node->right = NULL;
+    node->marked = false;
+
+    struct composed_slots *slots = table->slots;
+
+    if (slots == NULL || 2 * (table->count + 1) > slot_count(slots)) {
+        /* Grow; the old slot array is retired, not freed */
+        struct composed_slots *new_slots = slots_for_count(table->count + 1);
+
+        if (slots != NULL) {
+            for (size_t i = 0; i < slot_count(slots); i++) {
+                if (slots->v[i] != NULL)
+                    slots_insert(new_slots, slots->v[i]);
+            }
+
+            slots->next = table->retired;
+            table->retired = slots;
+        }
 
-    if (*root == NULL) {
-        *root = node;
-        return;
+        /* Published when complete; render workers may be looking
+         * up keys (pipelined frames, see grid_render()) */
+        __atomic_store_n(&table->slots, new_slots, __ATOMIC_RELEASE);
+        slots = new_slots;
     }
 
-    uint32_t key = node->key;
+    slots_insert(slots, node);
+    table->count++;
+}
+
+void
+composed_mark(const struct composed_table *table, uint32_t key)
+{
+    struct composed *cc = (struct composed *)composed_lookup(table, key);
+    xassert(cc != NULL);
+
+    if (cc != NULL)
+        cc->marked = true;
+}
+
+static void
+composed_destroy(struct composed *cc)
+{
+    free(cc->chars);
+    free(cc);
+}
+
+static void
+slots_free_retired(struct composed_table *table)
+{
+    for (struct composed_slots *s = table->retired, *next; s != NULL; s = next) {
+        next = s->next;
+        free(s);
+    }
+    table->retired = NULL;
+}
+
+size_t
+composed_sweep(struct composed_table *table)
+{
+    slots_free_retired(table);
 
-    struct composed *prev = NULL;
-    struct composed *n = *root;
+    struct composed_slots *slots = table->slots;
+    if (slots == NULL)
+        return 0;
+
+    size_t live = 0;
+    for (size_t i = 0; i < slot_count(slots); i++) {
+        if (slots->v[i] != NULL && slots->v[i]->marked)
+            live++;
+    }
+
+    /* Rebuild, since entries can't simply be removed from a
+     * linear probing table */
+    struct composed_slots *new_slots = live > 0 ? slots_for_count(live) : NULL;
 
-    while (n != NULL) {
-        xassert(n->key != node->key);
+    for (size_t i = 0; i < slot_count(slots); i++) {
+        struct composed *cc = slots->v[i];
+        if (cc == NULL)
+            continue;
 
-        prev = n;
-        n = key < n->key ? n->left : n->right;
+        if (cc->marked) {
+            cc->marked = false;
+            slots_insert(new_slots, cc);
+        } else
+            composed_destroy(cc);
     }
 
-    xassert(prev != NULL);
-    xassert(n == NULL);
+    free(slots);
+    table->slots = new_slots;
+
+    const size_t freed = table->count - live;
+    table->count = live;
+    return freed;
+}
 
-    if (key < prev->key) {
-        xassert(prev->left == NULL);
-        prev->left = node;
-    } else {
-        xassert(prev->right == NULL);
-        prev->right = node;
+UNITTEST
+{
+    struct composed_table table = {0};
+    xassert(composed_lookup(&table, 0) == NULL);
+
+    /* Consecutive keys, like the ones produced by collisions */
+    for (uint32_t key = 100; key < 1100; key++) {
+        struct composed *cc = xcalloc(1, sizeof(*cc));
+        cc->chars = xmalloc(sizeof(cc->chars[0]));
+        cc->key = key;
+        composed_insert(&table, cc);
+    }
+
+    xassert(table.count == 1000);
+    xassert(table.retired != NULL);
+    for (uint32_t key = 100; key < 1100; key++)
+        xassert(composed_lookup(&table, key)->key == key);
+    xassert(composed_lookup(&table, 99) == NULL);
+    xassert(composed_lookup(&table, 1100) == NULL);
+
+    /* Keep every third entry */
+    for (uint32_t key = 100; key < 1100; key += 3)
+        composed_mark(&table, key);
+
+    xassert(composed_sweep(&table) == 666);
+    xassert(table.count == 334);
+    xassert(table.retired == NULL);
+
+    for (uint32_t key = 100; key < 1100; key++) {
+        const struct composed *cc = composed_lookup(&table, key);
+        xassert((cc != NULL) == ((key - 100) % 3 == 0));
+        xassert(cc == NULL || !cc->marked);
     }
+
+    /* Nothing referenced */
+    xassert(composed_sweep(&table) == 334);
+    xassert(table.count == 0);
+    xassert(table.slots == NULL);
+
+    composed_free(&table);
 }
 
 void
-composed_free(struct composed *root)
+composed_free(struct composed_table *table)
 {
-    if (root == NULL)
-        return;
+    slots_free_retired(table);
 
-    composed_free(root->left);
-    composed_free(root->right);
+    struct composed_slots *slots = table->slots;
+    if (slots != NULL) {
+        for (size_t i = 0; i < slot_count(slots); i++) {
+            if (slots->v[i] != NULL)
+                composed_destroy(slots->v[i]);
+        }
+        free(slots);
+    }
 
-    free(root->chars);
-    free(root);
+    table->slots = NULL;
+    table->count = 0;
 }
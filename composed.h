@@ -1,25 +1,62 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <uchar.h>
 
 struct composed {
     char32_t *chars;
-    struct composed *left;
-    struct composed *right;
     uint32_t key;
     uint8_t count;
     uint8_t width;
     uint8_t forced_width;
+    bool marked;  /* Referenced, see composed_sweep() */
+};
+
+/* Open addressing (linear probing) hash table, indexed by 'key' */
+struct composed_slots {
+    struct composed_slots *next;  /* Retired slot arrays */
+    unsigned shift;               /* 32 - log2(slot count) */
+    struct composed *v[];
+};
+
+struct composed_table {
+    struct composed_slots *slots;  /* NULL when empty */
+
+    /*
+     * Slot arrays replaced when growing the table. Kept until the
+     * next sweep, since the render workers may still be reading them
+     * (see grid_render()).
+     */
+    struct composed_slots *retired;
+
+    size_t count;
+    size_t gc_threshold;  /* Count at which to garbage collect */
 };
 
 uint32_t composed_key_from_chars(const uint32_t chars[], size_t count);
 uint32_t composed_key_from_key(uint32_t prev_key, uint32_t next_char);
 
-const struct composed *composed_lookup(struct composed *root, uint32_t key);
+/*
+ * Lookups are the only operation allowed concurrently with
+ * composed_insert() (render workers, during pipelined frames; see
+ * grid_render()). Everything else must not overlap with inserts.
+ */
+const struct composed *composed_lookup(
+    const struct composed_table *table, uint32_t key);
 const struct composed *composed_lookup_without_collision(
-    struct composed *root, uint32_t *key,
+    const struct composed_table *table, uint32_t *key,
     const char32_t *prefix, size_t prefix_len, char32_t wc, int forced_width);
-void composed_insert(struct composed **root, struct composed *node);
+void composed_insert(struct composed_table *table, struct composed *node);
+
+/*
+ * Garbage collection: mark all keys still referenced, then sweep
+ * the table. Sweeping frees all unmarked entries, and returns the
+ * number of freed entries. The table must not be read by other
+ * threads while sweeping.
+ */
+void composed_mark(const struct composed_table *table, uint32_t key);
+size_t composed_sweep(struct composed_table *table);
 
-void composed_free(struct composed *root);
+void composed_free(struct composed_table *table);
@@ -2768,6 +2768,19 @@ parse_section_tweak(struct context *ctx)
         return true;
     }
 
+    else if (streq(key, "pty-reader-thread"))
+        return value_to_bool(ctx, &conf->tweak.pty_reader_thread);
+
+    else if (streq(key, "pty-ring-size-kb"))
+        return value_to_uint32(ctx, 10, &conf->tweak.pty_ring_size_kb);
+
+    else if (streq(key, "pty-parse-budget-kb"))
+        return value_to_uint32(ctx, 10, &conf->tweak.pty_parse_budget_kb);
+
+    else if (streq(key, "scrollback-compression-screens"))
+        return value_to_uint32(
+            ctx, 10, &conf->tweak.scrollback_compression_screens);
+
     else if (streq(key, "box-drawing-base-thickness"))
         return value_to_float(ctx, &conf->tweak.box_drawing_base_thickness);
 
@@ -3430,6 +3443,10 @@ config_load(struct config *conf, const char *conf_path,
             .delayed_render_lower_ns = 500000,         /* 0.5ms */
             .delayed_render_upper_ns = 16666666 / 2,   /* half a frame period (60Hz) */
             .max_shm_pool_size = 512 * 1024 * 1024,
+            .pty_reader_thread = false,
+            .pty_ring_size_kb = 4096,
+            .pty_parse_budget_kb = 256,
+            .scrollback_compression_screens = 0,
             .render_timer = RENDER_TIMER_NONE,
             .damage_whole_window = false,
             .box_drawing_base_thickness = 0.04,
@@ -397,6 +397,10 @@ struct config {
         uint32_t delayed_render_lower_ns;
         uint32_t delayed_render_upper_ns;
         off_t max_shm_pool_size;
+        bool pty_reader_thread;
+        uint32_t pty_ring_size_kb;
+        uint32_t pty_parse_budget_kb;
+        uint32_t scrollback_compression_screens;
         float box_drawing_base_thickness;
         bool box_drawing_solid_shades;
         bool font_monospace_warn;
@@ -337,6 +337,7 @@ decset_decrst(struct terminal *term, unsigned param, bool enable)
     case 5:
         /* DECSCNM */
         term->reverse = enable;
+        term_render_state_changed(term);
         term_damage_all(term);
         term_damage_margins(term);
         break;
@@ -504,6 +505,9 @@ decset_decrst(struct terminal *term, unsigned param, bool enable)
 
             term->grid = &term->alt;
 
+            /* Absolute row in the normal grid; the alt screen is erased */
+            term->render.last_cursor.row = -1;
+
             /* Cursor retains its position from the normal grid */
             term_cursor_to(
                 term,
@@ -511,6 +515,7 @@ decset_decrst(struct terminal *term, unsigned param, bool enable)
                 min(term->normal.cursor.point.col, term->cols - 1));
 
             tll_free(term->normal.scroll_damage);
+            term->normal.scroll_damage_lines = 0;
             term_erase(term, 0, 0, term->rows - 1, term->cols - 1);
         }
 
@@ -519,6 +524,9 @@ decset_decrst(struct terminal *term, unsigned param, bool enable)
 
             term->grid = &term->normal;
 
+            /* Absolute row in the alt grid; the view is damaged below */
+            term->render.last_cursor.row = -1;
+
             /* Cursor retains its position from the alt grid */
             term_cursor_to(
                 term, min(term->alt.cursor.point.row, term->rows - 1),
@@ -534,6 +542,7 @@ decset_decrst(struct terminal *term, unsigned param, bool enable)
             }
 
             tll_free(term->alt.scroll_damage);
+            term->alt.scroll_damage_lines = 0;
             term_damage_view(term);
         }
 
@@ -1076,8 +1085,12 @@ csi_dispatch(struct terminal *term, uint8_t final)
                     remaining * sizeof(term->grid->cur_row->cells[0]));
 
             for (size_t c = 0; c < remaining; c++)
-                term->grid->cur_row->cells[term->grid->cursor.point.col + c].attrs.clean = 0;
-            term->grid->cur_row->dirty = true;
+                cell_set_clean(&term->grid->cur_row->cells[term->grid->cursor.point.col + c], false);
+            if (remaining > 0) {
+                row_set_dirty_cols(
+                    term->grid->cur_row, term->grid->cursor.point.col,
+                    term->grid->cursor.point.col + remaining - 1);
+            }
 
             /* Erase the remainder of the line */
             const struct coord *cursor = &term->grid->cursor.point;
@@ -1104,8 +1117,12 @@ csi_dispatch(struct terminal *term, uint8_t final)
                     &term->grid->cur_row->cells[term->grid->cursor.point.col],
                     remaining * sizeof(term->grid->cur_row->cells[0]));
             for (size_t c = 0; c < remaining; c++)
-                term->grid->cur_row->cells[term->grid->cursor.point.col + count + c].attrs.clean = 0;
-            term->grid->cur_row->dirty = true;
+                cell_set_clean(&term->grid->cur_row->cells[term->grid->cursor.point.col + count + c], false);
+            if (remaining > 0) {
+                row_set_dirty_cols(
+                    term->grid->cur_row, term->grid->cursor.point.col + count,
+                    term->cols - 1);
+            }
 
             /* Erase (insert space characters) */
             const struct coord *cursor = &term->grid->cursor.point;
@@ -1779,6 +1796,8 @@ csi_dispatch(struct terminal *term, uint8_t final)
                 term->cursor_blink.deccsusr = param & 1;
                 term_cursor_blink_update(term);
             }
+
+            term_render_state_changed(term);
             break;
         }
 
@@ -1873,11 +1892,12 @@ csi_dispatch(struct terminal *term, uint8_t final)
 
             for (int r = top; r <= bottom; r++) {
                 struct row *row = grid_row(term->grid, r);
-                row->dirty = true;
+                row_set_dirty_cols(row, left, right);
 
                 for (int c = left; c <= right; c++) {
-                    struct attributes *a = &row->cells[c].attrs;
-                    a->clean = 0;
+                    struct cell *cell = &row->cells[c];
+                    struct attributes a = cell_get_attrs(row, cell);
+                    a.clean = 0;
 
                     for (size_t i = 4; i < term->vt.params.idx; i++) {
                         const int param = term->vt.params.v[i].value;
@@ -1885,23 +1905,25 @@ csi_dispatch(struct terminal *term, uint8_t final)
                         /* DECCARA only supports a sub-set of SGR parameters */
                         switch (param) {
                         case 0:
-                            a->bold = false;
-                            a->underline = false;
-                            a->blink = false;
-                            a->reverse = false;
+                            a.bold = false;
+                            a.underline = false;
+                            a.blink = false;
+                            a.reverse = false;
                             break;
 
-                        case 1: a->bold = true; break;
-                        case 4: a->underline = true; break;
-                        case 5: a->blink = true; break;
-                        case 7: a->reverse = true; break;
+                        case 1: a.bold = true; break;
+                        case 4: a.underline = true; break;
+                        case 5: a.blink = true; break;
+                        case 7: a.reverse = true; break;
 
-                        case 22: a->bold = false; break;
-                        case 24: a->underline = false; break;
-                        case 25: a->blink = false; break;
-                        case 27: a->reverse = false; break;
+                        case 22: a.bold = false; break;
+                        case 24: a.underline = false; break;
+                        case 25: a.blink = false; break;
+                        case 27: a.reverse = false; break;
                         }
                     }
+
+                    cell_set_attrs(row, cell, a);
                 }
             }
             break;
@@ -1917,11 +1939,12 @@ csi_dispatch(struct terminal *term, uint8_t final)
 
             for (int r = top; r <= bottom; r++) {
                 struct row *row = grid_row(term->grid, r);
-                row->dirty = true;
+                row_set_dirty_cols(row, left, right);
 
                 for (int c = left; c <= right; c++) {
-                    struct attributes *a = &row->cells[c].attrs;
-                    a->clean = 0;
+                    struct cell *cell = &row->cells[c];
+                    struct attributes a = cell_get_attrs(row, cell);
+                    a.clean = 0;
 
                     for (size_t i = 4; i < term->vt.params.idx; i++) {
                         const int param = term->vt.params.v[i].value;
@@ -1929,18 +1952,20 @@ csi_dispatch(struct terminal *term, uint8_t final)
                         /* DECRARA only supports a sub-set of SGR parameters */
                         switch (param) {
                         case 0:
-                            a->bold = !a->bold;
-                            a->underline = !a->underline;
-                            a->blink = !a->blink;
-                            a->reverse = !a->reverse;
+                            a.bold = !a.bold;
+                            a.underline = !a.underline;
+                            a.blink = !a.blink;
+                            a.reverse = !a.reverse;
                             break;
 
-                        case 1: a->bold = !a->bold; break;
-                        case 4: a->underline = !a->underline; break;
-                        case 5: a->blink = !a->blink; break;
-                        case 7: a->reverse = !a->reverse; break;
+                        case 1: a.bold = !a.bold; break;
+                        case 4: a.underline = !a.underline; break;
+                        case 5: a.blink = !a.blink; break;
+                        case 7: a.reverse = !a.reverse; break;
                         }
                     }
+
+                    cell_set_attrs(row, cell, a);
                 }
             }
             break;
@@ -1989,26 +2014,28 @@ csi_dispatch(struct terminal *term, uint8_t final)
              * memmove() behaves, but adapted to our row/cell
              * structure.
              */
-            struct cell **copy = xmalloc(row_count * sizeof(copy[0]));
+            struct row **copy = xmalloc(row_count * sizeof(copy[0]));
             for (int r = 0; r < row_count; r++) {
-                copy[r] = xmalloc(cell_count * sizeof(copy[r][0]));
+                copy[r] = grid_row_alloc(cell_count, false);
 
                 const struct row *row = grid_row(term->grid, src_top + r);
-                const struct cell *cell = &row->cells[src_left];
-                memcpy(copy[r], cell, cell_count * sizeof(copy[r][0]));
+                for (size_t c = 0; c < cell_count; c++) {
+                    cell_copy(copy[r], &copy[r]->cells[c],
+                              row, &row->cells[src_left + c]);
+                }
             }
 
             /* Paste into destination area */
             for (int r = 0; r < row_count; r++) {
                 struct row *row = grid_row(term->grid, dst_top + r);
-                row->dirty = true;
+                row_set_dirty_cols(row, dst_left, dst_left + cell_count - 1);
 
-                struct cell *cell = &row->cells[dst_left];
-                memcpy(cell, copy[r], cell_count * sizeof(copy[r][0]));
-                free(copy[r]);
-
-                for (;cell < &row->cells[dst_left + cell_count]; cell++)
-                    cell->attrs.clean = 0;
+                for (size_t c = 0; c < cell_count; c++) {
+                    struct cell *cell = &row->cells[dst_left + c];
+                    cell_copy(row, cell, copy[r], &copy[r]->cells[c]);
+                    cell_set_clean(cell, false);
+                }
+                grid_row_free(copy[r]);
 
                 if (unlikely(row->extra != NULL)) {
                     /* TODO: technically, we should copy the source URIs... */
@@ -2118,6 +2145,7 @@ csi_dispatch(struct terminal *term, uint8_t final)
                 memcpy(&term->colors, &term->color_stack.stack[slot - 1],
                        sizeof(term->colors));
                 term->color_stack.idx = slot - 1;
+                term_render_state_changed(term);
 
                 /* Assume a full palette switch *will* affect almost
                    all cells. The alternative is to call
@@ -233,7 +233,7 @@ extract_one(const struct terminal *term, const struct row *row,
     if (cell->wc >= CELL_COMB_CHARS_LO && cell->wc <= CELL_COMB_CHARS_HI)
     {
         const struct composed *composed = composed_lookup(
-            term->composed, cell->wc - CELL_COMB_CHARS_LO);
+            &term->composed, cell->wc - CELL_COMB_CHARS_LO);
 
         if (!ensure_size(ctx, composed->count))
             goto err;
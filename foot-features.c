@@ -16,6 +16,12 @@ const char version_and_features[] =
     " -ime"
 #endif
 
+#if defined(FOOT_COMPACT_CELLS) && FOOT_COMPACT_CELLS
+    " +compact-cells"
+#else
+    " -compact-cells"
+#endif
+
 #if defined(FOOT_GRAPHEME_CLUSTERING) && FOOT_GRAPHEME_CLUSTERING
     " +graphemes"
 #else
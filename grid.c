@@ -1,14 +1,19 @@
 #include "grid.h"
 
+#include <errno.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <sys/mman.h>
+
 #define LOG_MODULE "grid"
 #define LOG_ENABLE_DBG 0
 #include "log.h"
 #include "debug.h"
 #include "macros.h"
+#include "render.h"
 #include "sixel.h"
 #include "stride.h"
 #include "util.h"
@@ -20,6 +25,70 @@
 #include "misc.h"
 #endif
 
+/*
+ * Compressed rows
+ *
+ * The cells of a compressed row are stored as run-length encoded
+ * attributes, followed by the text (UTF-8, extended to 31 bits, to
+ * cover combining characters and spacers). Trailing empty cells are
+ * not stored in the text. Everything else in struct row, including
+ * the 'extra' ranges, is left untouched.
+ */
+
+struct attr_run {
+    uint16_t count;
+    struct attributes attrs;
+};
+
+struct row_packed {
+    uint32_t size;          /* Of this struct, including runs and text */
+    uint16_t cols;
+    uint16_t text_cells;    /* Cells in the text; the rest are empty */
+    uint16_t run_count;
+    struct attr_run runs[]; /* Followed by the text */
+};
+
+/*
+ * Row allocator
+ *
+ * Each grid has a pool, from which its rows' cell arrays are
+ * allocated. The cell arrays are carved out of large, mmap:ed slabs
+ * (all cell arrays in a pool have the same width). Freed cell arrays
+ * are recycled, and a slab is unmapped once all its cell arrays have
+ * been freed (one empty slab is kept around, to avoid unmapping and
+ * re-mapping slabs when rows are freed and allocated in lock step).
+ *
+ * The pool outlives its grid if rows are still using it (e.g. while
+ * reflowing to a new width); it is destroyed once its last slab is
+ * unmapped.
+ */
+#define ROW_SLAB_SIZE (1024 * 1024)
+
+struct row_slab {
+    struct row_pool *pool;
+    struct row_slab *prev;
+    struct row_slab *next;
+
+    struct cell *cells;   /* 'count' cell arrays, 'pool->cols' cells each */
+    size_t size;          /* Size of the mapping */
+    uint32_t count;
+    uint32_t used;        /* Cell arrays handed out */
+    uint32_t fresh;       /* Cell arrays from here on have never been used */
+    uint32_t free_list;   /* Index, linked through the first cell's 'wc' */
+};
+
+struct row_pool {
+    int cols;
+    bool orphaned;  /* The grid no longer uses the pool */
+
+    /* Slabs with free cell arrays first, full slabs last */
+    struct row_slab *head;
+    struct row_slab *tail;
+
+    size_t slab_count;
+    size_t empty_slabs;
+};
+
 /*
  * "sb" (scrollback relative) coordinates
  *
@@ -107,8 +176,8 @@ verify_no_overlapping_ranges_of_type(const struct row_ranges *ranges,
                 switch (type) {
                 case ROW_RANGE_URI:
                     BUG("OSC-8 URI overlap: %s: %d-%d: %s: %d-%d",
-                        r1->uri.uri, r1->start, r1->end,
-                        r2->uri.uri, r2->start, r2->end);
+                        r1->uri.uri->str, r1->start, r1->end,
+                        r2->uri.uri->str, r2->start, r2->end);
                     break;
 
                 case ROW_RANGE_UNDERLINE:
@@ -145,8 +214,8 @@ verify_ranges_of_type_are_sorted(const struct row_ranges *ranges,
                 case ROW_RANGE_URI:
                     BUG("OSC-8 URI not sorted correctly: "
                         "%s: %d-%d came before %s: %d-%d",
-                        last->uri.uri, last->start, last->end,
-                        r->uri.uri, r->start, r->end);
+                        last->uri.uri->str, last->start, last->end,
+                        r->uri.uri->str, r->start, r->end);
                     break;
 
                 case ROW_RANGE_UNDERLINE:
@@ -207,7 +276,7 @@ range_insert(struct row_ranges *ranges, size_t idx, int start, int end,
     switch (type) {
     case ROW_RANGE_URI:
         r->uri.id = data->uri.id;
-        r->uri.uri = xstrdup(data->uri.uri);
+        r->uri.uri = osc8_uri_ref(data->uri.uri);
         break;
 
     case ROW_RANGE_UNDERLINE:
@@ -248,7 +317,7 @@ range_append(struct row_ranges *ranges, int start, int end,
         range_append_by_ref(
             ranges, start, end, type,
             &(union row_range_data){.uri = {.id = data->uri.id,
-                                            .uri = xstrdup(data->uri.uri)}});
+                                            .uri = osc8_uri_ref(data->uri.uri)}});
         break;
 
     case ROW_RANGE_UNDERLINE:
@@ -270,136 +339,6 @@ range_delete(struct row_ranges *ranges, enum row_range_type type, size_t idx)
     ranges->count--;
 }
 
-struct grid *
-grid_snapshot(const struct grid *grid)
-{
-    struct grid *clone = xmalloc(sizeof(*clone));
-    clone->num_rows = grid->num_rows;
-    clone->num_cols = grid->num_cols;
-    clone->offset = grid->offset;
-    clone->view = grid->view;
-    clone->cursor = grid->cursor;
-    clone->saved_cursor = grid->saved_cursor;
-    clone->kitty_kbd = grid->kitty_kbd;
-    clone->rows = xcalloc(grid->num_rows, sizeof(clone->rows[0]));
-    memset(&clone->scroll_damage, 0, sizeof(clone->scroll_damage));
-    memset(&clone->sixel_images, 0, sizeof(clone->sixel_images));
-
-    tll_foreach(grid->scroll_damage, it)
-        tll_push_back(clone->scroll_damage, it->item);
-
-    for (int r = 0; r < grid->num_rows; r++) {
-        const struct row *row = grid->rows[r];
-
-        if (row == NULL)
-            continue;
-
-        struct row *clone_row = xmalloc(sizeof(*row));
-        clone->rows[r] = clone_row;
-
-        clone_row->cells = xmalloc(grid->num_cols * sizeof(clone_row->cells[0]));
-        clone_row->linebreak = row->linebreak;
-        clone_row->dirty = row->dirty;
-        clone_row->shell_integration = row->shell_integration;
-
-        for (int c = 0; c < grid->num_cols; c++)
-            clone_row->cells[c] = row->cells[c];
-
-        const struct row_data *extra = row->extra;
-
-        if (extra != NULL) {
-            struct row_data *clone_extra = xcalloc(1, sizeof(*clone_extra));
-            clone_row->extra = clone_extra;
-
-            range_ensure_size(&clone_extra->uri_ranges, extra->uri_ranges.count);
-            range_ensure_size(&clone_extra->underline_ranges, extra->underline_ranges.count);
-
-            for (int i = 0; i < extra->uri_ranges.count; i++) {
-                const struct row_range *range = &extra->uri_ranges.v[i];
-                range_append(
-                    &clone_extra->uri_ranges,
-                    range->start, range->end, ROW_RANGE_URI, &range->data);
-            }
-
-            for (int i = 0; i < extra->underline_ranges.count; i++) {
-                const struct row_range *range = &extra->underline_ranges.v[i];
-                range_append_by_ref(
-                    &clone_extra->underline_ranges, range->start, range->end,
-                    ROW_RANGE_UNDERLINE, &range->data);
-            }
-        } else
-            clone_row->extra = NULL;
-    }
-
-    tll_foreach(grid->sixel_images, it) {
-        int original_width = it->item.original.width;
-        int original_height = it->item.original.height;
-        pixman_image_t *original_pix = it->item.original.pix;
-        pixman_format_code_t original_pix_fmt = pixman_image_get_format(original_pix);
-        int original_stride = stride_for_format_and_width(original_pix_fmt, original_width);
-
-        size_t original_size = original_stride * original_height;
-        void *new_original_data = xmemdup(it->item.original.data, original_size);
-
-        pixman_image_t *new_original_pix = pixman_image_create_bits_no_clear(
-            original_pix_fmt, original_width, original_height,
-            new_original_data, original_stride);
-
-        void *new_scaled_data = NULL;
-        pixman_image_t *new_scaled_pix = NULL;
-        int scaled_width = -1;
-        int scaled_height = -1;
-
-        if (it->item.scaled.data != NULL) {
-            scaled_width = it->item.scaled.width;
-            scaled_height = it->item.scaled.height;
-
-            pixman_image_t *scaled_pix = it->item.scaled.pix;
-            pixman_format_code_t scaled_pix_fmt = pixman_image_get_format(scaled_pix);
-            int scaled_stride = stride_for_format_and_width(scaled_pix_fmt, scaled_width);
-
-            size_t scaled_size = scaled_stride * scaled_height;
-            new_scaled_data = xmemdup(it->item.scaled.data, scaled_size);
-
-            new_scaled_pix = pixman_image_create_bits_no_clear(
-                scaled_pix_fmt, scaled_width, scaled_height, new_scaled_data,
-                scaled_stride);
-        }
-
-        struct sixel six = {
-            .pix = (it->item.pix == it->item.original.pix
-                    ? new_original_pix
-                    : (it->item.pix == it->item.scaled.pix
-                       ? new_scaled_pix
-                       : NULL)),
-            .width = it->item.width,
-            .height = it->item.height,
-            .rows = it->item.rows,
-            .cols = it->item.cols,
-            .pos = it->item.pos,
-            .opaque = it->item.opaque,
-            .cell_width = it->item.cell_width,
-            .cell_height = it->item.cell_height,
-            .original = {
-                .data = new_original_data,
-                .pix = new_original_pix,
-                .width = original_width,
-                .height = original_height,
-            },
-            .scaled = {
-                .data = new_scaled_data,
-                .pix = new_scaled_pix,
-                .width = scaled_width,
-                .height = scaled_height,
-            },
-        };
-
-        tll_push_back(clone->sixel_images, six);
-    }
-
-    return clone;
-}
-
 void
 grid_free(struct grid *grid)
 {
@@ -416,6 +355,10 @@ grid_free(struct grid *grid)
 
     free(grid->rows);
     tll_free(grid->scroll_damage);
+
+    grid_reflow_discard(grid);
+    row_pool_release(grid->pool);
+    grid->pool = NULL;
 }
 
 void
@@ -434,388 +377,2250 @@ grid_swap_row(struct grid *grid, int row_a, int row_b)
     grid->rows[real_b] = a;
 }
 
-struct row *
-grid_row_alloc(int cols, bool initialize)
+#define SLAB_FREE_LIST_END UINT32_MAX
+
+struct row_pool *
+row_pool_new(int cols)
 {
-    struct row *row = xmalloc(sizeof(*row));
-    row->dirty = false;
-    row->linebreak = true;
-    row->extra = NULL;
-    row->shell_integration.prompt_marker = false;
-    row->shell_integration.cmd_start = -1;
-    row->shell_integration.cmd_end = -1;
+    struct row_pool *pool = xmalloc(sizeof(*pool));
+    *pool = (struct row_pool){.cols = cols};
+    return pool;
+}
 
-    if (initialize) {
-        row->cells = xcalloc(cols, sizeof(row->cells[0]));
-        for (size_t c = 0; c < cols; c++)
-            row->cells[c].attrs.clean = 1;
-    } else
-        row->cells = xmalloc(cols * sizeof(row->cells[0]));
+static void
+slab_unlink(struct row_pool *pool, struct row_slab *slab)
+{
+    if (slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        pool->head = slab->next;
 
-    return row;
+    if (slab->next != NULL)
+        slab->next->prev = slab->prev;
+    else
+        pool->tail = slab->prev;
+
+    slab->prev = slab->next = NULL;
 }
 
-void
-grid_row_free(struct row *row)
+static void
+slab_push_front(struct row_pool *pool, struct row_slab *slab)
 {
-    if (row == NULL)
-        return;
+    slab->prev = NULL;
+    slab->next = pool->head;
+
+    if (pool->head != NULL)
+        pool->head->prev = slab;
+    else
+        pool->tail = slab;
+    pool->head = slab;
+}
 
-    grid_row_reset_extra(row);
-    free(row->extra);
-    free(row->cells);
-    free(row);
+static void
+slab_push_back(struct row_pool *pool, struct row_slab *slab)
+{
+    slab->next = NULL;
+    slab->prev = pool->tail;
+
+    if (pool->tail != NULL)
+        pool->tail->next = slab;
+    else
+        pool->head = slab;
+    pool->tail = slab;
 }
 
-void
-grid_resize_without_reflow(
-    struct grid *grid, int new_rows, int new_cols,
-    int old_screen_rows, int new_screen_rows)
+static struct row_slab *
+slab_new(struct row_pool *pool)
 {
-    struct row *const *old_grid = grid->rows;
-    const int old_rows = grid->num_rows;
-    const int old_cols = grid->num_cols;
+    const size_t array_size = pool->cols * sizeof(struct cell);
+    const size_t count = max(ROW_SLAB_SIZE / array_size, 1);
+    const size_t size = count * array_size;
+
+    /* Pages are zero-filled, and not committed until touched */
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        FATAL_ERROR(__func__, errno);
+
+    struct row_slab *slab = xmalloc(sizeof(*slab));
+    *slab = (struct row_slab){
+        .pool = pool,
+        .cells = mem,
+        .size = size,
+        .count = count,
+        .free_list = SLAB_FREE_LIST_END,
+    };
 
-    struct row **new_grid = xcalloc(new_rows, sizeof(new_grid[0]));
+    slab_push_front(pool, slab);
+    pool->slab_count++;
+    pool->empty_slabs++;
+    return slab;
+}
 
-    tll(struct sixel) untranslated_sixels = tll_init();
-    tll_foreach(grid->sixel_images, it)
-        tll_push_back(untranslated_sixels, it->item);
-    tll_free(grid->sixel_images);
+static void
+slab_destroy(struct row_pool *pool, struct row_slab *slab)
+{
+    xassert(slab->used == 0);
 
-    int new_offset = 0;
+    slab_unlink(pool, slab);
+    munmap(slab->cells, slab->size);
+    free(slab);
 
-    /* Copy old lines, truncating them if old rows were longer */
-    for (int r = 0, n = min(old_screen_rows, new_screen_rows); r < n; r++) {
-        const int old_row_idx = (grid->offset + r) & (old_rows - 1);
-        const int new_row_idx = (new_offset + r) & (new_rows - 1);
+    xassert(pool->slab_count > 0);
+    xassert(pool->empty_slabs > 0);
+    pool->slab_count--;
+    pool->empty_slabs--;
 
-        const struct row *old_row = old_grid[old_row_idx];
-        xassert(old_row != NULL);
+    if (pool->orphaned && pool->slab_count == 0)
+        free(pool);
+}
 
-        struct row *new_row = grid_row_alloc(new_cols, false);
-        new_grid[new_row_idx] = new_row;
+static struct cell *
+slab_alloc(struct row_pool *pool, struct row_slab **owner)
+{
+    struct row_slab *slab = pool->head;
 
-        memcpy(new_row->cells,
-               old_row->cells,
-               sizeof(struct cell) * min(old_cols, new_cols));
+    if (slab == NULL || slab->used == slab->count)
+        slab = slab_new(pool);
 
-        new_row->dirty = old_row->dirty;
-        new_row->shell_integration.prompt_marker = old_row->shell_integration.prompt_marker;
-        new_row->shell_integration.cmd_start = min(old_row->shell_integration.cmd_start, new_cols - 1);
-        new_row->shell_integration.cmd_end = min(old_row->shell_integration.cmd_end, new_cols - 1);
+    struct cell *cells;
 
-        if (new_cols > old_cols) {
-            /* Clear "new" columns */
-            memset(&new_row->cells[old_cols], 0,
-                   sizeof(struct cell) * (new_cols - old_cols));
-            new_row->dirty = true;
-        } else if (old_cols > new_cols) {
-            /* Make sure we don't cut a multi-column character in two */
-            for (int i = new_cols; i > 0 && old_row->cells[i].wc > CELL_SPACER; i--)
-                new_row->cells[i - 1].wc = 0;
-        }
+    if (slab->free_list != SLAB_FREE_LIST_END) {
+        cells = &slab->cells[(size_t)slab->free_list * pool->cols];
+        slab->free_list = cells[0].wc;
+    } else {
+        xassert(slab->fresh < slab->count);
+        cells = &slab->cells[(size_t)slab->fresh++ * pool->cols];
+    }
 
-        /* Map sixels on current "old" row to current "new row" */
-        tll_foreach(untranslated_sixels, it) {
-            if (it->item.pos.row != old_row_idx)
-                continue;
+    if (slab->used++ == 0)
+        pool->empty_slabs--;
 
-            struct sixel sixel = it->item;
-            sixel.pos.row = new_row_idx;
+    if (slab->used == slab->count && slab != pool->tail) {
+        /* Full; move out of the way */
+        slab_unlink(pool, slab);
+        slab_push_back(pool, slab);
+    }
 
-            if (sixel.pos.col < new_cols)
-                tll_push_back(grid->sixel_images, sixel);
-            else
-                sixel_destroy(&it->item);
-            tll_remove(untranslated_sixels, it);
-        }
+    *owner = slab;
+    return cells;
+}
 
-        /* Copy URI ranges, truncating them if necessary */
-        const struct row_data *old_extra = old_row->extra;
-        if (old_extra == NULL)
-            continue;
+static void
+slab_free(struct row_slab *slab, struct cell *cells)
+{
+    struct row_pool *pool = slab->pool;
+    const size_t idx = (cells - slab->cells) / pool->cols;
 
-        ensure_row_has_extra_data(new_row);
-        struct row_data *new_extra = new_row->extra;
+    xassert(cells >= slab->cells);
+    xassert(idx < slab->count);
+    xassert(slab->used > 0);
 
-        range_ensure_size(&new_extra->uri_ranges, old_extra->uri_ranges.count);
-        range_ensure_size(&new_extra->underline_ranges, old_extra->underline_ranges.count);
+    cells[0].wc = slab->free_list;
+    slab->free_list = idx;
 
-        for (int i = 0; i < old_extra->uri_ranges.count; i++) {
-            const struct row_range *range = &old_extra->uri_ranges.v[i];
+    if (slab->used-- == slab->count && slab != pool->head) {
+        /* Was full; make it available again */
+        slab_unlink(pool, slab);
+        slab_push_front(pool, slab);
+    }
 
-            if (range->start >= new_cols) {
-                /* The whole range is truncated */
-                continue;
-            }
+    if (slab->used == 0) {
+        pool->empty_slabs++;
+        if (pool->orphaned || pool->empty_slabs > 1)
+            slab_destroy(pool, slab);
+    }
+}
 
-            const int start = range->start;
-            const int end = min(range->end, new_cols - 1);
-            range_append(&new_extra->uri_ranges, start, end, ROW_RANGE_URI, &range->data);
-        }
+void
+row_pool_trim(struct row_pool *pool)
+{
+    if (pool == NULL)
+        return;
 
-        for (int i = 0; i < old_extra->underline_ranges.count; i++) {
-            const struct row_range *range = &old_extra->underline_ranges.v[i];
+    for (struct row_slab *slab = pool->head, *next; slab != NULL; slab = next) {
+        next = slab->next;
+        if (slab->used == 0)
+            slab_destroy(pool, slab);
+    }
+}
 
-            if (range->start >= new_cols) {
-                /* The whole range is truncated */
-                continue;
-            }
+void
+row_pool_release(struct row_pool *pool)
+{
+    if (pool == NULL)
+        return;
 
-            const int start = range->start;
-            const int end = min(range->end, new_cols - 1);
-            range_append_by_ref(&new_extra->underline_ranges, start, end, ROW_RANGE_UNDERLINE, &range->data);
-        }
+    /* Rows still using the pool (if any) free it when they're gone */
+    pool->orphaned = true;
+
+    if (pool->slab_count == 0)
+        free(pool);
+    else
+        row_pool_trim(pool);
 }
 
-    /* Clear "new" lines */
-    for (int r = min(old_screen_rows, new_screen_rows); r < new_screen_rows; r++) {
-        struct row *new_row = grid_row_alloc(new_cols, false);
-        new_grid[(new_offset + r) & (new_rows - 1)] = new_row;
+static struct cell *
+cells_alloc(struct row_pool *pool, int cols, struct row_slab **owner)
+{
+    if (pool == NULL) {
+        *owner = NULL;
+        return xmalloc(cols * sizeof(struct cell));
+    }
+
+    xassert(pool->cols == cols);
+    return slab_alloc(pool, owner);
+}
+
+static void
+cells_free(struct row *row)
+{
+    if (row->slab != NULL)
+        slab_free(row->slab, row->cells);
+    else
+        free(row->cells);
+
+    row->cells = NULL;
+    row->slab = NULL;
+}
+
+/* See row->gen. Rows are allocated by the workers too, when reflowing */
+static uint64_t
+row_gen_next(void)
+{
+    static atomic_uint_least64_t next = 1;
+    return atomic_fetch_add_explicit(&next, 1, memory_order_relaxed);
+}
+
+#if defined(FOOT_COMPACT_CELLS) && FOOT_COMPACT_CELLS
+
+/*
+ * Per-row attribute tables (compact cells)
+ *
+ * Entries are never removed one by one; when the table is full, it
+ * is garbage collected (unused entries are dropped, and the cells
+ * re-indexed), and grown if that didn't free up at least half of
+ * it. A table may grow to twice the number of attributes a row can
+ * reference, guaranteeing each collection frees up at least half of
+ * the table, and thus amortizing its cost over the following
+ * insertions.
+ *
+ * Entries are looked up through an open-addressed hash table, with
+ * twice as many slots as there are entries, allocated together with
+ * the entries (see row_attrs_hash()). Slots hold 'index + 1'; zero
+ * is an empty slot.
+ */
+
+#define ROW_ATTRS_MAX_SIZE 32768
+
+static inline uint16_t *
+row_attrs_hash(const struct row *row)
+{
+    return (uint16_t *)&row->attrs.v[row->attrs.size];
+}
+
+static inline size_t
+row_attrs_bytes(size_t size)
+{
+    return size * (sizeof(struct attributes) + 2 * sizeof(uint16_t));
+}
+
+/* Slot holding 'bits', or the empty slot to insert it in */
+static inline uint16_t *
+row_attrs_lookup(const struct row *row, uint64_t bits)
+{
+    uint16_t *hash = row_attrs_hash(row);
+    const uint32_t mask = 2u * row->attrs.size - 1;
+
+    for (uint32_t h = (bits * 0x9e3779b97f4a7c15ull) >> 40;; h++) {
+        uint16_t *slot = &hash[h & mask];
+        if (*slot == 0 || attrs_sgr_bits(row->attrs.v[*slot - 1]) == bits)
+            return slot;
+    }
+}
+
+static void
+row_attrs_rehash(struct row *row)
+{
+    memset(row_attrs_hash(row), 0, 2 * row->attrs.size * sizeof(uint16_t));
+
+    for (uint16_t i = 0; i < row->attrs.count; i++)
+        *row_attrs_lookup(row, attrs_sgr_bits(row->attrs.v[i])) = i + 1;
+}
+
+static void
+row_attrs_resize(struct row *row, uint16_t size)
+{
+    xassert(size >= row->attrs.count);
+    xassert((size & (size - 1)) == 0);
+
+    row->attrs.v = xrealloc(row->attrs.v, row_attrs_bytes(size));
+    row->attrs.size = size;
+    row_attrs_rehash(row);
+}
+
+static size_t
+row_attrs_max_size(int cols)
+{
+    size_t size = 4;
+    while (size < 2 * (cols + 2) && size < ROW_ATTRS_MAX_SIZE)
+        size *= 2;
+    return size;
+}
+
+void
+row_attrs_init(struct row *row, int cols)
+{
+    /* Leave room for the default, and one pending, attribute */
+    xassert(cols + 2 < ROW_ATTRS_MAX_SIZE);
+
+    row->attrs.v = NULL;
+    row->attrs.count = 0;
+    row->attrs.size = 0;
+    row->attrs.last = 0;
+    row->attrs.cols = cols;
+
+    row_attrs_resize(row, 4);
+    row->attrs.v[0] = (struct attributes){0};
+    row->attrs.count = 1;
+    *row_attrs_lookup(row, 0) = 1;
+}
+
+void
+row_attrs_free(struct row *row)
+{
+    free(row->attrs.v);
+    row->attrs.v = NULL;
+    row->attrs.count = row->attrs.size = row->attrs.last = 0;
+}
+
+void
+row_attrs_copy(struct row *dst, const struct row *src)
+{
+    if (dst->attrs.size != src->attrs.size) {
+        dst->attrs.v = xrealloc(dst->attrs.v, row_attrs_bytes(src->attrs.size));
+        dst->attrs.size = src->attrs.size;
+    }
+
+    memcpy(dst->attrs.v, src->attrs.v, src->attrs.count * sizeof(dst->attrs.v[0]));
+    memcpy(row_attrs_hash(dst), row_attrs_hash(src),
+           2 * src->attrs.size * sizeof(uint16_t));
+    dst->attrs.count = src->attrs.count;
+    dst->attrs.last = src->attrs.last;
+}
+
+void
+row_attrs_reset(struct row *row)
+{
+    if (row->attrs.v == NULL)
+        return;
+
+    row->attrs.count = 1;
+    row->attrs.last = 0;
+    row_attrs_rehash(row);
+}
+
+static void
+row_attrs_gc(struct row *row)
+{
+    const int count = row->attrs.count;
+    const int cols = row->attrs.cols;
+
+    /*
+     * The hash table is rebuilt afterwards; use it to map the
+     * entries in use to their new index + 1
+     */
+    uint16_t *remap = row_attrs_hash(row);
+    memset(remap, 0, count * sizeof(remap[0]));
+    remap[0] = 1;
+
+    /* Cells not yet written may hold anything; ignore invalid indices */
+    for (int c = 0; c < cols; c++) {
+        const uint16_t idx = row->cells[c].attrs_idx;
+        if (idx < count)
+            remap[idx] = 1;
+    }
+
+    int new_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (remap[i] == 0)
+            continue;
+        row->attrs.v[new_count] = row->attrs.v[i];
+        remap[i] = ++new_count;
+    }
+
+    for (int c = 0; c < cols; c++) {
+        struct cell *cell = &row->cells[c];
+        if (cell->attrs_idx < count)
+            cell->attrs_idx = remap[cell->attrs_idx] - 1;
+    }
+
+    row->attrs.count = new_count;
+    row->attrs.last = 0;
+    row_attrs_rehash(row);
+}
+
+uint16_t
+row_attrs_intern_slow(struct row *row, struct attributes attrs)
+{
+    xassert(row->attrs.v != NULL);
+
+    const uint64_t bits = attrs_sgr_bits(attrs);
+    uint16_t *slot = row_attrs_lookup(row, bits);
+
+    if (*slot != 0) {
+        row->attrs.last = *slot - 1;
+        return row->attrs.last;
+    }
+
+    if (row->attrs.count == row->attrs.size) {
+        /*
+         * There can't be more attributes in use than there are
+         * cells, plus the default attributes, plus the one being
+         * added (the cell it's for still references its old
+         * attributes)
+         */
+        const size_t max_size = row_attrs_max_size(row->attrs.cols);
+
+        if (row->attrs.size >= 16 || row->attrs.size >= max_size)
+            row_attrs_gc(row);
+
+        if (row->attrs.count > row->attrs.size / 2 &&
+            row->attrs.size < max_size)
+        {
+            row_attrs_resize(row, row->attrs.size * 2);
+        }
+
+        slot = row_attrs_lookup(row, bits);
+    }
+
+    xassert(row->attrs.count < row->attrs.size);
+
+    const uint16_t idx = row->attrs.count++;
+    memcpy(&row->attrs.v[idx], &bits, sizeof(bits));
+    *slot = idx + 1;
+    row->attrs.last = idx;
+    return idx;
+}
+
+UNITTEST
+{
+    const int cols = 20;
+    struct row *row = grid_row_alloc(cols, true);
+
+    /* Repeatedly overwrite the row with (mostly) unique attributes */
+    for (int i = 0; i < 100; i++) {
+        for (int c = 0; c < cols; c++) {
+            cell_set_attrs(row, &row->cells[c], (struct attributes){
+                .fg = i * cols + c,
+                .fg_src = COLOR_RGB,
+                .bold = c % 2,
+                .selected = c % 3 == 0,
+            });
+        }
+
+        /* The table never grows beyond twice what a row can
+         * reference (rounded up to a power of two) */
+        xassert(row->attrs.size <= 64);
+    }
+
+    for (int c = 0; c < cols; c++) {
+        const struct cell *cell = &row->cells[c];
+        const struct attributes *a = cell_attrs(row, cell);
+
+        xassert(a->fg == 99 * cols + c);
+        xassert(a->fg_src == COLOR_RGB);
+        xassert(a->bold == c % 2);
+        xassert(!a->selected);
+        xassert(cell_selected(cell) == (c % 3 == 0));
+    }
+
+    /* Identical attributes share a single entry */
+    for (int c = 0; c < cols; c++)
+        cell_set_attrs(row, &row->cells[c], (struct attributes){.italic = true});
+    cell_set_attrs(row, &row->cells[0], (struct attributes){.italic = true});
+
+    xassert(row->cells[0].attrs_idx == row->cells[cols - 1].attrs_idx);
+
+    grid_row_free(row);
+
+    /* Wide row, with unique attributes in every cell (e.g. a gradient) */
+    const int wide_cols = 500;
+    row = grid_row_alloc(wide_cols, true);
+
+    for (int i = 0; i < 3; i++) {
+        for (int c = 0; c < wide_cols; c++) {
+            cell_set_attrs(row, &row->cells[c], (struct attributes){
+                .bg = (i * wide_cols + c) % 1000,
+                .bg_src = COLOR_RGB,
+            });
+        }
+    }
+
+    /* Looking up existing attributes doesn't add new entries */
+    const uint16_t count = row->attrs.count;
+    for (int c = wide_cols - 1; c >= 0; c--) {
+        const uint16_t idx = row->cells[c].attrs_idx;
+        cell_set_attrs(row, &row->cells[c], *cell_attrs(row, &row->cells[c]));
+        xassert(row->cells[c].attrs_idx == idx);
+        xassert(cell_attrs(row, &row->cells[c])->bg == (2 * wide_cols + c) % 1000);
+    }
+    xassert(row->attrs.count == count);
+
+    row_attrs_reset(row);
+    xassert(row->attrs.count == 1);
+    cell_set_attrs(row, &row->cells[0], (struct attributes){0});
+    xassert(row->cells[0].attrs_idx == 0);
+
+    grid_row_free(row);
+}
+
+#endif /* FOOT_COMPACT_CELLS */
+
+struct row *
+grid_row_alloc_from(struct row_pool *pool, int cols, bool initialize)
+{
+    struct row *row = xmalloc(sizeof(*row));
+    row->dirty = false;
+    row->dirty_start = row->dirty_end = 0;
+    row->linebreak = true;
+    row->blink = false;
+    row->default_colors = false;
+    row->palette = 0;
+    row->shares = 0;
+    row->extra = NULL;
+    row->packed = NULL;
+    row->shell_integration.prompt_marker = false;
+    row->shell_integration.cmd_start = -1;
+    row->shell_integration.cmd_end = -1;
+    row->cells = cells_alloc(pool, cols, &row->slab);
+    row->gen = row_gen_next();
+    row_attrs_init(row, cols);
+
+    if (initialize) {
+        memset(row->cells, 0, cols * sizeof(row->cells[0]));
+        for (size_t c = 0; c < cols; c++)
+            cell_set_clean(&row->cells[c], true);
+    }
+
+    return row;
+}
+
+struct row *
+grid_row_alloc(int cols, bool initialize)
+{
+    return grid_row_alloc_from(NULL, cols, initialize);
+}
+
+void
+grid_row_free(struct row *row)
+{
+    if (row == NULL)
+        return;
+
+    if (row->shares > 0) {
+        /* Still referenced by another grid */
+        row->shares--;
+        return;
+    }
+
+    grid_row_reset_extra(row);
+    free(row->extra);
+    if (row->cells != NULL)
+        cells_free(row);
+    row_attrs_free(row);
+    free(row->packed);
+    free(row);
+}
+
+/* Deep copy of 'row'. The cells are allocated from 'pool' */
+static struct row *
+row_clone(struct row_pool *pool, const struct row *row, int cols)
+{
+    struct row *clone_row = xcalloc(1, sizeof(*row));
+
+    clone_row->linebreak = row->linebreak;
+    clone_row->blink = row->blink;
+    clone_row->default_colors = row->default_colors;
+    clone_row->palette = row->palette;
+    clone_row->dirty = row->dirty;
+    clone_row->dirty_start = row->dirty_start;
+    clone_row->dirty_end = row->dirty_end;
+    clone_row->shell_integration = row->shell_integration;
+
+    if (row->packed != NULL) {
+        clone_row->cells = NULL;
+        clone_row->packed = xmemdup(row->packed, row->packed->size);
+    } else {
+        clone_row->cells = cells_alloc(pool, cols, &clone_row->slab);
+        clone_row->gen = row_gen_next();
+        clone_row->packed = NULL;
+
+        for (int c = 0; c < cols; c++)
+            clone_row->cells[c] = row->cells[c];
+
+        row_attrs_init(clone_row, cols);
+        row_attrs_copy(clone_row, row);
+    }
+
+    const struct row_data *extra = row->extra;
+
+    if (extra != NULL) {
+        struct row_data *clone_extra = xcalloc(1, sizeof(*clone_extra));
+        clone_row->extra = clone_extra;
+
+        range_ensure_size(&clone_extra->uri_ranges, extra->uri_ranges.count);
+        range_ensure_size(&clone_extra->underline_ranges, extra->underline_ranges.count);
+
+        for (int i = 0; i < extra->uri_ranges.count; i++) {
+            const struct row_range *range = &extra->uri_ranges.v[i];
+            range_append(
+                &clone_extra->uri_ranges,
+                range->start, range->end, ROW_RANGE_URI, &range->data);
+        }
+
+        for (int i = 0; i < extra->underline_ranges.count; i++) {
+            const struct row_range *range = &extra->underline_ranges.v[i];
+            range_append_by_ref(
+                &clone_extra->underline_ranges, range->start, range->end,
+                ROW_RANGE_UNDERLINE, &range->data);
+        }
+    } else
+        clone_row->extra = NULL;
+
+    return clone_row;
+}
+
+/*
+ * The rows are shared with the snapshot, not copied. A shared row
+ * is copied by whichever grid first modifies it (see
+ * grid_row_unshare()). The exception is the cursor row, since
+ * 'cur_row' is written to directly.
+ */
+struct grid *
+grid_snapshot(const struct grid *grid)
+{
+    struct grid *clone = xmalloc(sizeof(*clone));
+    clone->num_rows = grid->num_rows;
+    clone->num_cols = grid->num_cols;
+    clone->offset = grid->offset;
+    clone->view = grid->view;
+    clone->cursor = grid->cursor;
+    clone->saved_cursor = grid->saved_cursor;
+    clone->kitty_kbd = grid->kitty_kbd;
+    clone->rows = xcalloc(grid->num_rows, sizeof(clone->rows[0]));
+    memset(&clone->scroll_damage, 0, sizeof(clone->scroll_damage));
+    memset(&clone->sixel_images, 0, sizeof(clone->sixel_images));
+
+    tll_foreach(grid->scroll_damage, it)
+        tll_push_back(clone->scroll_damage, it->item);
+    clone->scroll_damage_lines = grid->scroll_damage_lines;
+    clone->compressed = grid->compressed;
+    clone->pool = NULL;
+    clone->reflow = NULL;
+
+    for (int r = 0; r < grid->num_rows; r++) {
+        struct row *row = grid->rows[r];
+
+        if (row == NULL)
+            continue;
+
+        if (row == grid->cur_row) {
+            clone->rows[r] = row_clone(NULL, row, grid->num_cols);
+            continue;
+        }
+
+        xassert(row->shares < UINT16_MAX);
+        row->shares++;
+        clone->rows[r] = row;
+    }
+
+    tll_foreach(grid->sixel_images, it) {
+        int original_width = it->item.original.width;
+        int original_height = it->item.original.height;
+        pixman_image_t *original_pix = it->item.original.pix;
+        pixman_format_code_t original_pix_fmt = pixman_image_get_format(original_pix);
+        int original_stride = stride_for_format_and_width(original_pix_fmt, original_width);
+
+        size_t original_size = original_stride * original_height;
+        void *new_original_data = xmemdup(it->item.original.data, original_size);
+
+        pixman_image_t *new_original_pix = pixman_image_create_bits_no_clear(
+            original_pix_fmt, original_width, original_height,
+            new_original_data, original_stride);
+
+        void *new_scaled_data = NULL;
+        pixman_image_t *new_scaled_pix = NULL;
+        int scaled_width = -1;
+        int scaled_height = -1;
+
+        if (it->item.scaled.data != NULL) {
+            scaled_width = it->item.scaled.width;
+            scaled_height = it->item.scaled.height;
+
+            pixman_image_t *scaled_pix = it->item.scaled.pix;
+            pixman_format_code_t scaled_pix_fmt = pixman_image_get_format(scaled_pix);
+            int scaled_stride = stride_for_format_and_width(scaled_pix_fmt, scaled_width);
+
+            size_t scaled_size = scaled_stride * scaled_height;
+            new_scaled_data = xmemdup(it->item.scaled.data, scaled_size);
+
+            new_scaled_pix = pixman_image_create_bits_no_clear(
+                scaled_pix_fmt, scaled_width, scaled_height, new_scaled_data,
+                scaled_stride);
+        }
+
+        struct sixel six = {
+            .pix = (it->item.pix == it->item.original.pix
+                    ? new_original_pix
+                    : (it->item.pix == it->item.scaled.pix
+                       ? new_scaled_pix
+                       : NULL)),
+            .width = it->item.width,
+            .height = it->item.height,
+            .rows = it->item.rows,
+            .cols = it->item.cols,
+            .pos = it->item.pos,
+            .opaque = it->item.opaque,
+            .cell_width = it->item.cell_width,
+            .cell_height = it->item.cell_height,
+            .original = {
+                .data = new_original_data,
+                .pix = new_original_pix,
+                .width = original_width,
+                .height = original_height,
+            },
+            .scaled = {
+                .data = new_scaled_data,
+                .pix = new_scaled_pix,
+                .width = scaled_width,
+                .height = scaled_height,
+            },
+        };
+
+        tll_push_back(clone->sixel_images, six);
+    }
+
+    return clone;
+}
+
+struct row *
+grid_row_unshare(struct grid *grid, int abs_row_no)
+{
+    struct row *row = grid->rows[abs_row_no];
+    xassert(row->shares > 0);
+
+    struct row *copy = row_clone(grid->pool, row, grid->num_cols);
+    grid->rows[abs_row_no] = copy;
+    row->shares--;
+    return copy;
+}
+
+static inline uint64_t
+attrs_for_packing(const struct row *row, const struct cell *cell)
+{
+    struct attributes attrs = *cell_attrs(row, cell);
+
+    /* Render state; recalculated when the row is rendered again */
+    attrs.clean = false;
+    attrs.confined = false;
+
+    attrs.selected = cell_selected(cell);
+    attrs.url = cell_url(cell);
+
+    uint64_t v;
+    memcpy(&v, &attrs, sizeof(v));
+    return v;
+}
+
+static inline size_t
+wc_encoded_len(char32_t wc)
+{
+    return wc < 0x80 ? 1
+        : wc < 0x800 ? 2
+        : wc < 0x10000 ? 3
+        : wc < 0x200000 ? 4
+        : wc < 0x4000000 ? 5
+        : 6;
+}
+
+static inline uint8_t *
+wc_encode(uint8_t *p, char32_t wc)
+{
+    const size_t len = wc_encoded_len(wc);
+    if (len == 1) {
+        *p++ = wc;
+        return p;
+    }
+
+    static const uint8_t lead[] = {0, 0, 0xc0, 0xe0, 0xf0, 0xf8, 0xfc};
+    for (size_t i = len - 1; i > 0; i--) {
+        p[i] = 0x80 | (wc & 0x3f);
+        wc >>= 6;
+    }
+
+    p[0] = lead[len] | wc;
+    return p + len;
+}
+
+static inline const uint8_t *
+wc_decode(const uint8_t *p, char32_t *wc)
+{
+    const uint8_t b = *p++;
+
+    if (b < 0x80) {
+        *wc = b;
+        return p;
+    }
+
+    const size_t len = b >= 0xfc ? 6 : b >= 0xf8 ? 5 : b >= 0xf0 ? 4 : b >= 0xe0 ? 3 : 2;
+    char32_t v = b & (0x7f >> len);
+
+    for (size_t i = 1; i < len; i++)
+        v = (v << 6) | (*p++ & 0x3f);
+
+    *wc = v;
+    return p;
+}
+
+bool
+grid_row_compress(struct grid *grid, struct row *row)
+{
+    const int cols = grid->num_cols;
+
+    if (row->packed != NULL)
+        return true;
+    if (cols > UINT16_MAX)
+        return false;
+
+    /* The other grid(s) account for it as uncompressed */
+    if (row->shares > 0)
+        return false;
+
+    const struct cell *cells = row->cells;
+
+    int text_cells = 0;
+    size_t text_size = 0;
+    size_t run_count = 1;
+    uint64_t attrs = attrs_for_packing(row, &cells[0]);
+
+    for (int c = 0; c < cols; c++) {
+        const char32_t wc = cells[c].wc;
+        if (wc != 0) {
+            /* Empty cells before this one are encoded as NUL bytes */
+            text_size += c - text_cells + wc_encoded_len(wc);
+            text_cells = c + 1;
+        }
+
+        const uint64_t a = attrs_for_packing(row, &cells[c]);
+        if (a != attrs) {
+            attrs = a;
+            run_count++;
+        }
+    }
+
+    const size_t size = sizeof(struct row_packed) +
+        run_count * sizeof(struct attr_run) + text_size;
+
+    /* Not worth it */
+    if (size >= cols * sizeof(cells[0]))
+        return false;
+
+    struct row_packed *packed = xmalloc(size);
+    packed->size = size;
+    packed->cols = cols;
+    packed->text_cells = text_cells;
+    packed->run_count = run_count;
+
+    struct attr_run *run = &packed->runs[0];
+    attrs = attrs_for_packing(row, &cells[0]);
+    run->count = 0;
+    memcpy(&run->attrs, &attrs, sizeof(attrs));
+
+    for (int c = 0; c < cols; c++) {
+        const uint64_t a = attrs_for_packing(row, &cells[c]);
+        if (a != attrs) {
+            attrs = a;
+            run++;
+            run->count = 0;
+            memcpy(&run->attrs, &attrs, sizeof(attrs));
+        }
+        run->count++;
+    }
+
+    xassert(run == &packed->runs[run_count - 1]);
+
+    uint8_t *text = (uint8_t *)&packed->runs[run_count];
+    for (int c = 0; c < text_cells; c++)
+        text = wc_encode(text, cells[c].wc);
+
+    xassert(text == (uint8_t *)packed + size);
+
+    cells_free(row);
+    row_attrs_free(row);
+    row->packed = packed;
+
+    grid->compressed.rows++;
+    grid->compressed.bytes += size;
+    return true;
+}
+
+void
+grid_row_decompress(struct grid *grid, struct row *row)
+{
+    const struct row_packed *packed = row->packed;
+    if (packed == NULL)
+        return;
+
+    xassert(packed->cols == grid->num_cols);
+
+    struct cell *cells = cells_alloc(grid->pool, packed->cols, &row->slab);
+    row->cells = cells;
+    row->gen = row_gen_next();
+    row_attrs_init(row, packed->cols);
+
+    const uint8_t *text = (const uint8_t *)&packed->runs[packed->run_count];
+    for (int c = 0; c < packed->text_cells; c++)
+        text = wc_decode(text, &cells[c].wc);
+    for (int c = packed->text_cells; c < packed->cols; c++)
+        cells[c].wc = 0;
+
+    for (int i = 0, c = 0; i < packed->run_count; i++) {
+        const struct attr_run *run = &packed->runs[i];
+        for (int j = 0; j < run->count; j++)
+            cell_set_attrs(row, &cells[c++], run->attrs);
+    }
+
+    xassert(grid->compressed.rows > 0);
+    xassert(grid->compressed.bytes >= packed->size);
+    grid->compressed.rows--;
+    grid->compressed.bytes -= packed->size;
+    grid->compressed.decompressed++;
+
+    free(row->packed);
+    row->packed = NULL;
+    row_set_dirty(row);
+}
+
+void
+grid_row_discard_compressed(struct grid *grid, struct row *row)
+{
+    if (row->packed == NULL)
+        return;
+
+    xassert(grid->compressed.rows > 0);
+    grid->compressed.rows--;
+    grid->compressed.bytes -= row->packed->size;
+
+    free(row->packed);
+    row->packed = NULL;
+    row->cells = cells_alloc(grid->pool, grid->num_cols, &row->slab);
+    row->gen = row_gen_next();
+    row_attrs_init(row, grid->num_cols);
+}
+
+void
+grid_compress_scrollback(struct grid *grid, int screen_rows, int first, int last)
+{
+    /*
+     * Compress the scrollback rows 'first' through 'last', counted
+     * backwards from the top of the screen (i.e. 1 is the newest
+     * scrollback row). Rows in the current view are skipped.
+     */
+    const int max_dist = grid->num_rows - screen_rows;
+    last = min(last, max_dist);
+
+    const int view_dist =
+        (grid->offset - grid->view + grid->num_rows) & (grid->num_rows - 1);
+
+    for (int dist = max(first, 1); dist <= last; dist++) {
+        if (view_dist > 0 && dist <= view_dist && dist > view_dist - screen_rows)
+            continue;
+
+        const int idx = (grid->offset - dist) & (grid->num_rows - 1);
+        struct row *row = grid->rows[idx];
+
+        if (row == NULL || row->packed != NULL)
+            continue;
+
+        grid_row_compress(grid, row);
+    }
+}
+
+/* Pool for the new cells, when resizing to 'new_cols' columns */
+static struct row_pool *
+resize_pool(const struct grid *grid, int new_cols)
+{
+    return grid->pool != NULL && grid->pool->cols == new_cols
+        ? grid->pool
+        : row_pool_new(new_cols);
+}
+
+static void
+resize_pool_done(struct grid *grid, struct row_pool *new_pool)
+{
+    if (grid->pool != new_pool)
+        row_pool_release(grid->pool);
+    grid->pool = new_pool;
+}
+
+void
+grid_resize_without_reflow(
+    struct grid *grid, int new_rows, int new_cols,
+    int old_screen_rows, int new_screen_rows)
+{
+    struct row *const *old_grid = grid->rows;
+    const int old_rows = grid->num_rows;
+    const int old_cols = grid->num_cols;
+
+    struct row **new_grid = xcalloc(new_rows, sizeof(new_grid[0]));
+    struct row_pool *new_pool = resize_pool(grid, new_cols);
+
+    tll(struct sixel) untranslated_sixels = tll_init();
+    tll_foreach(grid->sixel_images, it)
+        tll_push_back(untranslated_sixels, it->item);
+    tll_free(grid->sixel_images);
+
+    int new_offset = 0;
+
+    /* Copy old lines, truncating them if old rows were longer */
+    for (int r = 0, n = min(old_screen_rows, new_screen_rows); r < n; r++) {
+        const int old_row_idx = (grid->offset + r) & (old_rows - 1);
+        const int new_row_idx = (new_offset + r) & (new_rows - 1);
+
+        const struct row *old_row = old_grid[old_row_idx];
+        xassert(old_row != NULL);
+
+        struct row *new_row = grid_row_alloc_from(new_pool, new_cols, false);
+        new_grid[new_row_idx] = new_row;
+
+        memcpy(new_row->cells,
+               old_row->cells,
+               sizeof(struct cell) * min(old_cols, new_cols));
+        row_attrs_copy(new_row, old_row);
+
+        new_row->dirty = old_row->dirty;
+        new_row->dirty_start = old_row->dirty_start;
+        new_row->dirty_end = old_row->dirty_end;
+        new_row->shell_integration.prompt_marker = old_row->shell_integration.prompt_marker;
+        new_row->shell_integration.cmd_start = min(old_row->shell_integration.cmd_start, new_cols - 1);
+        new_row->shell_integration.cmd_end = min(old_row->shell_integration.cmd_end, new_cols - 1);
+
+        if (new_cols > old_cols) {
+            /* Clear "new" columns */
+            memset(&new_row->cells[old_cols], 0,
+                   sizeof(struct cell) * (new_cols - old_cols));
+            row_set_dirty_cols(new_row, old_cols, new_cols - 1);
+        } else if (old_cols > new_cols) {
+            /* Make sure we don't cut a multi-column character in two */
+            for (int i = new_cols; i > 0 && old_row->cells[i].wc > CELL_SPACER; i--)
+                new_row->cells[i - 1].wc = 0;
+        }
+
+        /* Map sixels on current "old" row to current "new row" */
+        tll_foreach(untranslated_sixels, it) {
+            if (it->item.pos.row != old_row_idx)
+                continue;
+
+            struct sixel sixel = it->item;
+            sixel.pos.row = new_row_idx;
+
+            if (sixel.pos.col < new_cols)
+                tll_push_back(grid->sixel_images, sixel);
+            else
+                sixel_destroy(&it->item);
+            tll_remove(untranslated_sixels, it);
+        }
+
+        /* Copy URI ranges, truncating them if necessary */
+        const struct row_data *old_extra = old_row->extra;
+        if (old_extra == NULL)
+            continue;
+
+        ensure_row_has_extra_data(new_row);
+        struct row_data *new_extra = new_row->extra;
+
+        range_ensure_size(&new_extra->uri_ranges, old_extra->uri_ranges.count);
+        range_ensure_size(&new_extra->underline_ranges, old_extra->underline_ranges.count);
+
+        for (int i = 0; i < old_extra->uri_ranges.count; i++) {
+            const struct row_range *range = &old_extra->uri_ranges.v[i];
+
+            if (range->start >= new_cols) {
+                /* The whole range is truncated */
+                continue;
+            }
+
+            const int start = range->start;
+            const int end = min(range->end, new_cols - 1);
+            range_append(&new_extra->uri_ranges, start, end, ROW_RANGE_URI, &range->data);
+        }
+
+        for (int i = 0; i < old_extra->underline_ranges.count; i++) {
+            const struct row_range *range = &old_extra->underline_ranges.v[i];
+
+            if (range->start >= new_cols) {
+                /* The whole range is truncated */
+                continue;
+            }
+
+            const int start = range->start;
+            const int end = min(range->end, new_cols - 1);
+            range_append_by_ref(&new_extra->underline_ranges, start, end, ROW_RANGE_UNDERLINE, &range->data);
+        }
+}
+
+    /* Clear "new" lines */
+    for (int r = min(old_screen_rows, new_screen_rows); r < new_screen_rows; r++) {
+        struct row *new_row = grid_row_alloc_from(new_pool, new_cols, false);
+        new_grid[(new_offset + r) & (new_rows - 1)] = new_row;
+
+        memset(new_row->cells, 0, sizeof(struct cell) * new_cols);
+        row_set_dirty(new_row);
+    }
+
+#if defined(_DEBUG)
+    for (size_t r = 0; r < new_rows; r++) {
+        const struct row *row = new_grid[r];
+
+        if (row == NULL)
+            continue;
+        if (row->extra == NULL)
+            continue;
+
+        verify_no_overlapping_ranges(row->extra);
+        verify_ranges_are_sorted(row->extra);
+    }
+#endif
+
+    /* Free old grid (the scrollback, including compressed rows, is dropped) */
+    for (int r = 0; r < grid->num_rows; r++)
+        grid_row_free(old_grid[r]);
+    free(grid->rows);
+    memset(&grid->compressed, 0, sizeof(grid->compressed));
+    resize_pool_done(grid, new_pool);
+
+    grid->rows = new_grid;
+    grid->num_rows = new_rows;
+    grid->num_cols = new_cols;
+
+    grid->view = grid->offset = new_offset;
+
+    /* Keep cursor at current position, but clamp to new dimensions */
+    struct coord cursor = grid->cursor.point;
+    if (cursor.row == old_screen_rows - 1) {
+        /* 'less' breaks if the cursor isn't at the bottom */
+        cursor.row = new_screen_rows - 1;
+    }
+    cursor.row = min(cursor.row, new_screen_rows - 1);
+    cursor.col = min(cursor.col, new_cols - 1);
+    grid->cursor.point = cursor;
+
+    struct coord saved_cursor = grid->saved_cursor.point;
+    if (saved_cursor.row == old_screen_rows - 1)
+        saved_cursor.row = new_screen_rows - 1;
+    saved_cursor.row = min(saved_cursor.row, new_screen_rows - 1);
+    saved_cursor.col = min(saved_cursor.col, new_cols - 1);
+    grid->saved_cursor.point = saved_cursor;
+
+    grid->cur_row = new_grid[(grid->offset + cursor.row) & (new_rows - 1)];
+    xassert(grid->cur_row != NULL);
+
+    grid->cursor.lcf = false;
+    grid->saved_cursor.lcf = false;
+
+    /* Free sixels we failed to "map" to the new grid */
+    tll_foreach(untranslated_sixels, it)
+        sixel_destroy(&it->item);
+    tll_free(untranslated_sixels);
+
+#if defined(_DEBUG)
+    for (int r = 0; r < new_screen_rows; r++)
+        grid_row_in_view(grid, r);
+#endif
+}
+
+static void
+reflow_range_start(struct row_range *range, enum row_range_type type,
+                   struct row *new_row, int new_col_idx)
+{
+    ensure_row_has_extra_data(new_row);
+
+    struct row_ranges *new_ranges = NULL;
+    switch (type) {
+    case ROW_RANGE_URI: new_ranges = &new_row->extra->uri_ranges; break;
+    case ROW_RANGE_UNDERLINE: new_ranges = &new_row->extra->underline_ranges; break;
+    }
+
+    if (new_ranges == NULL)
+        BUG("unhandled range type");
+
+    range_append_by_ref(new_ranges, new_col_idx, -1, type, &range->data);
+
+    switch (type) {
+    case ROW_RANGE_URI: range->uri.uri = NULL; break; /* Owned by new_ranges */
+    case ROW_RANGE_UNDERLINE: break;
+    }
+}
+
+static void
+reflow_range_end(struct row_range *range, enum row_range_type type,
+                 struct row *new_row, int new_col_idx)
+{
+    struct row_data *extra = new_row->extra;
+    struct row_ranges *ranges = NULL;
+
+    switch (type) {
+    case ROW_RANGE_URI: ranges = &extra->uri_ranges; break;
+    case ROW_RANGE_UNDERLINE: ranges = &extra->underline_ranges; break;
+    }
+
+    if (ranges == NULL)
+        BUG("unhandled range type");
+
+    xassert(ranges->count > 0);
+
+    struct row_range *new_range = &ranges->v[ranges->count - 1];
+    xassert(new_range->end < 0);
+
+    switch (type) {
+    case ROW_RANGE_URI:
+        xassert(new_range->uri.id == range->uri.id);
+        break;
+
+    case ROW_RANGE_UNDERLINE:
+        xassert(new_range->underline.style == range->underline.style);
+        xassert(new_range->underline.color_src == range->underline.color_src);
+        xassert(new_range->underline.color == range->underline.color);
+        break;
+    }
+
+    new_range->end = new_col_idx;
+}
+
+static struct row *
+_line_wrap(struct grid *old_grid, struct row **new_grid, struct row *row,
+           struct row_pool *pool, int *row_idx, int *col_idx,
+           int row_count, int col_count)
+{
+    *col_idx = 0;
+    *row_idx = (*row_idx + 1) & (row_count - 1);
+
+    struct row *new_row = new_grid[*row_idx];
+
+    if (new_row == NULL) {
+        /* Scrollback not yet full, allocate a completely new row */
+        new_row = grid_row_alloc_from(pool, col_count, false);
+        new_grid[*row_idx] = new_row;
+    } else {
+        /* Scrollback is full, need to reuse a row */
+        if (unlikely(new_row->packed != NULL)) {
+            /* Compressed while reflowing, see reflow_compress() */
+            free(new_row->packed);
+            new_row->packed = NULL;
+            new_row->cells = cells_alloc(pool, col_count, &new_row->slab);
+            new_row->gen = row_gen_next();
+            row_attrs_init(new_row, col_count);
+        }
+
+        grid_row_reset_extra(new_row);
+        new_row->shell_integration.prompt_marker = false;
+        new_row->shell_integration.cmd_start = -1;
+        new_row->shell_integration.cmd_end = -1;
+
+        tll_foreach(old_grid->sixel_images, it) {
+            if (it->item.pos.row == *row_idx) {
+                sixel_destroy(&it->item);
+                tll_remove(old_grid->sixel_images, it);
+            }
+        }
+
+        /*
+         * TODO: detect if the reused row is covered by the
+         * selection. Of so, cancel the selection. The problem: we
+         * don't know if we've translated the selection coordinates
+         * yet.
+         */
+    }
+
+    struct row_data *extra = row->extra;
+    if (extra == NULL)
+        return new_row;
+
+    /*
+     * URI ranges are per row. Thus, we need to 'close' the still-open
+     * ranges on the previous row, and re-open them on the
+     * next/current row.
+     */
+    if (extra->uri_ranges.count > 0) {
+        struct row_range *range =
+            &extra->uri_ranges.v[extra->uri_ranges.count - 1];
+
+        if (range->end < 0) {
+
+            /* Terminate URI range on the previous row */
+            range->end = col_count - 1;
+
+            /* Open a new range on the new/current row */
+            ensure_row_has_extra_data(new_row);
+            range_append(&new_row->extra->uri_ranges, 0, -1,
+                         ROW_RANGE_URI, &range->data);
+        }
+    }
+
+    if (extra->underline_ranges.count > 0) {
+        struct row_range *range =
+            &extra->underline_ranges.v[extra->underline_ranges.count - 1];
+
+        if (range->end < 0) {
+
+            /* Terminate URI range on the previous row */
+            range->end = col_count - 1;
+
+            /* Open a new range on the new/current row */
+            ensure_row_has_extra_data(new_row);
+            range_append(&new_row->extra->underline_ranges, 0, -1,
+                         ROW_RANGE_UNDERLINE, &range->data);
+        }
+    }
+
+    return new_row;
+}
+
+static struct {
+    int scrollback_start;
+    int rows;
+} tp_cmp_ctx;
+
+static int
+tp_cmp(const void *_a, const void *_b)
+{
+    const struct coord *a = *(const struct coord **)_a;
+    const struct coord *b = *(const struct coord **)_b;
+
+    int scrollback_start = tp_cmp_ctx.scrollback_start;
+    int num_rows = tp_cmp_ctx.rows;
+
+    int a_row = (a->row - scrollback_start + num_rows) & (num_rows - 1);
+    int b_row = (b->row - scrollback_start + num_rows) & (num_rows - 1);
+
+    xassert(a_row >= 0);
+    xassert(a_row < num_rows || num_rows == 0);
+    xassert(b_row >= 0);
+    xassert(b_row < num_rows || num_rows == 0);
+
+    if (a_row < b_row)
+        return -1;
+    if (a_row > b_row)
+        return 1;
+
+    xassert(a_row == b_row);
+
+    if (a->col < b->col)
+        return -1;
+    if (a->col > b->col)
+        return 1;
+
+    xassert(a->col == b->col);
+    return 0;
+}
+
+/*
+ * Incremental reflow
+ *
+ * grid_resize_and_reflow() only reflows the bottom part of the
+ * scrollback right away. That part covers the screen, the viewport,
+ * all tracking points, and a margin. The older rows are left as they
+ * are, in a "segment", and are reflowed later, in chunks, by
+ * grid_reflow_step(). Newer rows are reflowed first.
+ *
+ * Reflowed chunks are inserted above the oldest row in the grid.
+ * I.e. the scrollback looks like one that hasn't been filled up yet,
+ * and grows at the top. It stops growing when the segments have been
+ * reflowed, or when it runs out of free rows (the remaining rows are
+ * then discarded, just like a full reflow would have done).
+ *
+ * Segments, and chunks, always start at the beginning of a logical
+ * line. Logical lines are reflowed independently of each other.
+ */
+
+/* Rows above the screen/viewport that are always reflowed right away */
+#define REFLOW_SYNC_MARGIN 1000
+
+/* Don't bother deferring fewer rows than this */
+#define REFLOW_MIN_DEFERRED 4000
+
+/* Old rows reflowed between compressing the new ones, see reflow_compress() */
+#define REFLOW_COMPRESS_SEGMENT 16384
+
+struct reflow_segment {
+    /*
+     * The rows not yet reflowed, at their old positions, in the old
+     * row array. 'grid.offset' is the index of the oldest row, and
+     * 'grid.sixel_images' holds the sixels not yet mapped
+     */
+    struct grid grid;
+    int count;
+};
+
+struct grid_reflow {
+    struct reflow_segment *v;  /* Newest last */
+    size_t count;
+};
+
+/* Reflow state: where, in the new grid, the next cell goes */
+struct reflow {
+    const struct terminal *term;
+    struct grid *sixels;       /* Receives the mapped sixels */
+    struct row **rows;         /* New rows (ring buffer) */
+    struct row_pool *pool;
+    int num_rows;
+    int max_rows;              /* 'rows' is grown up to this size */
+    int num_cols;
+    bool keep_old_rows;        /* Old rows are freed by the caller */
+
+    struct row *row;
+    int row_idx;
+    int col_idx;
+    int count;                 /* Rows started, including 'row' */
+
+    bool content;              /* Reflowed at least one non-empty row */
+
+    int coalesced_linebreaks;
+    struct coord **next_tp;
+
+    /* Rows this many rows older than 'row' are compressed (0: none) */
+    int compress_dist;
+    int compressed_count;      /* 'count', as of the last reflow_compress() */
+};
+
+static void
+reflow_begin(struct reflow *rf)
+{
+    xassert(rf->rows[0] == NULL);
+    rf->row = grid_row_alloc_from(rf->pool, rf->num_cols, false);
+    rf->rows[0] = rf->row;
+    rf->row_idx = 0;
+    rf->col_idx = 0;
+    rf->count = 1;
+}
+
+static void
+reflow_grow(struct reflow *rf)
+{
+    if (likely(rf->count < rf->num_rows || rf->num_rows >= rf->max_rows))
+        return;
+
+    /* Nothing has wrapped around yet; double the ring buffer */
+    const int n = rf->num_rows;
+    rf->rows = xreallocarray(rf->rows, 2 * n, sizeof(rf->rows[0]));
+    memset(&rf->rows[n], 0, n * sizeof(rf->rows[0]));
+    rf->num_rows = 2 * n;
+}
+
+static void
+reflow_line_wrap(struct reflow *rf)
+{
+    reflow_grow(rf);
+    rf->row = _line_wrap(
+        rf->sixels, rf->rows, rf->row, rf->pool,
+        &rf->row_idx, &rf->col_idx, rf->num_rows, rf->num_cols);
+    rf->count++;
+}
+
+/* Emit coalesced (empty) lines. 'wrap' is false on the very last row */
+static void
+reflow_emit_linebreaks(struct reflow *rf, bool wrap)
+{
+    for (int i = 0; i < rf->coalesced_linebreaks; i++) {
+        /* Erase the remaining cells */
+        memset(&rf->row->cells[rf->col_idx], 0,
+               (rf->num_cols - rf->col_idx) * sizeof(rf->row->cells[0]));
+        rf->row->linebreak = true;
+
+        if (wrap)
+            reflow_line_wrap(rf);
+    }
+
+    rf->coalesced_linebreaks = 0;
+}
+
+/*
+ * Reflows a single row, at index 'old_row_idx' in the old grid, and
+ * frees it (unless 'keep_old_rows'). 'last' is true for the newest row
+ * of the old grid.
+ */
+static void
+reflow_row(struct reflow *rf, struct grid *old_grid, int old_row_idx,
+           bool last)
+{
+    const int old_cols = old_grid->num_cols;
+    const int new_cols = rf->num_cols;
+
+    /* Unallocated (empty) rows we can simply skip */
+    const struct row *old_row = grid_row_abs(old_grid, old_row_idx);
+    if (old_row == NULL)
+        return;
+
+    /* Map sixels on current "old" row to current "new row" */
+    tll_foreach(old_grid->sixel_images, it) {
+        if (it->item.pos.row != old_row_idx)
+            continue;
+
+        struct sixel sixel = it->item;
+        sixel.pos.row = rf->row_idx;
+
+        tll_push_back(rf->sixels->sixel_images, sixel);
+        tll_remove(old_grid->sixel_images, it);
+    }
+
+    /* Find last non-empty cell */
+    int col_count = 0;
+    for (int c = old_cols - 1; c >= 0; c--) {
+        const struct cell *cell = &old_row->cells[c];
+        if (!(cell->wc == 0 || cell->wc == CELL_SPACER)) {
+            col_count = c + 1;
+            break;
+        }
+    }
+
+    if (!old_row->linebreak && col_count > 0) {
+        /* Don't truncate logical lines */
+        while (col_count < old_cols && old_row->cells[col_count].wc == 0)
+            col_count++;
+    }
+
+    xassert(col_count >= 0 && col_count <= old_cols);
+
+    /* Do we have a (at least one) tracking point on this row */
+    struct coord *tp;
+    if (unlikely((*rf->next_tp)->row == old_row_idx)) {
+        tp = *rf->next_tp;
+
+        /* Find the *last* tracking point on this row */
+        struct coord *last_on_row = tp;
+        for (struct coord **iter = rf->next_tp; (*iter)->row == old_row_idx; iter++)
+            last_on_row = *iter;
+
+        /* And make sure its end point is included in the col range */
+        xassert(last_on_row->row == old_row_idx);
+        col_count = max(col_count, last_on_row->col + 1);
+    } else
+        tp = NULL;
+
+    /* Does this row have any URIs? */
+    struct row_range *uri_range, *uri_range_terminator;
+    struct row_range *underline_range, *underline_range_terminator;
+    const struct row_data *extra = old_row->extra;
+
+    if (extra != NULL && extra->uri_ranges.count > 0) {
+        uri_range = &extra->uri_ranges.v[0];
+        uri_range_terminator = &extra->uri_ranges.v[extra->uri_ranges.count];
+
+        /* Make sure the *last* URI range's end point is included
+         * in the copy */
+        const struct row_range *last_on_row =
+            &extra->uri_ranges.v[extra->uri_ranges.count - 1];
+        col_count = max(col_count, last_on_row->end + 1);
+    } else
+        uri_range = uri_range_terminator = NULL;
+
+    if (extra != NULL && extra->underline_ranges.count > 0) {
+        underline_range = &extra->underline_ranges.v[0];
+        underline_range_terminator = &extra->underline_ranges.v[extra->underline_ranges.count];
+
+        const struct row_range *last_on_row =
+            &extra->underline_ranges.v[extra->underline_ranges.count - 1];
+        col_count = max(col_count, last_on_row->end + 1);
+    } else
+        underline_range = underline_range_terminator = NULL;
+
+    if (col_count > 0)
+        rf->content = true;
+
+    if (unlikely(col_count > 0 && rf->coalesced_linebreaks > 0))
+        reflow_emit_linebreaks(rf, !last);
+
+    for (int c = 0; c < col_count;) {
+        const struct cell *old = &old_row->cells[c];
+
+        /* Row full, emit newline and get a new, fresh, row */
+        xassert(rf->col_idx <= new_cols);
+        if (unlikely(rf->col_idx >= new_cols))
+            reflow_line_wrap(rf);
+
+        char32_t wc = old->wc;
+        int width = 1;
+
+        if (unlikely(wc >= CELL_COMB_CHARS_LO && wc <= CELL_COMB_CHARS_HI)) {
+            const struct composed *composed =
+                composed_lookup(&rf->term->composed, wc - CELL_COMB_CHARS_LO);
+
+            width = composed->forced_width > 0 ? composed->forced_width : composed->width;
+        } else if (unlikely(c + 1 < col_count && (old + 1)->wc >= CELL_SPACER + 1)) {
+            /* Wide character, get its width from the next cell's
+               SPACER value */
+            width = (old + 1)->wc - CELL_SPACER + 1;
+        }
+
+        /*
+         * Check if character fits, if not, emit spacers, and push
+           the character to the next row */
+        if (unlikely(rf->col_idx + width > new_cols && width <= new_cols)) {
+            for (; rf->col_idx < new_cols; rf->col_idx++) {
+                rf->row->cells[rf->col_idx].wc = CELL_SPACER;
+                cell_set_attrs(rf->row, &rf->row->cells[rf->col_idx],
+                               (struct attributes){0});
+            }
+            reflow_line_wrap(rf);
+        }
+
+        struct row *new_row = rf->row;
+        new_row->shell_integration.prompt_marker = old_row->shell_integration.prompt_marker;
+
+        for (int i = 0; i < width; i++) {
+            if (unlikely(uri_range != NULL && uri_range != uri_range_terminator)) {
+                if (unlikely(uri_range->start == c)) {
+                    reflow_range_start(
+                        uri_range, ROW_RANGE_URI, new_row, rf->col_idx);
+                }
+
+                if (unlikely(uri_range->end == c)) {
+                    reflow_range_end(
+                        uri_range, ROW_RANGE_URI, new_row, rf->col_idx);
+                    grid_row_uri_range_destroy(uri_range);
+                    uri_range++;
+                }
+            }
+
+            if (unlikely(underline_range != NULL && underline_range != underline_range_terminator)) {
+                if (unlikely(underline_range->start == c)) {
+                    reflow_range_start(
+                        underline_range, ROW_RANGE_UNDERLINE, new_row, rf->col_idx);
+                }
+
+                if (unlikely(underline_range->end == c)) {
+                    reflow_range_end(
+                        underline_range, ROW_RANGE_UNDERLINE, new_row, rf->col_idx);
+                    grid_row_underline_range_destroy(underline_range);
+                    underline_range++;
+                }
+            }
+
+            if (unlikely(tp != NULL)) {
+                if (unlikely(tp->col == c)) {
+                    do {
+                        xassert(tp->row == old_row_idx);
+
+                        tp->row = rf->row_idx;
+                        tp->col = rf->col_idx;
+
+                        rf->next_tp++;
+                        tp = *rf->next_tp;
+                    } while (tp->row == old_row_idx && tp->col == c);
+
+                    if (tp->row != old_row_idx)
+                        tp = NULL;
+
+                    LOG_DBG("next TP (tp=%p): %dx%d",
+                            (void*)tp, (*rf->next_tp)->row, (*rf->next_tp)->col);
+                }
+            }
+
+            if (unlikely(old_row->shell_integration.cmd_start == c))
+                new_row->shell_integration.cmd_start = rf->col_idx;
+
+            if (unlikely(old_row->shell_integration.cmd_end == c))
+                new_row->shell_integration.cmd_end = rf->col_idx;
+
+            if (unlikely(width > new_cols)) {
+                /* Wide character no longer fits on a row, replace
+                   it with a single space */
+                new_row->cells[rf->col_idx].wc = 0;
+                cell_set_attrs(new_row, &new_row->cells[rf->col_idx++],
+                               (struct attributes){0});
+                c++;
+
+                /* Walk past the SPACER cells */
+                for (int i = 1; i < width; i++, c++, old++)
+                    ;
 
-        memset(new_row->cells, 0, sizeof(struct cell) * new_cols);
-        new_row->dirty = true;
-    }
+                /* Continue with next character in the *old* grid */
+                break;
+            }
 
-#if defined(_DEBUG)
-    for (size_t r = 0; r < new_rows; r++) {
-        const struct row *row = new_grid[r];
+            cell_copy(new_row, &new_row->cells[rf->col_idx++], old_row, old);
 
-        if (row == NULL)
-            continue;
-        if (row->extra == NULL)
-            continue;
+            /*
+             * TODO: simulate LCF instead?
+             *
+             * Rows have linebreak=true by default. This is needed
+             * for a number of reasons. However, we want non-empty
+             * rows to have linebreak=false, *until* we reach the
+             * end of an old row with linebreak=true, at which
+             * point we set linebreak=true on the new row.
+             */
+            new_row->linebreak = false;
+            old++;
+            c++;
+        }
+    }
 
-        verify_no_overlapping_ranges(row->extra);
-        verify_ranges_are_sorted(row->extra);
+    if (old_row->linebreak) {
+        if (col_count > 0) {
+            struct row *new_row = rf->row;
+
+            /* Erase the remaining cells */
+            memset(&new_row->cells[rf->col_idx], 0,
+                   (new_cols - rf->col_idx) * sizeof(new_row->cells[0]));
+            new_row->linebreak = true;
+
+            if (!last) {
+                /* Not the last (old) row */
+                reflow_line_wrap(rf);
+            } else if (new_row->extra != NULL) {
+                if (new_row->extra->uri_ranges.count > 0) {
+                    /*
+                     * line_wrap() "closes" still-open URIs. Since
+                     * this is the *last* row, and since we're
+                     * line-breaking due to a hard line-break (rather
+                     * than running out of cells in the "new_row"),
+                     * there shouldn't be an open URI (it would have
+                     * been closed when we reached the end of the URI
+                     * while reflowing the last "old" row).
+                     */
+                    int last_idx = new_row->extra->uri_ranges.count - 1;
+                    xassert(new_row->extra->uri_ranges.v[last_idx].end >= 0);
+                }
+
+                if (new_row->extra->underline_ranges.count > 0) {
+                    int last_idx = new_row->extra->underline_ranges.count - 1;
+                    xassert(new_row->extra->underline_ranges.v[last_idx].end >= 0);
+                }
+            }
+        } else {
+            /*
+             * rows have linebreak=true by default. But we don't
+             * want trailing empty lines to result in actual lines
+             * in the new grid (think: empty window with prompt at
+             * the top)
+             */
+            rf->coalesced_linebreaks++;
+        }
     }
-#endif
 
-    /* Free old grid */
-    for (int r = 0; r < grid->num_rows; r++)
-        grid_row_free(old_grid[r]);
-    free(grid->rows);
+    if (!rf->keep_old_rows) {
+        grid_row_free(old_grid->rows[old_row_idx]);
+        old_grid->rows[old_row_idx] = NULL;
+    }
+}
 
-    grid->rows = new_grid;
-    grid->num_rows = new_rows;
-    grid->num_cols = new_cols;
+/* Reflows 'count' old rows, starting at index 'start' in the old grid */
+static void
+reflow_rows(struct reflow *rf, struct grid *old_grid, int start, int count,
+            bool last)
+{
+    const int mask = old_grid->num_rows - 1;
 
-    grid->view = grid->offset = new_offset;
+    for (int r = 0; r < count; r++)
+        reflow_row(rf, old_grid, (start + r) & mask, last && r + 1 == count);
 
-    /* Keep cursor at current position, but clamp to new dimensions */
-    struct coord cursor = grid->cursor.point;
-    if (cursor.row == old_screen_rows - 1) {
-        /* 'less' breaks if the cursor isn't at the bottom */
-        cursor.row = new_screen_rows - 1;
+    if (last) {
+        /* Erase the remaining cells */
+        memset(&rf->row->cells[rf->col_idx], 0,
+               (rf->num_cols - rf->col_idx) * sizeof(rf->row->cells[0]));
     }
-    cursor.row = min(cursor.row, new_screen_rows - 1);
-    cursor.col = min(cursor.col, new_cols - 1);
-    grid->cursor.point = cursor;
+}
 
-    struct coord saved_cursor = grid->saved_cursor.point;
-    if (saved_cursor.row == old_screen_rows - 1)
-        saved_cursor.row = new_screen_rows - 1;
-    saved_cursor.row = min(saved_cursor.row, new_screen_rows - 1);
-    saved_cursor.col = min(saved_cursor.col, new_cols - 1);
-    grid->saved_cursor.point = saved_cursor;
+/*
+ * Compresses the new rows that have become at least 'compress_dist'
+ * rows older than the current row since the last call. Only the
+ * current row is still being written to. Rows that end up in the
+ * view are decompressed again when rendered.
+ */
+static void
+reflow_compress(struct reflow *rf)
+{
+    if (rf->compress_dist == 0)
+        return;
 
-    grid->cur_row = new_grid[(grid->offset + cursor.row) & (new_rows - 1)];
-    xassert(grid->cur_row != NULL);
+    const int mask = rf->num_rows - 1;
+    const int advanced = min(rf->count - rf->compressed_count, rf->num_rows);
 
-    grid->cursor.lcf = false;
-    grid->saved_cursor.lcf = false;
+    /* Only 'num_cols', and the counters (recounted by the caller) */
+    struct grid packed = {.num_cols = rf->num_cols};
 
-    /* Free sixels we failed to "map" to the new grid */
-    tll_foreach(untranslated_sixels, it)
-        sixel_destroy(&it->item);
-    tll_free(untranslated_sixels);
+    for (int dist = rf->compress_dist;
+         dist < rf->compress_dist + advanced && dist < rf->num_rows;
+         dist++)
+    {
+        struct row *row = rf->rows[(rf->row_idx - dist) & mask];
+        if (row == NULL)
+            break;
+        grid_row_compress(&packed, row);
+    }
 
-#if defined(_DEBUG)
-    for (int r = 0; r < new_screen_rows; r++)
-        grid_row_in_view(grid, r);
-#endif
+    rf->compressed_count = rf->count;
 }
 
+/*
+ * Parallel reflow
+ *
+ * Logical lines are reflowed independently of each other. Large
+ * ranges are split, at hard line breaks, into jobs that are reflowed
+ * on the render workers. Each job has its own copy of the old grid
+ * (with the sixels in its range), its own ring buffer and its own
+ * row pool. The results are then stitched together, in order,
+ * exactly as if they had been reflowed in one go.
+ */
+
+/* Smallest range worth reflowing on a render worker */
+#define REFLOW_JOB_MIN_ROWS 1024
+
+/* Jobs per render worker, for load balancing */
+#define REFLOW_JOBS_PER_WORKER 4
+
+struct reflow_job {
+    struct grid old;           /* Private sixel list and compression counters */
+    int start;
+    int count;
+
+    struct coord **tps;        /* Terminated, like the caller's */
+    struct grid mapped;        /* Sixels, mapped to 'rf.rows' */
+    struct reflow rf;
+};
+
 static void
-reflow_range_start(struct row_range *range, enum row_range_type type,
-                   struct row *new_row, int new_col_idx)
+reflow_job_run(void *data, size_t idx)
 {
-    ensure_row_has_extra_data(new_row);
+    struct reflow_job *job = &((struct reflow_job *)data)[idx];
 
-    struct row_ranges *new_ranges = NULL;
-    switch (type) {
-    case ROW_RANGE_URI: new_ranges = &new_row->extra->uri_ranges; break;
-    case ROW_RANGE_UNDERLINE: new_ranges = &new_row->extra->underline_ranges; break;
-    }
+    reflow_begin(&job->rf);
+    reflow_rows(&job->rf, &job->old, job->start, job->count, false);
+}
 
-    if (new_ranges == NULL)
-        BUG("unhandled range type");
+/* Moves all of 'src's slabs to 'dst', and frees 'src' */
+static void
+row_pool_merge(struct row_pool *dst, struct row_pool *src)
+{
+    xassert(dst->cols == src->cols);
 
-    range_append_by_ref(new_ranges, new_col_idx, -1, type, &range->data);
+    for (struct row_slab *slab = src->head, *next; slab != NULL; slab = next) {
+        next = slab->next;
+        slab->pool = dst;
 
-    switch (type) {
-    case ROW_RANGE_URI: range->uri.uri = NULL; break; /* Owned by new_ranges */
-    case ROW_RANGE_UNDERLINE: break;
+        if (slab->used < slab->count)
+            slab_push_front(dst, slab);
+        else
+            slab_push_back(dst, slab);
     }
+
+    dst->slab_count += src->slab_count;
+    dst->empty_slabs += src->empty_slabs;
+    free(src);
 }
 
+/*
+ * Appends a job's rows to 'dst', as if they had been reflowed
+ * there. Jobs start at a logical line, meaning 'dst's current row is
+ * either empty, or terminated by its coalesced line breaks.
+ */
 static void
-reflow_range_end(struct row_range *range, enum row_range_type type,
-                 struct row *new_row, int new_col_idx)
+reflow_stitch(struct reflow *dst, struct reflow_job *job)
 {
-    struct row_data *extra = new_row->extra;
-    struct row_ranges *ranges = NULL;
+    struct reflow *rf = &job->rf;
+    const int mask = rf->num_rows - 1;
 
-    switch (type) {
-    case ROW_RANGE_URI: ranges = &extra->uri_ranges; break;
-    case ROW_RANGE_UNDERLINE: ranges = &extra->underline_ranges; break;
+    if (!rf->content) {
+        /* Only empty lines; nothing to place */
+        xassert(rf->count == 1);
+        xassert((*job->tps)->row < 0);
+
+        tll_foreach(job->mapped.sixel_images, it) {
+            struct sixel sixel = it->item;
+            sixel.pos.row = dst->row_idx;
+            tll_push_back(dst->sixels->sixel_images, sixel);
+            tll_remove(job->mapped.sixel_images, it);
+        }
+
+        dst->coalesced_linebreaks += rf->coalesced_linebreaks;
+        return;
     }
 
-    if (ranges == NULL)
-        BUG("unhandled range type");
+    reflow_emit_linebreaks(dst, true);
+    xassert(dst->col_idx == 0);
 
-    xassert(ranges->count > 0);
+    /* The job's first row replaces the current (empty) row */
+    const int n = min(rf->count, rf->num_rows);
+    const int oldest = (rf->row_idx - n + 1) & mask;
 
-    struct row_range *new_range = &ranges->v[ranges->count - 1];
-    xassert(new_range->end < 0);
+    for (int i = 0; i < n; i++) {
+        const int idx = (oldest + i) & mask;
 
-    switch (type) {
-    case ROW_RANGE_URI:
-        xassert(new_range->uri.id == range->uri.id);
-        break;
+        if (i > 0) {
+            reflow_grow(dst);
+            dst->row_idx = (dst->row_idx + 1) & (dst->num_rows - 1);
+            dst->count++;
 
-    case ROW_RANGE_UNDERLINE:
-        xassert(new_range->underline.style == range->underline.style);
-        xassert(new_range->underline.color_src == range->underline.color_src);
-        xassert(new_range->underline.color == range->underline.color);
-        break;
+            /* Scrollback is full, the row is reused */
+            tll_foreach(dst->sixels->sixel_images, it) {
+                if (it->item.pos.row == dst->row_idx) {
+                    sixel_destroy(&it->item);
+                    tll_remove(dst->sixels->sixel_images, it);
+                }
+            }
+        }
+
+        grid_row_free(dst->rows[dst->row_idx]);
+        dst->rows[dst->row_idx] = rf->rows[idx];
+        rf->rows[idx] = NULL;
     }
 
-    new_range->end = new_col_idx;
+    /* Rows dropped by the job itself */
+    dst->count += rf->count - n;
+
+    dst->row = dst->rows[dst->row_idx];
+    dst->col_idx = rf->col_idx;
+    dst->coalesced_linebreaks = rf->coalesced_linebreaks;
+    dst->content = true;
+
+    /* Where the job's first row ended up */
+    const int dst_mask = dst->num_rows - 1;
+    const int base = (dst->row_idx - (n - 1)) & dst_mask;
+
+    for (struct coord **tp = job->tps; (*tp)->row >= 0; tp++)
+        (*tp)->row = (base + (((*tp)->row - oldest) & mask)) & dst_mask;
+
+    tll_foreach(job->mapped.sixel_images, it) {
+        struct sixel sixel = it->item;
+        sixel.pos.row = (base + ((sixel.pos.row - oldest) & mask)) & dst_mask;
+        tll_push_back(dst->sixels->sixel_images, sixel);
+        tll_remove(job->mapped.sixel_images, it);
+    }
 }
 
-static struct row *
-_line_wrap(struct grid *old_grid, struct row **new_grid, struct row *row,
-           int *row_idx, int *col_idx, int row_count, int col_count)
+/*
+ * Reflows 'count' old rows, starting at index 'start' in the old
+ * grid, into 'dst'. Large ranges are reflowed on the render workers.
+ */
+static void
+reflow_range(struct reflow *dst, struct terminal *term, struct grid *old_grid,
+             int start, int count, bool last)
 {
-    *col_idx = 0;
-    *row_idx = (*row_idx + 1) & (row_count - 1);
+    const int mask = old_grid->num_rows - 1;
+    const int workers = term->render.workers.count;
 
-    struct row *new_row = new_grid[*row_idx];
+    /* Unallocated rows are skipped anyway */
+    while (count > 0 && old_grid->rows[start] == NULL) {
+        start = (start + 1) & mask;
+        count--;
+    }
 
-    if (new_row == NULL) {
-        /* Scrollback not yet full, allocate a completely new row */
-        new_row = grid_row_alloc(col_count, false);
-        new_grid[*row_idx] = new_row;
-    } else {
-        /* Scrollback is full, need to reuse a row */
-        grid_row_reset_extra(new_row);
-        new_row->shell_integration.prompt_marker = false;
-        new_row->shell_integration.cmd_start = -1;
-        new_row->shell_integration.cmd_end = -1;
+    if (workers == 0 || count < 2 * REFLOW_JOB_MIN_ROWS) {
+        reflow_rows(dst, old_grid, start, count, last);
+        return;
+    }
+
+    const int job_rows = max(
+        count / (workers * REFLOW_JOBS_PER_WORKER), REFLOW_JOB_MIN_ROWS);
+
+    struct reflow_job *jobs = xcalloc(count / job_rows + 1, sizeof(jobs[0]));
+    size_t job_count = 0;
+
+    struct coord terminator = {-1, -1};
+    struct coord **next_tp = dst->next_tp;
+    const struct compressed_stats {
+        size_t rows, bytes, decompressed;
+    } compressed = {
+        old_grid->compressed.rows,
+        old_grid->compressed.bytes,
+        old_grid->compressed.decompressed,
+    };
+
+    /*
+     * The last logical line is reflowed by us, after the jobs, since
+     * the last row gets special treatment
+     */
+    int end = last ? count - 1 : count;
+    while (end > 0) {
+        const struct row *prev = old_grid->rows[(start + end - 1) & mask];
+        if (prev != NULL && prev->linebreak)
+            break;
+        end--;
+    }
+
+    for (int first = 0; first < end;) {
+        int job_end = min(first + job_rows, end);
+
+        /* Split at hard line breaks only */
+        while (job_end < end) {
+            const struct row *prev = old_grid->rows[(start + job_end - 1) & mask];
+            if (prev != NULL && prev->linebreak)
+                break;
+            job_end++;
+        }
+
+        struct reflow_job *job = &jobs[job_count++];
+        job->start = (start + first) & mask;
+        job->count = job_end - first;
+
+        /* Tracking points are sorted */
+        size_t tp_count = 0;
+        while (next_tp[tp_count]->row >= 0 &&
+               ((next_tp[tp_count]->row - job->start) & mask) < job->count)
+        {
+            tp_count++;
+        }
+
+        job->tps = xmalloc((tp_count + 1) * sizeof(job->tps[0]));
+        memcpy(job->tps, next_tp, tp_count * sizeof(job->tps[0]));
+        job->tps[tp_count] = &terminator;
+        next_tp += tp_count;
+
+        job->old = *old_grid;
+        job->old.pool = NULL;
+        memset(&job->old.sixel_images, 0, sizeof(job->old.sixel_images));
 
         tll_foreach(old_grid->sixel_images, it) {
-            if (it->item.pos.row == *row_idx) {
-                sixel_destroy(&it->item);
+            if (((it->item.pos.row - job->start) & mask) < job->count) {
+                tll_push_back(job->old.sixel_images, it->item);
                 tll_remove(old_grid->sixel_images, it);
             }
         }
 
-        /*
-         * TODO: detect if the reused row is covered by the
-         * selection. Of so, cancel the selection. The problem: we
-         * don't know if we've translated the selection coordinates
-         * yet.
-         */
+        const int ring_size = min(
+            1 << (32 - __builtin_clz(job->count)), dst->max_rows);
+
+        job->rf = (struct reflow){
+            .term = dst->term,
+            .sixels = &job->mapped,
+            .rows = xcalloc(ring_size, sizeof(job->rf.rows[0])),
+            .pool = dst->pool != NULL ? row_pool_new(dst->num_cols) : NULL,
+            .num_rows = ring_size,
+            .max_rows = dst->max_rows,
+            .num_cols = dst->num_cols,
+            .keep_old_rows = true,
+            .next_tp = job->tps,
+        };
+
+        first = job_end;
     }
 
-    struct row_data *extra = row->extra;
-    if (extra == NULL)
-        return new_row;
+    LOG_DBG("reflowing %d rows in %zu jobs", end, job_count);
+    render_workers_run(term, job_count, &reflow_job_run, jobs);
 
-    /*
-     * URI ranges are per row. Thus, we need to 'close' the still-open
-     * ranges on the previous row, and re-open them on the
-     * next/current row.
-     */
-    if (extra->uri_ranges.count > 0) {
-        struct row_range *range =
-            &extra->uri_ranges.v[extra->uri_ranges.count - 1];
+    for (size_t i = 0; i < job_count; i++) {
+        struct reflow_job *job = &jobs[i];
 
-        if (range->end < 0) {
+        reflow_stitch(dst, job);
 
-            /* Terminate URI range on the previous row */
-            range->end = col_count - 1;
+        /* Not done by the jobs; freeing rows isn't thread safe */
+        for (int r = 0; r < job->count; r++) {
+            const int idx = (job->start + r) & mask;
+            grid_row_free(old_grid->rows[idx]);
+            old_grid->rows[idx] = NULL;
+        }
 
-            /* Open a new range on the new/current row */
-            ensure_row_has_extra_data(new_row);
-            range_append(&new_row->extra->uri_ranges, 0, -1,
-                         ROW_RANGE_URI, &range->data);
+        /* Rows decompressed by the job */
+        old_grid->compressed.rows -= compressed.rows - job->old.compressed.rows;
+        old_grid->compressed.bytes -= compressed.bytes - job->old.compressed.bytes;
+        old_grid->compressed.decompressed +=
+            job->old.compressed.decompressed - compressed.decompressed;
+
+        /* Sixels on unallocated rows */
+        tll_foreach(job->old.sixel_images, it) {
+            tll_push_back(old_grid->sixel_images, it->item);
+            tll_remove(job->old.sixel_images, it);
         }
+
+        if (job->rf.pool != NULL)
+            row_pool_merge(dst->pool, job->rf.pool);
+
+        free(job->rf.rows);
+        free(job->tps);
     }
 
-    if (extra->underline_ranges.count > 0) {
-        struct row_range *range =
-            &extra->underline_ranges.v[extra->underline_ranges.count - 1];
+    free(jobs);
 
-        if (range->end < 0) {
+    dst->next_tp = next_tp;
+    reflow_rows(dst, old_grid, (start + end) & mask, count - end, last);
+}
 
-            /* Terminate URI range on the previous row */
-            range->end = col_count - 1;
+static void
+reflow_segment_free(struct reflow_segment *seg)
+{
+    struct grid *old = &seg->grid;
 
-            /* Open a new range on the new/current row */
-            ensure_row_has_extra_data(new_row);
-            range_append(&new_row->extra->underline_ranges, 0, -1,
-                         ROW_RANGE_UNDERLINE, &range->data);
-        }
+    for (int r = 0; r < seg->count; r++)
+        grid_row_free(old->rows[(old->offset + r) & (old->num_rows - 1)]);
+
+    tll_foreach(old->sixel_images, it) {
+        sixel_destroy(&it->item);
+        tll_remove(old->sixel_images, it);
     }
 
-    return new_row;
+    free(old->rows);
 }
 
-static struct {
-    int scrollback_start;
-    int rows;
-} tp_cmp_ctx;
+void
+grid_reflow_discard(struct grid *grid)
+{
+    struct grid_reflow *reflow = grid->reflow;
+    if (reflow == NULL)
+        return;
+
+    for (size_t i = 0; i < reflow->count; i++)
+        reflow_segment_free(&reflow->v[i]);
+
+    free(reflow->v);
+    free(reflow);
+    grid->reflow = NULL;
+}
+
+bool
+grid_reflow_step(struct grid *grid, struct terminal *term,
+                 int screen_rows, uint32_t compression_screens, int max_rows,
+                 bool *sixels_mapped)
+{
+    struct grid_reflow *reflow = grid->reflow;
+    if (reflow == NULL)
+        return false;
+
+    xassert(reflow->count > 0);
+    struct reflow_segment *seg = &reflow->v[reflow->count - 1];
+    struct grid *old = &seg->grid;
+    const int old_mask = old->num_rows - 1;
+    const int mask = grid->num_rows - 1;
+
+    /* Reflowed rows are inserted above the oldest row */
+    const int top = grid_sb_start_ignore_uninitialized(grid, screen_rows);
+    if (grid->rows[(top - 1) & mask] != NULL) {
+        /* Scrollback is full */
+        grid_reflow_discard(grid);
+        return false;
+    }
+
+    /* The newest 'max_rows' rows, extended to the start of their
+     * logical line */
+    int first = max(seg->count - max_rows, 0);
+    while (first > 0) {
+        const struct row *prev = old->rows[(old->offset + first - 1) & old_mask];
+        if (prev == NULL) {
+            /* Uninitialized scrollback; nothing more to reflow */
+            first = 0;
+            break;
+        }
+        if (prev->linebreak)
+            break;
+        first--;
+    }
+
+    struct grid mapped = {.num_rows = grid->num_rows};
+    struct coord terminator = {-1, -1};
+    struct coord *no_tracking_points[] = {&terminator};
+
+    /* Grown as needed */
+    const int ring_size = min(REFLOW_JOB_MIN_ROWS, grid->num_rows);
+
+    struct reflow rf = {
+        .term = term,
+        .sixels = &mapped,
+        .rows = xcalloc(ring_size, sizeof(rf.rows[0])),
+        .pool = grid->pool,
+        .num_rows = ring_size,
+        .max_rows = grid->num_rows,
+        .num_cols = grid->num_cols,
+        .next_tp = no_tracking_points,
+    };
+
+    reflow_begin(&rf);
+    reflow_range(
+        &rf, term, old, (old->offset + first) & old_mask, seg->count - first,
+        false);
+
+    /* Chunks are always followed by (already reflowed) lines */
+    reflow_emit_linebreaks(&rf, true);
+    xassert(rf.col_idx == 0);
+
+    /* The last row is the one the next line would have started on */
+    grid_row_free(rf.rows[rf.row_idx]);
+    rf.rows[rf.row_idx] = NULL;
+
+    const int rf_mask = rf.num_rows - 1;
+    const int newest = (rf.row_idx - 1) & rf_mask;
+    const int count = min(rf.count - 1, rf.num_rows - 1);
+
+    /* Insert, newest first, until we run out of free rows */
+    int inserted = 0;
+    for (; inserted < count; inserted++) {
+        const int dst = (top - 1 - inserted) & mask;
+        const int src = (newest - inserted) & rf_mask;
+
+        if (grid->rows[dst] != NULL)
+            break;
+
+        grid->rows[dst] = rf.rows[src];
+        rf.rows[src] = NULL;
+    }
+
+    for (int i = inserted; i < count; i++)
+        grid_row_free(rf.rows[(newest - i) & rf_mask]);
+    free(rf.rows);
+
+    tll_foreach(mapped.sixel_images, it) {
+        const int dist = (newest - it->item.pos.row) & rf_mask;
 
-static int
-tp_cmp(const void *_a, const void *_b)
-{
-    const struct coord *a = *(const struct coord **)_a;
-    const struct coord *b = *(const struct coord **)_b;
+        if (dist < inserted) {
+            struct sixel sixel = it->item;
+            sixel.pos.row = (top - 1 - dist) & mask;
+            tll_push_back(grid->sixel_images, sixel);
+            *sixels_mapped = true;
+        } else
+            sixel_destroy(&it->item);
 
-    int scrollback_start = tp_cmp_ctx.scrollback_start;
-    int num_rows = tp_cmp_ctx.rows;
+        tll_remove(mapped.sixel_images, it);
+    }
 
-    int a_row = (a->row - scrollback_start + num_rows) & (num_rows - 1);
-    int b_row = (b->row - scrollback_start + num_rows) & (num_rows - 1);
+    if (compression_screens > 0 && grid->view == grid->offset) {
+        /* Above the uncompressed rows (if any), and out of view */
+        const int dist = (grid->offset - (top - 1)) & mask;
+        grid_compress_scrollback(
+            grid, screen_rows,
+            max(dist, (int)compression_screens * screen_rows + 1),
+            dist + inserted - 1);
+    } else {
+        /* Trigger a re-compression sweep, see grid_compress_scrollback() */
+        grid->compressed.decompressed += inserted;
+    }
 
-    xassert(a_row >= 0);
-    xassert(a_row < num_rows || num_rows == 0);
-    xassert(b_row >= 0);
-    xassert(b_row < num_rows || num_rows == 0);
+    LOG_DBG("reflowed %d old rows into %d rows (%d inserted)",
+            seg->count - first, count, inserted);
 
-    if (a_row < b_row)
-        return -1;
-    if (a_row > b_row)
-        return 1;
+    seg->count = first;
 
-    xassert(a_row == b_row);
+    if (inserted < count) {
+        /* Out of free rows; the remaining rows wouldn't fit either */
+        grid_reflow_discard(grid);
+        return false;
+    }
 
-    if (a->col < b->col)
-        return -1;
-    if (a->col > b->col)
-        return 1;
+    if (seg->count == 0) {
+        reflow_segment_free(seg);
+        if (--reflow->count == 0) {
+            free(reflow->v);
+            free(reflow);
+            grid->reflow = NULL;
+            return false;
+        }
+    }
 
-    xassert(a->col == b->col);
-    return 0;
+    return true;
 }
 
 void
 grid_resize_and_reflow(
-    struct grid *grid, const struct terminal *term, int new_rows, int new_cols,
-    int old_screen_rows, int new_screen_rows,
+    struct grid *grid, struct terminal *term, int new_rows, int new_cols,
+    int old_screen_rows, int new_screen_rows, uint32_t compression_screens,
     size_t tracking_points_count,
     struct coord *const _tracking_points[static tracking_points_count])
 {
@@ -824,32 +2629,34 @@ grid_resize_and_reflow(
     clock_gettime(CLOCK_MONOTONIC, &start);
 #endif
 
-    struct row *const *old_grid = grid->rows;
     const int old_rows = grid->num_rows;
     const int old_cols = grid->num_cols;
 
     /* Is viewpoint tracking current grid offset? */
     const bool view_follows = grid->view == grid->offset;
 
-    int new_col_idx = 0;
-    int new_row_idx = 0;
+    /*
+     * The old rows, and their sixels. Rows are freed as we go; if the
+     * width is unchanged, their cell arrays are recycled for the new
+     * rows
+     */
+    struct grid old = {
+        .num_rows = old_rows,
+        .num_cols = old_cols,
+        .rows = grid->rows,
+        .pool = grid->pool,
+        .compressed = grid->compressed,
+        .sixel_images = grid->sixel_images,
+    };
+    memset(&grid->sixel_images, 0, sizeof(grid->sixel_images));
 
     struct row **new_grid = xcalloc(new_rows, sizeof(new_grid[0]));
-    struct row *new_row = new_grid[new_row_idx];
-
-    xassert(new_row == NULL);
-    new_row = grid_row_alloc(new_cols, false);
-    new_grid[new_row_idx] = new_row;
+    struct row_pool *new_pool = resize_pool(grid, new_cols);
 
     /* Start at the beginning of the old grid's scrollback. That is,
      * at the output that is *oldest* */
     int offset = grid->offset + old_screen_rows;
 
-    tll(struct sixel) untranslated_sixels = tll_init();
-    tll_foreach(grid->sixel_images, it)
-        tll_push_back(untranslated_sixels, it->item);
-    tll_free(grid->sixel_images);
-
     /* Turn cursor coordinates into grid absolute coordinates */
     struct coord cursor = grid->cursor.point;
     cursor.row += grid->offset;
@@ -884,7 +2691,6 @@ grid_resize_and_reflow(
     /* NULL terminate */
     struct coord terminator = {-1, -1};
     tracking_points[tp_count - 1] = &terminator;
-    struct coord **next_tp = &tracking_points[0];
 
     LOG_DBG("scrollback-start=%d", offset);
     for (size_t i = 0; i < tp_count - 1; i++) {
@@ -892,289 +2698,87 @@ grid_resize_and_reflow(
                 i, tracking_points[i]->row, tracking_points[i]->col);
     }
 
-    int coalesced_linebreaks = 0;
-
     /*
-     * Walk the old grid
+     * Rows older than 'sync_start' (scrollback relative) are deferred
+     * (see grid_reflow_step()). The tracking points are sorted; the
+     * first one is the oldest. The cursor is on the screen.
      */
-    for (int r = 0; r < old_rows; r++) {
+    int sync_start = (tracking_points[0]->row - offset + old_rows) & (old_rows - 1);
+    sync_start = min(sync_start, old_rows - old_screen_rows);
+    sync_start = max(sync_start - REFLOW_SYNC_MARGIN, 0);
 
-        const size_t old_row_idx = (offset + r) & (old_rows - 1);
+    while (sync_start > 0) {
+        const struct row *prev =
+            old.rows[(offset + sync_start - 1) & (old_rows - 1)];
 
-        /* Unallocated (empty) rows we can simply skip */
-        const struct row *old_row = old_grid[old_row_idx];
-        if (old_row == NULL)
-            continue;
+        if (prev == NULL || prev->linebreak)
+            break;
+        sync_start--;
+    }
 
-        /* Map sixels on current "old" row to current "new row" */
-        tll_foreach(untranslated_sixels, it) {
-            if (it->item.pos.row != old_row_idx)
-                continue;
+    const int sb_start = grid_sb_start_ignore_uninitialized(grid, old_screen_rows);
+    const int sb_start_rel = (sb_start - offset + old_rows) & (old_rows - 1);
+    if (sync_start - sb_start_rel < REFLOW_MIN_DEFERRED)
+        sync_start = 0;
 
-            struct sixel sixel = it->item;
-            sixel.pos.row = new_row_idx;
+    /*
+     * With scrollback compression, the new rows are compressed as we
+     * go, except those that compress_scrollback() would have left
+     * uncompressed, instead of having the entire reflowed scrollback
+     * decompressed at once. The old rows are decompressed one at a
+     * time, as they're reflowed (see grid_row_abs()).
+     */
+    const bool compress =
+        compression_screens > 0 &&
+        compression_screens < (uint32_t)(new_rows / new_screen_rows);
+
+    struct reflow rf = {
+        .term = term,
+        .sixels = grid,
+        .rows = new_grid,
+        .pool = new_pool,
+        .num_rows = new_rows,
+        .max_rows = new_rows,
+        .num_cols = new_cols,
+        .next_tp = &tracking_points[0],
+        .compress_dist = compress ? (compression_screens + 1) * new_screen_rows : 0,
+    };
 
-            tll_push_back(grid->sixel_images, sixel);
-            tll_remove(untranslated_sixels, it);
-        }
+    reflow_begin(&rf);
 
-#define line_wrap()                                                 \
-        new_row = _line_wrap(                                       \
-            grid, new_grid, new_row, &new_row_idx, &new_col_idx,    \
-            new_rows, new_cols)
-
-        /* Find last non-empty cell */
-        int col_count = 0;
-        for (int c = old_cols - 1; c >= 0; c--) {
-            const struct cell *cell = &old_row->cells[c];
-            if (!(cell->wc == 0 || cell->wc == CELL_SPACER)) {
-                col_count = c + 1;
+    /*
+     * Walk the old grid, in segments when compressing. Segments end
+     * at hard line breaks, since reflow_range() splits them into
+     * jobs that must start at the beginning of a logical line.
+     */
+    int first = sync_start;
+    do {
+        int end = compress
+            ? min(first + REFLOW_COMPRESS_SEGMENT, old_rows)
+            : old_rows;
+
+        while (end < old_rows) {
+            const struct row *prev = old.rows[(offset + end - 1) & (old_rows - 1)];
+            if (prev == NULL || prev->linebreak)
                 break;
-            }
-        }
-
-        if (!old_row->linebreak && col_count > 0) {
-            /* Don't truncate logical lines */
-            while (col_count < old_cols && old_row->cells[col_count].wc == 0)
-                col_count++;
-        }
-
-        xassert(col_count >= 0 && col_count <= old_cols);
-
-        /* Do we have a (at least one) tracking point on this row */
-        struct coord *tp;
-        if (unlikely((*next_tp)->row == old_row_idx)) {
-            tp = *next_tp;
-
-            /* Find the *last* tracking point on this row */
-            struct coord *last_on_row = tp;
-            for (struct coord **iter = next_tp; (*iter)->row == old_row_idx; iter++)
-                last_on_row = *iter;
-
-            /* And make sure its end point is included in the col range */
-            xassert(last_on_row->row == old_row_idx);
-            col_count = max(col_count, last_on_row->col + 1);
-        } else
-            tp = NULL;
-
-        /* Does this row have any URIs? */
-        struct row_range *uri_range, *uri_range_terminator;
-        struct row_range *underline_range, *underline_range_terminator;
-        const struct row_data *extra = old_row->extra;
-
-        if (extra != NULL && extra->uri_ranges.count > 0) {
-            uri_range = &extra->uri_ranges.v[0];
-            uri_range_terminator = &extra->uri_ranges.v[extra->uri_ranges.count];
-
-            /* Make sure the *last* URI range's end point is included
-             * in the copy */
-            const struct row_range *last_on_row =
-                &extra->uri_ranges.v[extra->uri_ranges.count - 1];
-            col_count = max(col_count, last_on_row->end + 1);
-        } else
-            uri_range = uri_range_terminator = NULL;
-
-        if (extra != NULL && extra->underline_ranges.count > 0) {
-            underline_range = &extra->underline_ranges.v[0];
-            underline_range_terminator = &extra->underline_ranges.v[extra->underline_ranges.count];
-
-            const struct row_range *last_on_row =
-                &extra->underline_ranges.v[extra->underline_ranges.count - 1];
-            col_count = max(col_count, last_on_row->end + 1);
-        } else
-            underline_range = underline_range_terminator = NULL;
-
-        if (unlikely(col_count > 0 && coalesced_linebreaks > 0)) {
-            for (size_t apa = 0; apa < coalesced_linebreaks; apa++) {
-                /* Erase the remaining cells */
-                memset(&new_row->cells[new_col_idx], 0,
-                       (new_cols - new_col_idx) * sizeof(new_row->cells[0]));
-                new_row->linebreak = true;
-
-                if (r + 1 < old_rows)
-                    line_wrap();
-            }
-
-            coalesced_linebreaks = 0;
-        }
-
-        for (int c = 0; c < col_count;) {
-            const struct cell *old = &old_row->cells[c];
-
-            /* Row full, emit newline and get a new, fresh, row */
-            xassert(new_col_idx <= new_cols);
-            if (unlikely(new_col_idx >= new_cols))
-                line_wrap();
-
-            char32_t wc = old->wc;
-            int width = 1;
-
-            if (unlikely(wc >= CELL_COMB_CHARS_LO && wc <= CELL_COMB_CHARS_HI)) {
-                const struct composed *composed =
-                    composed_lookup(term->composed, wc - CELL_COMB_CHARS_LO);
-
-                width = composed->forced_width > 0 ? composed->forced_width : composed->width;
-            } else if (unlikely(c + 1 < col_count && (old + 1)->wc >= CELL_SPACER + 1)) {
-                /* Wide character, get its width from the next cell's
-                   SPACER value */
-                width = (old + 1)->wc - CELL_SPACER + 1;
-            }
-
-            /*
-             * Check if character fits, if not, emit spacers, and push
-               the character to the next row */
-            if (unlikely(new_col_idx + width > new_cols && width <= new_cols)) {
-                for (; new_col_idx < new_cols; new_col_idx++) {
-                    new_row->cells[new_col_idx].wc = CELL_SPACER;
-                    new_row->cells[new_col_idx].attrs = (struct attributes){0};
-                }
-                line_wrap();
-            }
-
-            new_row->shell_integration.prompt_marker = old_row->shell_integration.prompt_marker;
-
-            for (int i = 0; i < width; i++) {
-                if (unlikely(uri_range != NULL && uri_range != uri_range_terminator)) {
-                    if (unlikely(uri_range->start == c)) {
-                        reflow_range_start(
-                            uri_range, ROW_RANGE_URI, new_row, new_col_idx);
-                    }
-
-                    if (unlikely(uri_range->end == c)) {
-                        reflow_range_end(
-                            uri_range, ROW_RANGE_URI, new_row, new_col_idx);
-                        grid_row_uri_range_destroy(uri_range);
-                        uri_range++;
-                    }
-                }
-
-                if (unlikely(underline_range != NULL && underline_range != underline_range_terminator)) {
-                    if (unlikely(underline_range->start == c)) {
-                        reflow_range_start(
-                            underline_range, ROW_RANGE_UNDERLINE, new_row, new_col_idx);
-                    }
-
-                    if (unlikely(underline_range->end == c)) {
-                        reflow_range_end(
-                            underline_range, ROW_RANGE_UNDERLINE, new_row, new_col_idx);
-                        grid_row_underline_range_destroy(underline_range);
-                        underline_range++;
-                    }
-                }
-
-                if (unlikely(tp != NULL)) {
-                    if (unlikely(tp->col == c)) {
-                        do {
-                            xassert(tp->row == old_row_idx);
-
-                            tp->row = new_row_idx;
-                            tp->col = new_col_idx;
-
-                            next_tp++;
-                            tp = *next_tp;
-                        } while (tp->row == old_row_idx && tp->col == c);
-
-                        if (tp->row != old_row_idx)
-                            tp = NULL;
-
-                        LOG_DBG("next TP (tp=%p): %dx%d",
-                                (void*)tp, (*next_tp)->row, (*next_tp)->col);
-                    }
-                }
-
-                if (unlikely(old_row->shell_integration.cmd_start == c))
-                    new_row->shell_integration.cmd_start = new_col_idx;
-
-                if (unlikely(old_row->shell_integration.cmd_end == c))
-                    new_row->shell_integration.cmd_end = new_col_idx;
-
-                if (unlikely(width > new_cols)) {
-                    /* Wide character no longer fits on a row, replace
-                       it with a single space */
-                    new_row->cells[new_col_idx++].wc = 0;
-                    c++;
-
-                    /* Walk past the SPACER cells */
-                    for (int i = 1; i < width; i++, c++, old++)
-                        ;
-
-                    /* Continue with next character in the *old* grid */
-                    break;
-                }
-
-                new_row->cells[new_col_idx++] = *old;
-
-                /*
-                 * TODO: simulate LCF instead?
-                 *
-                 * Rows have linebreak=true by default. This is needed
-                 * for a number of reasons. However, we want non-empty
-                 * rows to have linebreak=false, *until* we reach the
-                 * end of an old row with linebreak=true, at which
-                 * point we set linebreak=true on the new row.
-                 */
-                new_row->linebreak = false;
-                old++;
-                c++;
-            }
-        }
-
-        if (old_row->linebreak) {
-            if (col_count > 0) {
-                /* Erase the remaining cells */
-                memset(&new_row->cells[new_col_idx], 0,
-                       (new_cols - new_col_idx) * sizeof(new_row->cells[0]));
-                new_row->linebreak = true;
-
-                if (r + 1 < old_rows) {
-                    /* Not the last (old) row */
-                    line_wrap();
-                } else if (new_row->extra != NULL) {
-                    if (new_row->extra->uri_ranges.count > 0) {
-                        /*
-                         * line_wrap() "closes" still-open URIs. Since
-                         * this is the *last* row, and since we're
-                         * line-breaking due to a hard line-break (rather
-                         * than running out of cells in the "new_row"),
-                         * there shouldn't be an open URI (it would have
-                         * been closed when we reached the end of the URI
-                         * while reflowing the last "old" row).
-                         */
-                        int last_idx = new_row->extra->uri_ranges.count - 1;
-                        xassert(new_row->extra->uri_ranges.v[last_idx].end >= 0);
-                    }
-
-                    if (new_row->extra->underline_ranges.count > 0) {
-                        int last_idx = new_row->extra->underline_ranges.count - 1;
-                        xassert(new_row->extra->underline_ranges.v[last_idx].end >= 0);
-                    }
-                }
-            } else {
-                /*
-                 * rows have linebreak=true by default. But we don't
-                 * want trailing empty lines to result in actual lines
-                 * in the new grid (think: empty window with prompt at
-                 * the top)
-                 */
-                coalesced_linebreaks++;
-            }
+            end++;
         }
 
-        grid_row_free(old_grid[old_row_idx]);
-        grid->rows[old_row_idx] = NULL;
+        reflow_range(
+            &rf, term, &old, (offset + first) & (old_rows - 1),
+            end - first, end == old_rows);
+        reflow_compress(&rf);
 
-#undef line_wrap
-    }
+        first = end;
+    } while (first < old_rows);
 
-    /* Erase the remaining cells */
-    memset(&new_row->cells[new_col_idx], 0,
-           (new_cols - new_col_idx) * sizeof(new_row->cells[0]));
+    const int new_row_idx = rf.row_idx;
 
-    for (struct coord **tp = next_tp; *tp != &terminator; tp++) {
+    for (struct coord **tp = rf.next_tp; *tp != &terminator; tp++) {
         LOG_DBG("TP: row=%d, col=%d (old cols: %d, new cols: %d)",
                 (*tp)->row, (*tp)->col, old_cols, new_cols);
     }
-    xassert(old_rows == 0 || *next_tp == &terminator);
+    xassert(old_rows == 0 || *rf.next_tp == &terminator);
 
 #if defined(_DEBUG)
     /* Verify all URI ranges have been "closed" */
@@ -1195,11 +2799,56 @@ grid_resize_and_reflow(
         verify_ranges_are_sorted(row->extra);
     }
 
-    /* Verify all old rows have been free:d */
-    for (int i = 0; i < old_rows; i++)
-        xassert(grid->rows[i] == NULL);
+    /* Verify all reflowed old rows have been free:d */
+    for (int r = sync_start; r < old_rows; r++)
+        xassert(old.rows[(offset + r) & (old_rows - 1)] == NULL);
 #endif
 
+    /* Reflowed rows have been decompressed, and possibly compressed
+     * again, deferred rows are still accounted for in the old grid */
+    grid->compressed.rows = 0;
+    grid->compressed.bytes = 0;
+    grid->compressed.decompressed = old.compressed.decompressed;
+
+    for (int r = 0; compress && r < new_rows; r++) {
+        const struct row *row = new_grid[r];
+        if (row != NULL && row->packed != NULL) {
+            grid->compressed.rows++;
+            grid->compressed.bytes += row->packed->size;
+        }
+    }
+
+    if (sync_start > 0) {
+        /* Defer the older rows; they're reflowed before any older,
+         * already deferred, rows */
+        struct grid_reflow *reflow = grid->reflow;
+        if (reflow == NULL)
+            reflow = grid->reflow = xcalloc(1, sizeof(*reflow));
+
+        reflow->v = xreallocarray(
+            reflow->v, reflow->count + 1, sizeof(reflow->v[0]));
+
+        /* Compressed rows left in the old grid are all deferred */
+        old.offset = offset & (old_rows - 1);
+        old.pool = NULL;
+        old.compressed.decompressed = 0;
+
+        reflow->v[reflow->count++] = (struct reflow_segment){
+            .grid = old,
+            .count = sync_start,
+        };
+
+        LOG_DBG("deferred %d rows", sync_start);
+    } else {
+        /* Free old grid (rows already free:d) */
+        free(old.rows);
+
+        /* Free sixels we failed to "map" to the new grid */
+        tll_foreach(old.sixel_images, it)
+            sixel_destroy(&it->item);
+        tll_free(old.sixel_images);
+    }
+
     /* Set offset such that the last reflowed row is at the bottom */
     grid->offset = new_row_idx - new_screen_rows + 1;
 
@@ -1212,11 +2861,10 @@ grid_resize_and_reflow(
     for (int r = 0; r < new_screen_rows; r++) {
         int idx = (grid->offset + r) & (new_rows - 1);
         if (new_grid[idx] == NULL)
-            new_grid[idx] = grid_row_alloc(new_cols, true);
+            new_grid[idx] = grid_row_alloc_from(new_pool, new_cols, true);
     }
 
-    /* Free old grid (rows already free:d) */
-    free(grid->rows);
+    resize_pool_done(grid, new_pool);
 
     grid->rows = new_grid;
     grid->num_rows = new_rows;
@@ -1266,11 +2914,6 @@ grid_resize_and_reflow(
     grid->cursor.point = cursor;
     grid->saved_cursor.point = saved_cursor;
 
-    /* Free sixels we failed to "map" to the new grid */
-    tll_foreach(untranslated_sixels, it)
-        sixel_destroy(&it->item);
-    tll_free(untranslated_sixels);
-
 #if defined(TIME_REFLOW) && TIME_REFLOW
     struct timespec stop;
     clock_gettime(CLOCK_MONOTONIC, &stop);
@@ -1284,6 +2927,59 @@ grid_resize_and_reflow(
 #endif
 }
 
+static void
+row_composed_mark(const struct row *row, int cols,
+                  const struct composed_table *composed)
+{
+    if (row->packed != NULL) {
+        const struct row_packed *packed = row->packed;
+        const uint8_t *text = (const uint8_t *)&packed->runs[packed->run_count];
+
+        for (int c = 0; c < packed->text_cells; c++) {
+            char32_t wc;
+            text = wc_decode(text, &wc);
+
+            if (wc >= CELL_COMB_CHARS_LO && wc <= CELL_COMB_CHARS_HI)
+                composed_mark(composed, wc - CELL_COMB_CHARS_LO);
+        }
+        return;
+    }
+
+    for (int c = 0; c < cols; c++) {
+        const char32_t wc = row->cells[c].wc;
+
+        if (wc >= CELL_COMB_CHARS_LO && wc <= CELL_COMB_CHARS_HI)
+            composed_mark(composed, wc - CELL_COMB_CHARS_LO);
+    }
+}
+
+void
+grid_composed_mark(const struct grid *grid,
+                   const struct composed_table *composed)
+{
+    for (int r = 0; r < grid->num_rows; r++) {
+        const struct row *row = grid->rows[r];
+        if (row != NULL)
+            row_composed_mark(row, grid->num_cols, composed);
+    }
+
+    if (grid->reflow == NULL)
+        return;
+
+    /* Rows not yet reflowed */
+    for (size_t i = 0; i < grid->reflow->count; i++) {
+        const struct reflow_segment *seg = &grid->reflow->v[i];
+        const struct grid *old = &seg->grid;
+
+        for (int r = 0; r < seg->count; r++) {
+            const struct row *row =
+                old->rows[(old->offset + r) & (old->num_rows - 1)];
+            if (row != NULL)
+                row_composed_mark(row, old->num_cols, composed);
+        }
+    }
+}
+
 static bool
 ranges_match(const struct row_range *r1, const struct row_range *r2,
              enum row_range_type type)
@@ -1404,7 +3100,7 @@ grid_row_range_put(struct row_ranges *ranges, int col,
         switch (type) {
         case ROW_RANGE_URI:
             ranges->v[insert_idx].uri.id = data->uri.id;
-            ranges->v[insert_idx].uri.uri = xstrdup(data->uri.uri);
+            ranges->v[insert_idx].uri.uri = osc8_uri_ref(data->uri.uri);
             break;
 
         case ROW_RANGE_UNDERLINE:
@@ -1429,13 +3125,13 @@ grid_row_range_put(struct row_ranges *ranges, int col,
 }
 
 void
-grid_row_uri_range_put(struct row *row, int col, const char *uri, uint64_t id)
+grid_row_uri_range_put(struct row *row, int col, struct osc8_uri *uri, uint64_t id)
 {
     ensure_row_has_extra_data(row);
 
     grid_row_range_put(
         &row->extra->uri_ranges, col,
-        &(union row_range_data){.uri = {.id = id, .uri = (char *)uri}},
+        &(union row_range_data){.uri = {.id = id, .uri = uri}},
         ROW_RANGE_URI);
 
     verify_no_overlapping_ranges(row->extra);
@@ -1461,6 +3157,12 @@ UNITTEST
     struct row_data row_data = {.uri_ranges = {0}};
     struct row row = {.extra = &row_data};
 
+    struct osc8_uri_table uris = {0};
+    struct osc8_uri *foo = osc8_uri_intern(&uris, "http://foo.bar");
+    struct osc8_uri *head = osc8_uri_intern(&uris, "http://head");
+    struct osc8_uri *tail = osc8_uri_intern(&uris, "http://tail");
+    struct osc8_uri *splice = osc8_uri_intern(&uris, "http://splice");
+
 #define verify_range(idx, _start, _end, _id)                     \
     do {                                                         \
         xassert(idx < row_data.uri_ranges.count);                \
@@ -1469,55 +3171,69 @@ UNITTEST
         xassert(row_data.uri_ranges.v[idx].uri.id == _id);       \
     } while (0)
 
-    grid_row_uri_range_put(&row, 0, "http://foo.bar", 123);
-    grid_row_uri_range_put(&row, 1, "http://foo.bar", 123);
-    grid_row_uri_range_put(&row, 2, "http://foo.bar", 123);
-    grid_row_uri_range_put(&row, 3, "http://foo.bar", 123);
+    grid_row_uri_range_put(&row, 0, foo, 123);
+    grid_row_uri_range_put(&row, 1, foo, 123);
+    grid_row_uri_range_put(&row, 2, foo, 123);
+    grid_row_uri_range_put(&row, 3, foo, 123);
     xassert(row_data.uri_ranges.count == 1);
     verify_range(0, 0, 3, 123);
 
     /* No-op */
-    grid_row_uri_range_put(&row, 0, "http://foo.bar", 123);
+    grid_row_uri_range_put(&row, 0, foo, 123);
     xassert(row_data.uri_ranges.count == 1);
     verify_range(0, 0, 3, 123);
 
     /* Replace head */
-    grid_row_uri_range_put(&row, 0, "http://head", 456);
+    grid_row_uri_range_put(&row, 0, head, 456);
     xassert(row_data.uri_ranges.count == 2);
     verify_range(0, 0, 0, 456);
     verify_range(1, 1, 3, 123);
 
     /* Replace tail */
-    grid_row_uri_range_put(&row, 3, "http://tail", 789);
+    grid_row_uri_range_put(&row, 3, tail, 789);
     xassert(row_data.uri_ranges.count == 3);
     verify_range(1, 1, 2, 123);
     verify_range(2, 3, 3, 789);
 
     /* Replace tail + extend head */
-    grid_row_uri_range_put(&row, 2, "http://tail", 789);
+    grid_row_uri_range_put(&row, 2, tail, 789);
     xassert(row_data.uri_ranges.count == 3);
     verify_range(1, 1, 1, 123);
     verify_range(2, 2, 3, 789);
 
     /* Replace + extend tail */
-    grid_row_uri_range_put(&row, 1, "http://head", 456);
+    grid_row_uri_range_put(&row, 1, head, 456);
     xassert(row_data.uri_ranges.count == 2);
     verify_range(0, 0, 1, 456);
     verify_range(1, 2, 3, 789);
 
     /* Replace + extend, then splice */
-    grid_row_uri_range_put(&row, 1, "http://tail", 789);
-    grid_row_uri_range_put(&row, 2, "http://splice", 000);
+    grid_row_uri_range_put(&row, 1, tail, 789);
+    grid_row_uri_range_put(&row, 2, splice, 000);
     xassert(row_data.uri_ranges.count == 4);
     verify_range(0, 0, 0, 456);
     verify_range(1, 1, 1, 789);
     verify_range(2, 2, 2, 000);
     verify_range(3, 3, 3, 789);
 
+    /* Ranges share the interned URIs */
+    xassert(row_data.uri_ranges.v[1].uri.uri == tail);
+    xassert(row_data.uri_ranges.v[3].uri.uri == tail);
+    xassert(uris.count == 4);
+
     for (size_t i = 0; i < row_data.uri_ranges.count; i++)
         grid_row_uri_range_destroy(&row_data.uri_ranges.v[i]);
     free(row_data.uri_ranges.v);
 
+    /* Only our own references remain */
+    xassert(osc8_uri_table_sweep(&uris) == 0);
+    osc8_uri_unref(foo);
+    osc8_uri_unref(head);
+    osc8_uri_unref(tail);
+    osc8_uri_unref(splice);
+    xassert(osc8_uri_table_sweep(&uris) == 4);
+    osc8_uri_table_free(&uris);
+
 #undef verify_range
 }
 
@@ -1593,10 +3309,11 @@ UNITTEST
 {
     struct row_data row_data = {.uri_ranges = {0}};
     struct row row = {.extra = &row_data};
+    struct osc8_uri_table uris = {0};
     const union row_range_data data = {
         .uri = {
             .id = 0,
-            .uri = (char *)"dummy",
+            .uri = osc8_uri_intern(&uris, "dummy"),
         },
     };
 
@@ -1675,4 +3392,363 @@ UNITTEST
 
     grid_row_ranges_destroy(&row_data.uri_ranges, ROW_RANGE_URI);
     free(row_data.uri_ranges.v);
+
+    osc8_uri_unref(data.uri.uri);
+    xassert(osc8_uri_table_sweep(&uris) == 1);
+    osc8_uri_table_free(&uris);
+}
+
+UNITTEST
+{
+    struct grid grid = {.num_cols = 80};
+    struct row *row = grid_row_alloc(grid.num_cols, true);
+
+    const char32_t text[] = {
+        U'a', U'ö', U'€', U'😀', CELL_SPACER + 1, 0, U' ', U'b',
+        CELL_COMB_CHARS_LO + 17, CELL_COMB_CHARS_HI, CELL_SPACER + 2,
+    };
+
+    for (size_t i = 0; i < ALEN(text); i++)
+        row->cells[10 + i].wc = text[i];
+    for (int c = 12; c < 20; c++) {
+        cell_set_attrs(row, &row->cells[c], (struct attributes){
+            .bold = true,
+            .fg = 0x123456,
+            .fg_src = COLOR_RGB,
+            .selected = c >= 14,
+        });
+    }
+    cell_set_confined(&row->cells[15], true);
+    row->linebreak = true;
+
+    struct cell orig[80];
+    struct attributes orig_attrs[80];
+    memcpy(orig, row->cells, sizeof(orig));
+    for (int c = 0; c < grid.num_cols; c++)
+        orig_attrs[c] = *cell_attrs(row, &row->cells[c]);
+
+    xassert(grid_row_compress(&grid, row));
+    xassert(row->cells == NULL);
+    xassert(row->packed != NULL);
+    xassert(grid.compressed.rows == 1);
+    xassert(grid.compressed.bytes < grid.num_cols * sizeof(struct cell));
+
+    grid_row_decompress(&grid, row);
+    xassert(row->packed == NULL);
+    xassert(row->dirty);
+    xassert(row->linebreak);
+    xassert(grid.compressed.rows == 0);
+    xassert(grid.compressed.bytes == 0);
+    xassert(grid.compressed.decompressed == 1);
+
+    for (int c = 0; c < grid.num_cols; c++) {
+        const struct cell *cell = &row->cells[c];
+        struct attributes a = *cell_attrs(row, cell);
+        struct attributes b = orig_attrs[c];
+        a.clean = b.clean = false;
+        a.confined = b.confined = false;
+        a.selected = b.selected = false;
+
+        xassert(cell->wc == orig[c].wc);
+        xassert(memcmp(&a, &b, sizeof(a)) == 0);
+        xassert(cell_selected(cell) == cell_selected(&orig[c]));
+        xassert(!cell_confined(cell));
+        xassert(!cell_clean(cell));
+    }
+
+    grid_row_free(row);
+}
+
+UNITTEST
+{
+    /* Copy-on-write snapshots */
+    struct grid grid = {
+        .num_rows = 8,
+        .num_cols = 4,
+        .rows = xcalloc(8, sizeof(grid.rows[0])),
+    };
+
+    for (int r = 0; r < 6; r++) {
+        grid.rows[r] = grid_row_alloc(grid.num_cols, true);
+        grid.rows[r]->cells[0].wc = U'a' + r;
+    }
+
+    grid.offset = grid.view = 2;
+    grid.cursor.point = (struct coord){0, 1};
+    grid.cur_row = grid.rows[3];
+
+    struct grid *snapshot = grid_snapshot(&grid);
+
+    /* The cursor row is copied, the others are shared */
+    xassert(snapshot->rows[3] != grid.rows[3]);
+    xassert(snapshot->rows[3]->cells[0].wc == U'd');
+    for (int r = 0; r < 6; r++) {
+        if (r == 3)
+            continue;
+        xassert(snapshot->rows[r] == grid.rows[r]);
+        xassert(grid.rows[r]->shares == 1);
+    }
+    xassert(snapshot->rows[6] == NULL);
+
+    /* Writing to a shared row copies it */
+    struct row *row = grid_row(&grid, 0);
+    xassert(row != snapshot->rows[2]);
+    xassert(row->shares == 0);
+    xassert(snapshot->rows[2]->shares == 0);
+    row->cells[0].wc = U'x';
+    xassert(snapshot->rows[2]->cells[0].wc == U'c');
+
+    /* ...in both directions */
+    row = grid_row_abs(snapshot, 5);
+    xassert(row != grid.rows[5]);
+    row->cells[0].wc = U'y';
+    xassert(grid.rows[5]->cells[0].wc == U'f');
+
+    /* Rows still shared outlive the first grid freeing them */
+    grid_free(&grid);
+    xassert(snapshot->rows[0]->shares == 0);
+    xassert(snapshot->rows[0]->cells[0].wc == U'a');
+
+    grid_free(snapshot);
+    free(snapshot);
+}
+
+UNITTEST
+{
+    const int cols = 100;
+    struct row_pool *pool = row_pool_new(cols);
+
+    /* Enough rows to need more than one slab */
+    const size_t per_slab = ROW_SLAB_SIZE / (cols * sizeof(struct cell));
+    const size_t count = per_slab + per_slab / 2;
+    struct row **rows = xcalloc(count, sizeof(rows[0]));
+
+    for (size_t i = 0; i < count; i++) {
+        rows[i] = grid_row_alloc_from(pool, cols, i & 1);
+        xassert(rows[i]->slab != NULL);
+        rows[i]->cells[cols - 1].wc = U'x';
+    }
+
+    xassert(pool->slab_count == 2);
+    xassert(pool->empty_slabs == 0);
+    xassert(pool->head->used < pool->head->count);
+    xassert(pool->tail->used == pool->tail->count);
+
+    /* Freed cell arrays are recycled */
+    struct cell *cells = rows[3]->cells;
+    grid_row_free(rows[3]);
+    rows[3] = grid_row_alloc_from(pool, cols, true);
+    xassert(rows[3]->cells == cells);
+    for (int c = 0; c < cols; c++) {
+        xassert(rows[3]->cells[c].wc == 0);
+        xassert(cell_clean(&rows[3]->cells[c]));
+    }
+
+    /* Compressed rows give their cells back to the pool */
+    struct grid grid = {.num_cols = cols, .pool = pool};
+    xassert(grid_row_compress(&grid, rows[5]));
+    xassert(rows[5]->cells == NULL);
+    xassert(rows[5]->slab == NULL);
+
+    grid_row_decompress(&grid, rows[5]);
+    xassert(rows[5]->slab != NULL);
+    xassert(rows[5]->cells[cols - 1].wc == U'x');
+
+    /* One empty slab is kept around... */
+    for (size_t i = 0; i < per_slab; i++) {
+        grid_row_free(rows[i]);
+        rows[i] = NULL;
+    }
+
+    xassert(pool->slab_count == 2);
+    xassert(pool->empty_slabs == 1);
+
+    /* ...until trimmed */
+    row_pool_trim(pool);
+    xassert(pool->slab_count == 1);
+    xassert(pool->empty_slabs == 0);
+
+    /* The pool outlives the grid, as long as there are rows left */
+    row_pool_release(pool);
+    for (size_t i = 0; i < count; i++)
+        grid_row_free(rows[i]);
+
+    free(rows);
+}
+
+UNITTEST
+{
+    /* Deferred (incremental) reflow */
+    const int cols = 80;
+    const int screen_rows = 24;
+    const int num_rows = 8192;
+
+    static struct terminal term = {0};
+    struct grid grid = {
+        .num_rows = num_rows,
+        .num_cols = cols,
+        .rows = xcalloc(num_rows, sizeof(grid.rows[0])),
+        .pool = row_pool_new(cols),
+    };
+
+    /* Logical lines, 1-150 characters each, wrapped at 80 columns */
+    int row_count = 0;
+    int line_count = 0;
+    while (row_count < 7000) {
+        const int len = 1 + line_count % 150;
+
+        for (int i = 0; i < len; i++) {
+            if (i % cols == 0) {
+                struct row *row = grid_row_alloc_from(grid.pool, cols, true);
+                row->linebreak = false;
+                grid.rows[row_count++] = row;
+            }
+
+            struct row *row = grid.rows[row_count - 1];
+            row->cells[i % cols].wc = U'a' + (line_count + i) % 26;
+        }
+
+        grid.rows[row_count - 1]->linebreak = true;
+        line_count++;
+    }
+
+    grid.offset = grid.view = row_count - screen_rows;
+    grid.cur_row = grid.rows[grid.offset];
+
+    struct coord *no_tracking_points[1];
+    grid_resize_and_reflow(
+        &grid, &term, num_rows, 120, screen_rows, screen_rows, 0,
+        0, no_tracking_points);
+
+    /* Most of the scrollback is deferred... */
+    xassert(grid_reflow_pending(&grid));
+    xassert(grid.rows[(grid.offset + screen_rows) & (num_rows - 1)] == NULL);
+
+    /* ...and reflowed in chunks */
+    int steps = 0;
+    bool sixels_mapped = false;
+    while (grid_reflow_step(&grid, &term, screen_rows, 0, 1000, &sixels_mapped))
+        steps++;
+
+    xassert(steps > 1);
+    xassert(!grid_reflow_pending(&grid));
+    xassert(!sixels_mapped);
+
+    /* Verify all lines are there, in order */
+    const int start = grid_sb_start_ignore_uninitialized(&grid, screen_rows);
+    int line = 0;
+    int col = 0;
+
+    for (int r = 0; r < num_rows; r++) {
+        const struct row *row = grid.rows[(start + r) & (num_rows - 1)];
+        if (row == NULL)
+            break;
+
+        const int len = 1 + line % 150;
+        for (int c = 0; c < grid.num_cols && col < len; c++, col++)
+            xassert(row->cells[c].wc == U'a' + (line + col) % 26);
+
+        if (row->linebreak) {
+            xassert(col == len);
+            line++;
+            col = 0;
+        }
+    }
+
+    xassert(line == line_count);
+
+    grid_free(&grid);
+}
+
+UNITTEST
+{
+    /* Reflow with scrollback compression */
+    const int cols = 80;
+    const int screen_rows = 24;
+    const int num_rows = 8192;
+
+    static struct terminal term = {0};
+    struct grid grid = {
+        .num_rows = num_rows,
+        .num_cols = cols,
+        .rows = xcalloc(num_rows, sizeof(grid.rows[0])),
+        .pool = row_pool_new(cols),
+    };
+
+    /* Logical lines, 1-150 characters each, wrapped at 80 columns */
+    int row_count = 0;
+    int line_count = 0;
+    while (row_count < 7000) {
+        const int len = 1 + line_count % 150;
+
+        for (int i = 0; i < len; i++) {
+            if (i % cols == 0) {
+                struct row *row = grid_row_alloc_from(grid.pool, cols, true);
+                row->linebreak = false;
+                grid.rows[row_count++] = row;
+            }
+
+            struct row *row = grid.rows[row_count - 1];
+            row->cells[i % cols].wc = U'a' + (line_count + i) % 26;
+        }
+
+        grid.rows[row_count - 1]->linebreak = true;
+        line_count++;
+    }
+
+    grid.offset = grid.view = row_count - screen_rows;
+    grid.cur_row = grid.rows[grid.offset];
+
+    grid_compress_scrollback(&grid, screen_rows, 1, num_rows);
+    xassert(grid.compressed.rows == row_count - screen_rows);
+
+    /* Tracking the oldest row; nothing is deferred */
+    struct coord oldest = {0, 0};
+    struct coord *tracking_points[] = {&oldest};
+    grid_resize_and_reflow(
+        &grid, &term, num_rows, 120, screen_rows, screen_rows, 2,
+        ALEN(tracking_points), tracking_points);
+    xassert(!grid_reflow_pending(&grid));
+
+    /* Everything but the screen, and two screens above it, is compressed */
+    size_t packed = 0;
+    for (int r = 0; r < num_rows; r++) {
+        const struct row *row = grid.rows[(grid.offset + r) & (num_rows - 1)];
+        if (row == NULL || row->packed == NULL)
+            continue;
+
+        xassert(r >= screen_rows);
+        xassert(num_rows - r > 2 * screen_rows);
+        packed++;
+    }
+
+    xassert(packed > 0);
+    xassert(packed == grid.compressed.rows);
+
+    /* Verify all lines are there, in order */
+    const int start = grid_sb_start_ignore_uninitialized(&grid, screen_rows);
+    int line = 0;
+    int col = 0;
+
+    for (int r = 0; r < num_rows; r++) {
+        const struct row *row =
+            grid_row_abs(&grid, (start + r) & (num_rows - 1));
+        if (row == NULL)
+            break;
+
+        const int len = 1 + line % 150;
+        for (int c = 0; c < grid.num_cols && col < len; c++, col++)
+            xassert(row->cells[c].wc == U'a' + (line + col) % 26);
+
+        if (row->linebreak) {
+            xassert(col == len);
+            line++;
+            col = 0;
+        }
+    }
+
+    xassert(line == line_count);
+    xassert(grid.compressed.rows == 0);
+
+    grid_free(&grid);
 }
@@ -4,23 +4,87 @@
 #include "debug.h"
 #include "terminal.h"
 
+/*
+ * Snapshots share their rows with the original grid. The row
+ * accessors below copy a shared row before returning it, meaning
+ * rows must be looked up (again) before being modified.
+ */
 struct grid *grid_snapshot(const struct grid *grid);
+struct row *grid_row_unshare(struct grid *grid, int abs_row_no);
 void grid_free(struct grid *grid);
 
 void grid_swap_row(struct grid *grid, int row_a, int row_b);
+/*
+ * Row pool; allocates the grid's cell arrays from large slabs, and
+ * recycles them. Each grid has its own pool (see grid.c).
+ */
+struct row_pool *row_pool_new(int cols);
+
+/* Grid is done with the pool; it's destroyed when its last row is freed */
+void row_pool_release(struct row_pool *pool);
+
+/* Unmaps all unused slabs */
+void row_pool_trim(struct row_pool *pool);
+
+/* 'pool' may be NULL, in which case the cells are malloc:ed */
+struct row *grid_row_alloc_from(
+    struct row_pool *pool, int cols, bool initialize);
 struct row *grid_row_alloc(int cols, bool initialize);
 void grid_row_free(struct row *row);
 
+/*
+ * Compressed scrollback rows. A compressed row has its cells
+ * replaced by a compact representation; row->cells is NULL until
+ * the row is decompressed again. Use grid_row_in_view(), or
+ * grid_row_abs(), to access rows that may be compressed.
+ */
+bool grid_row_compress(struct grid *grid, struct row *row);
+void grid_row_decompress(struct grid *grid, struct row *row);
+
+/* Drops the compressed data, leaving the row with uninitialized cells */
+void grid_row_discard_compressed(struct grid *grid, struct row *row);
+
+/* Compresses scrollback rows 'first' - 'last' rows above the screen */
+void grid_compress_scrollback(
+    struct grid *grid, int screen_rows, int first, int last);
+
 void grid_resize_without_reflow(
     struct grid *grid, int new_rows, int new_cols,
     int old_screen_rows, int new_screen_rows);
 
+/*
+ * 'compression_screens' is tweak.scrollback-compression-screens; the
+ * reflowed rows are compressed the way compress_scrollback() would
+ * have (0 to leave them uncompressed).
+ */
 void grid_resize_and_reflow(
-    struct grid *grid, const struct terminal *term, int new_rows, int new_cols,
-    int old_screen_rows, int new_screen_rows,
+    struct grid *grid, struct terminal *term, int new_rows, int new_cols,
+    int old_screen_rows, int new_screen_rows, uint32_t compression_screens,
     size_t tracking_points_count,
     struct coord *const _tracking_points[static tracking_points_count]);
 
+/*
+ * grid_resize_and_reflow() may defer reflowing the older part of the
+ * scrollback. grid_reflow_step() reflows (at least) 'max_rows' of the
+ * remaining old rows, and inserts them at the top of the
+ * scrollback. Returns true if there are more rows to reflow.
+ * 'sixels_mapped' is set if sixels were added to the grid.
+ */
+static inline bool
+grid_reflow_pending(const struct grid *grid)
+{
+    return grid->reflow != NULL;
+}
+
+bool grid_reflow_step(
+    struct grid *grid, struct terminal *term, int screen_rows,
+    uint32_t compression_screens, int max_rows, bool *sixels_mapped);
+void grid_reflow_discard(struct grid *grid);
+
+/* Marks the composed characters referenced by the grid, see composed_sweep() */
+void grid_composed_mark(
+    const struct grid *grid, const struct composed_table *composed);
+
 /* Convert row numbers between scrollback-relative and absolute coordinates */
 int grid_row_abs_to_sb(const struct grid *grid, int screen_rows, int abs_row);
 int grid_row_sb_to_abs(const struct grid *grid, int screen_rows, int sb_rel_row);
@@ -52,11 +116,14 @@ _grid_row_maybe_alloc(struct grid *grid, int row_no, bool alloc_if_null)
     struct row *row = grid->rows[real_row];
 
     if (row == NULL && alloc_if_null) {
-        row = grid_row_alloc(grid->num_cols, false);
+        row = grid_row_alloc_from(grid->pool, grid->num_cols, false);
         grid->rows[real_row] = row;
     }
 
     xassert(row != NULL);
+
+    if (unlikely(row->shares > 0))
+        row = grid_row_unshare(grid, real_row);
     return row;
 }
 
@@ -81,11 +148,30 @@ grid_row_in_view(struct grid *grid, int row_no)
     struct row *row = grid->rows[real_row];
 
     xassert(row != NULL);
+
+    if (unlikely(row->shares > 0))
+        row = grid_row_unshare(grid, real_row);
+    if (unlikely(row->packed != NULL))
+        grid_row_decompress(grid, row);
+    return row;
+}
+
+/* Row at absolute row number 'abs_row_no' (NULL if unallocated),
+ * decompressed if necessary */
+static inline struct row *
+grid_row_abs(struct grid *grid, int abs_row_no)
+{
+    struct row *row = grid->rows[abs_row_no];
+
+    if (unlikely(row != NULL && row->shares > 0))
+        row = grid_row_unshare(grid, abs_row_no);
+    if (unlikely(row != NULL && row->packed != NULL))
+        grid_row_decompress(grid, row);
     return row;
 }
 
 void grid_row_uri_range_put(
-    struct row *row, int col, const char *uri, uint64_t id);
+    struct row *row, int col, struct osc8_uri *uri, uint64_t id);
 void grid_row_uri_range_erase(struct row *row, int start, int end);
 
 void grid_row_underline_range_put(
@@ -95,7 +181,7 @@ void grid_row_underline_range_erase(struct row *row, int start, int end);
 static inline void
 grid_row_uri_range_destroy(struct row_range *range)
 {
-    free(range->uri.uri);
+    osc8_uri_unref(range->uri.uri);
 }
 
 static inline void
@@ -10,6 +10,7 @@
 #define LOG_ENABLE_DBG 0
 #include "log.h"
 #include "char32.h"
+#include "grid.h"
 #include "render.h"
 #include "search.h"
 #include "terminal.h"
@@ -45,8 +46,9 @@ ime_reset_preedit(struct seat *seat)
         return;
 
     free(seat->ime.preedit.text);
-    free(seat->ime.preedit.cells);
+    grid_row_free(seat->ime.preedit.row);
     seat->ime.preedit.text = NULL;
+    seat->ime.preedit.row = NULL;
     seat->ime.preedit.cells = NULL;
     seat->ime.preedit.count = 0;
 }
@@ -238,8 +240,8 @@ done(void *data, struct zwp_text_input_v3 *zwp_text_input_v3,
     }
 
     /* Allocate cells */
-    seat->ime.preedit.cells = xmalloc(
-        cell_count * sizeof(seat->ime.preedit.cells[0]));
+    seat->ime.preedit.row = grid_row_alloc(cell_count, false);
+    seat->ime.preedit.cells = seat->ime.preedit.row->cells;
     seat->ime.preedit.count = cell_count;
 
     /* Populate cells */
@@ -249,12 +251,14 @@ done(void *data, struct zwp_text_input_v3 *zwp_text_input_v3,
         int width = widths[i];
 
         cell->wc = seat->ime.preedit.text[i];
-        cell->attrs = (struct attributes){.clean = 0};
+        cell_set_attrs(seat->ime.preedit.row, cell,
+                       (struct attributes){.clean = 0});
 
         for (int j = 1; j < width; j++) {
             cell = &seat->ime.preedit.cells[cell_idx + j];
             cell->wc = CELL_SPACER + width - j;
-            cell->attrs = (struct attributes){.clean = 1};
+            cell_set_attrs(seat->ime.preedit.row, cell,
+                           (struct attributes){.clean = 1});
         }
 
         cell_idx += width;
@@ -359,8 +363,12 @@ done(void *data, struct zwp_text_input_v3 *zwp_text_input_v3,
 
     for (size_t i = 0, cell_idx = 0; i < wchars; cell_idx += widths[i], i++) {
         if (hidden || start == end || cell_idx < start || cell_idx >= end) {
+            struct row *row = seat->ime.preedit.row;
             struct cell *cell = &seat->ime.preedit.cells[cell_idx];
-            cell->attrs.underline = true;
+
+            struct attributes attrs = cell_get_attrs(row, cell);
+            attrs.underline = true;
+            cell_set_attrs(row, cell, attrs);
         }
     }
 
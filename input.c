@@ -257,6 +257,7 @@ execute_binding(struct seat *seat, struct terminal *term,
         bool success;
         switch (action) {
         case BIND_ACTION_PIPE_SCROLLBACK:
+            term_reflow_complete(term);
             success = term_scrollback_to_text(term, &text, &len);
             break;
 
@@ -364,6 +365,8 @@ execute_binding(struct seat *seat, struct terminal *term,
         if (term->grid != &term->normal)
             return false;
 
+        term_reflow_complete(term);
+
         struct grid *grid = term->grid;
         const int sb_start =
             grid_sb_start_ignore_uninitialized(grid, term->rows);
@@ -526,6 +526,7 @@ main(int argc, char *const *argv)
     struct key_binding_manager *key_binding_manager = NULL;
     struct wayland *wayl = NULL;
     struct renderer *renderer = NULL;
+    struct render_pool *render_pool = NULL;
     struct terminal *term = NULL;
     struct server *server = NULL;
     struct shutdown_context shutdown_ctx = {.term = &term, .exit_code = foot_exit_failure};
@@ -589,8 +590,16 @@ main(int argc, char *const *argv)
     if ((renderer = render_init(fdm, wayl)) == NULL)
         goto out;
 
+    /* Shared by all terminals */
+    if (conf.render_worker_count > 0 &&
+        (render_pool = render_pool_init(conf.render_worker_count)) == NULL)
+    {
+        goto out;
+    }
+
     if (!as_server && (term = term_init(
-                           &conf, fdm, reaper, wayl, "foot", cwd, token, pty_path,
+                           &conf, fdm, reaper, wayl, render_pool, "foot", cwd,
+                           token, pty_path,
                            argc, argv, NULL,
                            &term_shutdown_cb, &shutdown_ctx)) == NULL) {
         goto out;
@@ -598,7 +607,7 @@ main(int argc, char *const *argv)
     free(_cwd);
     _cwd = NULL;
 
-    if (as_server && (server = server_init(&conf, fdm, reaper, wayl)) == NULL)
+    if (as_server && (server = server_init(&conf, fdm, reaper, wayl, render_pool)) == NULL)
         goto out;
 
     volatile sig_atomic_t aborted = false;
@@ -639,6 +648,7 @@ out:
     term_destroy(term);
 
     shm_fini();
+    render_pool_destroy(render_pool);
     render_destroy(renderer);
     wayl_destroy(wayl);
     key_binding_manager_destroy(key_binding_manager);
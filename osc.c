@@ -1239,7 +1239,7 @@ kitty_text_size(struct terminal *term, char *string)
     uint32_t key = composed_key_from_chars(wchars, len);
 
     const struct composed *composed = composed_lookup_without_collision(
-        term->composed, &key, wchars, len - 1, wchars[len - 1], forced_width);
+        &term->composed, &key, wchars, len - 1, wchars[len - 1], forced_width);
 
     if (composed == NULL) {
         struct composed *new_cc = xmalloc(sizeof(*new_cc));
@@ -1249,8 +1249,7 @@ kitty_text_size(struct terminal *term, char *string)
         new_cc->width = width;
         new_cc->forced_width = forced_width;
 
-        term->composed_count++;
-        composed_insert(&term->composed, new_cc);
+        term_composed_insert(term, new_cc);
         composed = new_cc;
     } else if (composed->width == width) {
         free(wchars);
@@ -1357,6 +1356,7 @@ osc_dispatch(struct terminal *term)
                         idx, term->colors.table[idx], color);
 
                 term->colors.table[idx] = color;
+                term_render_state_changed(term);
                 term_damage_color(term, COLOR_BASE256, idx);
             }
         }
@@ -1447,6 +1447,8 @@ osc_dispatch(struct terminal *term)
                               "selection foreground",
                 color);
 
+        term_render_state_changed(term);
+
         switch (param) {
         case 10:
             term->colors.fg = color;
@@ -1539,6 +1541,8 @@ osc_dispatch(struct terminal *term)
             }
 
         }
+
+        term_render_state_changed(term);
         break;
     }
 
@@ -1548,6 +1552,7 @@ osc_dispatch(struct terminal *term)
     case 110: /* Reset default text foreground color */
         LOG_DBG("resetting foreground color");
         term->colors.fg = term->conf->colors.fg;
+        term_render_state_changed(term);
         term_damage_color(term, COLOR_DEFAULT, 0);
         break;
 
@@ -1557,6 +1562,7 @@ osc_dispatch(struct terminal *term)
 
         term->colors.bg = term->conf->colors.bg;
         term->colors.alpha = term->conf->colors.alpha;
+        term_render_state_changed(term);
 
         if (alpha_changed) {
             wayl_win_alpha_changed(term->window);
@@ -1572,6 +1578,7 @@ osc_dispatch(struct terminal *term)
         LOG_DBG("resetting cursor color");
         term->colors.cursor_fg = term->conf->cursor.color.text;
         term->colors.cursor_bg = term->conf->cursor.color.cursor;
+        term_render_state_changed(term);
         term_damage_cursor(term);
         break;
 
@@ -1579,12 +1586,14 @@ osc_dispatch(struct terminal *term)
         LOG_DBG("resetting selection background color");
         term->colors.selection_bg = term->conf->colors.selection_bg;
         term->colors.use_custom_selection = term->conf->colors.use_custom.selection;
+        term_render_state_changed(term);
         break;
 
     case 119:
         LOG_DBG("resetting selection foreground color");
         term->colors.selection_fg = term->conf->colors.selection_fg;
         term->colors.use_custom_selection = term->conf->colors.use_custom.selection;
+        term_render_state_changed(term);
         break;
 
     case 133:
@@ -0,0 +1,175 @@
+#include "osc8-uri.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE "osc8-uri"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "debug.h"
+#include "macros.h"
+#include "util.h"
+#include "xmalloc.h"
+#include "xsnprintf.h"
+
+/* URIs, before the table is swept for the first time */
+#define OSC8_URI_GC_MIN 256
+
+static uint32_t
+uri_hash(const char *uri, size_t *len)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    const char *p = uri;
+
+    for (; *p != '\0'; p++)
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+
+    *len = p - uri;
+    return hash;
+}
+
+static void
+table_grow(struct osc8_uri_table *table)
+{
+    const size_t new_size = table->size > 0 ? table->size * 2 : 64;
+    struct osc8_uri **buckets = xcalloc(new_size, sizeof(buckets[0]));
+
+    for (size_t i = 0; i < table->size; i++) {
+        for (struct osc8_uri *uri = table->buckets[i], *next;
+             uri != NULL;
+             uri = next)
+        {
+            next = uri->next;
+
+            struct osc8_uri **bucket = &buckets[uri->hash & (new_size - 1)];
+            uri->next = *bucket;
+            *bucket = uri;
+        }
+    }
+
+    free(table->buckets);
+    table->buckets = buckets;
+    table->size = new_size;
+}
+
+struct osc8_uri *
+osc8_uri_intern(struct osc8_uri_table *table, const char *str)
+{
+    size_t len;
+    const uint32_t hash = uri_hash(str, &len);
+
+    if (likely(table->size > 0)) {
+        for (struct osc8_uri *uri = table->buckets[hash & (table->size - 1)];
+             uri != NULL;
+             uri = uri->next)
+        {
+            if (uri->hash == hash && streq(uri->str, str))
+                return osc8_uri_ref(uri);
+        }
+    }
+
+    if (table->count >= max(table->gc_threshold, OSC8_URI_GC_MIN)) {
+        osc8_uri_table_sweep(table);
+
+        /* Amortize the cost of sweeping the table */
+        table->gc_threshold = 2 * table->count;
+    }
+
+    if (table->count >= table->size)
+        table_grow(table);
+
+    struct osc8_uri *uri = xmalloc(sizeof(*uri) + len + 1);
+    uri->hash = hash;
+    atomic_init(&uri->refcount, 1);
+    memcpy(uri->str, str, len + 1);
+
+    struct osc8_uri **bucket = &table->buckets[hash & (table->size - 1)];
+    uri->next = *bucket;
+    *bucket = uri;
+
+    table->count++;
+    return uri;
+}
+
+size_t
+osc8_uri_table_sweep(struct osc8_uri_table *table)
+{
+    size_t freed = 0;
+
+    for (size_t i = 0; i < table->size; i++) {
+        for (struct osc8_uri **prev = &table->buckets[i], *uri = *prev;
+             uri != NULL;
+             uri = *prev)
+        {
+            if (atomic_load_explicit(&uri->refcount, memory_order_acquire) > 0) {
+                prev = &uri->next;
+                continue;
+            }
+
+            *prev = uri->next;
+            free(uri);
+            freed++;
+        }
+    }
+
+    xassert(freed <= table->count);
+    table->count -= freed;
+
+    LOG_DBG("swept %zu URIs, %zu remaining", freed, table->count);
+    return freed;
+}
+
+void
+osc8_uri_table_free(struct osc8_uri_table *table)
+{
+    for (size_t i = 0; i < table->size; i++) {
+        for (struct osc8_uri *uri = table->buckets[i], *next;
+             uri != NULL;
+             uri = next)
+        {
+            next = uri->next;
+            free(uri);
+        }
+    }
+
+    free(table->buckets);
+    *table = (struct osc8_uri_table){0};
+}
+
+UNITTEST
+{
+    struct osc8_uri_table table = {0};
+
+    struct osc8_uri *a = osc8_uri_intern(&table, "http://foo.bar");
+    struct osc8_uri *b = osc8_uri_intern(&table, "http://foo.bar");
+    struct osc8_uri *c = osc8_uri_intern(&table, "http://baz");
+
+    xassert(a == b);
+    xassert(a != c);
+    xassert(streq(a->str, "http://foo.bar"));
+    xassert(streq(c->str, "http://baz"));
+    xassert(table.count == 2);
+
+    osc8_uri_unref(a);
+    osc8_uri_unref(c);
+    xassert(osc8_uri_table_sweep(&table) == 1);
+    xassert(table.count == 1);
+
+    xassert(osc8_uri_intern(&table, "http://foo.bar") == b);
+    osc8_uri_unref(b);
+    osc8_uri_unref(b);
+    xassert(osc8_uri_table_sweep(&table) == 1);
+    xassert(table.count == 0);
+
+    /* Unreferenced URIs are freed when the table fills up */
+    char str[32];
+    for (int i = 0; i < 10 * OSC8_URI_GC_MIN; i++) {
+        xsnprintf(str, sizeof(str), "http://%d", i);
+        osc8_uri_unref(osc8_uri_intern(&table, str));
+    }
+
+    xassert(table.count <= OSC8_URI_GC_MIN);
+
+    osc8_uri_table_free(&table);
+}
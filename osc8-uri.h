@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "debug.h"
+
+/*
+ * Interned OSC-8 URIs. Each URI is stored once per terminal, and
+ * shared, by reference, by all URI ranges (in all rows and grids)
+ * using it.
+ */
+struct osc8_uri {
+    struct osc8_uri *next;   /* Hash chain */
+    uint32_t hash;
+
+    /* Ranges are copied, and freed, by the reflow jobs on the render
+     * workers */
+    atomic_size_t refcount;
+
+    char str[];
+};
+
+struct osc8_uri_table {
+    struct osc8_uri **buckets;
+    size_t size;              /* Bucket count, a power of two */
+    size_t count;
+    size_t gc_threshold;      /* Count at which to sweep the table */
+};
+
+/* Returns a new reference to the interned copy of 'uri' */
+struct osc8_uri *osc8_uri_intern(struct osc8_uri_table *table, const char *uri);
+
+static inline struct osc8_uri *
+osc8_uri_ref(struct osc8_uri *uri)
+{
+    atomic_fetch_add_explicit(&uri->refcount, 1, memory_order_relaxed);
+    return uri;
+}
+
+/*
+ * Unreferenced URIs aren't freed right away, but the next time the
+ * table is swept (on the main thread, see osc8_uri_intern()). 'uri'
+ * may be NULL.
+ */
+static inline void
+osc8_uri_unref(struct osc8_uri *uri)
+{
+    if (uri == NULL)
+        return;
+
+    const size_t old_count = atomic_fetch_sub_explicit(
+        &uri->refcount, 1, memory_order_release);
+    xassert(old_count > 0);
+    (void)old_count;
+}
+
+/* Frees all unreferenced URIs. Returns the number of freed URIs */
+size_t osc8_uri_table_sweep(struct osc8_uri_table *table);
+
+/* Frees all URIs; nothing may reference them anymore */
+void osc8_uri_table_free(struct osc8_uri_table *table);
@@ -3,6 +3,12 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <locale.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -13,8 +19,11 @@
 
 #include "async.h"
 #include "config.h"
+#include "grid.h"
 #include "key-binding.h"
+#include "misc.h"
 #include "reaper.h"
+#include "render.h"
 #include "sixel.h"
 #include "user-notification.h"
 #include "vt.h"
@@ -25,8 +34,27 @@ static void
 usage(const char *prog_name)
 {
     printf(
-        "Usage: %s stimuli-file1 stimuli-file2 ... stimuli-fileN\n",
-        prog_name);
+        "Usage: %s [OPTIONS...] stimuli-file1 stimuli-file2 ... stimuli-fileN\n"
+        "       %s [OPTIONS...] --reflow=LINES\n"
+        "\n"
+        "Options:\n"
+        "  -p,--per-byte    feed the VT parser one byte at a time (baseline for\n"
+        "                   comparing against the bulk printable-ASCII path)\n"
+        "  -c,--checksum    print a checksum of the grids' contents when done;\n"
+        "                   used to verify two builds parse identically\n"
+        "  -s,--scrollback-compression=SCREENS\n"
+        "                   compress scrollback rows more than SCREENS screens\n"
+        "                   above the screen (tweak.scrollback-compression-screens)\n"
+        "  -P,--page        page through the scrollback, from the bottom to the\n"
+        "                   top, after each stimuli file, and print the time it took\n"
+        "  -r,--reflow=LINES\n"
+        "                   instead of parsing stimuli files, fill the scrollback\n"
+        "                   with LINES lines, and time reflowing it when resizing\n"
+        "                   between 80 and 250 columns\n"
+        "  -j,--threads=N   number of render worker threads used by --reflow\n"
+        "                   (default: 0, i.e. reflow in the main thread)\n"
+        "  -h,--help        show this help and exit\n",
+        prog_name, prog_name);
 }
 
 enum async_write_status
@@ -47,6 +75,12 @@ fdm_del(struct fdm *fdm, int fd)
     return true;
 }
 
+bool
+fdm_del_no_close(struct fdm *fdm, int fd)
+{
+    return true;
+}
+
 bool
 fdm_event_add(struct fdm *fdm, int fd, int events)
 {
@@ -73,6 +107,7 @@ void render_refresh_app_id(struct terminal *term) {}
 void render_refresh_icon(struct terminal *term) {}
 
 void render_overlay(struct terminal *term) {}
+void render_workers_snapshot_free(struct terminal *term) {}
 
 bool
 render_xcursor_is_valid(const struct seat *seat, const char *cursor)
@@ -122,12 +157,65 @@ slave_spawn(
     return 0;
 }
 
-int
-render_worker_thread(void *_ctx)
+uint16_t
+render_pool_count(const struct render_pool *pool)
 {
     return 0;
 }
 
+struct workers_job {
+    void (*run)(void *data, size_t idx);
+    void *data;
+    size_t count;
+    atomic_size_t next;
+};
+
+static int
+workers_job_thread(void *_job)
+{
+    struct workers_job *job = _job;
+
+    for (size_t idx = atomic_fetch_add(&job->next, 1);
+         idx < job->count;
+         idx = atomic_fetch_add(&job->next, 1))
+    {
+        job->run(job->data, idx);
+    }
+
+    return 0;
+}
+
+/* Like the real thing, but with short-lived threads */
+void
+render_workers_run(struct terminal *term, size_t count,
+                   void (*run)(void *data, size_t idx), void *data)
+{
+    const size_t workers = term->render.workers.count;
+
+    if (workers == 0 || count <= 1) {
+        for (size_t i = 0; i < count; i++)
+            run(data, i);
+        return;
+    }
+
+    struct workers_job job = {.run = run, .data = data, .count = count};
+    atomic_init(&job.next, 0);
+
+    thrd_t threads[workers];
+    size_t started = 0;
+
+    for (; started < workers; started++) {
+        if (thrd_create(&threads[started], &workers_job_thread, &job) != thrd_success)
+            break;
+    }
+
+    /* Whatever is left (all of it, if no thread could be created) */
+    workers_job_thread(&job);
+
+    for (size_t i = 0; i < started; i++)
+        thrd_join(threads[i], NULL);
+}
+
 bool
 render_do_linear_blending(const struct terminal *term)
 {
@@ -251,14 +339,278 @@ key_binding_unref(struct key_binding_manager *mgr, const struct config *conf)
 {
 }
 
+static uint64_t
+fnv1a(uint64_t hash, uint64_t value)
+{
+    hash ^= value;
+    return hash * 0x100000001b3ull;
+}
+
+/*
+ * Checksum of the grid's contents: characters, attributes, line
+ * breaks and the cursor. Render state (e.g. dirty and clean bits) is
+ * excluded, as is anything stored in rows' 'extra' data.
+ */
+static uint64_t
+grid_checksum(const struct terminal *term, struct grid *grid)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (int r = 0; r < grid->num_rows; r++) {
+        const struct row *row = grid_row_abs(grid, r);
+
+        if (row == NULL) {
+            hash = fnv1a(hash, UINT64_MAX);
+            continue;
+        }
+
+        hash = fnv1a(hash, row->linebreak);
+
+        for (int c = 0; c < grid->num_cols; c++) {
+            const struct cell *cell = &row->cells[c];
+            const struct attributes a = cell_get_attrs(row, cell);
+            const char32_t wc = cell->wc;
+
+            if (wc >= CELL_COMB_CHARS_LO && wc <= CELL_COMB_CHARS_HI) {
+                const struct composed *composed = composed_lookup(
+                    &term->composed, wc - CELL_COMB_CHARS_LO);
+
+                for (size_t i = 0; composed != NULL && i < composed->count; i++)
+                    hash = fnv1a(hash, composed->chars[i]);
+            } else
+                hash = fnv1a(hash, wc);
+
+            hash = fnv1a(
+                hash,
+                (uint64_t)a.fg << 40 |
+                (uint64_t)a.bg << 16 |
+                a.fg_src << 14 |
+                a.bg_src << 12 |
+                a.url << 9 |
+                a.confined << 8 |
+                a.bold << 7 |
+                a.dim << 6 |
+                a.italic << 5 |
+                a.underline << 4 |
+                a.strikethrough << 3 |
+                a.blink << 2 |
+                a.conceal << 1 |
+                a.reverse << 0);
+        }
+    }
+
+    hash = fnv1a(hash, grid->offset);
+    hash = fnv1a(hash, grid->view);
+    hash = fnv1a(hash, grid->cursor.point.row);
+    hash = fnv1a(hash, grid->cursor.point.col);
+    hash = fnv1a(hash, grid->cursor.lcf);
+    return hash;
+}
+
+/*
+ * Scroll the view from the bottom of the scrollback to the top, one
+ * screen at a time, touching all rows in view (like the renderer
+ * does). Returns the number of pages.
+ */
+static int
+page_scrollback(struct terminal *term)
+{
+    struct grid *grid = term->grid;
+    int pages = 0;
+
+    for (int dist = 0; dist <= grid->num_rows - term->rows; dist += term->rows) {
+        const int view = (grid->offset - dist) & (grid->num_rows - 1);
+        if (grid->rows[view] == NULL)
+            break;
+
+        grid->view = view;
+        for (int r = 0; r < term->rows; r++) {
+            const struct row *row = grid_row_in_view(grid, r);
+            (void)row;
+        }
+
+        pages++;
+    }
+
+    grid->view = grid->offset;
+    return pages;
+}
+
+static double
+elapsed_ms(const struct timespec *start)
+{
+    struct timespec end, elapsed;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    timespec_sub(&end, start, &elapsed);
+    return elapsed.tv_sec * 1e3 + elapsed.tv_nsec / 1e6;
+}
+
+/*
+ * Fill the scrollback with 'lines' lines, of varying length, and time
+ * reflowing it, back and forth between 80 and 250 columns. The
+ * deferred part of the scrollback (see grid_reflow_step()) is
+ * reflowed right away, and included in the total time.
+ */
+static bool
+reflow_benchmark(int lines, int threads, bool checksum)
+{
+    const int screen_rows = 67;
+    const int max_line_len = 400;
+    int cols = 80;
+
+    /* Room for all lines, at the narrowest width */
+    int num_rows = 1;
+    while (num_rows < (lines * ((max_line_len + cols - 1) / cols) + screen_rows))
+        num_rows *= 2;
+
+    static struct terminal term;
+    term.render.workers.count = threads;
+
+    struct grid grid = {
+        .num_rows = num_rows,
+        .num_cols = cols,
+        .rows = calloc(num_rows, sizeof(grid.rows[0])),
+    };
+
+    if (grid.rows == NULL) {
+        fprintf(stderr, "error: failed to allocate grid\n");
+        return false;
+    }
+
+    int r = 0;
+    for (int i = 0; i < lines + screen_rows; i++) {
+        /* Mostly short lines, some long ones, and the screen empty */
+        const int len = i >= lines ? 0
+            : i % 17 == 0 ? (i * 7919) % max_line_len
+            : (i * 31) % 100;
+
+        int c = 0;
+        do {
+            struct row *row = grid_row_alloc(cols, true);
+            grid.rows[r++] = row;
+
+            for (int col = 0; col < cols && c < len; col++, c++)
+                row->cells[col].wc = U'a' + (i + c) % 26;
+
+            row->linebreak = c >= len;
+        } while (c < len);
+    }
+
+    grid.offset = grid.view = r - screen_rows;
+    grid.cur_row = grid.rows[grid.offset];
+
+    printf("Reflowing %d lines (%d rows, %d worker threads)\n",
+           lines, r, threads);
+
+    for (int i = 0; i < 4; i++) {
+        const int new_cols = cols == 80 ? 250 : 80;
+        struct coord *no_tracking_points[1];
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        grid_resize_and_reflow(
+            &grid, &term, num_rows, new_cols, screen_rows, screen_rows, 0,
+            0, no_tracking_points);
+        const double sync_ms = elapsed_ms(&start);
+
+        bool sixels_mapped;
+        while (grid_reflow_step(&grid, &term, screen_rows, 0, INT_MAX, &sixels_mapped))
+            ;
+        const double total_ms = elapsed_ms(&start);
+
+        printf("  %3d -> %3d columns: %.1fms (%.1fms before the resize returned)\n",
+               cols, new_cols, total_ms, sync_ms);
+
+        if (checksum) {
+            printf("  checksum: %016llx\n",
+                   (unsigned long long)grid_checksum(&term, &grid));
+        }
+
+        cols = new_cols;
+    }
+
+    grid_free(&grid);
+    return true;
+}
+
 int
 main(int argc, const char *const *argv)
 {
-    if (argc < 2) {
+    static const struct option longopts[] = {
+        {"per-byte", no_argument, NULL, 'p'},
+        {"checksum", no_argument, NULL, 'c'},
+        {"scrollback-compression", required_argument, NULL, 's'},
+        {"page",     no_argument, NULL, 'P'},
+        {"reflow",   required_argument, NULL, 'r'},
+        {"threads",  required_argument, NULL, 'j'},
+        {"help",     no_argument, NULL, 'h'},
+        {NULL,       no_argument, NULL, 0},
+    };
+
+    bool per_byte = false;
+    bool checksum = false;
+    bool page = false;
+    uint32_t compression_screens = 0;
+    int reflow_lines = 0;
+    int threads = 0;
+
+    while (true) {
+        int c = getopt_long(argc, (char *const *)argv, "+pcs:Pr:j:h", longopts, NULL);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'p':
+            per_byte = true;
+            break;
+
+        case 'c':
+            checksum = true;
+            break;
+
+        case 's':
+            compression_screens = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'P':
+            page = true;
+            break;
+
+        case 'r':
+            reflow_lines = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'j':
+            threads = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'h':
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+
+        case '?':
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (reflow_lines > 0) {
+        return reflow_benchmark(reflow_lines, threads, checksum)
+            ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (optind >= argc) {
         usage(argv[0]);
         return EXIT_FAILURE;
     }
 
+    /* Without a UTF-8 locale, wcwidth() fails for all non-ASCII */
+    if (setlocale(LC_CTYPE, "C.UTF-8") == NULL &&
+        setlocale(LC_CTYPE, "en_US.UTF-8") == NULL)
+    {
+        fprintf(stderr, "warning: failed to set a UTF-8 locale\n");
+    }
+
     const int row_count = 67;
     const int col_count = 135;
     const int grid_row_count = 16384;
@@ -279,14 +631,17 @@ main(int argc, const char *const *argv)
     for (int i = 0; i < grid_row_count; i++) {
         normal_rows[i] = calloc(1, sizeof(*normal_rows[i]));
         normal_rows[i]->cells = calloc(col_count, sizeof(normal_rows[i]->cells[0]));
+        row_attrs_init(normal_rows[i], col_count);
         alt_rows[i] = calloc(1, sizeof(*alt_rows[i]));
         alt_rows[i]->cells = calloc(col_count, sizeof(alt_rows[i]->cells[0]));
+        row_attrs_init(alt_rows[i], col_count);
     }
 
     struct config conf = {
         .tweak = {
             .delayed_render_lower_ns = 500000,         /* 0.5ms */
             .delayed_render_upper_ns = 16666666 / 2,   /* half a frame period (60Hz) */
+            .scrollback_compression_screens = compression_screens,
         },
     };
 
@@ -341,10 +696,11 @@ main(int argc, const char *const *argv)
     };
 
     tll_push_back(wayl.terms, &term);
+    term_update_ascii_printer(&term);
 
     int ret = EXIT_FAILURE;
 
-    for (int i = 1; i < argc; i++) {
+    for (int i = optind; i < argc; i++) {
         struct stat st;
         if (stat(argv[i], &st) < 0) {
             fprintf(stderr, "error: %s: failed to stat: %s\n",
@@ -359,7 +715,7 @@ main(int argc, const char *const *argv)
             goto out;
         }
 
-        int fd = open(argv[1], O_RDONLY);
+        int fd = open(argv[i], O_RDONLY);
         if (fd < 0) {
             fprintf(stderr, "error: %s: failed to open: %s\n",
                     argv[i], strerror(errno));
@@ -396,22 +752,67 @@ main(int argc, const char *const *argv)
             goto out;
         }
 
-        free(data);
-
         term.ptmx = mem_fd;
         lseek(mem_fd, 0, SEEK_SET);
 
-        printf("Feeding VT parser with %s (%lld bytes)\n",
-               argv[i], (long long)st.st_size);
-
-        while (lseek(mem_fd, 0, SEEK_CUR) < st.st_size) {
-            if (!fdm_ptmx(NULL, -1, EPOLLIN, &term)) {
-                fprintf(stderr, "error: fdm_ptmx() failed\n");
-                close(mem_fd);
-                goto out;
+        printf("Feeding VT parser with %s (%lld bytes%s)\n",
+               argv[i], (long long)st.st_size,
+               per_byte ? ", one byte at a time" : "");
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if (per_byte) {
+            for (off_t j = 0; j < st.st_size; j++)
+                vt_from_slave(&term, &data[j], 1);
+        } else {
+            while (lseek(mem_fd, 0, SEEK_CUR) < st.st_size) {
+                if (!fdm_ptmx(NULL, -1, EPOLLIN, &term)) {
+                    fprintf(stderr, "error: fdm_ptmx() failed\n");
+                    free(data);
+                    close(mem_fd);
+                    goto out;
+                }
             }
         }
+
+        free(data);
         close(mem_fd);
+
+        struct timespec end, elapsed;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        timespec_sub(&end, &start, &elapsed);
+
+        const double secs = elapsed.tv_sec + elapsed.tv_nsec / 1e9;
+        printf("  %.3fs, %.1f MB/s\n",
+               secs, secs > 0. ? st.st_size / secs / 1e6 : 0.);
+
+        if (compression_screens > 0) {
+            const struct grid *grid = term.grid;
+            printf("  %zu compressed rows, %zu bytes saved\n",
+                   grid->compressed.rows,
+                   grid->compressed.rows * grid->num_cols * sizeof(struct cell) -
+                   grid->compressed.bytes);
+        }
+
+        if (page) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            const int pages = page_scrollback(&term);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            timespec_sub(&end, &start, &elapsed);
+
+            const double page_secs = elapsed.tv_sec + elapsed.tv_nsec / 1e9;
+            printf("  paged through %d screens in %.3fms (%.1f µs/screen)\n",
+                   pages, page_secs * 1e3,
+                   pages > 0 ? page_secs * 1e6 / pages : 0.);
+        }
+    }
+
+    if (checksum) {
+        printf("normal grid checksum: %016llx\n",
+               (unsigned long long)grid_checksum(&term, &term.normal));
+        printf("alt grid checksum:    %016llx\n",
+               (unsigned long long)grid_checksum(&term, &term.alt));
     }
 
     ret = EXIT_SUCCESS;
@@ -420,12 +821,17 @@ out:
     tll_free(wayl.terms);
 
     for (int i = 0; i < grid_row_count; i++) {
-        if (normal_rows[i] != NULL)
+        if (normal_rows[i] != NULL) {
             free(normal_rows[i]->cells);
+            free(normal_rows[i]->packed);
+            row_attrs_free(normal_rows[i]);
+        }
         free(normal_rows[i]);
 
-        if (alt_rows[i] != NULL)
+        if (alt_rows[i] != NULL) {
             free(alt_rows[i]->cells);
+            row_attrs_free(alt_rows[i]);
+        }
         free(alt_rows[i]);
     }
 
@@ -0,0 +1,292 @@
+#include "ptmx-reader.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "macros.h"
+#if HAS_INCLUDE(<pthread_np.h>)
+ #include <pthread_np.h>
+ #define pthread_setname_np(thread, name) (pthread_set_name_np(thread, name), 0)
+#elif defined(__NetBSD__)
+ #define pthread_setname_np(thread, name) pthread_setname_np(thread, "%s", (void *)name)
+#endif
+
+#define LOG_MODULE "ptmx-reader"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "debug.h"
+#include "util.h"
+
+#define RING_SIZE_MIN (64 * 1024)
+#define RING_SIZE_MAX (1024 * 1024 * 1024)
+
+struct ptmx_reader {
+    int ptmx;
+    int notify_fd;   /* Reader -> main: data has been added to the ring */
+    int wake_fd;     /* Main -> reader: space has been freed, or stop */
+
+    uint8_t *ring;
+    size_t size;     /* Power of two */
+
+    thrd_t thread;
+    bool thread_running;
+
+    /* Free-running indices; head is only written by the reader
+     * thread, tail only by the main thread */
+    alignas(64) atomic_size_t head;
+    alignas(64) atomic_size_t tail;
+
+    atomic_bool notified;
+    atomic_bool waiting_for_space;
+    atomic_bool stop;
+
+    /* Back-pressure diagnostics, only written by the reader thread */
+    size_t high_water;
+    size_t full_count;
+};
+
+static int
+reader_thread(void *data)
+{
+    struct ptmx_reader *reader = data;
+
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+
+    if (pthread_setname_np(pthread_self(), "foot:ptmx") < 0)
+        LOG_ERRNO("failed to set process title");
+
+    while (!atomic_load(&reader->stop)) {
+        const size_t head = atomic_load_explicit(
+            &reader->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&reader->tail, memory_order_acquire);
+
+        if (head - tail == reader->size) {
+            /*
+             * Ring is full. Ask the main thread to wake us up when it
+             * has consumed something, then re-check, since it may
+             * have done so before it could see our request.
+             */
+            atomic_store(&reader->waiting_for_space, true);
+            tail = atomic_load(&reader->tail);
+
+            if (head - tail == reader->size)
+                reader->full_count++;
+        }
+
+        const size_t space = reader->size - (head - tail);
+
+        struct pollfd fds[] = {
+            {.fd = space > 0 ? reader->ptmx : -1, .events = POLLIN},
+            {.fd = reader->wake_fd, .events = POLLIN},
+        };
+
+        if (poll(fds, ALEN(fds), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            LOG_ERRNO("failed to poll pseudo terminal");
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t value;
+            if (read(reader->wake_fd, &value, sizeof(value)) < 0 &&
+                errno != EAGAIN)
+            {
+                LOG_ERRNO("failed to read wake event FD");
+            }
+        }
+
+        if (space == 0 || !(fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
+
+        const size_t idx = head & (reader->size - 1);
+        const size_t contiguous = min(space, reader->size - idx);
+
+        ssize_t count = read(reader->ptmx, &reader->ring[idx], contiguous);
+
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+
+            /* EIO: PTY was closed - main thread will see EPOLLHUP */
+            if (errno != EIO)
+                LOG_ERRNO("failed to read from pseudo terminal");
+            break;
+        } else if (count == 0) {
+            /* Reached end-of-file */
+            break;
+        }
+
+        atomic_store(&reader->head, head + count);
+
+        tail = atomic_load_explicit(&reader->tail, memory_order_relaxed);
+        reader->high_water = max(reader->high_water, head + count - tail);
+
+        if (!atomic_exchange(&reader->notified, true)) {
+            if (write(reader->notify_fd, &(uint64_t){1}, sizeof(uint64_t)) < 0)
+                LOG_ERRNO("failed to write notify event FD");
+        }
+    }
+
+    return 0;
+}
+
+struct ptmx_reader *
+ptmx_reader_init(int ptmx, size_t ring_size)
+{
+    ring_size = max(ring_size, RING_SIZE_MIN);
+    ring_size = min(ring_size, RING_SIZE_MAX);
+
+    size_t size = RING_SIZE_MIN;
+    while (size < ring_size)
+        size *= 2;
+
+    struct ptmx_reader *reader = calloc(1, sizeof(*reader));
+    uint8_t *ring = malloc(size);
+    int notify_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    int wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (reader == NULL || ring == NULL) {
+        LOG_ERRNO("failed to allocate %zu bytes PTY ring buffer", size);
+        goto err;
+    }
+
+    if (notify_fd < 0 || wake_fd < 0) {
+        LOG_ERRNO("failed to create PTY reader event FDs");
+        goto err;
+    }
+
+    reader->ptmx = ptmx;
+    reader->notify_fd = notify_fd;
+    reader->wake_fd = wake_fd;
+    reader->ring = ring;
+    reader->size = size;
+    atomic_init(&reader->head, 0);
+    atomic_init(&reader->tail, 0);
+    atomic_init(&reader->notified, false);
+    atomic_init(&reader->waiting_for_space, false);
+    atomic_init(&reader->stop, false);
+
+    int ret = thrd_create(&reader->thread, &reader_thread, reader);
+    if (ret != thrd_success) {
+        LOG_ERR("failed to create PTY reader thread: %s (%d)",
+                thrd_err_as_string(ret), ret);
+        goto err;
+    }
+
+    reader->thread_running = true;
+    LOG_DBG("PTY reader: %zu bytes ring buffer", size);
+    return reader;
+
+err:
+    if (notify_fd >= 0)
+        close(notify_fd);
+    if (wake_fd >= 0)
+        close(wake_fd);
+    free(ring);
+    free(reader);
+    return NULL;
+}
+
+void
+ptmx_reader_stop(struct ptmx_reader *reader)
+{
+    if (!reader->thread_running)
+        return;
+
+    atomic_store(&reader->stop, true);
+    if (write(reader->wake_fd, &(uint64_t){1}, sizeof(uint64_t)) < 0)
+        LOG_ERRNO("failed to write wake event FD");
+
+    thrd_join(reader->thread, NULL);
+    reader->thread_running = false;
+
+    LOG_INFO("PTY ring buffer: high-water mark: %zu/%zu bytes, "
+             "full %zu time(s)",
+             reader->high_water, reader->size, reader->full_count);
+}
+
+void
+ptmx_reader_destroy(struct ptmx_reader *reader)
+{
+    if (reader == NULL)
+        return;
+
+    ptmx_reader_stop(reader);
+
+    close(reader->notify_fd);
+    close(reader->wake_fd);
+    free(reader->ring);
+    free(reader);
+}
+
+int
+ptmx_reader_fd(const struct ptmx_reader *reader)
+{
+    return reader->notify_fd;
+}
+
+void
+ptmx_reader_rearm(struct ptmx_reader *reader)
+{
+    uint64_t value;
+    if (read(reader->notify_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+        LOG_ERRNO("failed to read notify event FD");
+
+    atomic_store(&reader->notified, false);
+
+    /* Data we haven't consumed, or that was added after the reader
+     * thread saw 'notified' still being set */
+    if (!ptmx_reader_is_empty(reader) &&
+        !atomic_exchange(&reader->notified, true))
+    {
+        if (write(reader->notify_fd, &(uint64_t){1}, sizeof(uint64_t)) < 0)
+            LOG_ERRNO("failed to write notify event FD");
+    }
+}
+
+size_t
+ptmx_reader_peek(struct ptmx_reader *reader, const uint8_t **data)
+{
+    const size_t head = atomic_load_explicit(
+        &reader->head, memory_order_acquire);
+    const size_t tail = atomic_load_explicit(
+        &reader->tail, memory_order_relaxed);
+
+    const size_t idx = tail & (reader->size - 1);
+    *data = &reader->ring[idx];
+    return min(head - tail, reader->size - idx);
+}
+
+void
+ptmx_reader_consume(struct ptmx_reader *reader, size_t count)
+{
+    const size_t tail = atomic_load_explicit(
+        &reader->tail, memory_order_relaxed);
+
+    xassert(count <= atomic_load(&reader->head) - tail);
+    atomic_store(&reader->tail, tail + count);
+
+    if (atomic_exchange(&reader->waiting_for_space, false)) {
+        if (write(reader->wake_fd, &(uint64_t){1}, sizeof(uint64_t)) < 0)
+            LOG_ERRNO("failed to write wake event FD");
+    }
+}
+
+bool
+ptmx_reader_is_empty(struct ptmx_reader *reader)
+{
+    return atomic_load(&reader->head) == atomic_load_explicit(
+        &reader->tail, memory_order_relaxed);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Threaded PTY reader.
+ *
+ * A dedicated thread drains the ptmx into a single-producer,
+ * single-consumer ring buffer. The main thread is notified through
+ * an event FD (see ptmx_reader_fd()), and consumes the ring with
+ * ptmx_reader_peek() + ptmx_reader_consume(), followed by
+ * ptmx_reader_rearm().
+ *
+ * When the ring is full, the reader thread stops reading from the
+ * ptmx until the main thread has consumed some of it, i.e. the
+ * client application is throttled by the kernel's PTY buffer.
+ *
+ * The reader thread does *not* handle hangups; it simply stops
+ * reading when the ptmx returns EOF, or EIO. The caller is expected
+ * to call ptmx_reader_stop() when it sees EPOLLHUP on the ptmx, drain
+ * whatever is left in the ring, and then read any remaining data
+ * from the ptmx directly.
+ */
+
+struct ptmx_reader;
+
+struct ptmx_reader *ptmx_reader_init(int ptmx, size_t ring_size);
+void ptmx_reader_destroy(struct ptmx_reader *reader);
+
+/* Stops, and joins, the reader thread. Data already in the ring is
+ * left in place */
+void ptmx_reader_stop(struct ptmx_reader *reader);
+
+/* Readable (EPOLLIN) whenever new data has been added to the ring */
+int ptmx_reader_fd(const struct ptmx_reader *reader);
+
+/* Acknowledges a notification on ptmx_reader_fd(). Call when done
+ * consuming; if the ring isn't empty, the FD is immediately made
+ * readable again */
+void ptmx_reader_rearm(struct ptmx_reader *reader);
+
+/* Returns the number of contiguous bytes available, starting at *data */
+size_t ptmx_reader_peek(struct ptmx_reader *reader, const uint8_t **data);
+void ptmx_reader_consume(struct ptmx_reader *reader, size_t count);
+
+bool ptmx_reader_is_empty(struct ptmx_reader *reader);
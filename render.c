@@ -29,6 +29,7 @@
 #define LOG_MODULE "render"
 #define LOG_ENABLE_DBG 0
 #include "log.h"
+#include "blend.h"
 #include "box-drawing.h"
 #include "char32.h"
 #include "config.h"
@@ -281,7 +282,8 @@ color_decrease_luminance(uint32_t color)
 }
 
 static inline uint32_t
-color_dim(const struct terminal *term, uint32_t color)
+color_dim(const struct terminal *term, const struct colors *colors,
+          uint32_t color)
 {
     const struct config *conf = term->conf;
     const uint8_t custom_dim = conf->colors.use_custom.dim;
@@ -293,14 +295,14 @@ color_dim(const struct terminal *term, uint32_t color)
         if (((custom_dim >> i) & 1) == 0)
             continue;
 
-        if (term->colors.table[0 + i] == color) {
+        if (colors->table[0 + i] == color) {
             /* "Regular" color, return the corresponding "dim" */
             return conf->colors.dim[i];
         }
 
-        else if (term->colors.table[8 + i] == color) {
+        else if (colors->table[8 + i] == color) {
             /* "Bright" color, return the corresponding "regular" */
-            return term->colors.table[i];
+            return colors->table[i];
         }
     }
 
@@ -308,7 +310,8 @@ color_dim(const struct terminal *term, uint32_t color)
 }
 
 static inline uint32_t
-color_brighten(const struct terminal *term, uint32_t color)
+color_brighten(const struct terminal *term, const struct colors *colors,
+               uint32_t color)
 {
     /*
      * First try to match the color against the base 8 colors. If we
@@ -316,8 +319,8 @@ color_brighten(const struct terminal *term, uint32_t color)
      */
     if (term->conf->bold_in_bright.palette_based) {
         for (size_t i = 0; i < 8; i++) {
-            if (term->colors.table[i] == color)
-                return term->colors.table[i + 8];
+            if (colors->table[i] == color)
+                return colors->table[i + 8];
         }
         return color;
     }
@@ -588,25 +591,25 @@ draw_strikeout(const struct terminal *term, pixman_image_t *pix,
 }
 
 static void
-cursor_colors_for_cell(const struct terminal *term, const struct cell *cell,
+cursor_colors_for_cell(const struct render_state *state, const struct cell *cell,
                        const pixman_color_t *fg, const pixman_color_t *bg,
                        pixman_color_t *cursor_color, pixman_color_t *text_color,
                        bool gamma_correct)
 {
-    if (term->colors.cursor_bg >> 31)
-        *cursor_color = color_hex_to_pixman(term->colors.cursor_bg, gamma_correct);
+    if (state->colors.cursor_bg >> 31)
+        *cursor_color = color_hex_to_pixman(state->colors.cursor_bg, gamma_correct);
     else
         *cursor_color = *fg;
 
-    if (term->colors.cursor_fg >> 31)
-        *text_color = color_hex_to_pixman(term->colors.cursor_fg, gamma_correct);
+    if (state->colors.cursor_fg >> 31)
+        *text_color = color_hex_to_pixman(state->colors.cursor_fg, gamma_correct);
     else {
         *text_color = *bg;
 
         if (unlikely(text_color->alpha != 0xffff)) {
             /* The *only* color that can have transparency is the
              * default background color */
-            *text_color = color_hex_to_pixman(term->colors.bg, gamma_correct);
+            *text_color = color_hex_to_pixman(state->colors.bg, gamma_correct);
         }
     }
 
@@ -614,8 +617,8 @@ cursor_colors_for_cell(const struct terminal *term, const struct cell *cell,
         text_color->green == cursor_color->green &&
         text_color->blue == cursor_color->blue)
     {
-        *text_color = color_hex_to_pixman(term->colors.bg, gamma_correct);
-        *cursor_color = color_hex_to_pixman(term->colors.fg, gamma_correct);
+        *text_color = color_hex_to_pixman(state->colors.bg, gamma_correct);
+        *cursor_color = color_hex_to_pixman(state->colors.fg, gamma_correct);
     }
 }
 
@@ -624,9 +627,11 @@ draw_cursor(const struct terminal *term, const struct cell *cell,
             const struct fcft_font *font, pixman_image_t *pix, pixman_color_t *fg,
             const pixman_color_t *bg, int x, int y, int cols)
 {
+    const struct render_state *state = &term->render.workers.snapshot.state;
+
     pixman_color_t cursor_color;
     pixman_color_t text_color;
-    cursor_colors_for_cell(term, cell, fg, bg, &cursor_color, &text_color,
+    cursor_colors_for_cell(state, cell, fg, bg, &cursor_color, &text_color,
                            render_do_linear_blending(term));
 
     if (unlikely(!term->kbd_focus)) {
@@ -643,9 +648,9 @@ draw_cursor(const struct terminal *term, const struct cell *cell,
         }
     }
 
-    switch (term->cursor_style) {
+    switch (state->cursor_style) {
     case CURSOR_BLOCK:
-        if (likely(term->cursor_blink.state == CURSOR_BLINK_ON) ||
+        if (likely(state->cursor_blink == CURSOR_BLINK_ON) ||
             !term->kbd_focus)
         {
             *fg = text_color;
@@ -656,7 +661,7 @@ draw_cursor(const struct terminal *term, const struct cell *cell,
         break;
 
     case CURSOR_BEAM:
-        if (likely(term->cursor_blink.state == CURSOR_BLINK_ON ||
+        if (likely(state->cursor_blink == CURSOR_BLINK_ON ||
                    !term->kbd_focus))
         {
             draw_beam_cursor(term, pix, font, &cursor_color, x, y);
@@ -664,7 +669,7 @@ draw_cursor(const struct terminal *term, const struct cell *cell,
         break;
 
     case CURSOR_UNDERLINE:
-        if (likely(term->cursor_blink.state == CURSOR_BLINK_ON ||
+        if (likely(state->cursor_blink == CURSOR_BLINK_ON ||
                    !term->kbd_focus))
         {
             draw_underline_cursor(term, pix, font, &cursor_color, x, y, cols);
@@ -672,80 +677,336 @@ draw_cursor(const struct terminal *term, const struct cell *cell,
         break;
 
     case CURSOR_HOLLOW:
-        if (likely(term->cursor_blink.state == CURSOR_BLINK_ON))
+        if (likely(state->cursor_blink == CURSOR_BLINK_ON))
             draw_hollow_block(term, pix, &cursor_color, x, y, cols);
         break;
     }
 }
 
+/*
+ * Cells whose background, and glyph, are drawn in bulk by
+ * render_row(). This is limited to cells with (at most) a single,
+ * non-color, glyph that fits inside the cell, and no cursor or
+ * decorations. Such cells do not affect their neighbors, meaning
+ * they can be drawn in any order.
+ *
+ * Other cells only add their background, and flush the run before
+ * drawing their foreground.
+ *
+ * Adjacent cells with the same background color share a single
+ * rectangle. All glyphs in a run share the same color. They are
+ * blended by our own kernels when possible (see blend.c), and
+ * otherwise composited with a single pixman_composite_glyphs() call.
+ */
+#define GLYPH_RUN_MAX 128
+
+struct glyph_run {
+    int y;
+    int x_start;  /* Left edge of the left-most cell */
+    int x_end;    /* Right edge of the right-most cell */
+
+    size_t rect_count;
+    pixman_color_t bg[GLYPH_RUN_MAX];
+    pixman_rectangle16_t rects[GLYPH_RUN_MAX];
+
+    pixman_color_t fg;
+    bool subpixel;  /* Glyphs have per-channel alpha */
+    size_t glyph_count;
+    const struct fcft_glyph *glyphs[GLYPH_RUN_MAX];
+    pixman_glyph_t pos[GLYPH_RUN_MAX];  /* Pen position */
+};
+
+static bool
+glyph_is_subpixel(const struct fcft_glyph *glyph)
+{
+    return PIXMAN_FORMAT_TYPE(pixman_image_get_format(glyph->pix)) !=
+        PIXMAN_TYPE_A;
+}
+
+static void
+glyph_run_flush(struct terminal *term, pixman_image_t *pix,
+                struct glyph_run *run)
+{
+    if (run->rect_count == 0)
+        return;
+
+    /* Backgrounds; one fill per sequence of rectangles sharing a color */
+    for (size_t i = 0; i < run->rect_count; ) {
+        size_t j = i + 1;
+        while (j < run->rect_count &&
+               memcmp(&run->bg[j], &run->bg[i], sizeof(run->bg[i])) == 0)
+        {
+            j++;
+        }
+
+        pixman_image_fill_rectangles(
+            PIXMAN_OP_SRC, pix, &run->bg[i], j - i, &run->rects[i]);
+        i = j;
+    }
+
+    run->rect_count = 0;
+
+    if (run->glyph_count == 0)
+        return;
+
+    /* Glyphs our own kernels can't blend are left for pixman */
+    const pixman_box32_t clip = {
+        run->x_start, run->y, run->x_end, run->y + term->cell_height};
+
+    size_t remaining = 0;
+    for (size_t i = 0; i < run->glyph_count; i++) {
+        const struct fcft_glyph *glyph = run->glyphs[i];
+
+        if (blend_mask_over_solid(
+                pix, &run->fg, glyph->pix,
+                run->pos[i].x + glyph->x, run->pos[i].y - glyph->y, &clip))
+        {
+            continue;
+        }
+
+        run->glyphs[remaining] = glyph;
+        run->pos[remaining] = run->pos[i];
+        remaining++;
+    }
+
+    run->glyph_count = remaining;
+    if (run->glyph_count == 0)
+        return;
+
+    pixman_image_t *clr_pix = pixman_image_create_solid_fill(&run->fg);
+
+    pixman_glyph_cache_t *cache = term->render.glyph_cache.cache;
+    const bool use_cache = run->glyph_count > 1 && cache != NULL;
+    bool cached = false;
+
+    if (use_cache) {
+        /*
+         * The cache is shared by all render workers. Freezing it
+         * prevents glyphs from being evicted while we use them;
+         * eviction happens when the last user thaws it.
+         *
+         * Glyph pointers are unique, and stable, until the fonts
+         * are reloaded, where the cache is re-created (see
+         * term_set_fonts()).
+         */
+        mtx_lock(&term->render.glyph_cache.lock);
+        pixman_glyph_cache_freeze(cache);
+
+        cached = true;
+        for (size_t i = 0; i < run->glyph_count; i++) {
+            const struct fcft_glyph *glyph = run->glyphs[i];
+            const void *cached_glyph = pixman_glyph_cache_lookup(
+                cache, NULL, (void *)glyph);
+
+            if (cached_glyph == NULL) {
+                cached_glyph = pixman_glyph_cache_insert(
+                    cache, NULL, (void *)glyph, -glyph->x, glyph->y,
+                    glyph->pix);
+            }
+
+            if (unlikely(cached_glyph == NULL)) {
+                cached = false;
+                break;
+            }
+
+            run->pos[i].glyph = cached_glyph;
+        }
+
+        mtx_unlock(&term->render.glyph_cache.lock);
+    }
+
+    if (cached) {
+        pixman_composite_glyphs(
+            PIXMAN_OP_OVER, clr_pix, pix,
+            pixman_glyph_get_mask_format(cache, run->glyph_count, run->pos),
+            0, 0, run->x_start, run->y, run->x_start, run->y,
+            run->x_end - run->x_start, term->cell_height,
+            cache, run->glyph_count, run->pos);
+    } else {
+        /* Glyphs may be taller than the row */
+        pixman_region32_t clip;
+        pixman_region32_init_rect(
+            &clip, run->x_start, run->y,
+            run->x_end - run->x_start, term->cell_height);
+        pixman_image_set_clip_region32(pix, &clip);
+        pixman_region32_fini(&clip);
+
+        for (size_t i = 0; i < run->glyph_count; i++) {
+            const struct fcft_glyph *glyph = run->glyphs[i];
+            pixman_image_composite32(
+                PIXMAN_OP_OVER, clr_pix, glyph->pix, pix, 0, 0, 0, 0,
+                run->pos[i].x + glyph->x, run->pos[i].y - glyph->y,
+                glyph->width, glyph->height);
+        }
+
+        pixman_image_set_clip_region32(pix, NULL);
+    }
+
+    if (use_cache) {
+        mtx_lock(&term->render.glyph_cache.lock);
+        pixman_glyph_cache_thaw(cache);
+        mtx_unlock(&term->render.glyph_cache.lock);
+    }
+
+    pixman_image_unref(clr_pix);
+    run->glyph_count = 0;
+}
+
+static void
+glyph_run_add(struct terminal *term, pixman_image_t *pix,
+              struct glyph_run *run, int x, int y, int width,
+              const pixman_color_t *bg, const pixman_color_t *fg,
+              const struct fcft_glyph *glyph)
+{
+    if (glyph != NULL && run->glyph_count > 0 &&
+        (memcmp(fg, &run->fg, sizeof(*fg)) != 0 ||
+         glyph_is_subpixel(glyph) != run->subpixel))
+    {
+        glyph_run_flush(term, pix, run);
+    }
+
+    if (run->rect_count >= GLYPH_RUN_MAX || run->glyph_count >= GLYPH_RUN_MAX)
+        glyph_run_flush(term, pix, run);
+
+    if (run->rect_count == 0 && run->glyph_count == 0) {
+        run->y = y;
+        run->x_start = x;
+        run->x_end = x + width;
+    } else {
+        xassert(run->y == y);
+        run->x_start = min(run->x_start, x);
+        run->x_end = max(run->x_end, x + width);
+    }
+
+    /* Cells are added right-to-left; extend the previous cell's rectangle */
+    pixman_rectangle16_t *prev = run->rect_count > 0
+        ? &run->rects[run->rect_count - 1]
+        : NULL;
+
+    if (prev != NULL && prev->x == x + width &&
+        memcmp(bg, &run->bg[run->rect_count - 1], sizeof(*bg)) == 0)
+    {
+        prev->x = x;
+        prev->width += width;
+    } else {
+        const size_t rect_idx = run->rect_count++;
+        run->bg[rect_idx] = *bg;
+        run->rects[rect_idx] = (pixman_rectangle16_t){
+            x, y, width, term->cell_height};
+    }
+
+    if (glyph == NULL)
+        return;
+
+    if (run->glyph_count == 0) {
+        run->fg = *fg;
+        run->subpixel = glyph_is_subpixel(glyph);
+    }
+
+    const size_t glyph_idx = run->glyph_count++;
+    run->glyphs[glyph_idx] = glyph;
+    run->pos[glyph_idx] = (pixman_glyph_t){
+        .x = x + term->font_x_ofs,
+        .y = y + term->font_baseline,
+    };
+}
+
+/* Flags the row for fdm_blink(), and ensures the blink timer is running */
+static void
+blinking_cell_rendered(struct terminal *term, struct row *row)
+{
+    row->blink = true;
+
+    if (term->blink.fd >= 0)
+        return;
+
+    /* TODO: use a custom lock for this? */
+    mtx_lock(&term->render.workers.lock);
+
+    /* The main thread may be using the FDM, see grid_render() */
+    if (term->render.workers.snapshot.active)
+        term->render.workers.arm_blink_timer = true;
+    else
+        term_arm_blink_timer(term);
+    mtx_unlock(&term->render.workers.lock);
+}
+
+/*
+ * Renders a single cell. If 'run' is non-NULL, simple cells are
+ * added to it instead of being drawn right away (see struct
+ * glyph_run).
+ */
 static int
 render_cell(struct terminal *term, pixman_image_t *pix,
             pixman_region32_t *damage, struct row *row, int row_no, int col,
-            bool has_cursor)
+            bool has_cursor, struct glyph_run *run)
 {
     struct cell *cell = &row->cells[col];
-    if (cell->attrs.clean)
+    if (cell_clean(cell))
         return 0;
 
-    cell->attrs.clean = 1;
-    cell->attrs.confined = true;
+    const struct render_state *state = &term->render.workers.snapshot.state;
+
+    cell_set_clean(cell, true);
+    cell_set_confined(cell, true);
 
     int width = term->cell_width;
     int height = term->cell_height;
     const int x = term->margins.left + col * width;
     const int y = term->margins.top + row_no * height;
 
-    bool is_selected = cell->attrs.selected;
+    const struct attributes *attrs = cell_attrs(row, cell);
+    bool is_selected = cell_selected(cell);
 
     uint32_t _fg = 0;
     uint32_t _bg = 0;
 
     uint16_t alpha = 0xffff;
 
-    if (is_selected && term->colors.use_custom_selection) {
-        _fg = term->colors.selection_fg;
-        _bg = term->colors.selection_bg;
+    if (is_selected && state->colors.use_custom_selection) {
+        _fg = state->colors.selection_fg;
+        _bg = state->colors.selection_bg;
     } else {
         /* Use cell specific color, if set, otherwise the default colors (possible reversed) */
-        switch (cell->attrs.fg_src) {
+        switch (attrs->fg_src) {
         case COLOR_RGB:
-            _fg = cell->attrs.fg;
+            _fg = attrs->fg;
             break;
 
         case COLOR_BASE16:
         case COLOR_BASE256:
-            xassert(cell->attrs.fg < ALEN(term->colors.table));
-            _fg = term->colors.table[cell->attrs.fg];
+            xassert(attrs->fg < ALEN(state->colors.table));
+            _fg = state->colors.table[attrs->fg];
             break;
 
         case COLOR_DEFAULT:
-            _fg = term->reverse ? term->colors.bg : term->colors.fg;
+            _fg = state->reverse ? state->colors.bg : state->colors.fg;
             break;
         }
 
-        switch (cell->attrs.bg_src) {
+        switch (attrs->bg_src) {
         case COLOR_RGB:
-            _bg = cell->attrs.bg;
+            _bg = attrs->bg;
             break;
 
         case COLOR_BASE16:
         case COLOR_BASE256:
-            xassert(cell->attrs.bg < ALEN(term->colors.table));
-            _bg = term->colors.table[cell->attrs.bg];
+            xassert(attrs->bg < ALEN(state->colors.table));
+            _bg = state->colors.table[attrs->bg];
             break;
 
         case COLOR_DEFAULT:
-            _bg = term->reverse ? term->colors.fg : term->colors.bg;
+            _bg = state->reverse ? state->colors.fg : state->colors.bg;
             break;
         }
 
-        if (cell->attrs.reverse ^ is_selected) {
+        if (attrs->reverse ^ is_selected) {
             uint32_t swap = _fg;
             _fg = _bg;
             _bg = swap;
         }
 
-        else if (cell->attrs.bg_src == COLOR_DEFAULT) {
+        else if (attrs->bg_src == COLOR_DEFAULT) {
             if (term->window->is_fullscreen) {
                 /*
                  * Note: disable transparency when fullscreened.
@@ -780,9 +1041,9 @@ render_cell(struct terminal *term, pixman_image_t *pix,
                  * NOTE: if changing this, also update render_margin()
                  */
                 // xassert(alpha == 0xffff);
-                alpha = term->colors.alpha;
+                alpha = state->colors.alpha;
             } else {
-                alpha = term->colors.alpha;
+                alpha = state->colors.alpha;
             }
         }
     }
@@ -793,19 +1054,19 @@ render_cell(struct terminal *term, pixman_image_t *pix,
         alpha = 0xffff;
     }
 
-    if (cell->attrs.dim)
-        _fg = color_dim(term, _fg);
-    if (term->conf->bold_in_bright.enabled && cell->attrs.bold)
-        _fg = color_brighten(term, _fg);
+    if (attrs->dim)
+        _fg = color_dim(term, &state->colors, _fg);
+    if (term->conf->bold_in_bright.enabled && attrs->bold)
+        _fg = color_brighten(term, &state->colors, _fg);
 
-    if (cell->attrs.blink && term->blink.state == BLINK_OFF)
+    if (attrs->blink && state->blink == BLINK_OFF)
         _fg = color_decrease_luminance(_fg);
 
     const bool gamma_correct = render_do_linear_blending(term);
     pixman_color_t fg = color_hex_to_pixman(_fg, gamma_correct);
     pixman_color_t bg = color_hex_to_pixman_with_alpha(_bg, alpha, gamma_correct);
 
-    struct fcft_font *font = attrs_to_font(term, &cell->attrs);
+    struct fcft_font *font = attrs_to_font(term, attrs);
     const struct composed *composed = NULL;
     const struct fcft_grapheme *grapheme = NULL;
     const struct fcft_glyph *single = NULL;
@@ -891,12 +1152,12 @@ render_cell(struct terminal *term, pixman_image_t *pix,
 
         else if (base >= CELL_COMB_CHARS_LO && base <= CELL_COMB_CHARS_HI)
         {
-            composed = composed_lookup(term->composed, base - CELL_COMB_CHARS_LO);
+            composed = composed_lookup(&term->composed, base - CELL_COMB_CHARS_LO);
             base = composed->chars[0];
 
             if (term->conf->can_shape_grapheme && term->conf->tweak.grapheme_shaping) {
                 grapheme = fcft_rasterize_grapheme_utf32(
-                    font, composed->count, composed->chars, term->font_subpixel);
+                    font, composed->count, composed->chars, state->font_subpixel);
             }
 
             if (grapheme != NULL) {
@@ -919,7 +1180,7 @@ render_cell(struct terminal *term, pixman_image_t *pix,
                 cell_cols = 1;
             } else {
                 xassert(base != 0);
-                single = fcft_rasterize_char_utf32(font, base, term->font_subpixel);
+                single = fcft_rasterize_char_utf32(font, base, state->font_subpixel);
                 if (single == NULL) {
                     glyph_count = 0;
                     cell_cols = 1;
@@ -959,43 +1220,71 @@ render_cell(struct terminal *term, pixman_image_t *pix,
             render_width = min(glyph_width, render_width + width);
 
             for (int i = 0; i < cell_cols; i++)
-                row->cells[col + i].attrs.confined = false;
+                cell_set_confined(&row->cells[col + i], false);
         }
     }
 
-    pixman_region32_t clip;
-    pixman_region32_init_rect(
-        &clip, x, y,
-        render_width, term->cell_height);
-    pixman_image_set_clip_region32(pix, &clip);
-
     if (damage != NULL) {
         pixman_region32_union_rect(
             damage, damage, x, y, render_width, term->cell_height);
     }
 
-    pixman_region32_fini(&clip);
+    if (unlikely(attrs->blink))
+        blinking_cell_rendered(term, row);
 
-    /* Background */
-    pixman_image_fill_rectangles(
-        PIXMAN_OP_SRC, pix, &bg, 1,
-        &(pixman_rectangle16_t){x, y, cell_cols * width, height});
+    const bool draw_glyphs =
+        !(cell->wc == 0 || cell->wc >= CELL_SPACER || cell->wc == U'\t' ||
+          (unlikely(attrs->conceal) && !is_selected));
 
-    if (cell->attrs.blink && term->blink.fd < 0) {
-        /* TODO: use a custom lock for this? */
-        mtx_lock(&term->render.workers.lock);
-        term_arm_blink_timer(term);
-        mtx_unlock(&term->render.workers.lock);
+    if (run != NULL) {
+        const struct fcft_glyph *glyph = glyph_count == 1 ? glyphs[0] : NULL;
+        const int glyph_x = glyph != NULL
+            ? x + term->font_x_ofs + glyph->x
+            : 0;
+
+        const bool batch =
+            !has_cursor &&
+            (!draw_glyphs ||
+             (glyph != NULL &&
+              composed == NULL &&
+              !glyph->is_color_glyph &&
+              glyph_x >= x &&
+              glyph_x + glyph->width <= x + cell_cols * width &&
+              render_width == cell_cols * width &&
+              !attrs->underline &&
+              !attrs->strikethrough &&
+              !cell_url(cell)));
+
+        glyph_run_add(
+            term, pix, run, x, y, cell_cols * width, &bg, &fg,
+            batch && draw_glyphs ? glyph : NULL);
+
+        if (batch)
+            return cell_cols;
+
+        /* May overflow into, or draw on top of, cells in the run */
+        glyph_run_flush(term, pix, run);
+    }
+
+    pixman_region32_t clip;
+    pixman_region32_init_rect(
+        &clip, x, y,
+        render_width, term->cell_height);
+    pixman_image_set_clip_region32(pix, &clip);
+    pixman_region32_fini(&clip);
+
+    /* Background (already filled, if added to the run) */
+    if (run == NULL) {
+        pixman_image_fill_rectangles(
+            PIXMAN_OP_SRC, pix, &bg, 1,
+            &(pixman_rectangle16_t){x, y, cell_cols * width, height});
     }
 
-    if (unlikely(has_cursor && term->cursor_style == CURSOR_BLOCK && term->kbd_focus))
+    if (unlikely(has_cursor && state->cursor_style == CURSOR_BLOCK && term->kbd_focus))
         draw_cursor(term, cell, font, pix, &fg, &bg, x, y, cell_cols);
 
-    if (cell->wc == 0 || cell->wc >= CELL_SPACER || cell->wc == U'\t' ||
-        (unlikely(cell->attrs.conceal) && !is_selected))
-    {
+    if (!draw_glyphs)
         goto draw_cursor;
-    }
 
     pixman_image_t *clr_pix = pixman_image_create_solid_fill(&fg);
 
@@ -1015,7 +1304,7 @@ render_cell(struct terminal *term, pixman_image_t *pix,
 
         if (unlikely(glyph->is_color_glyph)) {
             /* Glyph surface is a pre-rendered image (typically a color emoji...) */
-            if (!(cell->attrs.blink && term->blink.state == BLINK_OFF)) {
+            if (!(attrs->blink && state->blink == BLINK_OFF)) {
                 pixman_image_composite32(
                     PIXMAN_OP_OVER, glyph->pix, NULL, pix, 0, 0, 0, 0,
                     pen_x + letter_x_ofs + g_x, y + term->font_baseline - g_y,
@@ -1033,7 +1322,7 @@ render_cell(struct terminal *term, pixman_image_t *pix,
 
                 for (size_t j = 1; j < composed->count; j++) {
                     const struct fcft_glyph *g = fcft_rasterize_char_utf32(
-                        font, composed->chars[j], term->font_subpixel);
+                        font, composed->chars[j], state->font_subpixel);
 
                     if (g == NULL)
                         continue;
@@ -1080,7 +1369,7 @@ render_cell(struct terminal *term, pixman_image_t *pix,
     pixman_image_unref(clr_pix);
 
     /* Underline */
-    if (cell->attrs.underline) {
+    if (attrs->underline) {
         pixman_color_t underline_color = fg;
         enum underline_style underline_style = UNDERLINE_SINGLE;
 
@@ -1097,7 +1386,7 @@ render_cell(struct terminal *term, pixman_image_t *pix,
                     switch (range->underline.color_src) {
                     case COLOR_BASE256:
                         underline_color = color_hex_to_pixman(
-                            term->colors.table[range->underline.color], gamma_correct);
+                            state->colors.table[range->underline.color], gamma_correct);
                         break;
 
                     case COLOR_RGB:
@@ -1124,33 +1413,210 @@ render_cell(struct terminal *term, pixman_image_t *pix,
 
     }
 
-    if (cell->attrs.strikethrough)
+    if (attrs->strikethrough)
         draw_strikeout(term, pix, font, &fg, x, y, cell_cols);
 
-    if (unlikely(cell->attrs.url)) {
+    if (unlikely(cell_url(cell))) {
         pixman_color_t url_color = color_hex_to_pixman(
             term->conf->colors.use_custom.url
             ? term->conf->colors.url
-            : term->colors.table[3],
+            : state->colors.table[3],
             gamma_correct);
         draw_underline(term, pix, font, &url_color, x, y, cell_cols);
     }
 
 draw_cursor:
-    if (has_cursor && (term->cursor_style != CURSOR_BLOCK || !term->kbd_focus))
+    if (has_cursor && (state->cursor_style != CURSOR_BLOCK || !term->kbd_focus))
         draw_cursor(term, cell, font, pix, &fg, &bg, x, y, cell_cols);
 
     pixman_image_set_clip_region32(pix, NULL);
     return cell_cols;
 }
 
+static inline uint64_t
+row_hash_mix(uint64_t hash, uint64_t v)
+{
+    hash ^= v;
+    hash *= 0x9e3779b97f4a7c15ull;
+    return hash ^ (hash >> 29);
+}
+
+/*
+ * Hash of everything render_row() renders the row from, that isn't
+ * covered by term_damage_row_hashes(), i.e. the cells (including
+ * the selection and URL bits), the underline ranges, blinking text
+ * and the cursor.
+ */
+static uint64_t
+row_hash(const struct terminal *term, const struct row *row, int cursor_col,
+         bool *blink)
+{
+    const struct render_state *state = &term->render.workers.snapshot.state;
+    *blink = false;
+
+    uint64_t hash = row_hash_mix(0, (uint64_t)cursor_col);
+
+    if (cursor_col >= 0) {
+        hash = row_hash_mix(
+            hash,
+            (uint64_t)state->cursor_style << 2 |
+            (uint64_t)state->cursor_blink << 1 |
+            (uint64_t)term->kbd_focus);
+    }
+
+    for (int c = 0; c < term->cols; c++) {
+        const struct cell *cell = &row->cells[c];
+        struct attributes attrs = cell_get_attrs(row, cell);
+
+        /* Render state, not content */
+        attrs.clean = false;
+        attrs.confined = false;
+
+        uint64_t bits;
+        memcpy(&bits, &attrs, sizeof(bits));
+
+        hash = row_hash_mix(hash, cell->wc);
+        hash = row_hash_mix(hash, bits);
+
+        if (unlikely(attrs.blink)) {
+            hash = row_hash_mix(hash, state->blink);
+            *blink = true;
+        }
+    }
+
+    if (row->extra != NULL) {
+        const struct row_ranges *ranges = &row->extra->underline_ranges;
+        for (int i = 0; i < ranges->count; i++) {
+            const struct row_range *range = &ranges->v[i];
+            hash = row_hash_mix(
+                hash, (uint64_t)range->start << 32 | (uint32_t)range->end);
+            hash = row_hash_mix(
+                hash,
+                (uint64_t)range->underline.style << 34 |
+                (uint64_t)range->underline.color_src << 32 |
+                range->underline.color);
+        }
+    }
+
+    /* 0 means 'unknown' */
+    return hash != 0 ? hash : 1;
+}
+
+static inline void
+row_add_color(struct row *row, enum color_source src, uint32_t color)
+{
+    switch (src) {
+    case COLOR_DEFAULT:
+        row->default_colors = true;
+        break;
+
+    case COLOR_BASE16:
+    case COLOR_BASE256:
+        row->palette |= 1ull << (color % 64);
+        break;
+
+    case COLOR_RGB:
+        break;
+    }
+}
+
 static void
 render_row(struct terminal *term, pixman_image_t *pix,
            pixman_region32_t *damage, struct row *row,
            int row_no, int cursor_col)
 {
-    for (int col = term->cols - 1; col >= 0; col--)
-        render_cell(term, pix, damage, row, row_no, col, cursor_col == col);
+    /* Cells outside the dirty span are clean */
+    const int start = row->dirty_start;
+    const int end = min(row->dirty_end, term->cols - 1);
+
+    if (term->render.row_hash.enabled) {
+        /* The parser may reset row_hash.v[] while we're pipelined */
+        uint64_t *last = term->render.workers.snapshot.active
+            ? &term->render.workers.snapshot.hash[row_no]
+            : &term->render.row_hash.v[row_no];
+
+        /*
+         * Only worth hashing rows that have been (mostly) rewritten,
+         * e.g. by full screen applications redrawing the screen. For
+         * anything else, forget the last hash, since it won't match
+         * the rendered content anymore.
+         */
+        if (2 * (end - start + 1) < term->cols)
+            *last = 0;
+        else {
+            bool blink;
+            const uint64_t hash = row_hash(term, row, cursor_col, &blink);
+
+            if (hash == *last) {
+                /* Identical to what's already in the buffer */
+                for (int col = start; col <= end; col++)
+                    cell_set_clean(&row->cells[col], true);
+
+                /* What render_cell() would have done */
+                if (unlikely(blink))
+                    blinking_cell_rendered(term, row);
+
+                atomic_fetch_add_explicit(
+                    &term->render.row_hash.hits, 1, memory_order_relaxed);
+                return;
+            }
+
+            *last = hash;
+            atomic_fetch_add_explicit(
+                &term->render.row_hash.misses, 1, memory_order_relaxed);
+        }
+    }
+
+    /* Colors used by the row, see term_damage_color_apply() */
+    if (start == 0 && end == term->cols - 1) {
+        row->palette = 0;
+        row->default_colors = false;
+    }
+
+    for (int col = start; col <= end; col++) {
+        const struct attributes *attrs = cell_attrs(row, &row->cells[col]);
+        row_add_color(row, attrs->fg_src, attrs->fg);
+        row_add_color(row, attrs->bg_src, attrs->bg);
+    }
+
+    if (row->extra != NULL) {
+        const struct row_ranges *underlines = &row->extra->underline_ranges;
+        for (int i = 0; i < underlines->count; i++) {
+            row_add_color(row, underlines->v[i].underline.color_src,
+                          underlines->v[i].underline.color);
+        }
+    }
+
+    int first = -1;  /* Left-most rendered column */
+    int last = -1;   /* Right-most column covered by a rendered cell */
+
+    struct glyph_run run = {0};
+
+    for (int col = end; col >= start; col--) {
+        const int cols = render_cell(
+            term, pix, NULL, row, row_no, col, cursor_col == col, &run);
+
+        if (cols > 0) {
+            first = col;
+            last = max(last, col + cols - 1);
+        }
+    }
+
+    glyph_run_flush(term, pix, &run);
+
+    if (first < 0 || damage == NULL)
+        return;
+
+    /* Glyphs may overflow into the next cell, see render_cell() */
+    if (term->conf->tweak.overflowing_glyphs)
+        last = min(last + 1, term->cols - 1);
+
+    /* A single damage rectangle, instead of one per cell */
+    pixman_region32_union_rect(
+        damage, damage,
+        term->margins.left + first * term->cell_width,
+        term->margins.top + row_no * term->cell_height,
+        (last - first + 1) * term->cell_width, term->cell_height);
 }
 
 static void
@@ -1256,6 +1722,19 @@ render_margin(struct terminal *term, struct buffer *buf,
     }
 }
 
+/* Row hashes follow the pixels when scrolling, see render_row() */
+static void
+row_hashes_move(struct terminal *term, int src, int dst, int count)
+{
+    if (max(src, dst) + count > term->render.row_hash.count) {
+        term_damage_row_hashes(term, 0, term->rows - 1);
+        return;
+    }
+
+    memmove(&term->render.row_hash.v[dst], &term->render.row_hash.v[src],
+            count * sizeof(term->render.row_hash.v[0]));
+}
+
 static void
 grid_render_scroll(struct terminal *term, struct buffer *buf,
                    const struct damage *dmg)
@@ -1282,6 +1761,12 @@ grid_render_scroll(struct terminal *term, struct buffer *buf,
     int dst_y = term->margins.top + (dmg->region.start + 0) * term->cell_height;
     int src_y = term->margins.top + (dmg->region.start + dmg->lines) * term->cell_height;
 
+    row_hashes_move(
+        term, dmg->region.start + dmg->lines, dmg->region.start,
+        region_size - dmg->lines);
+    term_damage_row_hashes(
+        term, dmg->region.end - dmg->lines, dmg->region.end - 1);
+
     /*
      * SHM scrolling can be *much* faster, but it depends on how many
      * lines we're scrolling, and how much repairing we need to do.
@@ -1395,6 +1880,12 @@ grid_render_scroll_reverse(struct terminal *term, struct buffer *buf,
     int src_y = term->margins.top + (dmg->region.start + 0) * term->cell_height;
     int dst_y = term->margins.top + (dmg->region.start + dmg->lines) * term->cell_height;
 
+    row_hashes_move(
+        term, dmg->region.start, dmg->region.start + dmg->lines,
+        region_size - dmg->lines);
+    term_damage_row_hashes(
+        term, dmg->region.start, dmg->region.start + dmg->lines - 1);
+
     bool try_shm_scroll =
         shm_can_scroll(buf) && (
             dmg->lines +
@@ -1560,7 +2051,7 @@ render_sixel(struct terminal *term, pixman_image_t *pix,
         }
 
         /* Is the row dirty? */
-        struct row *row = term->grid->rows[abs_row_no];
+        struct row *row = grid_row_abs(term->grid, abs_row_no);
         xassert(row != NULL);  /* Should be visible */
 
         if (!row->dirty) {
@@ -1594,17 +2085,17 @@ render_sixel(struct terminal *term, pixman_image_t *pix,
             {
                 struct cell *cell = &row->cells[col];
 
-                if (!cell->attrs.clean) {
+                if (!cell_clean(cell)) {
                     bool last_row = abs_row_no == sixel->pos.row + sixel->rows - 1;
                     bool last_col = col == sixel->pos.col + sixel->cols - 1;
 
                     if ((last_row_needs_erase && last_row) ||
                         (last_col_needs_erase && last_col))
                     {
-                        render_cell(term, pix, damage, row, term_row_no, col, cursor_col == col);
+                        render_cell(term, pix, damage, row, term_row_no, col, cursor_col == col, NULL);
                     } else {
-                        cell->attrs.clean = 1;
-                        cell->attrs.confined = 1;
+                        cell_set_clean(cell, true);
+                        cell_set_confined(cell, true);
                     }
                 }
             }
@@ -1679,12 +2170,12 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
 
     const bool gamma_correct = render_do_linear_blending(term);
 
-    /* Adjust cursor position to viewport */
-    struct coord cursor;
-    cursor = term->grid->cursor.point;
-    cursor.row += term->grid->offset;
-    cursor.row -= term->grid->view;
-    cursor.row &= term->grid->num_rows - 1;
+    /*
+     * The cursor, and colors, the rows were rendered with; the
+     * parser may have changed them since (see grid_render())
+     */
+    const struct render_state *state = &term->render.workers.snapshot.state;
+    const struct coord cursor = state->cursor;
 
     if (cursor.row < 0 || cursor.row >= term->rows)
         return;
@@ -1753,13 +2244,16 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
      * from grid), and mark all cells as dirty. This ensures they are
      * re-rendered when the pre-edit text is modified or removed.
      */
-    struct cell *real_cells = xmalloc(cells_used * sizeof(real_cells[0]));
+    struct row *real = grid_row_alloc(cells_used, false);
     for (int i = 0; i < cells_used; i++) {
         xassert(col_idx + i < term->cols);
-        real_cells[i] = row->cells[col_idx + i];
-        real_cells[i].attrs.clean = 0;
+        cell_copy(real, &real->cells[i], row, &row->cells[col_idx + i]);
+        cell_set_clean(&real->cells[i], false);
     }
-    row->dirty = true;
+    row_set_dirty_cols(row, col_idx, col_idx + cells_used - 1);
+
+    /* The buffer won't match the row's content */
+    term_damage_row_hashes(term, row_idx, row_idx);
 
     /* Render pre-edit text */
     xassert(seat->ime.preedit.cells[ime_ofs].wc < CELL_SPACER);
@@ -1773,8 +2267,8 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
         if (col_idx + i + width > term->cols)
             break;
 
-        row->cells[col_idx + i] = *cell;
-        render_cell(term, buf->pix[0], NULL, row, row_idx, col_idx + i, false);
+        cell_copy(row, &row->cells[col_idx + i], seat->ime.preedit.row, cell);
+        render_cell(term, buf->pix[0], NULL, row, row_idx, col_idx + i, false, NULL);
     }
 
     int start = seat->ime.preedit.cursor.start - ime_ofs;
@@ -1783,12 +2277,12 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
     if (!seat->ime.preedit.cursor.hidden) {
         const struct cell *start_cell = &seat->ime.preedit.cells[0];
 
-        pixman_color_t fg = color_hex_to_pixman(term->colors.fg, gamma_correct);
-        pixman_color_t bg = color_hex_to_pixman(term->colors.bg, gamma_correct);
+        pixman_color_t fg = color_hex_to_pixman(state->colors.fg, gamma_correct);
+        pixman_color_t bg = color_hex_to_pixman(state->colors.bg, gamma_correct);
 
         pixman_color_t cursor_color, text_color;
         cursor_colors_for_cell(
-            term, start_cell, &fg, &bg, &cursor_color, &text_color, gamma_correct);
+            state, start_cell, &fg, &bg, &cursor_color, &text_color, gamma_correct);
 
         int x = term->margins.left + (col_idx + start) * term->cell_width;
         int y = term->margins.top + row_idx * term->cell_height;
@@ -1796,7 +2290,7 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
         if (end == start) {
             /* Bar */
             if (start >= 0) {
-                struct fcft_font *font = attrs_to_font(term, &start_cell->attrs);
+                struct fcft_font *font = attrs_to_font(term, cell_attrs(seat->ime.preedit.row, start_cell));
                 draw_beam_cursor(term, buf->pix[0], font, &cursor_color, x, y);
             }
             term_ime_set_cursor_rect(term, x, y, 1, term->cell_height);
@@ -1816,8 +2310,8 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
 
     /* Restore original content (but do not render) */
     for (int i = 0; i < cells_used; i++)
-        row->cells[col_idx + i] = real_cells[i];
-    free(real_cells);
+        cell_copy(row, &row->cells[col_idx + i], real, &real->cells[i]);
+    grid_row_free(real);
 
     const int damage_x = term->margins.left + col_idx * term->cell_width;
     const int damage_y = term->margins.top + row_idx * term->cell_height;
@@ -1830,6 +2324,18 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
 }
 #endif
 
+static bool
+ime_preedit_active(const struct terminal *term)
+{
+#if defined(FOOT_IME_ENABLED) && FOOT_IME_ENABLED
+    tll_foreach(term->wl->seats, it) {
+        if (it->item.kbd_focus == term && it->item.ime.preedit.cells != NULL)
+            return true;
+    }
+#endif
+    return false;
+}
+
 static void
 render_ime_preedit(struct terminal *term, struct buffer *buf)
 {
@@ -2124,11 +2630,61 @@ render_overlay(struct terminal *term)
     term->render.last_overlay_style = style;
 }
 
-int
+/*
+ * Claims the next batch of work, [*first, *last). Batches start out
+ * large, to keep the number of atomic operations down, and shrink as
+ * the work runs out, so that the workers finish at roughly the same
+ * time even when some rows are much more expensive than others.
+ */
+static bool
+render_worker_claim(struct terminal *term, int *first, int *last)
+{
+    atomic_int *next = &term->render.workers.work.next;
+    const int count = term->render.workers.work.count;
+    const int workers = term->render.workers.count;
+
+    int claimed = atomic_load_explicit(next, memory_order_relaxed);
+    if (claimed >= count)
+        return false;
+
+    const int batch = max(1, (count - claimed) / (2 * workers));
+    claimed = atomic_fetch_add_explicit(next, batch, memory_order_relaxed);
+    if (claimed >= count)
+        return false;
+
+    *first = claimed;
+    *last = min(claimed + batch, count);
+    return true;
+}
+
+/*
+ * Render threads, shared by all terminals (i.e. all windows of a
+ * server instance). Frames, and jobs, are submitted by the main
+ * thread, one at a time, and the main thread waits for each to
+ * finish; terminals are thus served in the order they render, and a
+ * terminal rendering many frames cannot starve the others.
+ */
+struct render_pool {
+    uint16_t count;
+    thrd_t *threads;
+    sem_t start;
+    sem_t done;
+    bool quit;
+
+    /* Terminal whose frame, or job, is being worked on */
+    struct terminal *term;
+};
+
+struct render_worker_context {
+    struct render_pool *pool;
+    int my_id;
+};
+
+static int
 render_worker_thread(void *_ctx)
 {
     struct render_worker_context *ctx = _ctx;
-    struct terminal *term = ctx->term;
+    struct render_pool *pool = ctx->pool;
     const int my_id = ctx->my_id;
     free(ctx);
 
@@ -2142,57 +2698,190 @@ render_worker_thread(void *_ctx)
     if (pthread_setname_np(pthread_self(), proc_title) < 0)
         LOG_ERRNO("render worker %d: failed to set process title", my_id);
 
-    sem_t *start = &term->render.workers.start;
-    sem_t *done = &term->render.workers.done;
-    mtx_t *lock = &term->render.workers.lock;
-
     while (true) {
-        sem_wait(start);
-
-        struct buffer *buf = term->render.workers.buf;
-
-        bool frame_done = false;
-
-        /* Translate offset-relative cursor row to view-relative */
-        struct coord cursor = {-1, -1};
-        if (!term->hide_cursor) {
-            cursor = term->grid->cursor.point;
-            cursor.row += term->grid->offset;
-            cursor.row -= term->grid->view;
-            cursor.row &= term->grid->num_rows - 1;
-        }
+        sem_wait(&pool->start);
 
-        while (!frame_done) {
-            mtx_lock(lock);
-            xassert(tll_length(term->render.workers.queue) > 0);
+        if (pool->quit)
+            return 0;
 
-            int row_no = tll_pop_front(term->render.workers.queue);
-            mtx_unlock(lock);
+        struct terminal *term = pool->term;
+        struct buffer *buf = term->render.workers.buf;
+        const struct coord cursor = term->render.workers.cursor;
+        const bool use_snapshot = term->render.workers.snapshot.active;
+        void (*run_job)(void *data, size_t idx) = term->render.workers.job.run;
+        void *job_data = term->render.workers.job.data;
+        const int *rows = term->render.workers.work.rows;
+
+        const bool timed =
+            run_job == NULL &&
+            term->conf->tweak.render_timer != RENDER_TIMER_NONE;
+
+        struct timespec start_time;
+        if (timed)
+            clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+        int first, last;
+        int rendered = 0;
+
+        while (render_worker_claim(term, &first, &last)) {
+            for (int i = first; i < last; i++) {
+                if (run_job != NULL) {
+                    run_job(job_data, i);
+                    continue;
+                }
 
-            switch (row_no) {
-            default: {
-                struct row *row = grid_row_in_view(term->grid, row_no);
+                const int row_no = rows[i];
+                struct row *row = use_snapshot
+                    ? &term->render.workers.snapshot.rows[row_no]
+                    : grid_row_in_view(term->grid, row_no);
                 int cursor_col = cursor.row == row_no ? cursor.col : -1;
 
                 render_row(term, buf->pix[my_id], &buf->dirty[my_id],
                            row, row_no, cursor_col);
-                break;
             }
 
-            case -1:
-                frame_done = true;
-                sem_post(done);
-                break;
+            rendered += last - first;
+        }
 
-            case -2:
-                return 0;
-            }
+        if (timed) {
+            struct timespec end_time;
+            clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+            /* Only read by the main thread once we've posted 'done' */
+            term->render.workers.stats[my_id - 1].rows = rendered;
+            timespec_sub(&end_time, &start_time,
+                         &term->render.workers.stats[my_id - 1].busy);
         }
+
+        sem_post(&pool->done);
     };
 
     return -1;
 }
 
+struct render_pool *
+render_pool_init(uint16_t count)
+{
+    xassert(count > 0);
+
+    struct render_pool *pool = malloc(sizeof(*pool));
+    if (unlikely(pool == NULL)) {
+        LOG_ERRNO("malloc() failed");
+        return NULL;
+    }
+
+    *pool = (struct render_pool){0};
+
+    if (sem_init(&pool->start, 0, 0) < 0 ||
+        sem_init(&pool->done, 0, 0) < 0)
+    {
+        LOG_ERRNO("failed to instantiate render worker semaphores");
+        free(pool);
+        return NULL;
+    }
+
+    LOG_INFO("using %hu rendering threads", count);
+
+    pool->threads = xcalloc(count, sizeof(pool->threads[0]));
+
+    for (size_t i = 0; i < count; i++) {
+        struct render_worker_context *ctx = xmalloc(sizeof(*ctx));
+        *ctx = (struct render_worker_context) {
+            .pool = pool,
+            .my_id = 1 + i,
+        };
+
+        int ret = thrd_create(&pool->threads[i], &render_worker_thread, ctx);
+        if (ret != thrd_success) {
+            LOG_ERR("failed to create render worker thread: %s (%d)",
+                    thrd_err_as_string(ret), ret);
+            free(ctx);
+
+            /* Only stop, and join, the threads we did start */
+            pool->count = i;
+            render_pool_destroy(pool);
+            return NULL;
+        }
+
+        pool->count = i + 1;
+    }
+
+    return pool;
+}
+
+void
+render_pool_destroy(struct render_pool *pool)
+{
+    if (pool == NULL)
+        return;
+
+    pool->quit = true;
+    for (size_t i = 0; i < pool->count; i++)
+        sem_post(&pool->start);
+    for (size_t i = 0; i < pool->count; i++)
+        thrd_join(pool->threads[i], NULL);
+
+    sem_destroy(&pool->start);
+    sem_destroy(&pool->done);
+    free(pool->threads);
+    free(pool);
+}
+
+uint16_t
+render_pool_count(const struct render_pool *pool)
+{
+    return pool != NULL ? pool->count : 0;
+}
+
+/*
+ * Lets all workers loose on the indices [0, count). Each worker posts
+ * 'done' when there's nothing left to claim. In the frame case (no
+ * job), 'rows' must already hold 'count' view rows.
+ */
+static void
+render_workers_start(struct terminal *term, int count)
+{
+    struct render_pool *pool = term->render.workers.pool;
+
+    term->render.workers.work.count = count;
+    atomic_store_explicit(
+        &term->render.workers.work.next, 0, memory_order_relaxed);
+
+    /* The previous frame, or job, must be done */
+    pool->term = term;
+
+    /* sem_post() publishes everything above to the workers */
+    for (size_t i = 0; i < pool->count; i++)
+        sem_post(&pool->start);
+}
+
+void
+render_workers_run(struct terminal *term, size_t count,
+                   void (*run)(void *data, size_t idx), void *data)
+{
+    const size_t workers = term->render.workers.count;
+
+    if (workers == 0 || count <= 1) {
+        for (size_t i = 0; i < count; i++)
+            run(data, i);
+        return;
+    }
+
+    /* Workers must be idle, i.e. not in the middle of a frame */
+    xassert(term->render.workers.buf == NULL);
+    xassert(count <= INT_MAX);
+
+    term->render.workers.job.run = run;
+    term->render.workers.job.data = data;
+    render_workers_start(term, (int)count);
+
+    for (size_t i = 0; i < workers; i++)
+        sem_wait(&term->render.workers.pool->done);
+
+    term->render.workers.job.run = NULL;
+    term->render.workers.job.data = NULL;
+}
+
 struct csd_data
 get_csd_data(const struct terminal *term, enum csd_surface surf_idx)
 {
@@ -2400,8 +3089,8 @@ render_csd_title(struct terminal *term, const struct csd_data *info,
         : term->conf->colors.bg;
 
     if (!term->visual_focus) {
-        bg = color_dim(term, bg);
-        fg = color_dim(term, fg);
+        bg = color_dim(term, &term->colors, bg);
+        fg = color_dim(term, &term->colors, fg);
     }
 
     char32_t *_title_text = ambstoc32(term->window_title);
@@ -2493,7 +3182,7 @@ render_csd_border(struct terminal *term, enum csd_surface surf_idx,
             conf->csd.color.title_set ? conf->csd.color.title :
             0xffu << 24 | term->conf->colors.fg;
         if (!term->visual_focus)
-            _color = color_dim(term, _color);
+            _color = color_dim(term, &term->colors, _color);
 
         uint16_t alpha = _color >> 24 | (_color >> 24 << 8);
         pixman_color_t color =
@@ -2795,7 +3484,7 @@ render_csd_button(struct terminal *term, enum csd_surface surf_idx,
     }
 
     if (!term->visual_focus)
-        _color = color_dim(term, _color);
+        _color = color_dim(term, &term->colors, _color);
 
     const bool gamma_correct = render_do_linear_blending(term);
     pixman_color_t color = color_hex_to_pixman_with_alpha(_color, alpha, gamma_correct);
@@ -3068,6 +3757,7 @@ static void
 force_full_repaint(struct terminal *term, struct buffer *buf)
 {
     tll_free(term->grid->scroll_damage);
+    term->grid->scroll_damage_lines = 0;
     render_margin(term, buf, 0, term->rows, true);
     term_damage_view(term);
 }
@@ -3119,15 +3809,17 @@ reapply_old_damage(struct terminal *term, struct buffer *new, struct buffer *old
             continue;
         }
 
-        bool row_all_dirty = true;
-        for (int c = 0; c < term->cols; c++) {
-            if (row->cells[c].attrs.clean) {
+        bool row_all_dirty =
+            row->dirty_start == 0 && row->dirty_end >= term->cols - 1;
+
+        for (int c = 0; row_all_dirty && c < term->cols; c++) {
+            if (cell_clean(&row->cells[c]))
                 row_all_dirty = false;
-                full_repaint_needed = false;
-                break;
-            }
         }
 
+        if (!row_all_dirty)
+            full_repaint_needed = false;
+
         if (row_all_dirty) {
             pixman_region32_union_rect(
                 &dirty, &dirty,
@@ -3180,19 +3872,53 @@ reapply_old_damage(struct terminal *term, struct buffer *new, struct buffer *old
 static void
 dirty_old_cursor(struct terminal *term)
 {
-    if (term->render.last_cursor.row != NULL && !term->render.last_cursor.hidden) {
-        struct row *row = term->render.last_cursor.row;
-        struct cell *cell = &row->cells[term->render.last_cursor.col];
-        cell->attrs.clean = 0;
-        row->dirty = true;
+    const int last_row = term->render.last_cursor.row;
+
+    if (last_row >= 0 && !term->render.last_cursor.hidden) {
+        xassert(last_row < term->grid->num_rows);
+        const struct row *old = term->grid->rows[last_row];
+
+        /* Compressed rows are fully re-rendered when decompressed */
+        if (old != NULL && old->packed == NULL) {
+            struct row *row = grid_row_abs(term->grid, last_row);
+            const int col = term->render.last_cursor.col;
+            cell_set_clean(&row->cells[col], false);
+            row_set_dirty_cols(row, col, col);
+        }
     }
 
     /* Remember current cursor position, for the next frame */
-    term->render.last_cursor.row = grid_row(term->grid, term->grid->cursor.point.row);
+    term->render.last_cursor.row = grid_row_absolute(
+        term->grid, term->grid->cursor.point.row);
     term->render.last_cursor.col = term->grid->cursor.point.col;
     term->render.last_cursor.hidden = term->hide_cursor;
 }
 
+/*
+ * True if nothing but (at most) the old and new cursor cells are
+ * dirty, as is the case for cursor blinks and plain cursor movement.
+ * Those are rendered directly on the main thread; waking up the
+ * workers, and merging their damage, costs more than rendering two
+ * cells.
+ */
+static bool
+only_cursor_dirty(const struct terminal *term)
+{
+    int dirty_cells = 0;
+
+    for (int r = 0; r < term->rows; r++) {
+        const struct row *row = grid_row_in_view(term->grid, r);
+
+        if (!row->dirty)
+            continue;
+
+        if (row->dirty_start != row->dirty_end || ++dirty_cells > 2)
+            return false;
+    }
+
+    return true;
+}
+
 static void
 dirty_cursor(struct terminal *term)
 {
@@ -3203,8 +3929,8 @@ dirty_cursor(struct terminal *term)
 
     struct row *row = grid_row(term->grid, cursor->row);
     struct cell *cell = &row->cells[cursor->col];
-    cell->attrs.clean = 0;
-    row->dirty = true;
+    cell_set_clean(cell, false);
+    row_set_dirty_cols(row, cursor->col, cursor->col);
 }
 
 pixman_image_t* scale_and_crop_image(pixman_image_t *bg_image, int dest_width, int dest_height) {
@@ -3316,6 +4042,171 @@ render_background_image(struct terminal *term) {
     return true;
 }
 
+void
+render_workers_snapshot_free(struct terminal *term)
+{
+    struct row *rows = term->render.workers.snapshot.rows;
+
+    for (int r = 0; r < term->render.workers.snapshot.num_rows; r++) {
+        free(rows[r].cells);
+        row_attrs_free(&rows[r]);
+        if (rows[r].extra != NULL) {
+            free(rows[r].extra->underline_ranges.v);
+            free(rows[r].extra);
+        }
+    }
+
+    free(rows);
+    free(term->render.workers.snapshot.src_gen);
+    free(term->render.workers.snapshot.hash);
+    free(term->render.workers.snapshot.hash_gen);
+
+    term->render.workers.snapshot.num_rows = 0;
+    term->render.workers.snapshot.num_cols = 0;
+    term->render.workers.snapshot.rows = NULL;
+    term->render.workers.snapshot.src_gen = NULL;
+    term->render.workers.snapshot.hash = NULL;
+    term->render.workers.snapshot.hash_gen = NULL;
+}
+
+/* Everything, besides the rows, the cells are rendered with */
+static void
+snapshot_state(struct terminal *term)
+{
+    struct render_state *state = &term->render.workers.snapshot.state;
+
+    memcpy(&state->colors, &term->colors, sizeof(state->colors));
+    state->reverse = term->reverse;
+    state->blink = term->blink.state;
+    state->cursor_style = term->cursor_style;
+    state->cursor_blink = term->cursor_blink.state;
+    state->font_subpixel = term->font_subpixel;
+
+    state->cursor = term->grid->cursor.point;
+    state->cursor.row += term->grid->offset;
+    state->cursor.row -= term->grid->view;
+    state->cursor.row &= term->grid->num_rows - 1;
+}
+
+static void
+snapshot_prepare(struct terminal *term)
+{
+    if (term->render.workers.snapshot.num_rows != term->rows ||
+        term->render.workers.snapshot.num_cols != term->cols)
+    {
+        render_workers_snapshot_free(term);
+
+        struct row *rows = xcalloc(term->rows, sizeof(rows[0]));
+        for (int r = 0; r < term->rows; r++)
+            rows[r].cells = xmalloc(term->cols * sizeof(rows[r].cells[0]));
+
+        term->render.workers.snapshot.num_rows = term->rows;
+        term->render.workers.snapshot.num_cols = term->cols;
+        term->render.workers.snapshot.rows = rows;
+        term->render.workers.snapshot.src_gen =
+            xcalloc(term->rows, sizeof(term->render.workers.snapshot.src_gen[0]));
+        term->render.workers.snapshot.hash =
+            xcalloc(term->rows, sizeof(term->render.workers.snapshot.hash[0]));
+        term->render.workers.snapshot.hash_gen =
+            xcalloc(term->rows, sizeof(term->render.workers.snapshot.hash_gen[0]));
+    }
+
+    memset(term->render.workers.snapshot.src_gen, 0,
+           term->rows * sizeof(term->render.workers.snapshot.src_gen[0]));
+}
+
+static void
+snapshot_row(struct terminal *term, int row_no, struct row *row)
+{
+    struct row *copy = &term->render.workers.snapshot.rows[row_no];
+    memcpy(copy->cells, row->cells, term->cols * sizeof(copy->cells[0]));
+    row_attrs_copy(copy, row);
+
+    /* Styled underlines are the only row data used by render_cell() */
+    const struct row_ranges *underlines =
+        row->extra != NULL ? &row->extra->underline_ranges : NULL;
+
+    if (underlines != NULL && underlines->count > 0) {
+        if (copy->extra == NULL)
+            copy->extra = xcalloc(1, sizeof(*copy->extra));
+
+        struct row_ranges *dst = &copy->extra->underline_ranges;
+        if (dst->size < underlines->count) {
+            dst->size = underlines->count;
+            dst->v = xreallocarray(dst->v, dst->size, sizeof(dst->v[0]));
+        }
+
+        memcpy(dst->v, underlines->v, underlines->count * sizeof(dst->v[0]));
+        dst->count = underlines->count;
+    } else if (copy->extra != NULL)
+        copy->extra->underline_ranges.count = 0;
+
+    copy->dirty_start = row->dirty_start;
+    copy->dirty_end = row->dirty_end;
+    copy->blink = false;
+    copy->palette = row->palette;
+    copy->default_colors = row->default_colors;
+
+    /* The live row is now, as far as the parser is concerned, rendered */
+    for (int c = row->dirty_start; c <= min(row->dirty_end, term->cols - 1); c++)
+        cell_set_clean(&row->cells[c], true);
+
+    term->render.workers.snapshot.src_gen[row_no] = row->gen;
+    term->render.workers.snapshot.hash[row_no] = term->render.row_hash.v[row_no];
+    term->render.workers.snapshot.hash_gen[row_no] = term->render.row_hash.gen[row_no];
+}
+
+static void
+snapshot_merge(struct terminal *term)
+{
+    /*
+     * Propagate the 'confined' bits, and the blink and color
+     * summaries, set when rendering, to the live rows. The parser
+     * may have scrolled, or even freed, the rows we copied, and a
+     * new row may have been allocated at the same address; rows are
+     * matched by generation, and only cells that haven't been
+     * modified since they were copied are updated.
+     */
+    const uint64_t *src_gen = term->render.workers.snapshot.src_gen;
+
+    /*
+     * The hashes of the rendered rows, unless the parser has reset
+     * them since; the rendered content is then already stale
+     */
+    for (int r = 0; r < term->rows; r++) {
+        if (src_gen[r] != 0 &&
+            term->render.workers.snapshot.hash_gen[r] == term->render.row_hash.gen[r])
+        {
+            term->render.row_hash.v[r] = term->render.workers.snapshot.hash[r];
+        }
+    }
+
+    for (int r = 0; r < term->rows; r++) {
+        struct row *row = grid_row_in_view(term->grid, r);
+
+        for (int i = 0; i < term->rows; i++) {
+            if (src_gen[i] != row->gen)
+                continue;
+
+            const struct cell *copy = term->render.workers.snapshot.rows[i].cells;
+            for (int c = 0; c < term->cols; c++) {
+                if (cell_clean(&row->cells[c]))
+                    cell_set_confined(&row->cells[c], cell_confined(&copy[c]));
+            }
+
+            /* Stale, at worst, which fdm_blink() deals with */
+            if (term->render.workers.snapshot.rows[i].blink)
+                row->blink = true;
+
+            /* False positives are fine, see term_damage_color_apply() */
+            row->palette |= term->render.workers.snapshot.rows[i].palette;
+            row->default_colors |=
+                term->render.workers.snapshot.rows[i].default_colors;
+            break;
+        }
+    }
+}
+
 static void
 grid_render(struct terminal *term)
 {
@@ -3337,6 +4228,26 @@ grid_render(struct terminal *term)
     struct buffer *buf = shm_get_buffer(
         chain, term->width, term->height, use_alpha);
 
+    if (unlikely(term->render.row_hash.count != term->rows)) {
+        term->render.row_hash.v = xreallocarray(
+            term->render.row_hash.v, term->rows,
+            sizeof(term->render.row_hash.v[0]));
+        term->render.row_hash.gen = xreallocarray(
+            term->render.row_hash.gen, term->rows,
+            sizeof(term->render.row_hash.gen[0]));
+        memset(term->render.row_hash.v, 0,
+               term->rows * sizeof(term->render.row_hash.v[0]));
+        memset(term->render.row_hash.gen, 0,
+               term->rows * sizeof(term->render.row_hash.gen[0]));
+        term->render.row_hash.count = term->rows;
+    }
+
+    /* Palette changes since last frame */
+    term_damage_color_apply(term);
+
+    /* A screenful, or more, was scrolled; see term_damage_scroll() */
+    if (unlikely(term->grid->scroll_damage_lines >= term->rows))
+        term_damage_view(term);
 
     /* Dirty old and current cursor cell, to ensure they're repainted */
     dirty_old_cursor(term);
@@ -3358,6 +4269,10 @@ grid_render(struct terminal *term)
         xassert(term->render.last_buf->width == buf->width);
         xassert(term->render.last_buf->height == buf->height);
 
+        /* Rows that are about to be re-rendered aren't copied from
+         * the old buffer, so they can't be skipped */
+        term_damage_row_hashes(term, 0, term->rows - 1);
+
         clock_gettime(CLOCK_MONOTONIC, &start_double_buffering);
         reapply_old_damage(term, buf, term->render.last_buf);
         clock_gettime(CLOCK_MONOTONIC, &stop_double_buffering);
@@ -3397,6 +4312,8 @@ grid_render(struct terminal *term)
         tll_remove(term->grid->scroll_damage, it);
     }
 
+    term->grid->scroll_damage_lines = 0;
+
     /*
      * Ensure selected cells have their 'selected' bit set. This is
      * normally "automatically" true - the bit is set when the
@@ -3416,15 +4333,13 @@ grid_render(struct terminal *term)
      */
     selection_dirty_cells(term);
 
+    snapshot_state(term);
+
     /* Translate offset-relative row to view-relative, unless cursor
      * is hidden, then we just set it to -1 */
     struct coord cursor = {-1, -1};
-    if (!term->hide_cursor) {
-        cursor = term->grid->cursor.point;
-        cursor.row += term->grid->offset;
-        cursor.row -= term->grid->view;
-        cursor.row &= term->grid->num_rows - 1;
-    }
+    if (!term->hide_cursor)
+        cursor = term->render.workers.snapshot.state.cursor;
 
     if (term->conf->tweak.overflowing_glyphs) {
         /*
@@ -3444,12 +4359,16 @@ grid_render(struct terminal *term)
             if (!row->dirty)
                 continue;
 
+            /* Cells dirtied below, outside the row's dirty span */
+            struct cell *first_dirty = &row->cells[row->dirty_start];
+            struct cell *last_dirty = first_dirty;
+
             /* Loop row from left to right, looking for dirty cells */
-            for (struct cell *cell = &row->cells[0];
-                 cell < &row->cells[term->cols];
+            for (struct cell *cell = &row->cells[row->dirty_start];
+                 cell <= &row->cells[min(row->dirty_end, term->cols - 1)];
                  cell++)
             {
-                if (cell->attrs.clean)
+                if (cell_clean(cell))
                     continue;
 
                 /*
@@ -3465,11 +4384,12 @@ grid_render(struct terminal *term)
                  * outer loop goes from left to right).
                  */
                 for (struct cell *c = cell - 1; c >= &row->cells[0]; c--) {
-                    if (c->attrs.confined)
+                    if (cell_confined(c))
                         break;
-                    if (!c->attrs.clean)
+                    if (!cell_clean(c))
                         break;
-                    c->attrs.clean = false;
+                    cell_set_clean(c, false);
+                    first_dirty = min(first_dirty, c);
                 }
 
                 /*
@@ -3486,11 +4406,15 @@ grid_render(struct terminal *term)
                  * glyphs again, in the outer loop.
                  */
                 for (; cell < &row->cells[term->cols]; cell++) {
-                    cell->attrs.clean = false;
-                    if (cell->attrs.confined)
+                    cell_set_clean(cell, false);
+                    last_dirty = max(last_dirty, cell);
+                    if (cell_confined(cell))
                         break;
                 }
             }
+
+            row_set_dirty_cols(
+                row, first_dirty - row->cells, last_dirty - row->cells);
         }
     }
 
@@ -3501,37 +4425,81 @@ grid_render(struct terminal *term)
         if (row->dirty) {
             bool all_clean = true;
             for (int c = 0; c < term->cols; c++) {
-                if (!row->cells[c].attrs.clean) {
+                if (!cell_clean(&row->cells[c])) {
                     all_clean = false;
                     break;
                 }
             }
             if (all_clean)
                 BUG("row #%d is dirty, but all cells are marked as clean", r);
+
+            for (int c = 0; c < term->cols; c++) {
+                if (!cell_clean(&row->cells[c]) &&
+                    (c < row->dirty_start || c > row->dirty_end))
+                {
+                    BUG("row #%d: cell #%d is dirty, but outside the "
+                        "dirty span %d-%d",
+                        r, c, row->dirty_start, row->dirty_end);
+                }
+            }
         } else {
             for (int c = 0; c < term->cols; c++) {
-                if (!row->cells[c].attrs.clean)
+                if (!cell_clean(&row->cells[c]))
                     BUG("row #%d is clean, but cell #%d is dirty", r, c);
             }
         }
     }
 #endif
 
+    /*
+     * Sixels are drawn on top of the cells; the buffer's content of
+     * those rows isn't determined by the cells alone
+     */
+    term->render.row_hash.enabled = tll_length(term->grid->sixel_images) == 0;
+    if (!term->render.row_hash.enabled)
+        term_damage_row_hashes(term, 0, term->rows - 1);
+
     pixman_region32_t damage;
     pixman_region32_init(&damage);
 
     render_sixel_images(term, buf->pix[0], &damage, &cursor);
 
+    /* These read the grid, which the parser may modify below */
+    render_overlay(term);
+    render_scrollback_position(term);
 
-    if (term->render.workers.count > 0) {
-        mtx_lock(&term->render.workers.lock);
-        term->render.workers.buf = buf;
-        for (size_t i = 0; i < term->render.workers.count; i++)
-            sem_post(&term->render.workers.start);
+    /*
+     * If there's PTY data waiting to be parsed, let the workers
+     * render copies of the dirty rows, and parse it while they're
+     * busy, instead of idling. The parser stops at sequences that
+     * change the render state (see term_render_state_changed()).
+     *
+     * Not done in URL mode, where term->grid is the URL mode
+     * snapshot, not the grid the parser writes to, nor while an IME
+     * pre-edit string is shown, since it's drawn into the live rows.
+     */
+    const bool use_workers =
+        term->render.workers.count > 0 && !only_cursor_dirty(term);
+
+    const bool pipelined =
+        use_workers &&
+        !urls_mode_is_active(term) &&
+        !ime_preedit_active(term) &&
+        term_ptmx_has_pending(term);
 
-        xassert(tll_length(term->render.workers.queue) == 0);
+    if (pipelined)
+        snapshot_prepare(term);
+
+    if (use_workers && term->render.workers.work.rows_size < term->rows)
+    {
+        term->render.workers.work.rows = xreallocarray(
+            term->render.workers.work.rows, term->rows,
+            sizeof(term->render.workers.work.rows[0]));
+        term->render.workers.work.rows_size = term->rows;
     }
 
+    int dirty_count = 0;
+
     for (int r = 0; r < term->rows; r++) {
         struct row *row = grid_row_in_view(term->grid, r);
 
@@ -3540,8 +4508,11 @@ grid_render(struct terminal *term)
 
         row->dirty = false;
 
-        if (term->render.workers.count > 0)
-            tll_push_back(term->render.workers.queue, r);
+        if (use_workers) {
+            if (pipelined)
+                snapshot_row(term, r, row);
+            term->render.workers.work.rows[dirty_count++] = r;
+        }
 
         else {
             /* TODO: damage region */
@@ -3550,18 +4521,43 @@ grid_render(struct terminal *term)
         }
     }
 
-    /* Signal workers the frame is done */
-    if (term->render.workers.count > 0) {
-        for (size_t i = 0; i < term->render.workers.count; i++)
-            tll_push_back(term->render.workers.queue, -1);
-        mtx_unlock(&term->render.workers.lock);
+    if (use_workers) {
+        term->render.workers.buf = buf;
+        term->render.workers.cursor = cursor;
+        term->render.workers.snapshot.active = pipelined;
+        render_workers_start(term, dirty_count);
+
+        size_t remaining = term->render.workers.count;
+
+        if (pipelined) {
+            while (remaining > 0) {
+                if (sem_trywait(&term->render.workers.pool->done) == 0)
+                    remaining--;
+                else if (term->vt.halt ||
+                         term_ptmx_parse_pending(term, 16 * 1024) == 0)
+                    break;
+            }
+
+            /* The rest is parsed after the frame */
+            term->vt.halt = false;
+        }
 
-        for (size_t i = 0; i < term->render.workers.count; i++)
-            sem_wait(&term->render.workers.done);
+        for (size_t i = 0; i < remaining; i++)
+            sem_wait(&term->render.workers.pool->done);
         term->render.workers.buf = NULL;
+
+        if (pipelined) {
+            snapshot_merge(term);
+            term->render.workers.snapshot.active = false;
+        }
+
+        if (term->render.workers.arm_blink_timer) {
+            term->render.workers.arm_blink_timer = false;
+            term_arm_blink_timer(term);
+        }
     }
 
-    for (size_t i = 0; i < term->render.workers.count; i++)
+    for (size_t i = 0; use_workers && i < term->render.workers.count; i++)
         pixman_region32_union(&damage, &damage, &buf->dirty[i + 1]);
 
     pixman_region32_union(&buf->dirty[0], &buf->dirty[0], &damage);
@@ -3580,9 +4576,7 @@ grid_render(struct terminal *term)
 
     pixman_region32_fini(&damage);
 
-    render_overlay(term);
     render_ime_preedit(term, buf);
-    render_scrollback_position(term);
 
     if (term->conf->tweak.render_timer != RENDER_TIMER_NONE) {
         struct timespec end_time;
@@ -3609,6 +4603,24 @@ grid_render(struct terminal *term)
                 render_time.tv_nsec,
                 (long)double_buffering_time.tv_sec,
                 double_buffering_time.tv_nsec);
+
+            const size_t hits = atomic_load_explicit(
+                &term->render.row_hash.hits, memory_order_relaxed);
+            const size_t misses = atomic_load_explicit(
+                &term->render.row_hash.misses, memory_order_relaxed);
+
+            if (hits + misses > 0) {
+                LOG_INFO("  unchanged rows skipped: %zu of %zu (%.1f%%)",
+                         hits, hits + misses, 100. * hits / (hits + misses));
+            }
+
+            for (size_t i = 0; use_workers && i < term->render.workers.count; i++) {
+                const struct timespec *busy =
+                    &term->render.workers.stats[i].busy;
+                LOG_INFO("  worker #%zu: %d rows in %lds %9ldns",
+                         i + 1, term->render.workers.stats[i].rows,
+                         (long)busy->tv_sec, busy->tv_nsec);
+            }
             break;
 
         case RENDER_TIMER_OSD:
@@ -4355,6 +5367,7 @@ delayed_reflow_of_normal_grid(struct terminal *term)
         term->interactive_resizing.grid, term,
         term->interactive_resizing.new_rows, term->normal.num_cols,
         term->interactive_resizing.old_screen_rows, term->rows,
+        term->conf->tweak.scrollback_compression_screens,
         term->selection.coords.end.row >= 0 ? ALEN(tracking_points) : 0,
         tracking_points);
 
@@ -4363,6 +5376,7 @@ delayed_reflow_of_normal_grid(struct terminal *term)
     grid_free(&term->normal);
     term->normal = *term->interactive_resizing.grid;
     free(term->interactive_resizing.grid);
+    term_reflow_schedule(term);
 
     term->hide_cursor = term->interactive_resizing.old_hide_cursor;
 
@@ -4375,9 +5389,10 @@ delayed_reflow_of_normal_grid(struct terminal *term)
     /* Invalidate render pointers */
     shm_unref(term->render.last_buf);
     term->render.last_buf = NULL;
-    term->render.last_cursor.row = NULL;
+    term->render.last_cursor.row = -1;
 
     tll_free(term->normal.scroll_damage);
+    term->normal.scroll_damage_lines = 0;
     sixel_reflow_grid(term, &term->normal);
 
     if (term->grid == &term->normal) {
@@ -4758,10 +5773,12 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
              i < term->interactive_resizing.old_screen_rows;
              i++, j = (j + 1) & (orig->num_rows - 1))
         {
+            const struct row *orig_row = grid_row_abs(orig, j);
+
             g.rows[i] = grid_row_alloc(g.num_cols, false);
-            memcpy(g.rows[i]->cells,
-                   orig->rows[j]->cells,
+            memcpy(g.rows[i]->cells, orig_row->cells,
                    g.num_cols * sizeof(g.rows[i]->cells[0]));
+            row_attrs_copy(g.rows[i], orig_row);
 
             if (orig->rows[j]->extra == NULL ||
                 orig->rows[j]->extra->underline_ranges.count == 0)
@@ -4854,8 +5871,10 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
 
         grid_resize_and_reflow(
             &term->normal, term, new_normal_grid_rows, new_cols, old_normal_rows, new_rows,
+            term->conf->tweak.scrollback_compression_screens,
             term->selection.coords.end.row >= 0 ? ALEN(tracking_points) : 0,
             tracking_points);
+        term_reflow_schedule(term);
     }
 
     grid_resize_without_reflow(
@@ -4885,7 +5904,7 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
         term->scroll_region.end = term->rows;
     }
 
-    term->render.last_cursor.row = NULL;
+    term->render.last_cursor.row = -1;
 
 damage_view:
     /* Signal TIOCSWINSZ */
@@ -4943,6 +5962,8 @@ damage_view:
 
     tll_free(term->normal.scroll_damage);
     tll_free(term->alt.scroll_damage);
+    term->normal.scroll_damage_lines = 0;
+    term->alt.scroll_damage_lines = 0;
 
     shm_unref(term->render.last_buf);
     term->render.last_buf = NULL;
@@ -33,11 +33,25 @@ bool render_xcursor_is_valid(const struct seat *seat, const char *cursor);
 
 void render_overlay(struct terminal *term);
 
-struct render_worker_context {
-    int my_id;
-    struct terminal *term;
-};
-int render_worker_thread(void *_ctx);
+/*
+ * Render worker threads, shared by all terminals. 'count' must be
+ * non-zero.
+ */
+struct render_pool;
+struct render_pool *render_pool_init(uint16_t count);
+void render_pool_destroy(struct render_pool *pool);
+uint16_t render_pool_count(const struct render_pool *pool);
+
+void render_workers_snapshot_free(struct terminal *term);
+
+/*
+ * Runs 'run(data, idx)', for idx 0 - count-1, on the render workers,
+ * and waits for all of them to finish. Runs them in the calling
+ * thread if there are no workers.
+ */
+void render_workers_run(
+    struct terminal *term, size_t count,
+    void (*run)(void *data, size_t idx), void *data);
 
 struct csd_data {
     int x;
@@ -33,7 +33,16 @@ def main():
     parser.add_argument('--attr-italic', action='store_true')
     parser.add_argument('--attr-underline', action='store_true')
     parser.add_argument('--sixel', action='store_true')
+    parser.add_argument('--normal-screen', action='store_true',
+                        help='write to the normal screen (and its scrollback) '
+                             'instead of the alt screen')
+    parser.add_argument(
+        '--stable-widths', action='store_true',
+        help='only use characters with the same width in all Unicode width tables '
+             '(e.g. glibc and utf8proc), for reproducible grid checksums')
     parser.add_argument('--seed', type=int)
+    parser.add_argument('--count', type=int, default=256 * 1024,
+                        help='number of characters to write (default: %(default)s)')
 
     opts = parser.parse_args()
     out = opts.out if opts.out is not None else sys.stdout
@@ -85,10 +94,13 @@ def main():
     assert height > 0, f'{height}'
 
     # Number of characters to write to screen
-    count = 256 * 1024**1
+    count = opts.count
 
     # Characters to choose from
     alphabet = 'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRTSTUVWXYZ0123456789 öäå 👨👩🧒👩🏽‍🔬🇸🇪'
+    if opts.stable_widths:
+        # Emoji widths differ between width tables; use CJK (3- and 4-byte UTF-8) instead
+        alphabet = 'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRTSTUVWXYZ0123456789 öäå 日本語𠀀𠀋'
 
     color_variants = ([ColorVariant.NONE] +
                       ([ColorVariant.REGULAR] if opts.colors_regular else []) +
@@ -97,7 +109,8 @@ def main():
                       ([ColorVariant.RGB] if opts.colors_rgb else []))
 
     # Enter alt screen
-    out.write('\033[?1049h')
+    if not opts.normal_screen:
+        out.write('\033[?1049h')
 
     # uses system time or /dev/urandom if available if opt.seed == None
     # pin seeding method to make seeding stable across future versions
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+import argparse
+import random
+import sys
+
+
+def cursor_motion(out, lines, cols, count):
+    """
+    Similar to vtebench's 'cursor motion' benchmark: move the cursor
+    to a random location, and print a single character there.
+    """
+    for _ in range(count):
+        row = random.randrange(lines)
+        col = random.randrange(cols)
+        out.write(f'\033[{row + 1};{col + 1}H{random.choice("abcdefgh")}')
+
+
+def vim_redraw(out, lines, cols, count):
+    """
+    Approximates the output of a full-screen editor scrolling through
+    a syntax highlighted file: scroll region manipulation, line
+    insertion/deletion, and short SGR-colored spans, each line
+    terminated by an erase-to-end-of-line.
+    """
+    keywords = ['static', 'const', 'struct', 'return', 'if', 'else', 'for',
+                'while', 'int', 'char', 'void', 'bool', 'size_t']
+    words = ['term', 'grid', 'row', 'col', 'cell', 'data', 'len', 'p', '=',
+             '->', '(', ')', '{', '}', ';', '0', '1', '&&', '||', '+=']
+
+    for _ in range(count):
+        # Scroll a random number of lines, within the text area
+        # (i.e. excluding the status line)
+        n = random.randrange(1, 4)
+        out.write(f'\033[1;{lines - 1}r')
+        if random.randrange(2):
+            out.write(f'\033[1;1H\033[{n}L')
+            first = 0
+        else:
+            out.write(f'\033[{lines - 1};1H\033[{n}M')
+            first = lines - 1 - n
+        out.write('\033[r')
+
+        # Redraw the exposed lines
+        for row in range(first, first + n):
+            out.write(f'\033[{row + 1};1H')
+            out.write(f'\033[33m{row + 1:>4} \033[m')
+
+            width = 5
+            while True:
+                if random.randrange(3) == 0:
+                    word = random.choice(keywords)
+                    sgr = random.choice(['\033[1;34m', '\033[32m',
+                                         '\033[38;5;208m',
+                                         '\033[38:2::200:100:50m'])
+                else:
+                    word = random.choice(words)
+                    sgr = ''
+
+                if width + len(word) + 1 >= cols:
+                    break
+
+                out.write(f'{sgr}{word}\033[m ' if sgr else f'{word} ')
+                width += len(word) + 1
+
+            out.write('\033[K')
+
+        # Status line
+        out.write(f'\033[{lines};1H\033[7m')
+        out.write(f'{random.randrange(10000)},{random.randrange(80)}'.ljust(cols))
+        out.write('\033[27m')
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Generate CSI heavy VT stimuli, for benchmarking the VT parser')
+    parser.add_argument(
+        'out', type=argparse.FileType(mode='w'), nargs='?', help='name of output file')
+    parser.add_argument('--mode', choices=['cursor-motion', 'vim-redraw'],
+                        default='cursor-motion')
+    parser.add_argument('--cols', type=int, default=135)
+    parser.add_argument('--rows', type=int, default=67)
+    parser.add_argument('--count', type=int, default=1024**2,
+                        help='number of cursor movements, or screen updates')
+    parser.add_argument('--seed', type=int)
+
+    opts = parser.parse_args()
+    out = opts.out if opts.out is not None else sys.stdout
+
+    assert opts.rows > 1, f'{opts.rows}'
+    assert opts.cols > 0, f'{opts.cols}'
+
+    # pin seeding method to make seeding stable across future versions
+    random.seed(a=opts.seed, version=2)
+
+    # Enter alt screen
+    out.write('\033[?1049h')
+
+    if opts.mode == 'cursor-motion':
+        cursor_motion(out, opts.rows, opts.cols, opts.count)
+    else:
+        vim_redraw(out, opts.rows, opts.cols, opts.count)
+
+    # Leave alt screen
+    out.write('\033[m\033[r\033[?1049l')
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -220,7 +220,7 @@ foreach_selected_normal(
     end_row &= (grid_rows - 1);
 
     for (int r = start_row; r != end_row; r = (r + 1) & (grid_rows - 1)) {
-        struct row *row = term->grid->rows[r];
+        struct row *row = grid_row_abs(term->grid, r);
         xassert(row != NULL);
 
         for (int c = start_col; c <= term->cols - 1; c++) {
@@ -232,7 +232,7 @@ foreach_selected_normal(
     }
 
     /* Last, partial row */
-    struct row *row = term->grid->rows[end_row];
+    struct row *row = grid_row_abs(term->grid, end_row);
     xassert(row != NULL);
 
     for (int c = start_col; c <= end_col; c++) {
@@ -273,7 +273,7 @@ foreach_selected_block(
 
     int r = top_left.row;
     while (true) {
-        struct row *row = term->grid->rows[r];
+        struct row *row = grid_row_abs(term->grid, r);
         xassert(row != NULL);
 
         for (int c = top_left.col; c <= bottom_right.col; c++) {
@@ -352,7 +352,7 @@ selection_find_word_boundary_left(const struct terminal *term, struct coord *pos
     xassert(pos->row >= 0);
     pos->row &= grid->num_rows - 1;
 
-    const struct row *r = grid->rows[pos->row];
+    const struct row *r = grid_row_abs(term->grid, pos->row);
     char32_t c = r->cells[pos->col].wc;
 
     while (c >= CELL_SPACER) {
@@ -364,7 +364,7 @@ selection_find_word_boundary_left(const struct terminal *term, struct coord *pos
     }
 
     if (c >= CELL_COMB_CHARS_LO && c <= CELL_COMB_CHARS_HI)
-        c = composed_lookup(term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
+        c = composed_lookup(&term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
 
     bool initial_is_space = c == 0 || isc32space(c);
     bool initial_is_delim =
@@ -376,7 +376,7 @@ selection_find_word_boundary_left(const struct terminal *term, struct coord *pos
         int next_col = pos->col - 1;
         int next_row = pos->row;
 
-        const struct row *row = grid->rows[next_row];
+        const struct row *row = grid_row_abs(term->grid, next_row);
 
         /* Linewrap */
         if (next_col < 0) {
@@ -391,7 +391,7 @@ selection_find_word_boundary_left(const struct terminal *term, struct coord *pos
                 break;
             }
 
-            row = grid->rows[next_row];
+            row = grid_row_abs(term->grid, next_row);
 
             if (row->linebreak) {
                 /* Hard linebreak, treat as space. I.e. break selection */
@@ -408,7 +408,7 @@ selection_find_word_boundary_left(const struct terminal *term, struct coord *pos
         }
 
         if (c >= CELL_COMB_CHARS_LO && c <= CELL_COMB_CHARS_HI)
-            c = composed_lookup(term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
+            c = composed_lookup(&term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
 
         bool is_space = c == 0 || isc32space(c);
         bool is_delim =
@@ -441,7 +441,7 @@ selection_find_word_boundary_right(const struct terminal *term, struct coord *po
     xassert(pos->row >= 0);
     pos->row &= grid->num_rows - 1;
 
-    const struct row *r = grid->rows[pos->row];
+    const struct row *r = grid_row_abs(term->grid, pos->row);
     char32_t c = r->cells[pos->col].wc;
 
     while (c >= CELL_SPACER) {
@@ -453,7 +453,7 @@ selection_find_word_boundary_right(const struct terminal *term, struct coord *po
     }
 
     if (c >= CELL_COMB_CHARS_LO && c <= CELL_COMB_CHARS_HI)
-        c = composed_lookup(term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
+        c = composed_lookup(&term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
 
     bool initial_is_space = c == 0 || isc32space(c);
     bool initial_is_delim =
@@ -466,7 +466,7 @@ selection_find_word_boundary_right(const struct terminal *term, struct coord *po
         int next_col = pos->col + 1;
         int next_row = pos->row;
 
-        const struct row *row = term->grid->rows[next_row];
+        const struct row *row = grid_row_abs(term->grid, next_row);
 
         /* Linewrap */
         if (next_col >= term->cols) {
@@ -483,7 +483,7 @@ selection_find_word_boundary_right(const struct terminal *term, struct coord *po
                 break;
             }
 
-            row = grid->rows[next_row];
+            row = grid_row_abs(term->grid, next_row);
         }
 
         c = row->cells[next_col].wc;
@@ -497,7 +497,7 @@ selection_find_word_boundary_right(const struct terminal *term, struct coord *po
         }
 
         if (c >= CELL_COMB_CHARS_LO && c <= CELL_COMB_CHARS_HI)
-            c = composed_lookup(term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
+            c = composed_lookup(&term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
 
         bool is_space = c == 0 || isc32space(c);
         bool is_delim =
@@ -906,11 +906,11 @@ mark_selected_region(struct terminal *term, pixman_box32_t *boxes,
              rel_r < box->y2;
              r = (r + 1) & (term->grid->num_rows - 1), rel_r++)
         {
-            struct row *row = term->grid->rows[r];
+            struct row *row = grid_row_abs(term->grid, r);
             xassert(row != NULL);
 
             if (dirty_cells)
-                row->dirty = true;
+                row_set_dirty_cols(row, box->x1, box->x2 - 1);
 
             for (int c = box->x1, empty_count = 0; c < box->x2; c++) {
                 struct cell *cell = &row->cells[c];
@@ -963,9 +963,9 @@ mark_selected_region(struct terminal *term, pixman_box32_t *boxes,
                      * a trailing empty cell, it will get re-tagged as
                      * selected in the for-loop below.
                      */
-                    cell->attrs.clean = false;
-                    cell->attrs.selected = false;
-                    row->dirty = true;
+                    cell_set_clean(cell, false);
+                    cell_set_selected(cell, false);
+                    row_set_dirty_cols(row, c, c);
                     continue;
                 }
 
@@ -974,10 +974,10 @@ mark_selected_region(struct terminal *term, pixman_box32_t *boxes,
                     struct cell *cell = &row->cells[c - j];
 
                     if (dirty_cells) {
-                        cell->attrs.clean = false;
-                        row->dirty = true;
+                        cell_set_clean(cell, false);
+                        row_set_dirty_cols(row, c - j, c - j);
                     }
-                    cell->attrs.selected = selected;
+                    cell_set_selected(cell, selected);
                 }
 
                 empty_count = 0;
@@ -1048,7 +1048,7 @@ set_pivot_point_for_block_and_char_wise(struct terminal *term,
     /* First, make sure 'start' isn't in the middle of a
      * multi-column character */
     while (true) {
-        const struct row *row = term->grid->rows[pivot_start->row & (term->grid->num_rows - 1)];
+        const struct row *row = grid_row_abs(term->grid, pivot_start->row & (term->grid->num_rows - 1));
         const struct cell *cell = &row->cells[pivot_start->col];
 
         if (cell->wc < CELL_SPACER)
@@ -1073,7 +1073,7 @@ set_pivot_point_for_block_and_char_wise(struct terminal *term,
     if (new_direction == SELECTION_RIGHT) {
         bool keep_going = true;
         while (keep_going) {
-            const struct row *row = term->grid->rows[pivot_end->row & (term->grid->num_rows - 1)];
+            const struct row *row = grid_row_abs(term->grid, pivot_end->row & (term->grid->num_rows - 1));
             const char32_t wc = row->cells[pivot_end->col].wc;
 
             keep_going = wc >= CELL_SPACER;
@@ -1089,7 +1089,7 @@ set_pivot_point_for_block_and_char_wise(struct terminal *term,
     } else {
         bool keep_going = true;
         while (keep_going) {
-            const struct row *row = term->grid->rows[pivot_start->row & (term->grid->num_rows - 1)];
+            const struct row *row = grid_row_abs(term->grid, pivot_start->row & (term->grid->num_rows - 1));
             const char32_t wc = pivot_start->col < term->cols - 1
                 ? row->cells[pivot_start->col + 1].wc : 0;
 
@@ -1239,8 +1239,8 @@ selection_update(struct terminal *term, int col, int row)
     size_t start_row_idx = new_start.row & (term->grid->num_rows - 1);
     size_t end_row_idx = new_end.row & (term->grid->num_rows - 1);
 
-    const struct row *row_start = term->grid->rows[start_row_idx];
-    const struct row *row_end = term->grid->rows[end_row_idx];
+    const struct row *row_start = grid_row_abs(term->grid, start_row_idx);
+    const struct row *row_end = grid_row_abs(term->grid, end_row_idx);
 
     /* If an end point is in the middle of a multi-column character,
      * expand the selection to cover the entire character */
@@ -1576,12 +1576,12 @@ static bool
 unmark_selected(struct terminal *term, struct row *row, struct cell *cell,
                 int row_no, int col, void *data)
 {
-    if (!cell->attrs.selected)
+    if (!cell_selected(cell))
         return true;
 
-    row->dirty = true;
-    cell->attrs.selected = false;
-    cell->attrs.clean = false;
+    row_set_dirty_cols(row, col, col);
+    cell_set_selected(cell, false);
+    cell_set_clean(cell, false);
     return true;
 }
 
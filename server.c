@@ -34,6 +34,7 @@ struct server {
     struct fdm *fdm;
     struct reaper *reaper;
     struct wayland *wayl;
+    struct render_pool *render_pool;
 
     int fd;
     const char *sock_path;
@@ -324,6 +325,15 @@ fdm_client(struct fdm *fdm, int fd, int events, void *data)
 
         config_override_apply(conf, &overrides, false);
 
+        if (conf->render_worker_count != server->conf->render_worker_count) {
+            LOG_WARN(
+                "client FD=%d: workers=%hu ignored; the render threads are "
+                "shared by all terminals, and sized by the server's "
+                "configuration (workers=%hu)",
+                client->fd, conf->render_worker_count,
+                server->conf->render_worker_count);
+        }
+
         if (conf->tweak.font_monospace_warn && conf->fonts[0].count > 0) {
             check_if_font_is_monospaced(
                 conf->fonts[0].arr[0].pattern,
@@ -339,7 +349,8 @@ fdm_client(struct fdm *fdm, int fd, int events, void *data)
 
     instance->terminal = term_init(
         conf != NULL ? conf : server->conf,
-        server->fdm, server->reaper, server->wayl, "footclient", cwd, token,
+        server->fdm, server->reaper, server->wayl, server->render_pool,
+        "footclient", cwd, token,
         NULL, cdata.argc, argv, (const char *const *)envp,
         &term_shutdown_handler, instance);
 
@@ -506,7 +517,7 @@ prepare_socket(int fd)
 
 struct server *
 server_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
-            struct wayland *wayl)
+            struct wayland *wayl, struct render_pool *render_pool)
 {
     int fd;
     struct server *server = NULL;
@@ -569,6 +580,7 @@ server_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
         .fdm = fdm,
         .reaper = reaper,
         .wayl = wayl,
+        .render_pool = render_pool,
 
         .fd = fd,
         .sock_path = sock_path,
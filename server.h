@@ -3,9 +3,11 @@
 #include "fdm.h"
 #include "config.h"
 #include "reaper.h"
+#include "render.h"
 #include "wayland.h"
 
 struct server;
 struct server *server_init(const struct config *conf, struct fdm *fdm,
-                           struct reaper *reaper, struct wayland *wayl);
+                           struct reaper *reaper, struct wayland *wayl,
+                           struct render_pool *render_pool);
 void server_destroy(struct server *server);
@@ -228,10 +228,19 @@ sixel_erase(struct terminal *term, struct sixel *sixel)
             continue;
         }
 
-        row->dirty = true;
+        if (row->packed != NULL) {
+            /* Fully re-rendered when decompressed */
+            continue;
+        }
+
+        const int end = min(sixel->pos.col + sixel->cols, term->cols);
+        if (sixel->pos.col >= end)
+            continue;
 
-        for (int c = sixel->pos.col; c < min(sixel->pos.col + sixel->cols, term->cols); c++)
-            row->cells[c].attrs.clean = 0;
+        row_set_dirty_cols(row, sixel->pos.col, end - 1);
+
+        for (int c = sixel->pos.col; c < end; c++)
+            cell_set_clean(&row->cells[c], false);
     }
 
     sixel_destroy(sixel);
@@ -1355,15 +1364,15 @@ sixel_unhook(struct terminal *term)
 
         /* Dirty touched cells, and scroll terminal content if necessary */
         for (size_t i = 0; i < image.rows; i++) {
-            struct row *row = term->grid->rows[cur_row + i];
-            row->dirty = true;
+            struct row *row = grid_row_abs(term->grid, cur_row + i);
+            xassert(row != NULL);
+            const int end = min(image.pos.col + image.cols, term->cols);
 
-            for (int col = image.pos.col;
-                 col < min(image.pos.col + image.cols, term->cols);
-                 col++)
-            {
-                row->cells[col].attrs.clean = 0;
-            }
+            for (int col = image.pos.col; col < end; col++)
+                cell_set_clean(&row->cells[col], false);
+
+            if (image.pos.col < end)
+                row_set_dirty_cols(row, image.pos.col, end - 1);
 
         }
 
@@ -34,6 +34,7 @@
 #include "ime.h"
 #include "input.h"
 #include "notify.h"
+#include "ptmx-reader.h"
 #include "quirks.h"
 #include "reaper.h"
 #include "render.h"
@@ -50,6 +51,9 @@
 
 #define PTMX_TIMING 0
 
+/* Composed characters, before the first garbage collection */
+#define COMPOSED_GC_MIN 1024
+
 static void
 enqueue_data_for_slave(const void *data, size_t len, size_t offset,
                        ptmx_buffer_list_t *buffer_list)
@@ -236,65 +240,9 @@ static struct timespec last = {0};
 
 static bool cursor_blink_rearm_timer(struct terminal *term);
 
-/* Externally visible, but not declared in terminal.h, to enable pgo
- * to call this function directly */
-bool
-fdm_ptmx(struct fdm *fdm, int fd, int events, void *data)
+static void
+schedule_delayed_render(struct terminal *term)
 {
-    struct terminal *term = data;
-
-    const bool pollin = events & EPOLLIN;
-    const bool pollout = events & EPOLLOUT;
-    const bool hup = events & EPOLLHUP;
-
-    if (pollout) {
-        if (!fdm_ptmx_out(fdm, fd, events, data))
-            return false;
-    }
-
-    /* Prevent blinking while typing */
-    if (term->cursor_blink.fd >= 0) {
-        term->cursor_blink.state = CURSOR_BLINK_ON;
-        cursor_blink_rearm_timer(term);
-    }
-
-    if (unlikely(term->interactive_resizing.grid != NULL)) {
-        /*
-         * Don't consume PTMX while we're doing an interactive resize,
-         * since the 'normal' grid we're currently using is a
-         * temporary one - all changes done to it will be lost when
-         * the interactive resize ends.
-         */
-        return true;
-    }
-
-    uint8_t buf[24 * 1024];
-    const size_t max_iterations = !hup ? 10 : SIZE_MAX;
-
-    for (size_t i = 0; i < max_iterations && pollin; i++) {
-        xassert(pollin);
-        ssize_t count = read(term->ptmx, buf, sizeof(buf));
-
-        if (count < 0) {
-            if (errno == EAGAIN || errno == EIO) {
-                /*
-                 * EAGAIN: no more to read - FDM will trigger us again
-                 * EIO: assume PTY was closed - we already have, or will get, a EPOLLHUP
-                 */
-                break;
-            }
-
-            LOG_ERRNO("failed to read from pseudo terminal");
-            return false;
-        } else if (count == 0) {
-            /* Reached end-of-file */
-            break;
-        }
-
-        xassert(term->interactive_resizing.grid == NULL);
-        vt_from_slave(term, buf, count);
-    }
-
     if (!term->render.app_sync_updates.enabled) {
         /*
          * We likely need to re-render. But, we don't want to do it
@@ -362,6 +310,151 @@ fdm_ptmx(struct fdm *fdm, int fd, int events, void *data)
         } else
             render_refresh(term);
     }
+}
+
+/*
+ * Parses at most 'budget' bytes from the PTY reader's ring buffer.
+ * Stops early if the VT parser is halted (see term_render_state_changed())
+ */
+static size_t
+ptmx_reader_parse(struct terminal *term, size_t budget)
+{
+    struct ptmx_reader *reader = term->ptmx_reader;
+    size_t total = 0;
+
+    while (total < budget && !term->vt.halt) {
+        const uint8_t *data;
+        size_t count = ptmx_reader_peek(reader, &data);
+
+        if (count == 0)
+            break;
+
+        count = min(count, budget - total);
+        count = vt_from_slave(term, data, count);
+        ptmx_reader_consume(reader, count);
+        total += count;
+    }
+
+    return total;
+}
+
+static void
+ptmx_reader_teardown(struct terminal *term)
+{
+    if (term->ptmx_reader == NULL)
+        return;
+
+    fdm_del_no_close(term->fdm, ptmx_reader_fd(term->ptmx_reader));
+    ptmx_reader_destroy(term->ptmx_reader);
+    term->ptmx_reader = NULL;
+}
+
+static bool
+fdm_ptmx_reader(struct fdm *fdm, int fd, int events, void *data)
+{
+    struct terminal *term = data;
+
+    if (events & EPOLLHUP)
+        return false;
+
+    /* Prevent blinking while typing */
+    if (term->cursor_blink.fd >= 0) {
+        term->cursor_blink.state = CURSOR_BLINK_ON;
+        cursor_blink_rearm_timer(term);
+    }
+
+    if (unlikely(term->interactive_resizing.grid != NULL)) {
+        /* See fdm_ptmx() - we're normally paused while resizing */
+        return true;
+    }
+
+    /*
+     * Parse a bounded slice, to let the FDM dispatch Wayland events,
+     * and render frames, in between. If there's more data in the
+     * ring, rearming makes the FD readable again, and we'll be
+     * called on the next FDM iteration.
+     */
+    const uint32_t budget_kb = term->conf->tweak.pty_parse_budget_kb;
+    ptmx_reader_parse(term, budget_kb > 0 ? (size_t)budget_kb * 1024 : SIZE_MAX);
+    ptmx_reader_rearm(term->ptmx_reader);
+
+    schedule_delayed_render(term);
+    return true;
+}
+
+/* Externally visible, but not declared in terminal.h, to enable pgo
+ * to call this function directly */
+bool
+fdm_ptmx(struct fdm *fdm, int fd, int events, void *data)
+{
+    struct terminal *term = data;
+
+    bool pollin = events & EPOLLIN;
+    const bool pollout = events & EPOLLOUT;
+    const bool hup = events & EPOLLHUP;
+
+    if (pollout) {
+        if (!fdm_ptmx_out(fdm, fd, events, data))
+            return false;
+    }
+
+    /* Prevent blinking while typing */
+    if (term->cursor_blink.fd >= 0) {
+        term->cursor_blink.state = CURSOR_BLINK_ON;
+        cursor_blink_rearm_timer(term);
+    }
+
+    if (unlikely(term->interactive_resizing.grid != NULL)) {
+        /*
+         * Don't consume PTMX while we're doing an interactive resize,
+         * since the 'normal' grid we're currently using is a
+         * temporary one - all changes done to it will be lost when
+         * the interactive resize ends.
+         */
+        return true;
+    }
+
+    if (term->ptmx_reader != NULL && hup) {
+        /*
+         * The reader thread has stopped, or will soon stop, reading
+         * (it doesn't handle hangups). Stop it, parse what's left in
+         * the ring, and then read the remaining data ourselves,
+         * below.
+         */
+        ptmx_reader_stop(term->ptmx_reader);
+        ptmx_reader_parse(term, SIZE_MAX);
+        ptmx_reader_teardown(term);
+        pollin = true;
+    }
+
+    uint8_t buf[24 * 1024];
+    const size_t max_iterations = !hup ? 10 : SIZE_MAX;
+
+    for (size_t i = 0; i < max_iterations && pollin; i++) {
+        xassert(pollin);
+        ssize_t count = read(term->ptmx, buf, sizeof(buf));
+
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EIO) {
+                /*
+                 * EAGAIN: no more to read - FDM will trigger us again
+                 * EIO: assume PTY was closed - we already have, or will get, a EPOLLHUP
+                 */
+                break;
+            }
+
+            LOG_ERRNO("failed to read from pseudo terminal");
+            return false;
+        } else if (count == 0) {
+            /* Reached end-of-file */
+            break;
+        }
+
+        xassert(term->interactive_resizing.grid == NULL);
+        vt_from_slave(term, buf, count);
+    }
+
+    schedule_delayed_render(term);
 
     if (hup) {
         del_utmp_record(term->conf, term->reaper, term->ptmx);
@@ -391,6 +484,11 @@ term_ptmx_pause(struct terminal *term)
 {
     if (term->ptmx < 0)
         return false;
+    if (term->ptmx_reader != NULL) {
+        /* Reader thread stops reading when the ring is full */
+        return fdm_event_del(
+            term->fdm, ptmx_reader_fd(term->ptmx_reader), EPOLLIN);
+    }
     return fdm_event_del(term->fdm, term->ptmx, EPOLLIN);
 }
 
@@ -399,9 +497,37 @@ term_ptmx_resume(struct terminal *term)
 {
     if (term->ptmx < 0)
         return false;
+    if (term->ptmx_reader != NULL) {
+        return fdm_event_add(
+            term->fdm, ptmx_reader_fd(term->ptmx_reader), EPOLLIN);
+    }
     return fdm_event_add(term->fdm, term->ptmx, EPOLLIN);
 }
 
+/* True if there's PTY data that has been read, but not yet parsed */
+bool
+term_ptmx_has_pending(struct terminal *term)
+{
+    return term->ptmx_reader != NULL &&
+           term->interactive_resizing.grid == NULL &&
+           !ptmx_reader_is_empty(term->ptmx_reader);
+}
+
+/*
+ * Parses at most 'budget' bytes of already read PTY data. Used by
+ * the renderer, to parse while the render workers are busy.
+ */
+size_t
+term_ptmx_parse_pending(struct terminal *term, size_t budget)
+{
+    if (!term_ptmx_has_pending(term))
+        return 0;
+
+    const size_t count = ptmx_reader_parse(term, budget);
+    schedule_delayed_render(term);
+    return count;
+}
+
 static bool
 fdm_flash(struct fdm *fdm, int fd, int events, void *data)
 {
@@ -460,16 +586,27 @@ fdm_blink(struct fdm *fdm, int fd, int events, void *data)
     term->blink.state = term->blink.state == BLINK_ON
         ? BLINK_OFF : BLINK_ON;
 
-    /* Scan all visible cells and mark rows with blinking cells dirty */
+    /*
+     * Mark blinking cells dirty. Only rows flagged by the renderer,
+     * when it rendered a blinking cell, can have any. The flag isn't
+     * cleared when the cells are overwritten; do it here instead.
+     */
     bool no_blinking_cells = true;
     for (int r = 0; r < term->rows; r++) {
         struct row *row = grid_row_in_view(term->grid, r);
+
+        if (likely(!row->blink))
+            continue;
+
+        row->blink = false;
+
         for (int col = 0; col < term->cols; col++) {
             struct cell *cell = &row->cells[col];
 
-            if (cell->attrs.blink) {
-                cell->attrs.clean = 0;
-                row->dirty = true;
+            if (cell_attrs(row, cell)->blink) {
+                cell_set_clean(cell, false);
+                row_set_dirty_cols(row, col, col);
+                row->blink = true;
                 no_blinking_cells = false;
             }
         }
@@ -518,14 +655,107 @@ term_arm_blink_timer(struct terminal *term)
     term->blink.fd = fd;
 }
 
+/* Old rows reflowed per main loop iteration (and render worker) */
+#define REFLOW_CHUNK_ROWS 2000
+
+static void
+reflow_step(struct terminal *term, int max_rows)
+{
+    bool sixels_mapped = false;
+    grid_reflow_step(
+        &term->normal, term, term->rows,
+        term->conf->tweak.scrollback_compression_screens, max_rows,
+        &sixels_mapped);
+
+    if (sixels_mapped)
+        sixel_reflow_grid(term, &term->normal);
+}
+
+static bool
+fdm_reflow(struct fdm *fdm, int fd, int events, void *data)
+{
+    if (events & EPOLLHUP)
+        return false;
+
+    struct terminal *term = data;
+
+    /*
+     * The event FD is never read; it stays readable, and we're called
+     * once per main loop iteration, interleaved with PTY input,
+     * rendering and Wayland events, until everything has been
+     * reflowed.
+     */
+    if (grid_reflow_pending(&term->normal)) {
+        /* Chunks are split between the render workers */
+        const int workers = max(term->render.workers.count, 1);
+        reflow_step(term, REFLOW_CHUNK_ROWS * workers);
+
+        /* Scrollbar, and the viewport when it's at the top */
+        render_refresh(term);
+    }
+
+    if (!grid_reflow_pending(&term->normal)) {
+        LOG_DBG("scrollback reflow done");
+        fdm_del(term->fdm, term->reflow_fd);
+        term->reflow_fd = -1;
+    }
+
+    return true;
+}
+
+void
+term_reflow_schedule(struct terminal *term)
+{
+    if (term->reflow_fd >= 0 || !grid_reflow_pending(&term->normal))
+        return;
+
+    int fd = eventfd(1, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd < 0) {
+        LOG_ERRNO("failed to create reflow event FD");
+        term_reflow_complete(term);
+        return;
+    }
+
+    if (!fdm_add(term->fdm, fd, EPOLLIN, &fdm_reflow, term)) {
+        close(fd);
+        term_reflow_complete(term);
+        return;
+    }
+
+    term->reflow_fd = fd;
+}
+
+void
+term_reflow_rows(struct terminal *term, int rows)
+{
+    while (grid_reflow_pending(&term->normal)) {
+        const int sb_rows = grid_row_abs_to_sb(
+            &term->normal, term->rows, term->normal.view);
+
+        if (sb_rows >= rows)
+            break;
+
+        reflow_step(term, max(rows - sb_rows, REFLOW_CHUNK_ROWS));
+    }
+}
+
+void
+term_reflow_complete(struct terminal *term)
+{
+    while (grid_reflow_pending(&term->normal))
+        reflow_step(term, INT_MAX);
+}
+
 static void
 cursor_refresh(struct terminal *term)
 {
     if (!term->window->is_configured)
         return;
 
-    term->grid->cur_row->cells[term->grid->cursor.point.col].attrs.clean = 0;
-    term->grid->cur_row->dirty = true;
+    cell_set_clean(&term->grid->cur_row->cells[term->grid->cursor.point.col], false);
+    row_set_dirty_cols(
+        term->grid->cur_row, term->grid->cursor.point.col,
+        term->grid->cursor.point.col);
     render_refresh(term);
 }
 
@@ -704,49 +934,25 @@ fdm_app_id_update_timeout(struct fdm *fdm, int fd, int events, void *data)
 static bool
 initialize_render_workers(struct terminal *term)
 {
-    LOG_INFO("using %hu rendering threads", term->render.workers.count);
-
-    if (sem_init(&term->render.workers.start, 0, 0) < 0 ||
-        sem_init(&term->render.workers.done, 0, 0) < 0)
-    {
-        LOG_ERRNO("failed to instantiate render worker semaphores");
-        return false;
-    }
-
     int err;
     if ((err = mtx_init(&term->render.workers.lock, mtx_plain)) != thrd_success) {
         LOG_ERR("failed to instantiate render worker mutex: %s (%d)",
                 thrd_err_as_string(err), err);
-        goto err_sem_destroy;
+        return false;
     }
 
-    term->render.workers.threads = xcalloc(
-        term->render.workers.count, sizeof(term->render.workers.threads[0]));
-
-    for (size_t i = 0; i < term->render.workers.count; i++) {
-        struct render_worker_context *ctx = xmalloc(sizeof(*ctx));
-        *ctx = (struct render_worker_context) {
-            .term = term,
-            .my_id = 1 + i,
-        };
-
-        int ret = thrd_create(
-            &term->render.workers.threads[i], &render_worker_thread, ctx);
-        if (ret != thrd_success) {
-
-            LOG_ERR("failed to create render worker thread: %s (%d)",
-                    thrd_err_as_string(ret), ret);
-            term->render.workers.threads[i] = 0;
-            return false;
-        }
+    if ((err = mtx_init(&term->render.glyph_cache.lock, mtx_plain)) != thrd_success) {
+        LOG_ERR("failed to instantiate glyph cache mutex: %s (%d)",
+                thrd_err_as_string(err), err);
+        return false;
     }
 
-    return true;
+    /* May be NULL; glyphs are then composited one at a time */
+    term->render.glyph_cache.cache = pixman_glyph_cache_create();
 
-err_sem_destroy:
-    sem_destroy(&term->render.workers.start);
-    sem_destroy(&term->render.workers.done);
-    return false;
+    term->render.workers.stats = xcalloc(
+        term->render.workers.count, sizeof(term->render.workers.stats[0]));
+    return true;
 }
 
 static void
@@ -825,6 +1031,12 @@ term_set_fonts(struct terminal *term, struct fcft_font *fonts[static 4],
     free_custom_glyphs(
         &term->custom_glyphs.octants, GLYPH_OCTANTS_COUNT);
 
+    /* Cached glyphs are keyed on the (now freed) glyph pointers */
+    if (term->render.glyph_cache.cache != NULL) {
+        pixman_glyph_cache_destroy(term->render.glyph_cache.cache);
+        term->render.glyph_cache.cache = pixman_glyph_cache_create();
+    }
+
     const struct config *conf = term->conf;
 
     const struct fcft_glyph *M = fcft_rasterize_char_utf32(
@@ -1286,7 +1498,8 @@ static const int PTY_OPEN_FLAGS = O_RDWR | O_NOCTTY;
 
 struct terminal *
 term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
-          struct wayland *wayl, const char *foot_exe, const char *cwd,
+          struct wayland *wayl, struct render_pool *render_pool,
+          const char *foot_exe, const char *cwd,
           const char *token, const char *pty_path,
           int argc, char *const *argv, const char *const *envp,
           void (*shutdown_cb)(void *data, int exit_code), void *shutdown_data)
@@ -1414,6 +1627,7 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
         .scale_before_unmap = -1,
         .flash = {.fd = flash_fd},
         .blink = {.fd = -1},
+        .reflow_fd = -1,
         .vt = {
             .state = 0,  /* STATE_GROUND */
         },
@@ -1456,7 +1670,7 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
         .normal = {.scroll_damage = tll_init(), .sixel_images = tll_init()},
         .alt = {.scroll_damage = tll_init(), .sixel_images = tll_init()},
         .grid = &term->normal,
-        .composed = NULL,
+        .composed = {.gc_threshold = COMPOSED_GC_MIN},
         .alt_scrolling = conf->mouse.alternate_scroll_mode,
         .meta = {
             .esc_prefix = true,
@@ -1469,7 +1683,7 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
         .render = {
             .chains = {
                 .background_image = shm_chain_new(wayl, false, 1, ten_bit_surfaces),
-                .grid = shm_chain_new(wayl, true, 1 + conf->render_worker_count,
+                .grid = shm_chain_new(wayl, true, 1 + render_pool_count(render_pool),
                                       ten_bit_surfaces),
                 .search = shm_chain_new(wayl, false, 1 ,ten_bit_surfaces),
                 .scrollback_indicator = shm_chain_new(wayl, false, 1, ten_bit_surfaces),
@@ -1489,9 +1703,10 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
             .app_id = {
                 .timer_fd = app_id_update_fd,
             },
+            .last_cursor = {.row = -1},
             .workers = {
-                .count = conf->render_worker_count,
-                .queue = tll_init(),
+                .pool = render_pool,
+                .count = render_pool_count(render_pool),
             },
         },
         .delayed_render_timer = {
@@ -1619,7 +1834,24 @@ term_window_configured(struct terminal *term)
     /* Enable ptmx FDM callback */
     if (!term->shutdown.in_progress) {
         xassert(term->window->is_configured);
-        fdm_add(term->fdm, term->ptmx, EPOLLIN, &fdm_ptmx, term);
+
+        if (term->conf->tweak.pty_reader_thread) {
+            term->ptmx_reader = ptmx_reader_init(
+                term->ptmx, (size_t)term->conf->tweak.pty_ring_size_kb * 1024);
+
+            if (term->ptmx_reader != NULL &&
+                !fdm_add(term->fdm, ptmx_reader_fd(term->ptmx_reader),
+                         EPOLLIN, &fdm_ptmx_reader, term))
+            {
+                ptmx_reader_destroy(term->ptmx_reader);
+                term->ptmx_reader = NULL;
+            }
+        }
+
+        /* With a reader thread, ptmx is only polled for EPOLLOUT
+         * (and EPOLLHUP) */
+        fdm_add(term->fdm, term->ptmx,
+                term->ptmx_reader != NULL ? 0 : EPOLLIN, &fdm_ptmx, term);
 
         const bool gamma_correct = render_do_linear_blending(term);
         LOG_INFO("gamma-correct blending: %s", gamma_correct ? "enabled" : "disabled");
@@ -1836,7 +2068,9 @@ term_shutdown(struct terminal *term)
     fdm_del(term->fdm, term->delayed_render_timer.upper_fd);
     fdm_del(term->fdm, term->blink.fd);
     fdm_del(term->fdm, term->flash.fd);
+    fdm_del(term->fdm, term->reflow_fd);
 
+    ptmx_reader_teardown(term);
     del_utmp_record(term->conf, term->reaper, term->ptmx);
 
     if (term->window != NULL && term->window->is_configured)
@@ -1888,6 +2122,7 @@ term_shutdown(struct terminal *term)
     term->delayed_render_timer.upper_fd = -1;
     term->blink.fd = -1;
     term->flash.fd = -1;
+    term->reflow_fd = -1;
     term->ptmx = -1;
 
     int event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
@@ -1944,6 +2179,8 @@ term_destroy(struct terminal *term)
     fdm_del(term->fdm, term->cursor_blink.fd);
     fdm_del(term->fdm, term->blink.fd);
     fdm_del(term->fdm, term->flash.fd);
+    fdm_del(term->fdm, term->reflow_fd);
+    ptmx_reader_teardown(term);
     fdm_del(term->fdm, term->ptmx);
     if (term->shutdown.terminate_timeout_fd >= 0)
         fdm_del(term->fdm, term->shutdown.terminate_timeout_fd);
@@ -1953,33 +2190,14 @@ term_destroy(struct terminal *term)
         term->window = NULL;
     }
 
-    mtx_lock(&term->render.workers.lock);
-    xassert(tll_length(term->render.workers.queue) == 0);
-
-    /* Count livinig threads - we may get here when only some of the
-     * threads have been successfully started */
-    size_t worker_count = 0;
-    if (term->render.workers.threads != NULL) {
-        for (size_t i = 0; i < term->render.workers.count; i++, worker_count++) {
-            if (term->render.workers.threads[i] == 0)
-                break;
-        }
-
-        for (size_t i = 0; i < worker_count; i++) {
-            sem_post(&term->render.workers.start);
-            tll_push_back(term->render.workers.queue, -2);
-        }
-    }
-    mtx_unlock(&term->render.workers.lock);
-
     key_binding_unref(term->wl->key_binding_manager, term->conf);
 
     urls_reset(term);
 
     free(term->vt.osc.data);
-    free(term->vt.osc8.uri);
+    osc8_uri_unref(term->vt.osc8.uri);
 
-    composed_free(term->composed);
+    composed_free(&term->composed);
 
     free(term->app_id);
     free(term->window_title);
@@ -2003,18 +2221,15 @@ term_destroy(struct terminal *term)
     free(term->search.buf);
     free(term->search.last.buf);
 
-    if (term->render.workers.threads != NULL) {
-        for (size_t i = 0; i < term->render.workers.count; i++) {
-            if (term->render.workers.threads[i] != 0)
-                thrd_join(term->render.workers.threads[i], NULL);
-        }
-    }
-    free(term->render.workers.threads);
+    free(term->render.workers.stats);
+    free(term->render.workers.work.rows);
+    free(term->render.row_hash.v);
+    free(term->render.row_hash.gen);
+    render_workers_snapshot_free(term);
     mtx_destroy(&term->render.workers.lock);
-    sem_destroy(&term->render.workers.start);
-    sem_destroy(&term->render.workers.done);
-    xassert(tll_length(term->render.workers.queue) == 0);
-    tll_free(term->render.workers.queue);
+    mtx_destroy(&term->render.glyph_cache.lock);
+    if (term->render.glyph_cache.cache != NULL)
+        pixman_glyph_cache_destroy(term->render.glyph_cache.cache);
 
     shm_unref(term->render.last_buf);
     shm_unref(term->render.background_image.last_buffer);
@@ -2055,9 +2270,17 @@ term_destroy(struct terminal *term)
 
     term_ime_reset(term);
 
+    if (term->conf->tweak.scrollback_compression_screens > 0) {
+        LOG_INFO("scrollback compression: %zu rows, %zu bytes saved",
+                 term->normal.compressed.rows,
+                 term->normal.compressed.rows * term->normal.num_cols *
+                 sizeof(struct cell) - term->normal.compressed.bytes);
+    }
+
     grid_free(&term->normal);
     grid_free(&term->alt);
     grid_free(term->interactive_resizing.grid);
+    osc8_uri_table_free(&term->osc8_uris);
     free(term->interactive_resizing.grid);
 
     free(term->foot_exe);
@@ -2166,7 +2389,7 @@ erase_cell_range(struct terminal *term, struct row *row, int start, int end)
     xassert(start < term->cols);
     xassert(end < term->cols);
 
-    row->dirty = true;
+    row_set_dirty_cols(row, start, end);
 
     const enum color_source bg_src = term->vt.attrs.bg_src;
 
@@ -2174,10 +2397,15 @@ erase_cell_range(struct terminal *term, struct row *row, int start, int end)
         for (int col = start; col <= end; col++) {
             struct cell *c = &row->cells[col];
             c->wc = 0;
-            c->attrs = (struct attributes){.bg_src = bg_src, .bg = term->vt.attrs.bg};
+            cell_set_attrs(
+                row, c,
+                (struct attributes){.bg_src = bg_src, .bg = term->vt.attrs.bg});
         }
-    } else
+    } else {
         memset(&row->cells[start], 0, (end - start + 1) * sizeof(row->cells[0]));
+        if (start == 0 && end == term->cols - 1)
+            row_attrs_reset(row);
+    }
 
     if (unlikely(row->extra != NULL)) {
         grid_row_uri_range_erase(row, start, end);
@@ -2200,6 +2428,9 @@ term_reset(struct terminal *term, bool hard)
 {
     LOG_INFO("%s resetting the terminal", hard ? "hard" : "soft");
 
+    /* Reverse video, and (hard) colors and cursor style */
+    term_render_state_changed(term);
+
     term->cursor_keys_mode = CURSOR_KEYS_NORMAL;
     term->keypad_keys_mode = KEYPAD_NUMERICAL;
     term->reverse = false;
@@ -2233,7 +2464,7 @@ term_reset(struct terminal *term, bool hard)
     term->scroll_region.start = 0;
     term->scroll_region.end = term->rows;
 
-    free(term->vt.osc8.uri);
+    osc8_uri_unref(term->vt.osc8.uri);
     free(term->vt.osc.data);
 
     term->vt = (struct vt){
@@ -2311,6 +2542,7 @@ term_reset(struct terminal *term, bool hard)
     term->alt.offset = term->alt.view = 0;
     for (size_t i = 0; i < term->rows; i++) {
         struct row *r = grid_row_and_alloc(&term->normal, i);
+        grid_row_discard_compressed(&term->normal, r);
         erase_line(term, r);
     }
     for (size_t i = 0; i < term->rows; i++) {
@@ -2325,11 +2557,17 @@ term_reset(struct terminal *term, bool hard)
         grid_row_free(term->alt.rows[i]);
         term->alt.rows[i] = NULL;
     }
+    memset(&term->normal.compressed, 0, sizeof(term->normal.compressed));
+    grid_reflow_discard(&term->normal);
+    row_pool_trim(term->normal.pool);
+    row_pool_trim(term->alt.pool);
     term->normal.cur_row = term->normal.rows[0];
     term->alt.cur_row = term->alt.rows[0];
     tll_free(term->normal.scroll_damage);
     tll_free(term->alt.scroll_damage);
-    term->render.last_cursor.row = NULL;
+    term->normal.scroll_damage_lines = 0;
+    term->alt.scroll_damage_lines = 0;
+    term->render.last_cursor.row = -1;
     term_damage_all(term);
 
     term->sixel.scrolling = true;
@@ -2586,11 +2824,15 @@ void
 term_damage_rows(struct terminal *term, int start, int end)
 {
     xassert(start <= end);
+
+    /* Grid rows, not view rows */
+    term_damage_row_hashes(term, 0, term->rows - 1);
+
     for (int r = start; r <= end; r++) {
         struct row *row = grid_row(term->grid, r);
-        row->dirty = true;
+        row_set_dirty(row);
         for (int c = 0; c < term->grid->num_cols; c++)
-            row->cells[c].attrs.clean = 0;
+            cell_set_clean(&row->cells[c], false);
     }
 }
 
@@ -2598,11 +2840,13 @@ void
 term_damage_rows_in_view(struct terminal *term, int start, int end)
 {
     xassert(start <= end);
+    term_damage_row_hashes(term, start, end);
+
     for (int r = start; r <= end; r++) {
         struct row *row = grid_row_in_view(term->grid, r);
-        row->dirty = true;
+        row_set_dirty(row);
         for (int c = 0; c < term->grid->num_cols; c++)
-            row->cells[c].attrs.clean = 0;
+            cell_set_clean(&row->cells[c], false);
     }
 }
 
@@ -2621,8 +2865,44 @@ term_damage_view(struct terminal *term)
 void
 term_damage_cursor(struct terminal *term)
 {
-    term->grid->cur_row->cells[term->grid->cursor.point.col].attrs.clean = 0;
-    term->grid->cur_row->dirty = true;
+    /* E.g. new cursor color; the cell's content is the same */
+    term_damage_row_hashes(term, 0, term->rows - 1);
+
+    cell_set_clean(&term->grid->cur_row->cells[term->grid->cursor.point.col], false);
+    row_set_dirty_cols(
+        term->grid->cur_row, term->grid->cursor.point.col,
+        term->grid->cursor.point.col);
+}
+
+/*
+ * Forgets the last rendered content of view rows start-end, forcing
+ * them to be re-rendered when dirty, even if their content hasn't
+ * changed. Use when something other than the cells themselves
+ * affects how they are rendered.
+ */
+void
+term_damage_row_hashes(struct terminal *term, int start, int end)
+{
+    xassert(start <= end);
+
+    end = min(end, term->render.row_hash.count - 1);
+    for (int r = max(start, 0); r <= end; r++) {
+        term->render.row_hash.v[r] = 0;
+        term->render.row_hash.gen[r]++;
+    }
+}
+
+/*
+ * Something copied to the render state (see struct render_state)
+ * has changed. When parsing while the render workers are busy,
+ * stop, and leave the rest to the next frame, which will be
+ * rendered with the new state.
+ */
+void
+term_render_state_changed(struct terminal *term)
+{
+    if (term->render.workers.snapshot.active)
+        term->vt.halt = true;
 }
 
 void
@@ -2631,66 +2911,88 @@ term_damage_margins(struct terminal *term)
     term->render.margins = true;
 }
 
+/*
+ * Records a palette change. Changes tend to come in bursts (e.g.
+ * theme switchers); all changes made before the next frame are
+ * applied in a single pass, see term_damage_color_apply().
+ */
 void
 term_damage_color(struct terminal *term, enum color_source src, int idx)
 {
     xassert(src == COLOR_DEFAULT || src == COLOR_BASE256);
 
-    for (int r = 0; r < term->rows; r++) {
-        struct row *row = grid_row_in_view(term->grid, r);
-        struct cell *cell = &row->cells[0];
-        const struct cell *end = &row->cells[term->cols];
+    term->render.color_damage.pending = true;
 
-        for (; cell < end; cell++) {
-            bool dirty = false;
+    if (src == COLOR_DEFAULT)
+        term->render.color_damage.default_colors = true;
+    else {
+        xassert(idx >= 0 && idx < 256);
+        term->render.color_damage.palette[idx / 64] |= 1ull << (idx % 64);
+    }
+}
 
-            switch (cell->attrs.fg_src) {
-            case COLOR_BASE16:
-            case COLOR_BASE256:
-                if (src == COLOR_BASE256 && cell->attrs.fg == idx)
-                    dirty = true;
-                break;
+static inline bool
+color_damaged(const struct terminal *term, enum color_source src,
+              uint32_t color)
+{
+    switch (src) {
+    case COLOR_DEFAULT:
+        /* Doesn't matter whether we've updated the default
+           foreground, or background, we still want to dirty this
+           cell, to be sure we handle all cases of color
+           inversion/reversal */
+        return term->render.color_damage.default_colors;
 
-            case COLOR_DEFAULT:
-                if (src == COLOR_DEFAULT) {
-                    /* Doesn't matter whether we've updated the
-                       default foreground, or background, we still
-                       want to dirty this cell, to be sure we handle
-                       all cases of color inversion/reversal */
-                    dirty = true;
-                }
-                break;
+    case COLOR_BASE16:
+    case COLOR_BASE256:
+        return (term->render.color_damage.palette[color / 64] >> (color % 64)) & 1;
 
-            case COLOR_RGB:
-                /* Not affected */
-                break;
-            }
+    case COLOR_RGB:
+        /* Not affected */
+        return false;
+    }
 
-            switch (cell->attrs.bg_src) {
-            case COLOR_BASE16:
-            case COLOR_BASE256:
-                if (src == COLOR_BASE256 && cell->attrs.bg == idx)
-                    dirty = true;
-                break;
+    BUG("Invalid color source");
+    return false;
+}
 
-            case COLOR_DEFAULT:
-                if (src == COLOR_DEFAULT) {
-                    /* Doesn't matter whether we've updated the
-                       default foreground, or background, we still
-                       want to dirty this cell, to be sure we handle
-                       all cases of color inversion/reversal */
-                    dirty = true;
-                }
-                break;
+/* Dirties all visible cells using the colors changed since last frame */
+void
+term_damage_color_apply(struct terminal *term)
+{
+    if (likely(!term->render.color_damage.pending))
+        return;
 
-            case COLOR_RGB:
-                /* Not affected */
-                break;
-            }
+    /* Palette entries, folded like the rows' summaries */
+    uint64_t palette = 0;
+    for (size_t i = 0; i < ALEN(term->render.color_damage.palette); i++)
+        palette |= term->render.color_damage.palette[i];
+
+    const bool default_colors = term->render.color_damage.default_colors;
+
+    for (int r = 0; r < term->rows; r++) {
+        struct row *row = grid_row_in_view(term->grid, r);
+
+        if (!(row->palette & palette) &&
+            !(row->default_colors && default_colors))
+        {
+            continue;
+        }
 
-            if (dirty) {
-                cell->attrs.clean = 0;
-                row->dirty = true;
+        bool damaged = false;
+
+        struct cell *cell = &row->cells[0];
+        const struct cell *end = &row->cells[term->cols];
+
+        for (; cell < end; cell++) {
+            const struct attributes *attrs = cell_attrs(row, cell);
+
+            if (color_damaged(term, attrs->fg_src, attrs->fg) ||
+                color_damaged(term, attrs->bg_src, attrs->bg))
+            {
+                cell_set_clean(cell, false);
+                row_set_dirty_cols(row, cell - row->cells, cell - row->cells);
+                damaged = true;
             }
         }
 
@@ -2707,24 +3009,55 @@ term_damage_color(struct terminal *term, enum color_source src, int idx)
                         range->underline.color_src == COLOR_BASE256 ||
                         range->underline.color_src == COLOR_RGB);
 
-                if (range->underline.color_src == src) {
+                if (color_damaged(term, range->underline.color_src,
+                                  range->underline.color))
+                {
                     struct cell *c = &row->cells[range->start];
                     const struct cell *e = &row->cells[range->end + 1];
 
                     for (; c < e; c++)
-                        c->attrs.clean = 0;
+                        cell_set_clean(c, false);
 
-                    row->dirty = true;
+                    row_set_dirty_cols(row, range->start, range->end);
+                    damaged = true;
                 }
             }
         }
+
+        /* Cells still have the same content, but not the same colors */
+        if (damaged)
+            term_damage_row_hashes(term, r, r);
     }
+
+    memset(&term->render.color_damage, 0, sizeof(term->render.color_damage));
 }
 
 void
 term_damage_scroll(struct terminal *term, enum damage_type damage_type,
                    struct scroll_region region, int lines)
 {
+    /*
+     * When the whole screen has been scrolled by a screenful, or
+     * more, since the last frame, the renderer repaints the entire
+     * view (see grid_render()). Drop the scroll damage, instead of
+     * having the renderer move pixels that are about to be
+     * overwritten.
+     *
+     * Scrolling a smaller region leaves the rows outside it as they
+     * are, and doesn't count; a full repaint would only add work.
+     */
+    if (unlikely(term->grid->scroll_damage_lines >= term->rows))
+        return;
+
+    if (region.start == 0 && region.end == term->rows) {
+        term->grid->scroll_damage_lines += min(lines, term->rows);
+
+        if (unlikely(term->grid->scroll_damage_lines >= term->rows)) {
+            tll_free(term->grid->scroll_damage);
+            return;
+        }
+    }
+
     if (likely(tll_length(term->grid->scroll_damage) > 0)) {
         struct damage *dmg = &tll_back(term->grid->scroll_damage);
 
@@ -2749,6 +3082,33 @@ term_damage_scroll(struct terminal *term, enum damage_type damage_type,
     tll_push_back(term->grid->scroll_damage, dmg);
 }
 
+UNITTEST
+{
+    struct terminal term = {.rows = 24};
+    term.grid = &term.normal;
+
+    /* A small region, scrolled over and over, is still moved */
+    const struct scroll_region pane = {.start = 2, .end = 7};
+    for (int i = 0; i < 100; i++)
+        term_damage_scroll(&term, DAMAGE_SCROLL, pane, 1);
+
+    xassert(term.normal.scroll_damage_lines == 0);
+    xassert(tll_length(term.normal.scroll_damage) == 1);
+    xassert(tll_front(term.normal.scroll_damage).lines == 100);
+
+    /* A screenful of the whole screen isn't */
+    const struct scroll_region screen = {.start = 0, .end = 24};
+    term_damage_scroll(&term, DAMAGE_SCROLL, screen, 10);
+    xassert(tll_length(term.normal.scroll_damage) == 2);
+
+    term_damage_scroll(&term, DAMAGE_SCROLL, screen, 14);
+    xassert(term.normal.scroll_damage_lines == 24);
+    xassert(tll_length(term.normal.scroll_damage) == 0);
+
+    term_damage_scroll(&term, DAMAGE_SCROLL, pane, 1);
+    xassert(tll_length(term.normal.scroll_damage) == 0);
+}
+
 void
 term_erase(struct terminal *term, int start_row, int start_col,
            int end_row, int end_col)
@@ -2843,8 +3203,8 @@ term_erase_scrollback(struct terminal *term)
     for (int i = start;; i = (i + 1) & mask) {
         struct row *row = term->grid->rows[i];
         if (row != NULL) {
-            if (term->render.last_cursor.row == row)
-                term->render.last_cursor.row = NULL;
+            if (term->render.last_cursor.row == i)
+                term->render.last_cursor.row = -1;
 
             grid_row_free(row);
             term->grid->rows[i] = NULL;
@@ -2854,6 +3214,15 @@ term_erase_scrollback(struct terminal *term)
             break;
     }
 
+    /* Only scrollback rows are compressed */
+    memset(&term->grid->compressed, 0, sizeof(term->grid->compressed));
+
+    /* Drop the not-yet-reflowed part of the scrollback too */
+    grid_reflow_discard(term->grid);
+
+    /* Give the memory back */
+    row_pool_trim(term->grid->pool);
+
     term->grid->view = term->grid->offset;
 
 #if defined(_DEBUG)
@@ -3139,6 +3508,7 @@ term_cursor_blink_update(struct terminal *term)
 
     if (activate && term->cursor_blink.fd < 0) {
         term->cursor_blink.state = CURSOR_BLINK_ON;
+        term_render_state_changed(term);
         cursor_blink_rearm_timer(term);
     } else if (!activate && term->cursor_blink.fd >= 0)
         cursor_blink_disarm_timer(term);
@@ -3160,6 +3530,54 @@ selection_on_bottom_region(const struct terminal *term,
         selection_on_rows(term, region.end, term->rows - 1);
 }
 
+static void
+compress_scrollback(struct terminal *term, int rows)
+{
+    struct grid *grid = term->grid;
+    const uint32_t screens = term->conf->tweak.scrollback_compression_screens;
+
+    if (screens >= (uint32_t)(grid->num_rows / term->rows)) {
+        /* Scrollback isn't large enough */
+        return;
+    }
+
+    /* Scrollback rows more than this many rows above the screen */
+    const int first = screens * term->rows + 1;
+
+    if (unlikely(grid->compressed.decompressed > 0) &&
+        grid->view == grid->offset)
+    {
+        /*
+         * Rows have been decompressed (viewed, searched, extracted,
+         * reflowed...) since the last sweep. Re-compress them, now
+         * that the viewport is back at the bottom.
+         */
+        grid->compressed.decompressed = 0;
+        grid_compress_scrollback(grid, term->rows, first, grid->num_rows);
+
+        LOG_DBG("scrollback: %zu compressed rows, %zu bytes saved",
+                grid->compressed.rows,
+                grid->compressed.rows * grid->num_cols * sizeof(struct cell) -
+                grid->compressed.bytes);
+    } else
+        grid_compress_scrollback(grid, term->rows, first, first + rows - 1);
+}
+
+/* grid_swap_row(), with the last rendered cursor following its row */
+static inline void
+swap_row(struct terminal *term, int row_a, int row_b)
+{
+    const int abs_a = grid_row_absolute(term->grid, row_a);
+    const int abs_b = grid_row_absolute(term->grid, row_b);
+
+    if (term->render.last_cursor.row == abs_a)
+        term->render.last_cursor.row = abs_b;
+    else if (term->render.last_cursor.row == abs_b)
+        term->render.last_cursor.row = abs_a;
+
+    grid_swap_row(term->grid, row_a, row_b);
+}
+
 void
 term_scroll_partial(struct terminal *term, struct scroll_region region, int rows)
 {
@@ -3207,20 +3625,31 @@ term_scroll_partial(struct terminal *term, struct scroll_region region, int rows
 
     /* Top non-scrolling region. */
     for (int i = region.start - 1; i >= 0; i--)
-        grid_swap_row(term->grid, i - rows, i);
+        swap_row(term, i - rows, i);
 
     /* Bottom non-scrolling region */
     for (int i = term->rows - 1; i >= region.end; i--)
-        grid_swap_row(term->grid, i - rows, i);
+        swap_row(term, i - rows, i);
 
     /* Erase scrolled in lines */
     for (int r = region.end - rows; r < region.end; r++) {
         struct row *row = grid_row_and_alloc(term->grid, r);
+
+        /* Re-used scrollback row */
+        if (unlikely(row->packed != NULL))
+            grid_row_discard_compressed(term->grid, row);
+
         erase_line(term, row);
     }
 
     term->grid->cur_row = grid_row(term->grid, term->grid->cursor.point.row);
 
+    if (unlikely(term->conf->tweak.scrollback_compression_screens > 0) &&
+        term->grid == &term->normal)
+    {
+        compress_scrollback(term, rows);
+    }
+
 #if defined(_DEBUG)
     for (int r = 0; r < term->rows; r++)
         xassert(grid_row(term->grid, r) != NULL);
@@ -3266,8 +3695,8 @@ term_scroll_reverse_partial(struct terminal *term,
         grid_row_free(row);
         term->grid->rows[abs_r] = NULL;
 
-        if (term->render.last_cursor.row == row)
-            term->render.last_cursor.row = NULL;
+        if (term->render.last_cursor.row == abs_r)
+            term->render.last_cursor.row = -1;
     }
 
     sixel_scroll_down(term, rows);
@@ -3288,15 +3717,20 @@ term_scroll_reverse_partial(struct terminal *term,
 
     /* Bottom non-scrolling region */
     for (int i = region.end + rows; i < term->rows + rows; i++)
-        grid_swap_row(term->grid, i, i - rows);
+        swap_row(term, i, i - rows);
 
     /* Top non-scrolling region */
     for (int i = 0 + rows; i < region.start + rows; i++)
-        grid_swap_row(term->grid, i, i - rows);
+        swap_row(term, i, i - rows);
 
     /* Erase scrolled in lines */
     for (int r = region.start; r < region.start + rows; r++) {
         struct row *row = grid_row_and_alloc(term->grid, r);
+
+        /* Scrollback row, compressed before it was scrolled back in */
+        if (unlikely(row->packed != NULL))
+            grid_row_discard_compressed(term->grid, row);
+
         erase_line(term, row);
     }
 
@@ -3982,7 +4416,12 @@ print_insert(struct terminal *term, int width)
 
     /* Mark moved cells as dirty */
     for (size_t i = term->grid->cursor.point.col + width; i < term->cols; i++)
-        row->cells[i].attrs.clean = 0;
+        cell_set_clean(&row->cells[i], false);
+
+    if (move_count > 0) {
+        row_set_dirty_cols(
+            row, term->grid->cursor.point.col + width, term->cols - 1);
+    }
 }
 
 static void
@@ -3993,7 +4432,8 @@ print_spacer(struct terminal *term, int col, int remaining)
     struct cell *cell = &row->cells[col];
 
     cell->wc = CELL_SPACER + remaining;
-    cell->attrs = (struct attributes){0};
+    cell_set_attrs(row, cell, (struct attributes){0});
+    row_set_dirty_cols(row, col, col);
 }
 
 /*
@@ -4013,10 +4453,12 @@ term_fill(struct terminal *term, int r, int c, uint8_t data, size_t count,
     bool use_sgr_attrs)
 {
     struct row *row = grid_row(term->grid, r);
-    row->dirty = true;
 
     xassert(c + count <= term->cols);
 
+    if (count > 0)
+        row_set_dirty_cols(row, c, c + count - 1);
+
     struct attributes attrs = use_sgr_attrs
         ? term->vt.attrs
         : (struct attributes){0};
@@ -4024,7 +4466,7 @@ term_fill(struct terminal *term, int r, int c, uint8_t data, size_t count,
     const struct cell *last = &row->cells[c + count];
     for (struct cell *cell = &row->cells[c]; cell < last; cell++) {
         cell->wc = data;
-        cell->attrs = attrs;
+        cell_set_attrs(row, cell, attrs);
 
         /* TODO: why do we print the URI here, and then erase it below? */
         if (unlikely(use_sgr_attrs && term->vt.osc8.uri != NULL)) {
@@ -4032,7 +4474,7 @@ term_fill(struct terminal *term, int r, int c, uint8_t data, size_t count,
 
             switch (term->conf->url.osc8_underline) {
             case OSC8_UNDERLINE_ALWAYS:
-                cell->attrs.url = true;
+                cell_set_url(cell, true);
                 break;
 
             case OSC8_UNDERLINE_URL_MODE:
@@ -4062,6 +4504,45 @@ term_fill(struct terminal *term, int r, int c, uint8_t data, size_t count,
     }
 }
 
+static void
+composed_gc(struct terminal *term)
+{
+    struct composed_table *composed = &term->composed;
+
+    grid_composed_mark(&term->normal, composed);
+    grid_composed_mark(&term->alt, composed);
+
+    if (term->url_grid_snapshot != NULL)
+        grid_composed_mark(term->url_grid_snapshot, composed);
+    if (term->interactive_resizing.grid != NULL)
+        grid_composed_mark(term->interactive_resizing.grid, composed);
+
+    /* Repeated by REP */
+    const char32_t last = term->vt.last_printed;
+    if (last >= CELL_COMB_CHARS_LO && last <= CELL_COMB_CHARS_HI)
+        composed_mark(composed, last - CELL_COMB_CHARS_LO);
+
+    if (composed_sweep(composed) > 0)
+        LOG_DBG("composed characters: %zu in use", composed->count);
+
+    /* Amortize the cost of marking the entire scrollback */
+    composed->gc_threshold = max(2 * composed->count, COMPOSED_GC_MIN);
+}
+
+void
+term_composed_insert(struct terminal *term, struct composed *cc)
+{
+    /* Not while the render workers may be reading the composed
+     * characters, see grid_render() */
+    if (unlikely(term->composed.count >= term->composed.gc_threshold) &&
+        !term->render.workers.snapshot.active)
+    {
+        composed_gc(term);
+    }
+
+    composed_insert(&term->composed, cc);
+}
+
 void
 term_print(struct terminal *term, char32_t wc, int width, bool insert_mode_disable)
 {
@@ -4108,12 +4589,12 @@ term_print(struct terminal *term, char32_t wc, int width, bool insert_mode_disab
 
     /* *Must* get current cell *after* linewrap+insert */
     struct row *row = grid->cur_row;
-    row->dirty = true;
+    row_set_dirty_cols(row, col, min(col + width, term->cols) - 1);
     row->linebreak = true;
 
     struct cell *cell = &row->cells[col];
     cell->wc = term->vt.last_printed = wc;
-    cell->attrs = term->vt.attrs;
+    cell_set_attrs(row, cell, term->vt.attrs);
 
     if (term->vt.osc8.uri != NULL) {
         grid_row_uri_range_put(
@@ -4121,7 +4602,7 @@ term_print(struct terminal *term, char32_t wc, int width, bool insert_mode_disab
 
         switch (term->conf->url.osc8_underline) {
         case OSC8_UNDERLINE_ALWAYS:
-            cell->attrs.url = true;
+            cell_set_url(cell, true);
             break;
 
         case OSC8_UNDERLINE_URL_MODE:
@@ -4177,12 +4658,12 @@ ascii_printer_fast(struct terminal *term, char32_t wc)
     const int uri_start = col;
 
     struct row *row = grid->cur_row;
-    row->dirty = true;
+    row_set_dirty_cols(row, col, col);
     row->linebreak = true;
 
     struct cell *cell = &row->cells[col];
     cell->wc = term->vt.last_printed = wc;
-    cell->attrs = term->vt.attrs;
+    cell_set_attrs(row, cell, term->vt.attrs);
 
     /* Advance cursor */
     if (unlikely(++col >= term->cols)) {
@@ -4211,6 +4692,88 @@ ascii_printer_single_shift(struct terminal *term, char32_t wc)
     term_update_ascii_printer(term);
 }
 
+/*
+ * Prints a run of printable ASCII characters (0x20-0x7e).
+ *
+ * When the fast ASCII printer is active, the run is written one row
+ * segment at a time: the cells are filled with a single attribute
+ * broadcast, and the row is marked dirty, and its URI/underline
+ * ranges erased, once per segment instead of once per character.
+ *
+ * Anything affecting how ASCII is printed (insert mode, charsets,
+ * sixels, OSC-8 and styled/colored underlines) falls back to the
+ * per-character printer.
+ */
+void
+term_print_ascii_run(struct terminal *term, const uint8_t *data, size_t len)
+{
+    /* Note: printer may change, e.g. after a single shift */
+    while (len > 0 && unlikely(term->ascii_printer != &ascii_printer_fast)) {
+        xassert(*data >= 0x20 && *data <= 0x7e);
+        term->ascii_printer(term, *data);
+        data++;
+        len--;
+    }
+
+    if (len == 0)
+        return;
+
+    struct grid *grid = term->grid;
+    const struct attributes attrs = term->vt.attrs;
+
+    xassert(term->charsets.set[term->charsets.selected] == CHARSET_ASCII);
+    xassert(!term->insert_mode);
+    xassert(tll_length(grid->sixel_images) == 0);
+
+    while (len > 0) {
+        print_linewrap(term);
+
+        if (unlikely(grid->cursor.lcf)) {
+            /*
+             * Auto-wrap disabled; all characters end up in the last
+             * column, each one overwriting the previous.
+             */
+            xassert(!term->auto_margin);
+            data += len - 1;
+            len = 1;
+        }
+
+        /* *Must* get current cell *after* linewrap */
+        const int col = grid->cursor.point.col;
+        const int count = min(len, (size_t)(term->cols - col));
+        xassert(count > 0);
+
+        struct row *row = grid->cur_row;
+        row_set_dirty_cols(row, col, col + count - 1);
+        row->linebreak = true;
+
+        struct cell *cell = &row->cells[col];
+        for (int i = 0; i < count; i++, cell++) {
+            xassert(data[i] >= 0x20 && data[i] <= 0x7e);
+            cell->wc = data[i];
+            cell_set_attrs(row, cell, attrs);
+        }
+
+        term->vt.last_printed = data[count - 1];
+
+        if (unlikely(row->extra != NULL)) {
+            const int end = col + count - 1;
+            grid_row_uri_range_erase(row, col, end);
+            grid_row_underline_range_erase(row, col, end);
+        }
+
+        /* Advance cursor */
+        if (col + count >= term->cols) {
+            grid->cursor.lcf = true;
+            grid->cursor.point.col = term->cols - 1;
+        } else
+            grid->cursor.point.col = col + count;
+
+        data += count;
+        len -= count;
+    }
+}
+
 void
 term_update_ascii_printer(struct terminal *term)
 {
@@ -4303,7 +4866,7 @@ term_process_and_print_non_ascii(struct terminal *term, char32_t wc)
         /* Is base cell already a cluster? */
         const struct composed *composed =
             (base >= CELL_COMB_CHARS_LO && base <= CELL_COMB_CHARS_HI)
-            ? composed_lookup(term->composed, base - CELL_COMB_CHARS_LO)
+            ? composed_lookup(&term->composed, base - CELL_COMB_CHARS_LO)
             : NULL;
 
         uint32_t key;
@@ -4389,7 +4952,7 @@ term_process_and_print_non_ascii(struct terminal *term, char32_t wc)
             /* Check if we already have a match for the entire compose chain */
             const struct composed *cc =
                 composed_lookup_without_collision(
-                    term->composed, &key,
+                    &term->composed, &key,
                     composed != NULL ? composed->chars : &(char32_t){base},
                     composed != NULL ? composed->count : 1,
                     wc, 0);
@@ -4403,7 +4966,7 @@ term_process_and_print_non_ascii(struct terminal *term, char32_t wc)
                 /* No match - allocate a new chain below */
             }
 
-            if (unlikely(term->composed_count >=
+            if (unlikely(term->composed.count >=
                          (CELL_COMB_CHARS_HI - CELL_COMB_CHARS_LO)))
             {
                 /* We reached our maximum number of allowed composed
@@ -4475,8 +5038,7 @@ term_process_and_print_non_ascii(struct terminal *term, char32_t wc)
                 break;
             }
 
-            term->composed_count++;
-            composed_insert(&term->composed, new_cc);
+            term_composed_insert(term, new_cc);
 
             wc = CELL_COMB_CHARS_LO + new_cc->key;
             width = new_cc->forced_width > 0 ? new_cc->forced_width : new_cc->width;
@@ -4494,6 +5056,106 @@ out:
         term_print(term, wc, width, insert_mode_disable);
 }
 
+/*
+ * Prints a run of decoded, non-ASCII, characters.
+ *
+ * Like term_print_ascii_run(), the common case - single and double
+ * width characters, without combining characters - is written one
+ * row segment at a time, with the row marked dirty, and its
+ * URI/underline ranges erased, once per segment.
+ *
+ * Everything else (zero-width and combining characters, double width
+ * characters not fitting on the current row, grapheme shaping, and
+ * anything that disables the fast ASCII printer) goes through
+ * term_process_and_print_non_ascii().
+ */
+void
+term_process_and_print_non_ascii_run(struct terminal *term,
+                                     const char32_t *wcs, size_t count)
+{
+    if (unlikely(term->ascii_printer != &ascii_printer_fast) ||
+        term->grapheme_shaping)
+    {
+        for (size_t i = 0; i < count; i++)
+            term_process_and_print_non_ascii(term, wcs[i]);
+        return;
+    }
+
+    struct grid *grid = term->grid;
+    const struct attributes attrs = term->vt.attrs;
+
+    xassert(!term->insert_mode);
+    xassert(tll_length(grid->sixel_images) == 0);
+
+    size_t i = 0;
+    while (i < count) {
+        print_linewrap(term);
+
+        if (unlikely(grid->cursor.lcf)) {
+            /* Auto-wrap disabled */
+            xassert(!term->auto_margin);
+            for (; i < count; i++)
+                term_process_and_print_non_ascii(term, wcs[i]);
+            break;
+        }
+
+        /* *Must* get current cell *after* linewrap */
+        const int start = grid->cursor.point.col;
+        struct row *row = grid->cur_row;
+        char32_t last = 0;
+        int col = start;
+
+        for (; i < count; i++) {
+            const char32_t wc = wcs[i];
+            const int width = c32width(wc);
+
+            if (width == 1 && col < term->cols) {
+                struct cell *cell = &row->cells[col++];
+                cell->wc = wc;
+                cell_set_attrs(row, cell, attrs);
+            } else if (width == 2 && col + 2 <= term->cols) {
+                struct cell *cell = &row->cells[col];
+                cell->wc = wc;
+                cell_set_attrs(row, cell, attrs);
+
+                /* See print_spacer() */
+                cell++;
+                cell->wc = CELL_SPACER + 1;
+                cell_set_attrs(row, cell, (struct attributes){0});
+                col += 2;
+            } else
+                break;
+
+            last = wc;
+        }
+
+        if (col == start) {
+            /* Not a simple character, or (row) segment is full */
+            term_process_and_print_non_ascii(term, wcs[i++]);
+            continue;
+        }
+
+        const int end = col - 1;
+        row_set_dirty_cols(row, start, end);
+        row->linebreak = true;
+
+        term->vt.last_printed = last;
+        term_reset_grapheme_state(term);
+
+        if (unlikely(row->extra != NULL)) {
+            grid_row_uri_range_erase(row, start, end);
+            grid_row_underline_range_erase(row, start, end);
+        }
+
+        /* Advance cursor */
+        if (col >= term->cols) {
+            grid->cursor.lcf = true;
+            grid->cursor.point.col = term->cols - 1;
+        } else
+            grid->cursor.point.col = col;
+    }
+}
+
 enum term_surface
 term_surface_kind(const struct terminal *term, const struct wl_surface *surface)
 {
@@ -4531,7 +5193,7 @@ rows_to_text(const struct terminal *term, int start, int end,
     int r = start;
 
     while (true) {
-        const struct row *row = term->grid->rows[r];
+        const struct row *row = grid_row_abs(term->grid, r);
         xassert(row != NULL);
 
         const int c_end = r == end ? col_end : term->cols;
@@ -4765,7 +5427,7 @@ term_osc8_open(struct terminal *term, uint64_t id, const char *uri)
     xassert(term->vt.osc8.uri == NULL);
 
     term->vt.osc8.id = id;
-    term->vt.osc8.uri = xstrdup(uri);
+    term->vt.osc8.uri = osc8_uri_intern(&term->osc8_uris, uri);
 
     term->bits_affecting_ascii_printer.osc8 = true;
     term_update_ascii_printer(term);
@@ -4774,7 +5436,7 @@ term_osc8_open(struct terminal *term, uint64_t id, const char *uri)
 void
 term_osc8_close(struct terminal *term)
 {
-    free(term->vt.osc8.uri);
+    osc8_uri_unref(term->vt.osc8.uri);
     term->vt.osc8.uri = NULL;
     term->vt.osc8.id = 0;
     term->bits_affecting_ascii_printer.osc8 = false;
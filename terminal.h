@@ -1,8 +1,11 @@
 #pragma once
 
+#include <limits.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 
 #include <threads.h>
 #include <semaphore.h>
@@ -21,6 +24,7 @@
 #include "key-binding.h"
 #include "macros.h"
 #include "notify.h"
+#include "osc8-uri.h"
 #include "reaper.h"
 #include "shm.h"
 #include "wayland.h"
@@ -65,11 +69,33 @@ static_assert(sizeof(struct attributes) == 8, "VT attribute struct too large");
 #define CELL_COMB_CHARS_HI          (CELL_COMB_CHARS_LO + 0x3fffffff)
 #define CELL_SPACER                 (CELL_COMB_CHARS_HI + 1)
 
+#if defined(FOOT_COMPACT_CELLS) && FOOT_COMPACT_CELLS
+/*
+ * Compact cells (-Dcompact-cells): the attributes are interned in a
+ * per-row table (struct row.attrs), and the cell only holds an index
+ * into it. There's usually only a handful of distinct attributes per
+ * row. The render state, which changes independently of the
+ * attributes, is stored in the cell itself.
+ *
+ * Always use the cell_*() accessors (see below) to access the
+ * attributes, and the render state.
+ */
+struct cell {
+    char32_t wc;
+    uint16_t attrs_idx;
+    bool clean:1;
+    bool confined:1;
+    bool selected:1;
+    bool url:1;
+};
+static_assert(sizeof(struct cell) == 8, "bad size");
+#else
 struct cell {
     char32_t wc;
     struct attributes attrs;
 };
 static_assert(sizeof(struct cell) == 12, "bad size");
+#endif
 
 struct scroll_region {
     int start;
@@ -102,7 +128,7 @@ struct damage {
 
 struct uri_range_data {
     uint64_t id;
-    char *uri;
+    struct osc8_uri *uri;  /* Reference, see osc8_uri_ref() */
 };
 
 enum underline_style {
@@ -154,12 +180,50 @@ struct row_data {
     struct row_ranges underline_ranges;
 };
 
+struct row_packed;
+struct row_pool;
+struct row_slab;
+
 struct row {
-    struct cell *cells;
+    struct cell *cells;         /* NULL when compressed */
+    struct row_slab *slab;      /* Slab 'cells' belong to, NULL if malloc:ed */
     struct row_data *extra;
+    struct row_packed *packed;  /* Compressed cells, see grid_row_compress() */
+
+#if defined(FOOT_COMPACT_CELLS) && FOOT_COMPACT_CELLS
+    /* Interned attributes; v[0] is always the default attributes */
+    struct {
+        struct attributes *v;
+        uint16_t count;
+        uint16_t size;
+        uint16_t last;  /* Most recently interned */
+        uint16_t cols;
+    } attrs;
+#endif
 
     bool dirty;
     bool linebreak;
+    bool blink;       /* May have blinking cells, see fdm_blink() */
+    bool default_colors;  /* Default fg/bg used, see 'palette' */
+    uint16_t shares;  /* Other grids referencing the row, see grid_snapshot() */
+
+    /*
+     * Unique; a new one is assigned whenever the row's cells are
+     * (re)allocated. Identifies the row in the render snapshot, where
+     * the row's address alone may have been reused.
+     */
+    uint64_t gen;
+
+    /* Columns with dirty cells, when 'dirty', see row_set_dirty_cols() */
+    int dirty_start;
+    int dirty_end;
+
+    /*
+     * Palette entries used by the cells (bit 'idx % 64'), as of when
+     * they were rendered. May have false positives. Used to find the
+     * rows affected by palette changes, see term_damage_color().
+     */
+    uint64_t palette;
 
     struct {
         bool prompt_marker;
@@ -168,6 +232,180 @@ struct row {
     } shell_integration;
 };
 
+/*
+ * Cell accessors
+ *
+ * cell_attrs() returns the cell's SGR attributes. The render state
+ * (clean, confined, selected and url) is *not* valid in the returned
+ * struct; use cell_clean(), cell_set_clean() etc.
+ *
+ * cell_get_attrs() returns a copy of the attributes, with the render
+ * state filled in. cell_set_attrs() sets both the attributes, and the
+ * render state, like a plain assignment of the default cell layout's
+ * 'attrs' member. Pointers returned by cell_attrs(), and cell
+ * indices copied out of a row, are invalidated by cell_set_attrs()
+ * on the same row.
+ */
+#if defined(FOOT_COMPACT_CELLS) && FOOT_COMPACT_CELLS
+
+uint16_t row_attrs_intern_slow(struct row *row, struct attributes attrs);
+void row_attrs_init(struct row *row, int cols);
+void row_attrs_copy(struct row *dst, const struct row *src);
+void row_attrs_free(struct row *row);
+
+/* All cells in the row are about to be reset to the default attributes */
+void row_attrs_reset(struct row *row);
+
+static inline uint64_t
+attrs_sgr_bits(struct attributes attrs)
+{
+    attrs.clean = false;
+    attrs.confined = false;
+    attrs.selected = false;
+    attrs.url = false;
+
+    uint64_t bits;
+    memcpy(&bits, &attrs, sizeof(bits));
+    return bits;
+}
+
+static inline uint16_t
+row_attrs_intern(struct row *row, struct attributes attrs)
+{
+    const uint64_t bits = attrs_sgr_bits(attrs);
+
+    if (likely(row->attrs.v != NULL) &&
+        attrs_sgr_bits(row->attrs.v[row->attrs.last]) == bits)
+    {
+        return row->attrs.last;
+    }
+
+    return row_attrs_intern_slow(row, attrs);
+}
+
+
+static inline const struct attributes *
+cell_attrs(const struct row *row, const struct cell *cell)
+{
+    xassert(cell->attrs_idx < row->attrs.count);
+    return &row->attrs.v[cell->attrs_idx];
+}
+
+static inline struct attributes
+cell_get_attrs(const struct row *row, const struct cell *cell)
+{
+    struct attributes attrs = *cell_attrs(row, cell);
+    attrs.clean = cell->clean;
+    attrs.confined = cell->confined;
+    attrs.selected = cell->selected;
+    attrs.url = cell->url;
+    return attrs;
+}
+
+static inline void
+cell_set_attrs(struct row *row, struct cell *cell, struct attributes attrs)
+{
+    cell->attrs_idx = row_attrs_intern(row, attrs);
+    cell->clean = attrs.clean;
+    cell->confined = attrs.confined;
+    cell->selected = attrs.selected;
+    cell->url = attrs.url;
+}
+
+/* Copies a cell, possibly from another row */
+static inline void
+cell_copy(struct row *dst_row, struct cell *dst,
+          const struct row *src_row, const struct cell *src)
+{
+    *dst = *src;
+    if (dst_row != src_row)
+        dst->attrs_idx = row_attrs_intern(dst_row, *cell_attrs(src_row, src));
+}
+
+static inline bool cell_clean(const struct cell *cell) { return cell->clean; }
+static inline void cell_set_clean(struct cell *cell, bool v) { cell->clean = v; }
+static inline bool cell_confined(const struct cell *cell) { return cell->confined; }
+static inline void cell_set_confined(struct cell *cell, bool v) { cell->confined = v; }
+static inline bool cell_selected(const struct cell *cell) { return cell->selected; }
+static inline void cell_set_selected(struct cell *cell, bool v) { cell->selected = v; }
+static inline bool cell_url(const struct cell *cell) { return cell->url; }
+static inline void cell_set_url(struct cell *cell, bool v) { cell->url = v; }
+
+#else
+
+static inline void row_attrs_init(struct row *row, int cols) {}
+static inline void row_attrs_copy(struct row *dst, const struct row *src) {}
+static inline void row_attrs_free(struct row *row) {}
+static inline void row_attrs_reset(struct row *row) {}
+
+static inline const struct attributes *
+cell_attrs(const struct row *row, const struct cell *cell)
+{
+    return &cell->attrs;
+}
+
+static inline struct attributes
+cell_get_attrs(const struct row *row, const struct cell *cell)
+{
+    return cell->attrs;
+}
+
+static inline void
+cell_set_attrs(struct row *row, struct cell *cell, struct attributes attrs)
+{
+    cell->attrs = attrs;
+}
+
+static inline void
+cell_copy(struct row *dst_row, struct cell *dst,
+          const struct row *src_row, const struct cell *src)
+{
+    *dst = *src;
+}
+
+static inline bool cell_clean(const struct cell *cell) { return cell->attrs.clean; }
+static inline void cell_set_clean(struct cell *cell, bool v) { cell->attrs.clean = v; }
+static inline bool cell_confined(const struct cell *cell) { return cell->attrs.confined; }
+static inline void cell_set_confined(struct cell *cell, bool v) { cell->attrs.confined = v; }
+static inline bool cell_selected(const struct cell *cell) { return cell->attrs.selected; }
+static inline void cell_set_selected(struct cell *cell, bool v) { cell->attrs.selected = v; }
+static inline bool cell_url(const struct cell *cell) { return cell->attrs.url; }
+static inline void cell_set_url(struct cell *cell, bool v) { cell->attrs.url = v; }
+
+#endif
+
+/*
+ * Row damage. All dirty cells of a dirty row are within its dirty
+ * span, and only the span is rendered. Always use these, instead of
+ * setting row->dirty directly.
+ */
+static inline void
+row_set_dirty_cols(struct row *row, int start, int end)
+{
+    xassert(start <= end);
+
+    if (!row->dirty) {
+        row->dirty = true;
+        row->dirty_start = start;
+        row->dirty_end = end;
+        return;
+    }
+
+    if (start < row->dirty_start)
+        row->dirty_start = start;
+    if (end > row->dirty_end)
+        row->dirty_end = end;
+}
+
+/* Dirty span covering the entire row */
+static inline void
+row_set_dirty(struct row *row)
+{
+    row->dirty = true;
+    row->dirty_start = 0;
+    row->dirty_end = INT_MAX;
+}
+
 struct sixel {
     /*
      * These three members reflect the "current", maybe scaled version
@@ -245,10 +483,29 @@ struct grid {
 
     struct row **rows;
     struct row *cur_row;
+    struct row_pool *pool;  /* Cell allocator */
 
     tll(struct damage) scroll_damage;
     tll(struct sixel) sixel_images;
 
+    /*
+     * Number of lines the whole screen (not a smaller scroll region)
+     * has been scrolled since the last frame. Once it reaches the
+     * screen height, scroll_damage is emptied, no more scroll
+     * damage is recorded, and the next frame is a full repaint (see
+     * term_damage_scroll())
+     */
+    int scroll_damage_lines;
+
+    /* Compressed scrollback (tweak.scrollback-compression-screens) */
+    struct {
+        size_t rows;          /* Currently compressed rows */
+        size_t bytes;         /* Size of the compressed data */
+        size_t decompressed;  /* Rows decompressed since the last sweep */
+    } compressed;
+
+    struct grid_reflow *reflow;  /* Scrollback not yet reflowed, see grid.c */
+
     struct {
         enum kitty_kbd_flags flags[8];
         uint8_t idx;
@@ -271,6 +528,7 @@ struct vt_param {
 struct vt {
     int state;  /* enum state */
     char32_t last_printed;
+    bool halt;  /* Return from vt_from_slave() after the current sequence */
 #if defined(FOOT_GRAPHEME_CLUSTERING)
     utf8proc_int32_t grapheme_state;
 #endif
@@ -297,7 +555,7 @@ struct vt {
     /* Start coordinate for current OSC-8 URI */
     struct {
         uint64_t id;
-        char *uri;
+        struct osc8_uri *uri;
     } osc8;
 
     struct underline_range_data underline;
@@ -407,6 +665,25 @@ struct colors {
     bool use_custom_selection;
 };
 
+enum blink_state { BLINK_ON, BLINK_OFF };
+enum cursor_blink_state { CURSOR_BLINK_ON, CURSOR_BLINK_OFF };
+
+/*
+ * Terminal state, other than the cells, that the grid is rendered
+ * from. Copied at the start of each frame, since the parser may
+ * change the live state while the render workers are busy (see
+ * grid_render()).
+ */
+struct render_state {
+    struct colors colors;
+    bool reverse;
+    enum blink_state blink;
+    enum cursor_style cursor_style;
+    enum cursor_blink_state cursor_blink;
+    struct coord cursor;  /* View relative, even when hidden */
+    enum fcft_subpixel font_subpixel;
+};
+
 struct terminal {
     struct fdm *fdm;
     struct reaper *reaper;
@@ -427,6 +704,7 @@ struct terminal {
 
     pid_t slave;
     int ptmx;
+    struct ptmx_reader *ptmx_reader;  /* tweak.pty-reader-thread */
 
     struct vt vt;
     struct grid *grid;
@@ -458,8 +736,8 @@ struct terminal {
 
     tll(int) tab_stops;
 
-    size_t composed_count;
-    struct composed *composed;
+    struct composed_table composed;
+    struct osc8_uri_table osc8_uris;
 
     /* Temporary: for FDM */
     struct {
@@ -568,10 +846,12 @@ struct terminal {
     } flash;
 
     struct {
-        enum { BLINK_ON, BLINK_OFF } state;
+        enum blink_state state;
         int fd;
     } blink;
 
+    int reflow_fd;  /* Deferred scrollback reflow, see term_reflow_schedule() */
+
     float scale;
     float scale_before_unmap;  /* Last scaling factor used */
     int width;  /* pixels */
@@ -600,7 +880,7 @@ struct terminal {
         bool decset;   /* Blink enabled via '\E[?12h' */
         bool deccsusr; /* Blink enabled via '\E[X q' */
         int fd;
-        enum { CURSOR_BLINK_ON, CURSOR_BLINK_OFF } state;
+        enum cursor_blink_state state;
     } cursor_blink;
 
     struct {
@@ -705,20 +985,94 @@ struct terminal {
             int timer_fd;
         } app_sync_updates;
 
-        /* Render threads + synchronization primitives */
+        /* Render threads (shared, see render_pool_init()) + per-frame state */
         struct {
+            struct render_pool *pool;  /* NULL if count == 0 */
             uint16_t count;
-            sem_t start;
-            sem_t done;
             mtx_t lock;
-            tll(int) queue;
-            thrd_t *threads;
             struct buffer *buf;
+            struct coord cursor;  /* View-relative, {-1, -1} if hidden */
+            bool arm_blink_timer;
+
+            /*
+             * Work for the current frame (or job). Workers claim
+             * batches of [0, count) by advancing 'next', see
+             * render_worker_thread()
+             */
+            struct {
+                int *rows;      /* Dirty view rows; unused by jobs */
+                int rows_size;  /* Allocated entries in 'rows' */
+                int count;
+                atomic_int next;
+            } work;
+
+            /* Per worker, for the render timer log */
+            struct {
+                int rows;
+                struct timespec busy;
+            } *stats;
+
+            /* Non-render job, see render_workers_run() */
+            struct {
+                void (*run)(void *data, size_t idx);
+                void *data;
+            } job;
+
+            /*
+             * Copies of the dirty rows, rendered by the workers
+             * instead of the live rows, while the main thread parses
+             * more PTY data (see grid_render()).
+             */
+            struct {
+                bool active;
+                int num_rows;
+                int num_cols;
+                struct row *rows;       /* Indexed by view row */
+                uint64_t *src_gen;      /* Live row's 'gen', 0 if not copied */
+
+                /* Taken every frame, whether pipelined or not */
+                struct render_state state;
+
+                /* Row hashes used, and updated, by the workers */
+                uint64_t *hash;
+                uint32_t *hash_gen;     /* row_hash.gen when copied */
+            } snapshot;
         } workers;
 
-        /* Last rendered cursor position */
+        /* Glyphs composited in bulk, see render_row() */
+        struct {
+            pixman_glyph_cache_t *cache;
+            mtx_t lock;
+        } glyph_cache;
+
+        /*
+         * Hash of each view row's content, as last rendered, used to
+         * skip rows rewritten with identical content. 0 if unknown,
+         * see render_row()
+         */
+        struct {
+            uint64_t *v;
+            uint32_t *gen; /* Bumped each time v[] is reset */
+            int count;
+            bool enabled;  /* This frame */
+            atomic_size_t hits;
+            atomic_size_t misses;
+        } row_hash;
+
+        /* Palette changes, applied once per frame, see term_damage_color() */
         struct {
-            struct row *row;
+            bool pending;
+            bool default_colors;
+            uint64_t palette[256 / 64];
+        } color_damage;
+
+        /*
+         * Last rendered cursor position. The row is an absolute row
+         * number (-1 if none), and is looked up again when used,
+         * since the row may have been unshared (see grid_snapshot()).
+         */
+        struct {
+            int row;
             int col;
             bool hidden;
         } last_cursor;
@@ -842,9 +1196,11 @@ struct terminal {
 };
 
 struct config;
+struct render_pool;
 struct terminal *term_init(
     const struct config *conf, struct fdm *fdm, struct reaper *reaper,
-    struct wayland *wayl, const char *foot_exe, const char *cwd,
+    struct wayland *wayl, struct render_pool *render_pool,
+    const char *foot_exe, const char *cwd,
     const char *token, const char *pty_path,
     int argc, char *const *argv, const char *const *envp,
     void (*shutdown_cb)(void *data, int exit_code), void *shutdown_data);
@@ -885,6 +1241,9 @@ void term_damage_view(struct terminal *term);
 void term_damage_cursor(struct terminal *term);
 void term_damage_margins(struct terminal *term);
 void term_damage_color(struct terminal *term, enum color_source src, int idx);
+void term_damage_color_apply(struct terminal *term);
+void term_damage_row_hashes(struct terminal *term, int start, int end);
+void term_render_state_changed(struct terminal *term);
 
 void term_reset_view(struct terminal *term);
 
@@ -909,8 +1268,15 @@ void term_cursor_down(struct terminal *term, int count);
 void term_cursor_blink_update(struct terminal *term);
 
 void term_process_and_print_non_ascii(struct terminal *term, char32_t wc);
+void term_process_and_print_non_ascii_run(
+    struct terminal *term, const char32_t *wcs, size_t count);
 void term_print(struct terminal *term, char32_t wc, int width,
                 bool insert_mode_disable);
+
+/* Adds a composed character; may first garbage collect unused ones */
+void term_composed_insert(struct terminal *term, struct composed *cc);
+void term_print_ascii_run(struct terminal *term, const uint8_t *data,
+                          size_t len);
 void term_fill(struct terminal *term, int row, int col, uint8_t c, size_t count,
                bool use_sgr_attrs);
 
@@ -928,6 +1294,12 @@ void term_reverse_index(struct terminal *term);
 
 void term_arm_blink_timer(struct terminal *term);
 
+/* Reflow the scrollback rows deferred by the last resize: in the
+ * background, until at least 'rows' rows above the viewport, or all */
+void term_reflow_schedule(struct terminal *term);
+void term_reflow_rows(struct terminal *term, int rows);
+void term_reflow_complete(struct terminal *term);
+
 void term_save_cursor(struct terminal *term);
 void term_restore_cursor(struct terminal *term, const struct cursor *cursor);
 
@@ -987,6 +1359,8 @@ void term_osc8_close(struct terminal *term);
 
 bool term_ptmx_pause(struct terminal *term);
 bool term_ptmx_resume(struct terminal *term);
+bool term_ptmx_has_pending(struct terminal *term);
+size_t term_ptmx_parse_pending(struct terminal *term, size_t budget);
 
 void term_enable_size_notifications(struct terminal *term);
 void term_disable_size_notifications(struct terminal *term);
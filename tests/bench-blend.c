@@ -0,0 +1,138 @@
+/*
+ * Micro-benchmark: blend_mask_over_solid() vs. pixman, compositing
+ * glyph sized masks onto a shm-like buffer.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pixman.h>
+
+#include "../blend.h"
+#include "../log.h"
+
+#define DST_WIDTH 1920
+#define DST_HEIGHT 1080
+
+static double
+now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Glyph-like coverage: mostly empty, with an opaque core and AA edges */
+static pixman_image_t *
+create_mask(pixman_format_code_t format, int width, int height)
+{
+    pixman_image_t *mask = pixman_image_create_bits(format, width, height, NULL, 0);
+    uint8_t *data = (uint8_t *)pixman_image_get_data(mask);
+    const int stride = pixman_image_get_stride(mask);
+    const bool subpixel = format != PIXMAN_a8;
+
+    for (int y = height / 4; y < height * 3 / 4; y++) {
+        for (int x = width / 5; x < width * 4 / 5; x++) {
+            const bool edge = x == width / 5 || y == height / 4;
+            const uint8_t a = edge ? 0x60 : 0xff;
+
+            if (subpixel) {
+                uint32_t *px = (uint32_t *)(data + y * stride) + x;
+                *px = (uint32_t)a << 24 | (uint32_t)a << 16 | (uint32_t)(a / 2) << 8 | a / 3;
+            } else
+                data[y * stride + x] = a;
+        }
+    }
+
+    if (subpixel)
+        pixman_image_set_component_alpha(mask, true);
+    return mask;
+}
+
+static void
+bench(const char *name, pixman_format_code_t dst_format,
+      pixman_format_code_t mask_format, int cell_width, int cell_height)
+{
+    pixman_image_t *dst = pixman_image_create_bits(
+        dst_format, DST_WIDTH, DST_HEIGHT, NULL, 0);
+    pixman_image_t *mask = create_mask(mask_format, cell_width, cell_height);
+
+    const pixman_color_t color = {0xdcdc, 0xdcdc, 0xcccc, 0xffff};
+    pixman_image_t *src = pixman_image_create_solid_fill(&color);
+
+    const int cols = DST_WIDTH / cell_width;
+    const int rows = DST_HEIGHT / cell_height;
+    const int frames = 20;
+    const size_t glyphs = (size_t)frames * cols * rows;
+
+    double start = now();
+    for (int f = 0; f < frames; f++) {
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                pixman_image_composite32(
+                    PIXMAN_OP_OVER, src, mask, dst, 0, 0, 0, 0,
+                    c * cell_width, r * cell_height, cell_width, cell_height);
+            }
+        }
+    }
+    const double pixman_time = now() - start;
+
+    bool supported = true;
+    start = now();
+    for (int f = 0; f < frames && supported; f++) {
+        for (int r = 0; r < rows && supported; r++) {
+            const pixman_box32_t clip = {
+                0, r * cell_height, DST_WIDTH, (r + 1) * cell_height};
+
+            for (int c = 0; c < cols && supported; c++) {
+                supported = blend_mask_over_solid(
+                    dst, &color, mask, c * cell_width, r * cell_height, &clip);
+            }
+        }
+    }
+    const double blend_time = now() - start;
+
+    if (supported) {
+        printf("%-24s %2dx%-2d  pixman: %6.1f ns/glyph  blend: %6.1f ns/glyph  (%.2fx)\n",
+               name, cell_width, cell_height,
+               pixman_time * 1e9 / glyphs, blend_time * 1e9 / glyphs,
+               pixman_time / blend_time);
+    } else
+        printf("%-24s %2dx%-2d  not supported\n", name, cell_width, cell_height);
+
+    pixman_image_unref(src);
+    pixman_image_unref(mask);
+    pixman_image_unref(dst);
+}
+
+int
+main(int argc, const char *const *argv)
+{
+    log_init(LOG_COLORIZE_AUTO, false, 0, LOG_CLASS_ERROR);
+
+    static const struct {
+        int width;
+        int height;
+    } cells[] = {
+        {8, 16},
+        {10, 21},
+        {13, 27},
+        {18, 38},
+    };
+
+    for (size_t i = 0; i < sizeof(cells) / sizeof(cells[0]); i++) {
+        const int w = cells[i].width;
+        const int h = cells[i].height;
+
+        bench("a8 -> x8r8g8b8", PIXMAN_x8r8g8b8, PIXMAN_a8, w, h);
+        bench("a8 -> a8r8g8b8", PIXMAN_a8r8g8b8, PIXMAN_a8, w, h);
+        bench("subpixel -> x8r8g8b8", PIXMAN_x8r8g8b8, PIXMAN_a8r8g8b8, w, h);
+        bench("a8 -> x2r10g10b10", PIXMAN_x2r10g10b10, PIXMAN_a8, w, h);
+    }
+
+    log_deinit();
+    return 0;
+}
@@ -1380,6 +1380,15 @@ test_section_tweak(void)
     test_float(&ctx, &parse_section_tweak, "bold-text-in-bright-amount",
                &conf.bold_in_bright.amount);
 
+    test_boolean(&ctx, &parse_section_tweak, "pty-reader-thread",
+                 &conf.tweak.pty_reader_thread);
+    test_uint32(&ctx, &parse_section_tweak, "pty-ring-size-kb",
+                &conf.tweak.pty_ring_size_kb);
+    test_uint32(&ctx, &parse_section_tweak, "pty-parse-budget-kb",
+                &conf.tweak.pty_parse_budget_kb);
+    test_uint32(&ctx, &parse_section_tweak, "scrollback-compression-screens",
+                &conf.tweak.scrollback_compression_screens);
+
 #if 0 /* Must be equal to, or less than INT32_MAX */
     test_uint32(&ctx, &parse_section_tweak, "max-shm-pool-size-mb",
                 &conf.tweak.max_shm_pool_size);
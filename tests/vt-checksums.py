@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+import argparse
+import os
+import subprocess
+import sys
+
+
+# Each stimuli file is parsed once per variant; all must produce the
+# recorded checksums
+VARIANTS = [
+    [],
+    ['--per-byte'],
+    ['--scrollback-compression=1'],
+    ['--per-byte', '--scrollback-compression=1'],
+]
+
+
+def checksums(pgo, variant, stimuli):
+    out = subprocess.run([pgo, '--checksum'] + variant + [stimuli],
+                         stdout=subprocess.PIPE, check=True, text=True).stdout
+
+    normal = None
+    alt = None
+
+    for line in out.splitlines():
+        if line.startswith('normal grid checksum:'):
+            normal = line.split()[-1]
+        elif line.startswith('alt grid checksum:'):
+            alt = line.split()[-1]
+
+    return normal, alt
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Verify the VT parser produces the recorded grid checksums')
+    parser.add_argument('pgo', help='path to the PGO helper binary')
+    parser.add_argument('expected', type=argparse.FileType('r'),
+                        help='file with the expected checksums')
+    parser.add_argument('stimuli', nargs='+', help='stimuli files')
+    opts = parser.parse_args()
+
+    expected = {}
+    for line in opts.expected:
+        line = line.strip()
+        if not line or line.startswith('#'):
+            continue
+
+        name, normal, alt = line.split()
+        expected[name] = (normal, alt)
+
+    failed = False
+
+    for stimuli in opts.stimuli:
+        name = os.path.basename(stimuli)
+        if name not in expected:
+            print(f'{name}: no recorded checksums')
+            failed = True
+            continue
+
+        for variant in VARIANTS:
+            actual = checksums(opts.pgo, variant, stimuli)
+            status = 'ok' if actual == expected[name] else 'FAILED'
+            failed = failed or actual != expected[name]
+
+            print(f'{name} ({" ".join(variant) or "chunked"}): '
+                  f'normal={actual[0]}, alt={actual[1]}: {status}')
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
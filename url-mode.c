@@ -342,7 +342,7 @@ regex_detected(const struct terminal *term, enum url_action action,
             /* Expand combining characters */
             if (wc[0] >= CELL_COMB_CHARS_LO && wc[0] <= CELL_COMB_CHARS_HI) {
                 const struct composed *composed =
-                    composed_lookup(term->composed, wc[0] - CELL_COMB_CHARS_LO);
+                    composed_lookup(&term->composed, wc[0] - CELL_COMB_CHARS_LO);
                 xassert(composed != NULL);
 
                 wc = composed->chars;
@@ -474,7 +474,7 @@ osc8_uris(const struct terminal *term, enum url_action action, url_list_t *urls)
                *urls,
                ((struct url){
                    .id = range->uri.id,
-                   .url = xstrdup(range->uri.uri),
+                   .url = xstrdup(range->uri.uri->str),
                    .range = {
                        .start = start,
                        .end = end,
@@ -697,13 +697,13 @@ tag_cells_for_url(struct terminal *term, const struct url *url, bool value)
     size_t r = start->row & (grid->num_rows - 1);
     size_t c = start->col;
 
-    struct row *row = grid->rows[r];
-    row->dirty = true;
+    struct row *row = grid_row_abs(grid, r);
 
     while (true) {
         struct cell *cell = &row->cells[c];
-        cell->attrs.url = value;
-        cell->attrs.clean = 0;
+        cell_set_url(cell, value);
+        cell_set_clean(cell, false);
+        row_set_dirty_cols(row, c, c);
 
         if (r == end_r && c == end->col)
             break;
@@ -712,13 +712,12 @@ tag_cells_for_url(struct terminal *term, const struct url *url, bool value)
             r = (r + 1) & (grid->num_rows - 1);
             c = 0;
 
-            row = grid->rows[r];
+            row = grid_row_abs(grid, r);
             if (row == NULL) {
                 /* Un-allocated scrollback. This most likely means a
                  * runaway OSC-8 URL. */
                 break;
             }
-            row->dirty = true;
         }
     }
 }
@@ -738,19 +737,26 @@ urls_render(struct terminal *term, const struct config_spawn_template *launch)
     }
 
     /* Dirty the last cursor, to ensure it is erased */
-    {
-        struct row *cursor_row = term->render.last_cursor.row;
-        if (cursor_row != NULL) {
+    if (term->render.last_cursor.row >= 0) {
+        const int last_row = term->render.last_cursor.row;
+        xassert(last_row < term->grid->num_rows);
+        const struct row *old = term->grid->rows[last_row];
+
+        if (old != NULL && old->packed == NULL) {
+            struct row *cursor_row = grid_row_abs(term->grid, last_row);
             struct cell *cell = &cursor_row->cells[term->render.last_cursor.col];
-            cell->attrs.clean = 0;
-            cursor_row->dirty = true;
+            cell_set_clean(cell, false);
+            row_set_dirty_cols(
+                cursor_row, term->render.last_cursor.col,
+                term->render.last_cursor.col);
         }
     }
-    term->render.last_cursor.row = NULL;
+    term->render.last_cursor.row = -1;
 
     /* Clear scroll damage, to ensure we don't apply it twice (once on
      * the snapshot:ed grid, and then later again on the real grid) */
     tll_free(term->grid->scroll_damage);
+    term->grid->scroll_damage_lines = 0;
 
     /* Damage the entire view, to ensure a full screen redraw, both
      * now, when entering URL mode, and later, when exiting it. */
@@ -802,7 +808,7 @@ urls_reset(struct terminal *term)
      * since we marked the cell as dirty *before* taking the grid
      * snapshot.
      */
-    term->render.last_cursor.row = NULL;
+    term->render.last_cursor.row = -1;
 
     if (term->window != NULL) {
         tll_foreach(term->window->urls, it) {
@@ -8,6 +8,12 @@
  #include <utf8proc.h>
 #endif
 
+#if defined(__AVX2__)
+ #include <immintrin.h>
+#elif defined(__SSE2__)
+ #include <emmintrin.h>
+#endif
+
 #define LOG_MODULE "vt"
 #define LOG_ENABLE_DBG 0
 #include "log.h"
@@ -103,11 +109,6 @@ esc_as_string(struct terminal *term, uint8_t final)
 }
 #endif
 
-static void
-action_ignore(struct terminal *term)
-{
-}
-
 static void
 action_clear(struct terminal *term)
 {
@@ -201,17 +202,17 @@ action_execute(struct terminal *term, uint8_t c)
          * subsequent cells, all the way until the next tab stop.
          */
         if (emit_tab_char) {
-            row->dirty = true;
+            row_set_dirty_cols(row, start_col, max(start_col, new_col - 1));
 
             row->cells[start_col].wc = U'\t';
-            row->cells[start_col].attrs.clean = 0;
+            cell_set_clean(&row->cells[start_col], false);
 
             for (struct cell *cell = &row->cells[start_col + 1];
                  cell < &row->cells[new_col];
                  cell++)
             {
                 cell->wc = U' ';
-                cell->attrs.clean = 0;
+                cell_set_clean(cell, false);
             }
         }
 
@@ -290,11 +291,97 @@ action_execute(struct terminal *term, uint8_t c)
     }
 }
 
+/*
+ * Returns the number of leading bytes in 'data' that are printable
+ * ASCII (0x20-0x7e). In the ground state, these all map to
+ * ACTION_PRINT, and can be printed as a single run.
+ */
+static size_t
+ascii_printable_run_length(const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+
+    /*
+     * Printable bytes are those that, interpreted as *signed* 8-bit
+     * integers, are > 0x1f and < 0x7f. This excludes C0 controls,
+     * DEL, and all bytes >= 0x80 (which are negative).
+     */
+
+#if defined(__AVX2__)
+    const __m256i lo32 = _mm256_set1_epi8(0x1f);
+    const __m256i hi32 = _mm256_set1_epi8(0x7f);
+
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)&data[i]);
+        const __m256i printable = _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, lo32), _mm256_cmpgt_epi8(hi32, v));
+
+        const uint32_t non_printable =
+            ~(uint32_t)_mm256_movemask_epi8(printable);
+
+        if (non_printable != 0)
+            return i + __builtin_ctz(non_printable);
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i lo16 = _mm_set1_epi8(0x1f);
+    const __m128i hi16 = _mm_set1_epi8(0x7f);
+
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)&data[i]);
+        const __m128i printable = _mm_and_si128(
+            _mm_cmpgt_epi8(v, lo16), _mm_cmplt_epi8(v, hi16));
+
+        const uint32_t non_printable =
+            ~(uint32_t)_mm_movemask_epi8(printable) & 0xffff;
+
+        if (non_printable != 0)
+            return i + __builtin_ctz(non_printable);
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (data[i] < 0x20 || data[i] > 0x7e)
+            break;
+    }
+
+    return i;
+}
+
+UNITTEST
+{
+    uint8_t data[100];
+
+    /* Verify every position, with every non-printable byte value, in
+     * both the SIMD and scalar parts of the scanner */
+    for (size_t len = 0; len <= sizeof(data); len += 33) {
+        for (size_t pos = 0; pos < len; pos++) {
+            for (int c = 0; c < 256; c++) {
+                if (c >= 0x20 && c <= 0x7e)
+                    continue;
+
+                memset(data, 'a', sizeof(data));
+                data[pos] = c;
+                xassert(ascii_printable_run_length(data, len) == pos);
+            }
+        }
+
+        memset(data, '~', sizeof(data));
+        xassert(ascii_printable_run_length(data, len) == len);
+    }
+
+    for (int c = 0x20; c <= 0x7e; c++) {
+        memset(data, c, sizeof(data));
+        xassert(ascii_printable_run_length(data, sizeof(data)) == sizeof(data));
+    }
+}
+
 static void
-action_print(struct terminal *term, uint8_t c)
+action_print_run(struct terminal *term, const uint8_t *data, size_t len)
 {
     term_reset_grapheme_state(term);
-    term->ascii_printer(term, c);
+    term_print_ascii_run(term, data, len);
 }
 
 static void
@@ -371,8 +458,12 @@ action_param_new_subparam(struct terminal *term, uint8_t c)
     *sub_param_value = 0;
 }
 
+/*
+ * Accumulates a run of parameter digits into the current (sub)
+ * parameter. Equivalent to calling action_param() for each digit.
+ */
 static void
-action_param(struct terminal *term, uint8_t c)
+action_param(struct terminal *term, const uint8_t *digits, size_t count)
 {
     action_param_lazy_init(term);
     xassert(term->vt.params.cur != NULL);
@@ -386,8 +477,11 @@ action_param(struct terminal *term, uint8_t c)
         value = &param->value;
 
     unsigned v = *value;
-    v *= 10;
-    v += c - '0';
+    for (size_t i = 0; i < count; i++) {
+        xassert(digits[i] >= '0' && digits[i] <= '9');
+        v *= 10;
+        v += digits[i] - '0';
+    }
     *value = v;
 }
 
@@ -739,395 +833,762 @@ action_utf8_44(struct terminal *term, uint8_t c)
     action_utf8_print(term, term->vt.utf8);
 }
 
-IGNORE_WARNING("-Wpedantic")
-
-static enum state
-anywhere(struct terminal *term, uint8_t data)
+/*
+ * Returns the number of leading bytes in 'data' that are *not* ASCII,
+ * i.e. that have their high bit set.
+ */
+static size_t
+non_ascii_run_length(const uint8_t *data, size_t len)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x18:                                           action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1a:                                           action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1b:                                                                            action_clear(term);              return STATE_ESCAPE;
-
-    /* 8-bit C1 control characters (not supported) */
-    case 0x80 ... 0x9f:                                                                                                    return STATE_GROUND;
-    }
+    size_t i = 0;
 
-    return term->vt.state;
-}
+#if defined(__AVX2__)
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)&data[i]);
+        const uint32_t ascii = ~(uint32_t)_mm256_movemask_epi8(v);
 
-static enum state
-state_ground_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_GROUND;
-
-    /* modified from 0x20..0x7f to 0x20..0x7e, since 0x7f is DEL, which is a zero-width character */
-    case 0x20 ... 0x7e:                                  action_print(term, data);                                         return STATE_GROUND;
-
-    case 0xc2 ... 0xdf:                                  action_utf8_21(term, data);                                       return STATE_UTF8_21;
-    case 0xe0 ... 0xef:                                  action_utf8_31(term, data);                                       return STATE_UTF8_31;
-    case 0xf0 ... 0xf4:                                  action_utf8_41(term, data);                                       return STATE_UTF8_41;
+        if (ascii != 0)
+            return i + __builtin_ctz(ascii);
     }
+#endif
 
-    return anywhere(term, data);
-}
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)&data[i]);
+        const uint32_t ascii = ~(uint32_t)_mm_movemask_epi8(v) & 0xffff;
 
-static enum state
-state_escape_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_ESCAPE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
-    case 0x30 ... 0x4f:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x50:                                                                            action_clear(term);              return STATE_DCS_ENTRY;
-    case 0x51 ... 0x57:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x58:                                                                                                             return STATE_SOS_PM_APC_STRING;
-    case 0x59:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x5a:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x5b:                                                                            action_clear(term);              return STATE_CSI_ENTRY;
-    case 0x5c:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x5d:                                                                            action_osc_start(term, data);    return STATE_OSC_STRING;
-    case 0x5e ... 0x5f:                                                                                                    return STATE_SOS_PM_APC_STRING;
-    case 0x60 ... 0x7e:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_ESCAPE;
+        if (ascii != 0)
+            return i + __builtin_ctz(ascii);
     }
+#endif
 
-    return anywhere(term, data);
-}
-
-static enum state
-state_escape_intermediate_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
-    case 0x30 ... 0x7e:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_ESCAPE_INTERMEDIATE;
+    for (; i < len; i++) {
+        if (data[i] < 0x80)
+            break;
     }
 
-    return anywhere(term, data);
+    return i;
 }
 
-static enum state
-state_csi_entry_switch(struct terminal *term, uint8_t data)
+static inline bool
+utf8_is_continuation(uint8_t c)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_ENTRY;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
-    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_CSI_PARAM;
-    case 0x3a:                                           action_param_new_subparam(term, data);                            return STATE_CSI_PARAM;
-    case 0x3b:                                           action_param_new(term, data);                                     return STATE_CSI_PARAM;
-
-    case 0x3c ... 0x3f:                                  action_collect(term, data);                                       return STATE_CSI_PARAM;
-    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_ENTRY;
-    }
-
-    return anywhere(term, data);
+    return (c & 0xc0) == 0x80;
 }
 
-static enum state
-state_csi_param_switch(struct terminal *term, uint8_t data)
+IGNORE_WARNING("-Wpedantic")
+
+/* Sequence length, by lead byte. 0 for invalid lead bytes */
+static const uint8_t utf8_seq_len[256] = {
+    [0xc2 ... 0xdf] = 2,
+    [0xe0 ... 0xef] = 3,
+    [0xf0 ... 0xf4] = 4,
+};
+
+UNIGNORE_WARNINGS
+
+/*
+ * Decodes complete, valid, UTF-8 sequences from 'data', into 'wcs'.
+ *
+ * Decoding stops at the first byte that doesn't start a valid
+ * sequence (including ASCII), at the first incomplete sequence, or
+ * when 'wcs' is full. Sequences the per-byte UTF-8 states would
+ * discard (UTF-16 surrogates, and code points above U+10FFFF) also
+ * stops decoding.
+ *
+ * Returns the number of decoded code points. The number of consumed
+ * bytes is returned in 'consumed'.
+ */
+static size_t
+utf8_decode_run(const uint8_t *data, size_t len,
+                char32_t *wcs, size_t wcs_len, size_t *consumed)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_PARAM;
+    /*
+     * Only bytes with the high bit set can be part of a sequence. No
+     * need to look further than what can fit in 'wcs'
+     */
+    len = non_ascii_run_length(data, min(len, wcs_len * 4));
 
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
+    size_t i = 0;
+    size_t count = 0;
 
-    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_CSI_PARAM;
-    case 0x3a:                                           action_param_new_subparam(term, data);                            return STATE_CSI_PARAM;
-    case 0x3b:                                           action_param_new(term, data);                                     return STATE_CSI_PARAM;
+    /*
+     * Main loop, with (at least) four bytes available: load the four
+     * bytes as a big endian word, and validate and decode the
+     * sequence using per-length masks and shifts. This avoids
+     * branching on the sequence length, which is unpredictable in
+     * e.g. mixed CJK and emoji text.
+     */
+    static const uint32_t cont_mask[5] = {
+        [2] = 0x00c00000, [3] = 0x00c0c000, [4] = 0x00c0c0c0};
+    static const uint32_t cont_bits[5] = {
+        [2] = 0x00800000, [3] = 0x00808000, [4] = 0x00808080};
+    static const uint8_t lead_mask[5] = {[2] = 0x1f, [3] = 0x0f, [4] = 0x07};
+
+    while (i + 4 <= len && count < wcs_len) {
+        const size_t seq_len = utf8_seq_len[data[i]];
+        if (seq_len == 0)
+            break;
 
-    case 0x3c ... 0x3f:                                                                                                    return STATE_CSI_IGNORE;
-    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_PARAM;
-    }
+        const uint32_t v =
+            (uint32_t)data[i + 0] << 24 |
+            (uint32_t)data[i + 1] << 16 |
+            (uint32_t)data[i + 2] << 8 |
+            (uint32_t)data[i + 3];
 
-    return anywhere(term, data);
-}
+        if ((v & cont_mask[seq_len]) != cont_bits[seq_len])
+            break;
 
-static enum state
-state_csi_intermediate_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_INTERMEDIATE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
-    case 0x30 ... 0x3f:                                                                                                    return STATE_CSI_IGNORE;
-    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_INTERMEDIATE;
-    }
+        const char32_t wc = (
+            (char32_t)(data[i] & lead_mask[seq_len]) << 18 |
+            (v >> 16 & 0x3f) << 12 |
+            (v >> 8 & 0x3f) << 6 |
+            (v & 0x3f)) >> (6 * (4 - seq_len));
 
-    return anywhere(term, data);
-}
+        if (unlikely((seq_len == 3 && wc >= 0xd800 && wc <= 0xdfff) ||
+                     wc > 0x10ffff))
+        {
+            break;
+        }
 
-static enum state
-state_csi_ignore_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_IGNORE;
-
-    case 0x20 ... 0x3f:                                  action_ignore(term);                                              return STATE_CSI_IGNORE;
-    case 0x40 ... 0x7e:                                                                                                    return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_IGNORE;
+        wcs[count++] = wc;
+        i += seq_len;
     }
 
-    return anywhere(term, data);
-}
+    /* Tail; less than four bytes left */
+    while (i < len && count < wcs_len) {
+        const uint8_t c = data[i];
+        char32_t wc;
 
-static enum state
-state_osc_string_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
+        if (c >= 0xc2 && c <= 0xdf) {
+            if (i + 2 > len || !utf8_is_continuation(data[i + 1]))
+                break;
 
-    /* Note: original was 20-7f, but I changed to 20-ff to include utf-8. Don't forget to add EXECUTE to 8-bit C1 if we implement that. */
-    default:                                             action_osc_put(term, data);                                       return STATE_OSC_STRING;
+            wc = (c & 0x1f) << 6 | (data[i + 1] & 0x3f);
+            i += 2;
+        }
 
-    case 0x07:          action_osc_end(term, data);                                                                        return STATE_GROUND;
+        else if (c >= 0xe0 && c <= 0xef) {
+            if (i + 3 > len ||
+                !utf8_is_continuation(data[i + 1]) ||
+                !utf8_is_continuation(data[i + 2]))
+            {
+                break;
+            }
 
-    case 0x00 ... 0x06:
-    case 0x08 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_OSC_STRING;
+            wc = (c & 0x0f) << 12 |
+                (data[i + 1] & 0x3f) << 6 |
+                (data[i + 2] & 0x3f);
 
+            if (unlikely(wc >= 0xd800 && wc <= 0xdfff))
+                break;
 
-    case 0x18:
-    case 0x1a:          action_osc_end(term, data);      action_execute(term, data);                                       return STATE_GROUND;
+            i += 3;
+        }
 
-    case 0x1b:          action_osc_end(term, data);      action_clear(term);                                               return STATE_ESCAPE;
-    }
-}
+        else
+            break;
 
-static enum state
-state_dcs_entry_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_ENTRY;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
-    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_DCS_PARAM;
-    case 0x3a:                                                                                                             return STATE_DCS_IGNORE;
-    case 0x3b:                                           action_param_new(term, data);                                     return STATE_DCS_PARAM;
-    case 0x3c ... 0x3f:                                  action_collect(term, data);                                       return STATE_DCS_PARAM;
-    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_ENTRY;
+        wcs[count++] = wc;
     }
 
-    return anywhere(term, data);
+    *consumed = i;
+    return count;
 }
 
-static enum state
-state_dcs_param_switch(struct terminal *term, uint8_t data)
+UNITTEST
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_PARAM;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
-    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_DCS_PARAM;
-    case 0x3a:                                                                                                             return STATE_DCS_IGNORE;
-    case 0x3b:                                           action_param_new(term, data);                                     return STATE_DCS_PARAM;
-    case 0x3c ... 0x3f:                                                                                                    return STATE_DCS_IGNORE;
-    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_PARAM;
-    }
-
-    return anywhere(term, data);
+    char32_t wcs[8];
+    size_t consumed;
+
+    /* 2, 3 and 4 byte sequences; decoding stops at ASCII */
+    const uint8_t mixed[] = "\xc3\xa5\xe6\x97\xa5\xf0\x9f\x98\x80x\xc3\xa5";
+    xassert(utf8_decode_run(mixed, sizeof(mixed) - 1, wcs, 8, &consumed) == 3);
+    xassert(consumed == 9);
+    xassert(wcs[0] == U'å');
+    xassert(wcs[1] == U'日');
+    xassert(wcs[2] == U'😀');
+
+    /* Output buffer full */
+    xassert(utf8_decode_run(mixed, sizeof(mixed) - 1, wcs, 2, &consumed) == 2);
+    xassert(consumed == 5);
+
+    /* Incomplete sequence, e.g. split across two reads */
+    const uint8_t split[] = "\xc3\xa5\xe6\x97";
+    xassert(utf8_decode_run(split, sizeof(split) - 1, wcs, 8, &consumed) == 1);
+    xassert(consumed == 2);
+
+    /* Invalid continuation byte */
+    const uint8_t invalid[] = "\xe6\xc3\xa5";
+    xassert(utf8_decode_run(invalid, sizeof(invalid) - 1, wcs, 8, &consumed) == 0);
+    xassert(consumed == 0);
+
+    /* Surrogates, and code points above U+10FFFF, are left to the
+     * per-byte states */
+    const uint8_t surrogate[] = "\xc3\xa5\xed\xa0\x80";
+    xassert(utf8_decode_run(surrogate, sizeof(surrogate) - 1, wcs, 8, &consumed) == 1);
+    xassert(consumed == 2);
+
+    /* ... but overlong encodings are not */
+    const uint8_t overlong[] = "\xf0\x8d\xa0\x80";
+    xassert(utf8_decode_run(overlong, sizeof(overlong) - 1, wcs, 8, &consumed) == 1);
+    xassert(consumed == 4);
+    xassert(wcs[0] == 0xd800);
+
+    const uint8_t too_large[] = "\xf4\x90\x80\x80";
+    xassert(utf8_decode_run(too_large, sizeof(too_large) - 1, wcs, 8, &consumed) == 0);
+    xassert(consumed == 0);
+
+    /* C1 control characters, and invalid lead bytes */
+    const uint8_t c1[] = "\x9b";
+    xassert(utf8_decode_run(c1, sizeof(c1) - 1, wcs, 8, &consumed) == 0);
+    const uint8_t lead[] = "\xc0\x80";
+    xassert(utf8_decode_run(lead, sizeof(lead) - 1, wcs, 8, &consumed) == 0);
+
+    /* Long run, exercising the SIMD part of the scanner */
+    uint8_t cjk[3 * 20];
+    for (size_t i = 0; i < sizeof(cjk); i += 3)
+        memcpy(&cjk[i], "\xe6\x97\xa5", 3);
+
+    xassert(utf8_decode_run(cjk, sizeof(cjk), wcs, 8, &consumed) == 8);
+    xassert(consumed == 3 * 8);
 }
 
-static enum state
-state_dcs_intermediate_switch(struct terminal *term, uint8_t data)
+/*
+ * Decodes, and prints, a run of UTF-8 encoded characters. Returns the
+ * number of bytes consumed; anything utf8_decode_run() cannot decode
+ * is left to the per-byte UTF-8 states.
+ */
+static size_t
+action_utf8_print_run(struct terminal *term, const uint8_t *data, size_t len)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_INTERMEDIATE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
-    case 0x30 ... 0x3f:                                                                                                    return STATE_DCS_IGNORE;
-    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_INTERMEDIATE;
-    }
+    char32_t wcs[256];
+    size_t total = 0;
 
-    return anywhere(term, data);
-}
+    while (true) {
+        size_t consumed;
+        const size_t count = utf8_decode_run(
+            &data[total], len - total, wcs, ALEN(wcs), &consumed);
 
-static enum state
-state_dcs_ignore_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:
-    case 0x20 ... 0x7f:                                  action_ignore(term);                                              return STATE_DCS_IGNORE;
+        if (count == 0)
+            break;
+
+        term_process_and_print_non_ascii_run(term, wcs, count);
+        total += consumed;
+
+        if (count < ALEN(wcs))
+            break;
     }
 
-    return anywhere(term, data);
+    return total;
 }
 
-static enum state
-state_dcs_passthrough_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x7e:                                  action_put(term, data);                                           return STATE_DCS_PASSTHROUGH;
+/*
+ * Parser actions. Exit and entry actions are folded into the
+ * transition's action, e.g. ACTION_OSC_END_CLEAR is the OSC string
+ * exit action, followed by the escape entry action.
+ */
+enum action {
+    ACTION_NONE,
+    ACTION_IGNORE,
+    ACTION_EXECUTE,
+    ACTION_PRINT,
+    ACTION_CLEAR,
+    ACTION_COLLECT,
+    ACTION_PARAM,
+    ACTION_PARAM_NEW,
+    ACTION_PARAM_NEW_SUBPARAM,
+    ACTION_ESC_DISPATCH,
+    ACTION_CSI_DISPATCH,
+
+    ACTION_OSC_START,
+    ACTION_OSC_PUT,
+    ACTION_OSC_END,
+    ACTION_OSC_END_EXECUTE,
+    ACTION_OSC_END_CLEAR,
+
+    ACTION_HOOK,
+    ACTION_PUT,
+    ACTION_UNHOOK,
+    ACTION_UNHOOK_EXECUTE,
+    ACTION_UNHOOK_CLEAR,
+
+    ACTION_UTF8_21,
+    ACTION_UTF8_22,
+    ACTION_UTF8_31,
+    ACTION_UTF8_32,
+    ACTION_UTF8_33,
+    ACTION_UTF8_41,
+    ACTION_UTF8_42,
+    ACTION_UTF8_43,
+    ACTION_UTF8_44,
+
+    ACTION_COUNT,
+};
 
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_PASSTHROUGH;
+#define STATE_COUNT (STATE_UTF8_43 + 1)
 
-    /* Anywhere */
-    case 0x18:          action_unhook(term, data);       action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1a:          action_unhook(term, data);       action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1b:          action_unhook(term, data);                                        action_clear(term);              return STATE_ESCAPE;
+struct transition {
+    uint8_t action;  /* enum action */
+    uint8_t state;   /* enum state - the new state */
+};
 
-    /* 8-bit C1 control characters (not supported) */
-    case 0x80 ... 0x9f: action_unhook(term, data);                                                                         return STATE_GROUND;
+#define T(action, state) {ACTION_##action, STATE_##state}
+
+/*
+ * Default transitions, shared by most states. Must come *first* in a
+ * state's table, since later (state specific) entries override them.
+ *
+ * Bytes not matched by anything leaves the state unchanged.
+ */
+#define ANYWHERE(state)                                         \
+    [0x00 ... 0xff] = T(NONE, state),                           \
+    [0x18] =          T(EXECUTE, GROUND),                       \
+    [0x1a] =          T(EXECUTE, GROUND),                       \
+    [0x1b] =          T(CLEAR, ESCAPE),                         \
+                                                                \
+    /* 8-bit C1 control characters (not supported) */           \
+    [0x80 ... 0x9f] = T(NONE, GROUND)
+
+/* C0 control characters, except CAN, SUB and ESC */
+#define C0(action, state)                                       \
+    [0x00 ... 0x17] = T(action, state),                         \
+    [0x19] =          T(action, state),                         \
+    [0x1c ... 0x1f] = T(action, state)
 
-    default:                                                                                                               return STATE_DCS_PASSTHROUGH;
-    }
-}
+IGNORE_WARNING("-Wpedantic")
+IGNORE_WARNING("-Woverride-init")
+IGNORE_WARNING("-Winitializer-overrides")
+
+static const struct transition transitions[STATE_COUNT][256] = {
+    [STATE_GROUND] = {
+        ANYWHERE(GROUND),
+        C0(EXECUTE, GROUND),
+
+        /* modified from 0x20..0x7f to 0x20..0x7e, since 0x7f is DEL, which is a zero-width character */
+        [0x20 ... 0x7e] = T(PRINT, GROUND),
+
+        [0xc2 ... 0xdf] = T(UTF8_21, UTF8_21),
+        [0xe0 ... 0xef] = T(UTF8_31, UTF8_31),
+        [0xf0 ... 0xf4] = T(UTF8_41, UTF8_41),
+    },
+
+    [STATE_ESCAPE] = {
+        ANYWHERE(ESCAPE),
+        C0(EXECUTE, ESCAPE),
+
+        [0x20 ... 0x2f] = T(COLLECT, ESCAPE_INTERMEDIATE),
+        [0x30 ... 0x4f] = T(ESC_DISPATCH, GROUND),
+        [0x50] =          T(CLEAR, DCS_ENTRY),
+        [0x51 ... 0x57] = T(ESC_DISPATCH, GROUND),
+        [0x58] =          T(NONE, SOS_PM_APC_STRING),
+        [0x59] =          T(ESC_DISPATCH, GROUND),
+        [0x5a] =          T(ESC_DISPATCH, GROUND),
+        [0x5b] =          T(CLEAR, CSI_ENTRY),
+        [0x5c] =          T(ESC_DISPATCH, GROUND),
+        [0x5d] =          T(OSC_START, OSC_STRING),
+        [0x5e ... 0x5f] = T(NONE, SOS_PM_APC_STRING),
+        [0x60 ... 0x7e] = T(ESC_DISPATCH, GROUND),
+        [0x7f] =          T(IGNORE, ESCAPE),
+    },
+
+    [STATE_ESCAPE_INTERMEDIATE] = {
+        ANYWHERE(ESCAPE_INTERMEDIATE),
+        C0(EXECUTE, ESCAPE_INTERMEDIATE),
+
+        [0x20 ... 0x2f] = T(COLLECT, ESCAPE_INTERMEDIATE),
+        [0x30 ... 0x7e] = T(ESC_DISPATCH, GROUND),
+        [0x7f] =          T(IGNORE, ESCAPE_INTERMEDIATE),
+    },
+
+    [STATE_CSI_ENTRY] = {
+        ANYWHERE(CSI_ENTRY),
+        C0(EXECUTE, CSI_ENTRY),
+
+        [0x20 ... 0x2f] = T(COLLECT, CSI_INTERMEDIATE),
+        [0x30 ... 0x39] = T(PARAM, CSI_PARAM),
+        [0x3a] =          T(PARAM_NEW_SUBPARAM, CSI_PARAM),
+        [0x3b] =          T(PARAM_NEW, CSI_PARAM),
+        [0x3c ... 0x3f] = T(COLLECT, CSI_PARAM),
+        [0x40 ... 0x7e] = T(CSI_DISPATCH, GROUND),
+        [0x7f] =          T(IGNORE, CSI_ENTRY),
+    },
+
+    [STATE_CSI_PARAM] = {
+        ANYWHERE(CSI_PARAM),
+        C0(EXECUTE, CSI_PARAM),
+
+        [0x20 ... 0x2f] = T(COLLECT, CSI_INTERMEDIATE),
+        [0x30 ... 0x39] = T(PARAM, CSI_PARAM),
+        [0x3a] =          T(PARAM_NEW_SUBPARAM, CSI_PARAM),
+        [0x3b] =          T(PARAM_NEW, CSI_PARAM),
+        [0x3c ... 0x3f] = T(NONE, CSI_IGNORE),
+        [0x40 ... 0x7e] = T(CSI_DISPATCH, GROUND),
+        [0x7f] =          T(IGNORE, CSI_PARAM),
+    },
+
+    [STATE_CSI_INTERMEDIATE] = {
+        ANYWHERE(CSI_INTERMEDIATE),
+        C0(EXECUTE, CSI_INTERMEDIATE),
+
+        [0x20 ... 0x2f] = T(COLLECT, CSI_INTERMEDIATE),
+        [0x30 ... 0x3f] = T(NONE, CSI_IGNORE),
+        [0x40 ... 0x7e] = T(CSI_DISPATCH, GROUND),
+        [0x7f] =          T(IGNORE, CSI_INTERMEDIATE),
+    },
+
+    [STATE_CSI_IGNORE] = {
+        ANYWHERE(CSI_IGNORE),
+        C0(EXECUTE, CSI_IGNORE),
+
+        [0x20 ... 0x3f] = T(IGNORE, CSI_IGNORE),
+        [0x40 ... 0x7e] = T(NONE, GROUND),
+        [0x7f] =          T(IGNORE, CSI_IGNORE),
+    },
+
+    [STATE_OSC_STRING] = {
+        /* Note: original was 20-7f, but I changed to 20-ff to include utf-8. Don't forget to add EXECUTE to 8-bit C1 if we implement that. */
+        [0x00 ... 0xff] = T(OSC_PUT, OSC_STRING),
+
+        [0x07] =          T(OSC_END, GROUND),
+
+        [0x00 ... 0x06] = T(IGNORE, OSC_STRING),
+        [0x08 ... 0x17] = T(IGNORE, OSC_STRING),
+        [0x19] =          T(IGNORE, OSC_STRING),
+        [0x1c ... 0x1f] = T(IGNORE, OSC_STRING),
+
+        [0x18] =          T(OSC_END_EXECUTE, GROUND),
+        [0x1a] =          T(OSC_END_EXECUTE, GROUND),
+        [0x1b] =          T(OSC_END_CLEAR, ESCAPE),
+    },
+
+    [STATE_DCS_ENTRY] = {
+        ANYWHERE(DCS_ENTRY),
+        C0(IGNORE, DCS_ENTRY),
+
+        [0x20 ... 0x2f] = T(COLLECT, DCS_INTERMEDIATE),
+        [0x30 ... 0x39] = T(PARAM, DCS_PARAM),
+        [0x3a] =          T(NONE, DCS_IGNORE),
+        [0x3b] =          T(PARAM_NEW, DCS_PARAM),
+        [0x3c ... 0x3f] = T(COLLECT, DCS_PARAM),
+        [0x40 ... 0x7e] = T(HOOK, DCS_PASSTHROUGH),
+        [0x7f] =          T(IGNORE, DCS_ENTRY),
+    },
+
+    [STATE_DCS_PARAM] = {
+        ANYWHERE(DCS_PARAM),
+        C0(IGNORE, DCS_PARAM),
+
+        [0x20 ... 0x2f] = T(COLLECT, DCS_INTERMEDIATE),
+        [0x30 ... 0x39] = T(PARAM, DCS_PARAM),
+        [0x3a] =          T(NONE, DCS_IGNORE),
+        [0x3b] =          T(PARAM_NEW, DCS_PARAM),
+        [0x3c ... 0x3f] = T(NONE, DCS_IGNORE),
+        [0x40 ... 0x7e] = T(HOOK, DCS_PASSTHROUGH),
+        [0x7f] =          T(IGNORE, DCS_PARAM),
+    },
+
+    [STATE_DCS_INTERMEDIATE] = {
+        ANYWHERE(DCS_INTERMEDIATE),
+        C0(IGNORE, DCS_INTERMEDIATE),
+
+        [0x20 ... 0x2f] = T(COLLECT, DCS_INTERMEDIATE),
+        [0x30 ... 0x3f] = T(NONE, DCS_IGNORE),
+        [0x40 ... 0x7e] = T(HOOK, DCS_PASSTHROUGH),
+        [0x7f] =          T(IGNORE, DCS_INTERMEDIATE),
+    },
+
+    [STATE_DCS_IGNORE] = {
+        ANYWHERE(DCS_IGNORE),
+        C0(IGNORE, DCS_IGNORE),
+
+        [0x20 ... 0x7f] = T(IGNORE, DCS_IGNORE),
+    },
+
+    [STATE_DCS_PASSTHROUGH] = {
+        [0x00 ... 0xff] = T(NONE, DCS_PASSTHROUGH),
+
+        C0(PUT, DCS_PASSTHROUGH),
+        [0x20 ... 0x7e] = T(PUT, DCS_PASSTHROUGH),
+        [0x7f] =          T(IGNORE, DCS_PASSTHROUGH),
+
+        /* Anywhere */
+        [0x18] =          T(UNHOOK_EXECUTE, GROUND),
+        [0x1a] =          T(UNHOOK_EXECUTE, GROUND),
+        [0x1b] =          T(UNHOOK_CLEAR, ESCAPE),
+
+        /* 8-bit C1 control characters (not supported) */
+        [0x80 ... 0x9f] = T(UNHOOK, GROUND),
+    },
+
+    [STATE_SOS_PM_APC_STRING] = {
+        ANYWHERE(SOS_PM_APC_STRING),
+        C0(IGNORE, SOS_PM_APC_STRING),
+
+        [0x20 ... 0x7f] = T(IGNORE, SOS_PM_APC_STRING),
+    },
 
-static enum state
-state_sos_pm_apc_string_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x7f:                                  action_ignore(term);                                              return STATE_SOS_PM_APC_STRING;
-    }
+    /*
+     * UTF-8 continuation bytes. Anything else (including C0
+     * controls) aborts the sequence, and is discarded.
+     */
 
-    return anywhere(term, data);
-}
+    [STATE_UTF8_21] = {
+        [0x00 ... 0xff] = T(NONE, GROUND),
+        [0x80 ... 0xbf] = T(UTF8_22, GROUND),
+    },
+
+    [STATE_UTF8_31] = {
+        [0x00 ... 0xff] = T(NONE, GROUND),
+        [0x80 ... 0xbf] = T(UTF8_32, UTF8_32),
+    },
+
+    [STATE_UTF8_32] = {
+        [0x00 ... 0xff] = T(NONE, GROUND),
+        [0x80 ... 0xbf] = T(UTF8_33, GROUND),
+    },
+
+    [STATE_UTF8_41] = {
+        [0x00 ... 0xff] = T(NONE, GROUND),
+        [0x80 ... 0xbf] = T(UTF8_42, UTF8_42),
+    },
+
+    [STATE_UTF8_42] = {
+        [0x00 ... 0xff] = T(NONE, GROUND),
+        [0x80 ... 0xbf] = T(UTF8_43, UTF8_43),
+    },
+
+    [STATE_UTF8_43] = {
+        [0x00 ... 0xff] = T(NONE, GROUND),
+        [0x80 ... 0xbf] = T(UTF8_44, GROUND),
+    },
+};
+
+UNIGNORE_WARNINGS
+UNIGNORE_WARNINGS
+UNIGNORE_WARNINGS
 
-static enum state
-state_utf8_21_switch(struct terminal *term, uint8_t data)
+#undef C0
+#undef ANYWHERE
+#undef T
+
+UNITTEST
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_22(term, data);                                       return STATE_GROUND;
-    default:                                                                                                               return STATE_GROUND;
+    for (int state = 0; state < STATE_COUNT; state++) {
+        for (int c = 0; c < 256; c++) {
+            const struct transition *t = &transitions[state][c];
+            xassert(t->action < ACTION_COUNT);
+            xassert(t->state < STATE_COUNT);
+        }
     }
-}
 
-static enum state
-state_utf8_31_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_32(term, data);                                       return STATE_UTF8_32;
-    default:                                                                                                               return STATE_GROUND;
+    /* CAN, SUB and ESC are recognized in all non-UTF-8 states */
+    for (int state = 0; state < STATE_UTF8_21; state++) {
+        xassert(transitions[state][0x18].state == STATE_GROUND);
+        xassert(transitions[state][0x1a].state == STATE_GROUND);
+        xassert(transitions[state][0x1b].state == STATE_ESCAPE);
     }
-}
 
-static enum state
-state_utf8_32_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_33(term, data);                                       return STATE_GROUND;
-    default:                                                                                                               return STATE_GROUND;
+    /*
+     * Printable ASCII in the ground state, and nothing else, prints;
+     * see vt_from_slave()
+     */
+    for (int state = 0; state < STATE_COUNT; state++) {
+        for (int c = 0; c < 256; c++) {
+            const struct transition *t = &transitions[state][c];
+            const bool printable =
+                state == STATE_GROUND && c >= 0x20 && c <= 0x7e;
+
+            xassert((t->action == ACTION_PRINT) == printable);
+            xassert(!printable || t->state == STATE_GROUND);
+        }
     }
-}
 
-static enum state
-state_utf8_41_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_42(term, data);                                       return STATE_UTF8_42;
-    default:                                                                                                               return STATE_GROUND;
+    /* UTF-8 lead bytes are only recognized in the ground state; see
+     * vt_from_slave() */
+    for (int state = 0; state < STATE_COUNT; state++) {
+        for (int c = 0; c < 256; c++) {
+            const enum action action = transitions[state][c].action;
+            xassert(state == STATE_GROUND ||
+                    (action != ACTION_UTF8_21 &&
+                     action != ACTION_UTF8_31 &&
+                     action != ACTION_UTF8_41));
+        }
     }
-}
 
-static enum state
-state_utf8_42_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_43(term, data);                                       return STATE_UTF8_43;
-    default:                                                                                                               return STATE_GROUND;
+    /* Digits keep us in the param states; see vt_from_slave() */
+    for (int state = 0; state < STATE_COUNT; state++) {
+        for (int c = '0'; c <= '9'; c++) {
+            const struct transition *t = &transitions[state][c];
+            if (t->action != ACTION_PARAM)
+                continue;
+
+            for (int d = '0'; d <= '9'; d++) {
+                xassert(transitions[t->state][d].action == ACTION_PARAM);
+                xassert(transitions[t->state][d].state == t->state);
+            }
+        }
     }
-}
 
-static enum state
-state_utf8_43_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_44(term, data);                                       return STATE_GROUND;
-    default:                                                                                                               return STATE_GROUND;
+    /* All CSI finals dispatch, and return to the ground state */
+    for (int c = 0x40; c <= 0x7e; c++) {
+        xassert(transitions[STATE_CSI_ENTRY][c].action == ACTION_CSI_DISPATCH);
+        xassert(transitions[STATE_CSI_PARAM][c].action == ACTION_CSI_DISPATCH);
+        xassert(transitions[STATE_CSI_INTERMEDIATE][c].action == ACTION_CSI_DISPATCH);
+        xassert(transitions[STATE_CSI_ENTRY][c].state == STATE_GROUND);
+        xassert(transitions[STATE_CSI_PARAM][c].state == STATE_GROUND);
+        xassert(transitions[STATE_CSI_INTERMEDIATE][c].state == STATE_GROUND);
     }
 }
 
-UNIGNORE_WARNINGS
+IGNORE_WARNING("-Wpedantic")
 
-void
+size_t
 vt_from_slave(struct terminal *term, const uint8_t *data, size_t len)
 {
-    enum state current_state = term->vt.state;
+    /*
+     * Each action ends by dispatching the next byte itself ("threaded
+     * dispatch"), rather than jumping back to a single, shared,
+     * dispatch point. This gives the branch predictor one indirect
+     * jump per action, which predicts *much* better (e.g. a CSI
+     * param is likely followed by another param, or a dispatch).
+     */
+    static const void *const labels[ACTION_COUNT] = {
+        [ACTION_NONE] = &&none,
+        [ACTION_IGNORE] = &&none,
+        [ACTION_EXECUTE] = &&execute,
+        [ACTION_PRINT] = &&print,
+        [ACTION_CLEAR] = &&clear,
+        [ACTION_COLLECT] = &&collect,
+        [ACTION_PARAM] = &&param,
+        [ACTION_PARAM_NEW] = &&param_new,
+        [ACTION_PARAM_NEW_SUBPARAM] = &&param_new_subparam,
+        [ACTION_ESC_DISPATCH] = &&esc_dispatch,
+        [ACTION_CSI_DISPATCH] = &&csi_dispatch,
+        [ACTION_OSC_START] = &&osc_start,
+        [ACTION_OSC_PUT] = &&osc_put,
+        [ACTION_OSC_END] = &&osc_end,
+        [ACTION_OSC_END_EXECUTE] = &&osc_end_execute,
+        [ACTION_OSC_END_CLEAR] = &&osc_end_clear,
+        [ACTION_HOOK] = &&hook,
+        [ACTION_PUT] = &&put,
+        [ACTION_UNHOOK] = &&unhook,
+        [ACTION_UNHOOK_EXECUTE] = &&unhook_execute,
+        [ACTION_UNHOOK_CLEAR] = &&unhook_clear,
+        [ACTION_UTF8_21] = &&utf8_21,
+        [ACTION_UTF8_22] = &&utf8_22,
+        [ACTION_UTF8_31] = &&utf8_31,
+        [ACTION_UTF8_32] = &&utf8_32,
+        [ACTION_UTF8_33] = &&utf8_33,
+        [ACTION_UTF8_41] = &&utf8_41,
+        [ACTION_UTF8_42] = &&utf8_42,
+        [ACTION_UTF8_43] = &&utf8_43,
+        [ACTION_UTF8_44] = &&utf8_44,
+    };
+
+    enum state state = term->vt.state;
 
     const uint8_t *p = data;
-    for (size_t i = 0; i < len; i++, p++) {
-        switch (current_state) {
-        case STATE_GROUND:              current_state = state_ground_switch(term, *p); break;
-        case STATE_ESCAPE:              current_state = state_escape_switch(term, *p); break;
-        case STATE_ESCAPE_INTERMEDIATE: current_state = state_escape_intermediate_switch(term, *p); break;
-        case STATE_CSI_ENTRY:           current_state = state_csi_entry_switch(term, *p); break;
-        case STATE_CSI_PARAM:           current_state = state_csi_param_switch(term, *p); break;
-        case STATE_CSI_INTERMEDIATE:    current_state = state_csi_intermediate_switch(term, *p); break;
-        case STATE_CSI_IGNORE:          current_state = state_csi_ignore_switch(term, *p); break;
-        case STATE_OSC_STRING:          current_state = state_osc_string_switch(term, *p); break;
-        case STATE_DCS_ENTRY:           current_state = state_dcs_entry_switch(term, *p); break;
-        case STATE_DCS_PARAM:           current_state = state_dcs_param_switch(term, *p); break;
-        case STATE_DCS_INTERMEDIATE:    current_state = state_dcs_intermediate_switch(term, *p); break;
-        case STATE_DCS_IGNORE:          current_state = state_dcs_ignore_switch(term, *p); break;
-        case STATE_DCS_PASSTHROUGH:     current_state = state_dcs_passthrough_switch(term, *p); break;
-        case STATE_SOS_PM_APC_STRING:   current_state = state_sos_pm_apc_string_switch(term, *p); break;
-
-        case STATE_UTF8_21:             current_state = state_utf8_21_switch(term, *p); break;
-        case STATE_UTF8_31:             current_state = state_utf8_31_switch(term, *p); break;
-        case STATE_UTF8_32:             current_state = state_utf8_32_switch(term, *p); break;
-        case STATE_UTF8_41:             current_state = state_utf8_41_switch(term, *p); break;
-        case STATE_UTF8_42:             current_state = state_utf8_42_switch(term, *p); break;
-        case STATE_UTF8_43:             current_state = state_utf8_43_switch(term, *p); break;
-        }
+    const uint8_t *const end = data + len;
+    uint8_t c;
+
+#define DISPATCH()                                                      \
+    do {                                                                \
+        if (unlikely(p >= end))                                         \
+            goto out;                                                   \
+        c = *p++;                                                       \
+        const struct transition t = transitions[state][c];              \
+        state = t.state;                                                \
+        goto *labels[t.action];                                         \
+    } while (0)
+
+    /* After sequences that may set 'halt' (see term_render_state_changed()) */
+#define DISPATCH_UNLESS_HALTED()                                        \
+    do {                                                                \
+        if (unlikely(term->vt.halt))                                    \
+            goto out;                                                   \
+        DISPATCH();                                                     \
+    } while (0)
+
+    DISPATCH();
+
+print: {
+        /*
+         * Printable ASCII in the ground state. Find the length of
+         * the run, and print it in one go.
+         */
+        const uint8_t *run = p - 1;
+        p = run + ascii_printable_run_length(run, end - run);
+        action_print_run(term, run, p - run);
+        DISPATCH();
+    }
 
-        term->vt.state = current_state;
+param: {
+        /* Once in a param state, digits stay in it (see the unit
+         * test above), so consume all of them in one go */
+        const uint8_t *digits = p - 1;
+        while (p < end && *p >= '0' && *p <= '9')
+            p++;
+        action_param(term, digits, p - digits);
+        DISPATCH();
     }
+
+none:                  DISPATCH();
+execute:               action_execute(term, c); DISPATCH();
+clear:                 action_clear(term); DISPATCH();
+collect:               action_collect(term, c); DISPATCH();
+param_new:             action_param_new(term, c); DISPATCH();
+param_new_subparam:    action_param_new_subparam(term, c); DISPATCH();
+esc_dispatch:          action_esc_dispatch(term, c); DISPATCH_UNLESS_HALTED();
+csi_dispatch:          action_csi_dispatch(term, c); DISPATCH_UNLESS_HALTED();
+osc_start:             action_osc_start(term, c); DISPATCH();
+osc_put:               action_osc_put(term, c); DISPATCH();
+osc_end:               action_osc_end(term, c); DISPATCH_UNLESS_HALTED();
+osc_end_execute:       action_osc_end(term, c); action_execute(term, c); DISPATCH_UNLESS_HALTED();
+osc_end_clear:         action_osc_end(term, c); action_clear(term); DISPATCH_UNLESS_HALTED();
+hook:                  action_hook(term, c); DISPATCH();
+put:                   action_put(term, c); DISPATCH();
+unhook:                action_unhook(term, c); DISPATCH();
+unhook_execute:        action_unhook(term, c); action_execute(term, c); DISPATCH();
+unhook_clear:          action_unhook(term, c); action_clear(term); DISPATCH();
+utf8_21:
+utf8_31:
+utf8_41: {
+        /*
+         * UTF-8 lead byte in the ground state. Decode as many
+         * complete characters as possible in one go. If there
+         * aren't any (invalid, or split, sequence), fall back to the
+         * per-byte UTF-8 states.
+         */
+        const uint8_t *run = p - 1;
+        const size_t consumed = action_utf8_print_run(term, run, end - run);
+
+        if (likely(consumed > 0)) {
+            p = run + consumed;
+            state = STATE_GROUND;
+        } else if (c <= 0xdf)
+            action_utf8_21(term, c);
+        else if (c <= 0xef)
+            action_utf8_31(term, c);
+        else
+            action_utf8_41(term, c);
+
+        DISPATCH();
+    }
+
+utf8_22:               action_utf8_22(term, c); DISPATCH();
+utf8_32:               action_utf8_32(term, c); DISPATCH();
+utf8_33:               action_utf8_33(term, c); DISPATCH();
+utf8_42:               action_utf8_42(term, c); DISPATCH();
+utf8_43:               action_utf8_43(term, c); DISPATCH();
+utf8_44:               action_utf8_44(term, c); DISPATCH();
+
+#undef DISPATCH_UNLESS_HALTED
+#undef DISPATCH
+
+out:
+    term->vt.state = state;
+    return p - data;
 }
+
+UNIGNORE_WARNINGS
@@ -6,7 +6,11 @@
 
 #include "terminal.h"
 
-void vt_from_slave(struct terminal *term, const uint8_t *data, size_t len);
+/*
+ * Returns the number of bytes parsed; less than 'len' only when a
+ * sequence sets term->vt.halt
+ */
+size_t vt_from_slave(struct terminal *term, const uint8_t *data, size_t len);
 
 static inline int
 vt_param_get(const struct terminal *term, size_t idx, int default_value)
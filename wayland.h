@@ -224,7 +224,8 @@ struct seat {
             } pending;
 
             char32_t *text;
-            struct cell *cells;
+            struct row *row;     /* Owns 'cells', and their attributes */
+            struct cell *cells;  /* row->cells */
             int count;
             struct {
                 bool hidden;